@@ -0,0 +1,201 @@
+// Times the emissive preprocessing of Scene::build over 100k emissive instances: keying each instance by the shape of
+// its transform, then EmissiveTriangles::compute once per shape. For comparison it also times compute once per
+// instance, which is what every instance did before shapes were shared, and the area loop apart from the emission map.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+
+// EmissionMap.cpp decodes files with stb_image, whose implementation reina_vk compiles in Image.cpp
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "graphics/EmissionMap.h"
+#include "scene/EmissiveTriangles.h"
+#include "tools/ThreadPool.h"
+
+namespace {
+    constexpr float PI = 3.14159265f;
+
+    struct Model {
+        reina::scene::ModelData data;
+        const reina::graphics::EmissionMap* emissionMap = nullptr;
+    };
+
+    // A UV sphere, like the bulb of a fairy light
+    reina::scene::ModelData sphere(uint32_t segments, uint32_t rings) {
+        reina::scene::ModelData data;
+        for (uint32_t ring = 0; ring <= rings; ring++) {
+            float theta = PI * static_cast<float>(ring) / static_cast<float>(rings);
+            for (uint32_t segment = 0; segment <= segments; segment++) {
+                float phi = 2.0f * PI * static_cast<float>(segment) / static_cast<float>(segments);
+                data.vertices.insert(data.vertices.end(), {std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)});
+            }
+        }
+        for (uint32_t ring = 0; ring < rings; ring++) {
+            for (uint32_t segment = 0; segment < segments; segment++) {
+                uint32_t a = ring * (segments + 1) + segment;
+                uint32_t b = a + segments + 1;
+                data.indices.insert(data.indices.end(), {a, b, a + 1, a + 1, b, b + 1});
+            }
+        }
+        return data;
+    }
+
+    // A grid of quads in the xz plane with UVs over [0, 1], like an LED panel or a large emissive surface
+    reina::scene::ModelData grid(uint32_t columns, uint32_t rows, float aspect) {
+        reina::scene::ModelData data;
+        for (uint32_t row = 0; row <= rows; row++) {
+            for (uint32_t column = 0; column <= columns; column++) {
+                float u = static_cast<float>(column) / static_cast<float>(columns);
+                float v = static_cast<float>(row) / static_cast<float>(rows);
+                data.vertices.insert(data.vertices.end(), {u * aspect, 0.0f, v});
+                data.texCoords.insert(data.texCoords.end(), {u, v});
+            }
+        }
+        for (uint32_t row = 0; row < rows; row++) {
+            for (uint32_t column = 0; column < columns; column++) {
+                uint32_t a = row * (columns + 1) + column;
+                uint32_t b = a + columns + 1;
+                data.indices.insert(data.indices.end(), {a, b, a + 1, a + 1, b, b + 1});
+            }
+        }
+        data.texIndices = data.indices;
+        return data;
+    }
+
+    // ModelData::view lives in Models.cpp, which needs Vulkan
+    reina::scene::ModelView viewOf(const reina::scene::ModelData& data) {
+        return reina::scene::ModelView{data.vertices, data.indices, data.tbns, data.tbnsIndices, data.texCoords, data.texIndices};
+    }
+
+    glm::mat3 randomRotation(std::mt19937& rng) {
+        std::normal_distribution<float> gaussian;
+        glm::vec3 x = glm::normalize(glm::vec3(gaussian(rng), gaussian(rng), gaussian(rng)));
+        glm::vec3 helper = std::abs(x.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+        glm::vec3 y = glm::normalize(glm::cross(x, helper));
+        return glm::mat3(x, y, glm::cross(x, y));
+    }
+
+    double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    struct EmissiveInstance {
+        uint32_t objectID;
+        int emissionMapTexID;
+        glm::mat3 linear;
+    };
+}
+
+int main() {
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    std::vector<float> luminance(512 * 512);
+    for (size_t i = 0; i < luminance.size(); i++) {
+        luminance[i] = 0.5f + 0.5f * std::sin(static_cast<float>(i % 512) * 0.05f) * std::cos(static_cast<float>(i / 512) * 0.03f);
+    }
+    reina::graphics::EmissionMap emissionMap{512, 512, luminance};
+
+    std::vector<Model> models;
+    models.push_back({sphere(16, 8)});                   // 0: fairy light bulbs
+    models.push_back({grid(1, 1, 2.0f)});                // 1: LED panels
+    models.push_back({grid(1000, 1, 100.0f)});           // 2: LED strips
+    models.push_back({grid(300, 300, 1.0f), &emissionMap});  // 3: large surfaces with an emission map
+
+    // 100k emissive instances. Bulbs and strips only differ by rotation, translation and uniform scale, panels come in
+    // a few aspect ratios and the large surfaces in two stretches.
+    std::vector<EmissiveInstance> instances;
+    for (int i = 0; i < 60000; i++) {
+        instances.push_back({0, -1, randomRotation(rng) * (0.01f + 0.02f * unit(rng))});
+    }
+    for (int i = 0; i < 30000; i++) {
+        float stretch = 1.0f + static_cast<float>(i % 4);
+        instances.push_back({1, -1, randomRotation(rng) * glm::mat3(glm::vec3(stretch, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1))});
+    }
+    for (int i = 0; i < 9990; i++) {
+        instances.push_back({2, -1, randomRotation(rng) * (0.5f + unit(rng))});
+    }
+    for (int i = 0; i < 10; i++) {
+        float stretch = i % 2 == 0 ? 1.0f : 3.0f;
+        instances.push_back({3, 0, randomRotation(rng) * glm::mat3(glm::vec3(stretch, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1))});
+    }
+
+    size_t totalTriangles = 0;
+    for (const EmissiveInstance& instance : instances) {
+        totalTriangles += models[instance.objectID].data.indices.size() / 3;
+    }
+    size_t threads = reina::tools::ThreadPool::shared().getThreadCount() + 1;
+    std::printf("%zu emissive instances of %zu models, %zu instanced triangles, %zu threads\n",
+                instances.size(), models.size(), totalTriangles, threads);
+
+    // Keying, as Scene::build does it
+    auto start = std::chrono::high_resolution_clock::now();
+    std::unordered_map<reina::scene::EmissiveShapeKey, size_t, reina::scene::EmissiveShapeKeyHash> shapeIndices;
+    std::vector<const EmissiveInstance*> shapeInstances;
+    std::vector<size_t> instanceShapes(instances.size());
+    for (size_t i = 0; i < instances.size(); i++) {
+        reina::scene::EmissiveShapeKey key{instances[i].objectID, instances[i].emissionMapTexID, instances[i].linear};
+        auto [shape, inserted] = shapeIndices.try_emplace(key, shapeInstances.size());
+        if (inserted) {
+            shapeInstances.push_back(&instances[i]);
+        }
+        instanceShapes[i] = shape->second;
+    }
+    double keyingMs = millisecondsSince(start);
+
+    start = std::chrono::high_resolution_clock::now();
+    std::vector<reina::scene::EmissiveTriangles> shapes(shapeInstances.size());
+    reina::tools::ThreadPool::shared().parallelFor(shapes.size(), [&](size_t i) {
+        const Model& model = models[shapeInstances[i]->objectID];
+        shapes[i] = reina::scene::EmissiveTriangles::compute(viewOf(model.data), shapeInstances[i]->linear, model.emissionMap);
+    });
+    double sharedMs = millisecondsSince(start);
+
+    std::printf("shared:       keyed into %zu shapes in %.1f ms (%.0f ns per instance), computed them in %.1f ms\n",
+                shapes.size(), keyingMs, keyingMs * 1e6 / static_cast<double>(instances.size()), sharedMs);
+
+    // Every instance computing its own, as before shapes were shared
+    start = std::chrono::high_resolution_clock::now();
+    std::vector<float> weights(instances.size());
+    reina::tools::ThreadPool::shared().parallelFor(instances.size(), [&](size_t i) {
+        const Model& model = models[instances[i].objectID];
+        weights[i] = reina::scene::EmissiveTriangles::compute(viewOf(model.data), instances[i].linear, model.emissionMap).weight;
+    });
+    double perInstanceMs = millisecondsSince(start);
+    std::printf("per instance: computed %zu distributions in %.1f ms\n", instances.size(), perInstanceMs);
+
+    // The shared distributions are the ones each instance would compute, up to the quantization of the keys
+    float largestDifference = 0.0f;
+    for (size_t i = 0; i < instances.size(); i++) {
+        float shared = shapes[instanceShapes[i]].weight;
+        largestDifference = std::max(largestDifference, std::abs(shared - weights[i]) / weights[i]);
+    }
+    std::printf("largest relative weight difference between shared and own distributions: %.2e\n", largestDifference);
+
+    // The surfaces with an emission map take most of the time above. Computing theirs without the map separates the
+    // area loop, the only part that would gain from SIMD, from rasterizing the UV triangles over the map.
+    const reina::scene::ModelData& surface = models[3].data;
+    size_t surfaceTriangles = surface.indices.size() / 3;
+    size_t cores = std::min<size_t>(threads, std::max(std::thread::hardware_concurrency(), 1u));
+    constexpr int REPEATS = 10;
+    for (const reina::graphics::EmissionMap* map : {static_cast<const reina::graphics::EmissionMap*>(nullptr), models[3].emissionMap}) {
+        reina::scene::EmissiveTriangles::compute(viewOf(surface), glm::mat3(1.0f), map);  // warm up
+        start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < REPEATS; i++) {
+            reina::scene::EmissiveTriangles::compute(viewOf(surface), randomRotation(rng), map);
+        }
+        double ms = millisecondsSince(start) / REPEATS;
+        std::printf("%s %zu triangles in %.2f ms, %.1f ns per triangle per core\n", map == nullptr ? "without map: " : "with map:    ",
+                    surfaceTriangles, ms, ms * 1e6 * static_cast<double>(cores) / static_cast<double>(surfaceTriangles));
+    }
+
+    return 0;
+}
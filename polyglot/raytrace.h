@@ -3,6 +3,8 @@
 
 // define this to show normals on non-dielectric surfaces
 //#define DEBUG_SHOW_NORMALS
+// define this to color surfaces by the height map fetches bumpMapping took, from blue for none to red for 64 or more
+//#define DEBUG_SHOW_BUMP_FETCHES
 
 #ifdef __cplusplus
     #include <cstdint>
@@ -15,8 +17,12 @@
     using mat4 = glm::mat4;
 #endif  // #ifdef __cplusplus
 
+// InstanceProperties::indexFlags
+const uint INDEX_FLAG_SHARED_TOPOLOGY = 1u;  // the TBN and UV indices are the position indices, so only one stream is stored
+const uint INDEX_FLAG_16_BIT = 2u;           // indices are packed two per uint, low half first
+
 struct InstanceProperties {
-    uint indicesOffset;
+    uint indicesOffset;    // index stream offsets are in uints into the shared index buffer
     vec3 albedo;
     vec3 emission;
     uint tbnsIndicesOffset;
@@ -38,11 +44,61 @@ struct InstanceProperties {
     float clearcoat;
     float specularTransmission;
     float sheen;
+    uint vertexOffset;     // added to position indices, which are stored relative to the model
+    uint tbnsOffset;       // added to TBN indices
+    uint texCoordsOffset;  // added to UV indices
+    uint indexFlags;
+    int emissionMapTexID;  // scales the emission; -1 for none
+    uint bumpMapMinHeights;  // 1 if G of the bump map holds min heights (see reina::graphics::storeMinHeights)
+};
+
+// An entry of a table that samples in constant time, built by reina::scene::buildAliasTable
+struct AliasEntry {
+    float threshold;    // picking this entry keeps it if a uniform random number is below this, else picks alias
+    uint alias;
+    float probability;  // of this entry being sampled, for the pdf
+};
+
+// LightBvhNode::triangle of interior nodes
+const uint LIGHT_BVH_INTERIOR = 0xFFFFFFFFu;
+
+// A node of reina::scene::LightBvh. The triangles under it emit from within boundsMin and boundsMax, with normals
+// within acos(cosThetaO) of axis, and light leaves them up to acos(cosThetaE) beyond their normals.
+struct LightBvhNode {
+    vec3 boundsMin;
+    float power;
+    vec3 boundsMax;
+    float cosThetaO;
+    vec3 axis;
+    float cosThetaE;
+    uint secondChild;       // interior nodes; the first child follows the node. Leaves: the emissive instance
+    uint triangle;          // leaves: the triangle within the emissive instance. LIGHT_BVH_INTERIOR for interior nodes
+    uint twoSided;          // 1 if any triangle under the node emits from its back too
 };
 
+const uint LIGHT_CACHE_SLOTS = 8u;  // emissive instances each light cache cell keeps statistics for
+
+// An entry of the light cache's hash grid, built by reina::graphics::LightCache and filled in by the shaders. Each slot
+// counts the shadow rays traced from the cell toward its emissive instance and how many reached it, and averages the
+// unshadowed contribution of those that did.
+struct LightCacheCell {
+    uint checksum;                           // of the cell's coordinates. 0 while unclaimed
+    uint instances[LIGHT_CACHE_SLOTS];       // the emissive instance plus 1. 0 for free slots
+    uint attempts[LIGHT_CACHE_SLOTS];
+    uint visible[LIGHT_CACHE_SLOTS];
+    float contribution[LIGHT_CACHE_SLOTS];
+};
+
+// RtPushConsts::restirPass. With ReSTIR, each frame traces the candidates pass, the spatial pass, then the shading pass
+const uint RESTIR_PASS_OFF = 0u;         // shades with next event estimation alone
+const uint RESTIR_PASS_CANDIDATES = 1u;  // draws initial light samples at the primary hits and reuses last frame's
+const uint RESTIR_PASS_SPATIAL = 2u;     // reuses the samples of neighboring pixels
+const uint RESTIR_PASS_SHADE = 3u;       // shades the primary hits with the reused samples
+
 struct RtPushConsts {
     mat4 invView;
     mat4 invProjection;
+    mat4 prevViewProjection;   // of the previous frame, which ReSTIR reprojects the primary hits with
     uint sampleBatch;
     float totalEmissiveWeight;
     float focusDist;
@@ -51,6 +107,12 @@ struct RtPushConsts {
     float indirectClamp;
     uint samplesPerPixel;
     uint maxBounces;
+    uint nextEventEstimation;  // 0 disables sampling the emissive objects and the environment map directly
+    uint lightBvh;             // 1 picks emissive triangles with the light BVH instead of the alias tables
+    uint restirPass;
+    uint restirFrame;          // frames traced with ReSTIR, which seeds its random numbers. 0 has no history to reuse
+    uint restirCandidates;     // light samples drawn per pixel in the candidates pass
+    uint restirSpatialNeighbors;
 };
 
 #endif // #ifndef RAYGUN_VK_POLYGLOT_COMMON_H
\ No newline at end of file
@@ -75,7 +75,7 @@ void main() {
     vec4 pixel = imageLoad(inImage, pixelCoord);
     vec3 color = pixel.rgb;
 
-    #ifndef DEBUG_SHOW_NORMALS
+    #if !defined(DEBUG_SHOW_NORMALS) && !defined(DEBUG_SHOW_BUMP_FETCHES)
         color = adjustExposure(color, pushConstants.exposure);
         color = tonemapACESFitted(color);
     #endif
@@ -10,21 +10,32 @@
 
 hitAttributeEXT vec2 attributes;
 
+// Tangent frames encoded by reina::scene::encodeTBN (VertexEncoding.h)
 layout (binding = 5, set = 0, scalar) buffer NormalsBuffer {
-    mat3 tbns[];
+    uvec2 tbns[];
 };
 
-layout (binding = 6, set = 0, scalar) buffer NormalsIndicesBuffer {
-    uint tbnsIndices[];
-};
+vec3 octDecode(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.x += v.x >= 0.0 ? -t : t;
+    v.y += v.y >= 0.0 ? -t : t;
+    return normalize(v);
+}
 
-layout (binding = 10, set = 0, scalar) buffer TexCoordsBuffer {
-    vec2 texCoords[];
-};
+vec3 decodeNormal(uvec2 encoded) {
+    return octDecode(unpackSnorm2x16(encoded.x));
+}
 
-layout (binding = 11, set = 0, scalar) buffer TexIndicesBuffer {
-    uint texIndices[];
-};
+// Returns the tangent, bitangent and normal columns
+mat3 decodeTBN(uvec2 encoded) {
+    vec3 normal = decodeNormal(encoded);
+    vec2 tangentOct = vec2(encoded.y & 0x7FFFu, (encoded.y >> 15) & 0x7FFFu) / 32767.0 * 2.0 - 1.0;
+    vec3 tangent = octDecode(tangentOct);
+    float bitangentSign = (encoded.y & 0x80000000u) != 0u ? -1.0 : 1.0;
+
+    return mat3(tangent, cross(normal, tangent) * bitangentSign, normal);
+}
 
 layout(location = 0) rayPayloadInEXT HitPayload pld;
 
@@ -36,8 +47,6 @@ layout(binding = 4, set = 0, scalar) buffer InstancePropertiesBuffer {
 //    sampler2D images[];
 //};
 
-layout(binding = 13, set = 0) uniform sampler2D textures[];
-
 struct HitInfo {
     vec3 objectPosition;
     vec3 worldPosition;
@@ -45,27 +54,47 @@ struct HitInfo {
     vec3 worldNormalGeometry;
     vec3 color;
     vec2 uv;
+    float uvDensity;  // sqrt of UV area per world space area of the triangle; 0 without tex coords
+    float coneWidth;  // width of the ray cone at the hit
+    float surfaceSpreadAngle;  // how much the curvature of the surface widens a reflected ray cone
+    float textureLod;  // mip level a 1x1 texture would be read at; textureMipLevel adds the size of a texture
     bool frontFace;
     mat3 tbn;
 };
 
+/*
+ * Mean curvature of a triangle from its vertex normals (Akenine-Möller et al., "Improved Shader and Texture Level of
+ * Detail Using Ray Cones", JCGT 2021): along each edge, how fast the normal turns per unit of length.
+ */
+float triangleCurvature(vec3 p0, vec3 p1, vec3 p2, vec3 n0, vec3 n1, vec3 n2) {
+    const vec3 e0 = p1 - p0;
+    const vec3 e1 = p2 - p1;
+    const vec3 e2 = p0 - p2;
+
+    const float k0 = dot(n1 - n0, e0) / max(dot(e0, e0), 1e-12);
+    const float k1 = dot(n2 - n1, e1) / max(dot(e1, e1), 1e-12);
+    const float k2 = dot(n0 - n2, e2) / max(dot(e2, e2), 1e-12);
+
+    return (k0 + k1 + k2) / 3.0;
+}
+
 HitInfo getObjectHitInfo() {
     HitInfo result;
     InstanceProperties props = instanceProperties[gl_InstanceCustomIndexEXT];
     // Get the ID of the triangle
     const uint primitiveID = gl_PrimitiveID;
 
-    const uint indexOffset = props.indicesOffset;
-
-    // Get the indices of the vertices of the triangle
-    const uint i0 = indices[3 * primitiveID + indexOffset + 0];
-    const uint i1 = indices[3 * primitiveID + indexOffset + 1];
-    const uint i2 = indices[3 * primitiveID + indexOffset + 2];
+    // Get the indices of the vertices of the triangle. When the topology is shared, the TBN and UV indices are the
+    // same as these.
+    const uvec3 triangleIndices = loadTriangleIndices(props.indicesOffset, primitiveID, props.indexFlags);
+    const bool sharedTopology = (props.indexFlags & INDEX_FLAG_SHARED_TOPOLOGY) != 0u;
 
     // Get the vertices of the triangle
-    const vec3 v0 = vertices[i0].xyz;
-    const vec3 v1 = vertices[i1].xyz;
-    const vec3 v2 = vertices[i2].xyz;
+    const vec3 v0 = vertices[props.vertexOffset + triangleIndices.x];
+    const vec3 v1 = vertices[props.vertexOffset + triangleIndices.y];
+    const vec3 v2 = vertices[props.vertexOffset + triangleIndices.z];
+
+    const uvec3 tbnsIndices = props.tbnsOffset + (sharedTopology ? triangleIndices : loadTriangleIndices(props.tbnsIndicesOffset, primitiveID, props.indexFlags));
 
     // Get the barycentric coordinates of the intersection
     vec3 barycentrics = vec3(0.0, attributes.x, attributes.y);
@@ -76,37 +105,42 @@ HitInfo getObjectHitInfo() {
     // Transform from object space to world space:
     result.worldPosition = gl_ObjectToWorldEXT * vec4(result.objectPosition, 1.0f);
 
+    const mat3 objectToWorld = mat3(gl_ObjectToWorldEXT);
+    const mat3 normalToWorld = transpose(inverse(objectToWorld));
+
     vec3 objectNormalGeometry = normalize(cross(v1 - v0, v2 - v0));
     vec3 objectNormal;
+    float curvature = 0.0;  // toward the outside normal, so positive on convex surfaces
     if (!props.interpNormals) {
         objectNormal = objectNormalGeometry;
     } else {
-        const uint tbnsIndexOffset = props.tbnsIndicesOffset;
-        const uint tbn0Index = tbnsIndices[3 * primitiveID + tbnsIndexOffset + 0];
-        const uint n1Index = tbnsIndices[3 * primitiveID + tbnsIndexOffset + 1];
-        const uint tbn2Index = tbnsIndices[3 * primitiveID + tbnsIndexOffset + 2];
-
-        const vec3 n0 = normalize(tbns[tbn0Index][2]);
-        const vec3 n1 = normalize(tbns[n1Index][2]);
-        const vec3 n2 = normalize(tbns[tbn2Index][2]);
+        const vec3 n0 = decodeNormal(tbns[tbnsIndices.x]);
+        const vec3 n1 = decodeNormal(tbns[tbnsIndices.y]);
+        const vec3 n2 = decodeNormal(tbns[tbnsIndices.z]);
 
         objectNormal = normalize(n0 * barycentrics.x + n1 * barycentrics.y + n2 * barycentrics.z);
+        curvature = triangleCurvature(
+            objectToWorld * v0, objectToWorld * v1, objectToWorld * v2,
+            normalize(normalToWorld * n0), normalize(normalToWorld * n1), normalize(normalToWorld * n2)
+        );
     }
 
     if (props.texIndicesOffset == 0xFFFFFFFFu) {
         // no tex coords for this model
         result.uv = vec2(0);
+        result.uvDensity = 0.0;
     } else {
-        const uint texIndexOffset = props.texIndicesOffset;
-        const uint t0Index = texIndices[3 * primitiveID + texIndexOffset + 0];
-        const uint t1Index = texIndices[3 * primitiveID + texIndexOffset + 1];
-        const uint t2Index = texIndices[3 * primitiveID + texIndexOffset + 2];
+        const uvec3 texIndices = props.texCoordsOffset + (sharedTopology ? triangleIndices : loadTriangleIndices(props.texIndicesOffset, primitiveID, props.indexFlags));
 
-        const vec2 t0 = texCoords[t0Index].xy;
-        const vec2 t1 = texCoords[t1Index].xy;
-        const vec2 t2 = texCoords[t2Index].xy;
+        const vec2 t0 = texCoords[texIndices.x].xy;
+        const vec2 t1 = texCoords[texIndices.y].xy;
+        const vec2 t2 = texCoords[texIndices.z].xy;
 
         result.uv = t0 * barycentrics.x + t1 * barycentrics.y + t2 * barycentrics.z;
+
+        const float worldArea = length(cross(objectToWorld * (v1 - v0), objectToWorld * (v2 - v0)));
+        const float uvArea = abs((t1.x - t0.x) * (t2.y - t0.y) - (t2.x - t0.x) * (t1.y - t0.y));
+        result.uvDensity = worldArea > 0.0 ? sqrt(uvArea / worldArea) : 0.0;
     }
 
     // Transform normals from object space to world space
@@ -117,23 +151,28 @@ HitInfo getObjectHitInfo() {
     result.worldNormal = faceforward(result.worldNormal, gl_WorldRayDirectionEXT, result.worldNormalGeometry);
     result.worldNormalGeometry = faceforward(result.worldNormalGeometry, gl_WorldRayDirectionEXT, result.worldNormalGeometry);
 
+    // Ray cones (Akenine-Möller et al., "Texture Level of Detail Strategies for Real-Time Ray Tracing", Ray Tracing
+    // Gems 2019). The cone grows linearly from where the ray left, and its footprint stretches on grazing hits. A
+    // converging cone can pass through zero, after which it widens again.
+    const float hitDistance = length(result.worldPosition - gl_WorldRayOriginEXT);
+    const float cosine = max(abs(dot(normalize(gl_WorldRayDirectionEXT), result.worldNormalGeometry)), 0.05);
+    result.coneWidth = abs(pld.coneWidth + pld.coneSpreadAngle * hitDistance);
+    result.surfaceSpreadAngle = 2.0 * (result.frontFace ? curvature : -curvature) * result.coneWidth;
+    result.textureLod = log2(max(result.coneWidth / cosine * result.uvDensity, 1e-8));
+
     // TBN stuff
     result.tbn = mat3(1.0);
-    const uint tbnsIndexOffset = props.tbnsIndicesOffset;
-    mat3 vertex1 = tbns[tbnsIndices[3 * primitiveID + tbnsIndexOffset + 0]];
-    mat3 vertex2 = tbns[tbnsIndices[3 * primitiveID + tbnsIndexOffset + 1]];
-    mat3 vertex3 = tbns[tbnsIndices[3 * primitiveID + tbnsIndexOffset + 2]];
+    mat3 vertex1 = decodeTBN(tbns[tbnsIndices.x]);
+    mat3 vertex2 = decodeTBN(tbns[tbnsIndices.y]);
+    mat3 vertex3 = decodeTBN(tbns[tbnsIndices.z]);
 
     vec3 tangent = normalize(vertex1[0] * barycentrics.x + vertex2[0] * barycentrics.y + vertex3[0] * barycentrics.z);
     vec3 bitangent = normalize(vertex1[1] * barycentrics.x + vertex2[1] * barycentrics.y + vertex3[1] * barycentrics.z);
     vec3 normal = normalize(vertex1[2] * barycentrics.x + vertex2[2] * barycentrics.y + vertex3[2] * barycentrics.z);
 
-    mat3 M = mat3(gl_ObjectToWorldEXT);
-    mat3 N = transpose(inverse(M));
-
-    vec3 worldT = normalize(M * tangent);
-    vec3 worldB = normalize(M * bitangent);
-    vec3 worldN = normalize(N * normal);
+    vec3 worldT = normalize(objectToWorld * tangent);
+    vec3 worldB = normalize(objectToWorld * bitangent);
+    vec3 worldN = normalize(normalToWorld * normal);
 
     // Re-orthagonalization
     worldT = normalize(worldT - worldN * dot(worldN, worldT));
@@ -147,6 +186,44 @@ HitInfo getObjectHitInfo() {
     return result;
 }
 
+/*
+ * Mip level of a texture at the hit, from the footprint of the ray cone mapped to texels through the triangle's UV
+ * density
+ */
+float textureMipLevel(int texID, HitInfo hitInfo) {
+    const ivec2 size = textureSize(textures[texID], 0);
+    return hitInfo.textureLod + 0.5 * log2(float(size.x * size.y));
+}
+
+// Angle of a lobe whose directions are offset by up to fuzz, like fuzzyReflection; a diffuse lobe has a fuzz of one
+float lobeSpreadAngle(float fuzz) {
+    return 2.0 * atan(fuzz);
+}
+
+/*
+ * Continues the ray cone from the hit along the scattered ray. Besides the curvature of the surface, a rough lobe
+ * spreads the paths a pixel's rays take, so the cone widens by lobeSpreadAngle too. The spread is capped at a half
+ * turn, which is already wider than any footprint a texture has a level for.
+ */
+void propagateRayCone(HitInfo hitInfo, float lobeSpreadAngle) {
+    pld.coneWidth = hitInfo.coneWidth;
+    pld.coneSpreadAngle = min(pld.coneSpreadAngle + hitInfo.surfaceSpreadAngle + lobeSpreadAngle, k_pi);
+}
+
+// The material's emission at uv, scaled by its emission map if it has one
+vec3 sampleEmission(InstanceProperties props, vec2 uv, HitInfo hitInfo) {
+    if (props.emissionMapTexID < 0) {
+        return props.emission;
+    }
+    return props.emission * textureLod(textures[props.emissionMapTexID], uv, textureMipLevel(props.emissionMapTexID, hitInfo)).rgb;
+}
+
+// Normal maps may be BC5 compressed, which only keeps x and y, so z is always rebuilt from them
+vec3 sampleNormalMap(int texID, vec2 uv, HitInfo hitInfo) {
+    const vec2 xy = textureLod(textures[texID], uv, textureMipLevel(texID, hitInfo)).rg * 2 - 1;
+    return vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+}
+
 /*
  * Credit: Carsten Wächter and Nikolaus Binder from "A Fast and Robust Method for Avoiding Self-Intersection"
  * from Ray Tracing Gems (version 1.7, 2020)
@@ -190,6 +267,7 @@ void skip(HitInfo hitInfo) {
     pld.rayDirection = gl_WorldRayDirectionEXT;
     pld.rayHitSky = false;
     pld.skip = true;
+    pld.coneWidth = hitInfo.coneWidth;
 }
 
 vec3 randomUnitVec(inout uint rngState) {
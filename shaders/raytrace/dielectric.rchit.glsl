@@ -57,17 +57,17 @@ void main() {
     uv = mod(uv, 1.0);
 
     if (props.bumpMapTexID >= 0) {
-        uv = bumpMapping(uv, normalize(gl_WorldRayDirectionEXT), hitInfo.tbn, textures[props.bumpMapTexID]);
+        uv = bumpMapping(uv, normalize(gl_WorldRayDirectionEXT), hitInfo.tbn, textures[props.bumpMapTexID], textureMipLevel(props.bumpMapTexID, hitInfo), props.bumpMapMinHeights != 0u);
     }
 
     vec3 albedo = props.albedo;
     if (props.textureID >= 0) {
-        albedo *= texture(textures[props.textureID], uv).rgb;
+        albedo *= textureLod(textures[props.textureID], uv, textureMipLevel(props.textureID, hitInfo)).rgb;
     }
 
     vec3 worldNormal = hitInfo.worldNormal;
     if (props.normalMapTexID >= 0) {
-        vec3 tangentNormal = texture(textures[props.normalMapTexID], uv).rgb * 2 - 1;
+        vec3 tangentNormal = sampleNormalMap(props.normalMapTexID, uv, hitInfo);
         tangentNormal.y *= -1;
         worldNormal = normalize(hitInfo.tbn * tangentNormal);
     }
@@ -100,7 +100,7 @@ void main() {
     }
 
     pld.albedo = pld.color;
-    pld.emission = props.emission;
+    pld.emission = sampleEmission(props, uv, hitInfo);
     pld.rayHitSky = false;
     pld.skip = false;
     pld.materialID = 2;
@@ -110,4 +110,5 @@ void main() {
     pld.props = props;
     pld.didRefract = false;  // only used for disney bsdf
     pld.eta = 0.0;  // only used for disney bsdf
+    propagateRayCone(hitInfo, lobeSpreadAngle(props.roughness));
 }
\ No newline at end of file
@@ -49,7 +49,7 @@ void main() {
     uv = mod(uv, 1.0);
 
     if (props.bumpMapTexID >= 0) {
-        uv = bumpMapping(uv, normalize(gl_WorldRayDirectionEXT), hitInfo.tbn, textures[props.bumpMapTexID]);
+        uv = bumpMapping(uv, normalize(gl_WorldRayDirectionEXT), hitInfo.tbn, textures[props.bumpMapTexID], textureMipLevel(props.bumpMapTexID, hitInfo), props.bumpMapMinHeights != 0u);
     }
 
     if (uv.x < 0.0 || uv.x > 1.0 || uv.y < 0.0 || uv.y > 1.0) {
@@ -59,7 +59,7 @@ void main() {
 
     vec3 worldNormal = hitInfo.worldNormal;
     if (props.normalMapTexID >= 0) {
-        vec3 tangentNormal = texture(textures[props.normalMapTexID], uv).rgb * 2 - 1;
+        vec3 tangentNormal = sampleNormalMap(props.normalMapTexID, uv, hitInfo);
         tangentNormal.y *= -1;
         worldNormal = normalize(hitInfo.tbn * tangentNormal);
     }
@@ -70,10 +70,12 @@ void main() {
         if (any(isnan(hitInfo.tbn[0]))) {
             albedo = vec3(1.0, 1.0, 1.0);  // red color for debugging
         }
+    #elif defined(DEBUG_SHOW_BUMP_FETCHES)
+        albedo = bumpMappingFetchesColor();
     #else
         albedo = props.albedo;
         if (props.textureID >= 0) {
-            vec4 texColor = texture(textures[props.textureID], uv);
+            vec4 texColor = textureLod(textures[props.textureID], uv, textureMipLevel(props.textureID, hitInfo));
             if (texColor.a < 0.999 && random(pld.rngState) > texColor.a) {
                 // transparency
                 skip(hitInfo);
@@ -175,7 +177,7 @@ void main() {
 
     pld.albedo = albedo;
     pld.pdf = pdf;
-    pld.emission = props.emission;
+    pld.emission = sampleEmission(props, uv, hitInfo);
     pld.rayOrigin = offsetPositionForDielectric(hitInfo.worldPosition, hitInfo.worldNormalGeometry, rayDir);
     pld.rayDirection = rayDir;
     pld.rayHitSky = false;
@@ -187,6 +189,7 @@ void main() {
     pld.didRefract = false;
     pld.eta = eta;
     pld.eta = 0;
+    propagateRayCone(hitInfo, lobeSpreadAngle(props.roughness * props.roughness));  // the microfacet lobes use roughness squared
 
     pld.insideDielectric = choseGlass;
 
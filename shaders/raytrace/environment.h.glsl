@@ -0,0 +1,117 @@
+#ifndef REINA_ENVIRONMENT_H
+#define REINA_ENVIRONMENT_H
+
+#include "shaderCommon.h.glsl"
+
+// Built by reina::graphics::EnvironmentMap. Rows are picked by the marginal CDF, then texels by the row's conditional
+// CDF. Each CDF omits its leading 0 and ends at 1.
+layout (binding = 11, set = 0, scalar) buffer EnvironmentSamplingBuffer {
+    uint environmentEnabled;
+    uint environmentWidth;
+    uint environmentHeight;
+    float environmentIntensity;
+    float environmentCdfs[];  // environmentHeight marginal entries, then environmentWidth entries per row
+};
+
+// Equirectangular, row 0 straight up
+layout (binding = 12, set = 0) uniform sampler2D environmentMap;
+
+struct EnvironmentSample {
+    vec3 direction;
+    vec3 radiance;
+    float pdf;  // per unit solid angle; 0 if the sample must be discarded
+};
+
+vec2 directionToEquirect(vec3 direction) {
+    return vec2(atan(direction.z, direction.x) * 0.5 * k_inv_pi + 0.5, acos(clamp(direction.y, -1.0, 1.0)) * k_inv_pi);
+}
+
+vec3 equirectToDirection(vec2 uv) {
+    const float phi = (uv.x - 0.5) * 2.0 * k_pi;
+    const float theta = uv.y * k_pi;
+    return vec3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+}
+
+vec3 environmentRadiance(vec3 direction) {
+    vec2 uv = directionToEquirect(normalize(direction));
+    // The sampler repeats, so v is kept off the poles to not blend in the opposite pole
+    const float halfTexel = 0.5 / float(environmentHeight);
+    uv.y = clamp(uv.y, halfTexel, 1.0 - halfTexel);
+
+    return textureLod(environmentMap, uv, 0.0).rgb * environmentIntensity;
+}
+
+// Returns the first entry in [start, start + count) that is at least u
+uint searchEnvironmentCdf(uint start, uint count, float u) {
+    int lowerBound = int(start);
+    int upperBound = int(start + count) - 1;
+
+    while (lowerBound < upperBound) {
+        int mid = (lowerBound + upperBound) / 2;
+        if (u <= environmentCdfs[mid]) {
+            upperBound = mid;
+        } else {
+            lowerBound = mid + 1;
+        }
+    }
+
+    return uint(lowerBound) - start;
+}
+
+// Start of CDF entry i, which is the end of entry i - 1
+float environmentCdfLow(uint start, uint i) {
+    return i == 0u ? 0.0 : environmentCdfs[start + i - 1u];
+}
+
+// Converts a density over the [0, 1]^2 image to one over solid angle
+float environmentSolidAnglePdf(float imagePdf, float v) {
+    const float sinTheta = sin(v * k_pi);
+    return sinTheta > 0.0 ? imagePdf / (2.0 * k_pi * k_pi * sinTheta) : 0.0;
+}
+
+float environmentPdf(vec3 direction) {
+    const vec2 uv = directionToEquirect(normalize(direction));
+    const uint row = min(uint(uv.y * float(environmentHeight)), environmentHeight - 1u);
+    const uint col = min(uint(uv.x * float(environmentWidth)), environmentWidth - 1u);
+    const uint rowStart = environmentHeight + row * environmentWidth;
+
+    const float rowProbability = environmentCdfs[row] - environmentCdfLow(0u, row);
+    const float colProbability = environmentCdfs[rowStart + col] - environmentCdfLow(rowStart, col);
+
+    return environmentSolidAnglePdf(rowProbability * float(environmentHeight) * colProbability * float(environmentWidth), uv.y);
+}
+
+EnvironmentSample sampleEnvironment(inout uint rngState) {
+    const float u1 = random(rngState);
+    const float u2 = random(rngState);
+
+    const uint row = searchEnvironmentCdf(0u, environmentHeight, u1);
+    const uint rowStart = environmentHeight + row * environmentWidth;
+    const uint col = searchEnvironmentCdf(rowStart, environmentWidth, u2);
+
+    const float rowLow = environmentCdfLow(0u, row);
+    const float colLow = environmentCdfLow(rowStart, col);
+    const float rowProbability = environmentCdfs[row] - rowLow;
+    const float colProbability = environmentCdfs[rowStart + col] - colLow;
+
+    EnvironmentSample result;
+    result.direction = vec3(0.0, 1.0, 0.0);
+    result.radiance = vec3(0.0);
+    result.pdf = 0.0;
+    if (rowProbability <= 0.0 || colProbability <= 0.0) {
+        return result;
+    }
+
+    // The remainders of u1 and u2 place the sample within the texel, so no more random numbers are needed
+    const vec2 uv = vec2(
+        (float(col) + clamp((u2 - colLow) / colProbability, 0.0, 1.0)) / float(environmentWidth),
+        (float(row) + clamp((u1 - rowLow) / rowProbability, 0.0, 1.0)) / float(environmentHeight)
+    );
+
+    result.direction = equirectToDirection(uv);
+    result.radiance = environmentRadiance(result.direction);
+    result.pdf = environmentSolidAnglePdf(rowProbability * float(environmentHeight) * colProbability * float(environmentWidth), uv.y);
+    return result;
+}
+
+#endif  // REINA_ENVIRONMENT_H
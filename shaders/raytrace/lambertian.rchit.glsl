@@ -24,7 +24,7 @@ void main() {
     uv = mod(uv, 1.0);
 
     if (props.bumpMapTexID >= 0) {
-        uv = bumpMapping(uv, normalize(gl_WorldRayDirectionEXT), hitInfo.tbn, textures[props.bumpMapTexID]);
+        uv = bumpMapping(uv, normalize(gl_WorldRayDirectionEXT), hitInfo.tbn, textures[props.bumpMapTexID], textureMipLevel(props.bumpMapTexID, hitInfo), props.bumpMapMinHeights != 0u);
     }
 
     if (uv.x < 0.0 || uv.x > 1.0 || uv.y < 0.0 || uv.y > 1.0) {
@@ -34,17 +34,19 @@ void main() {
 
     vec3 worldNormal = hitInfo.worldNormal;
     if (props.normalMapTexID >= 0) {
-        vec3 tangentNormal = texture(textures[props.normalMapTexID], uv).rgb * 2 - 1;
+        vec3 tangentNormal = sampleNormalMap(props.normalMapTexID, uv, hitInfo);
         tangentNormal.y *= -1;
         worldNormal = normalize(hitInfo.tbn * tangentNormal);
     }
 
     #ifdef DEBUG_SHOW_NORMALS
         pld.color = worldNormal * 0.5 + 0.5;
+    #elif defined(DEBUG_SHOW_BUMP_FETCHES)
+        pld.color = bumpMappingFetchesColor();
     #else
         pld.color = props.albedo;
         if (props.textureID >= 0) {
-            vec4 texColor = texture(textures[props.textureID], uv);
+            vec4 texColor = textureLod(textures[props.textureID], uv, textureMipLevel(props.textureID, hitInfo));
             if (texColor.a < 0.999 && random(pld.rngState) > texColor.a) {
                 // transparency
                 skip(hitInfo);
@@ -56,7 +58,7 @@ void main() {
     #endif
 
     pld.albedo = pld.color;
-    pld.emission = props.emission;
+    pld.emission = sampleEmission(props, uv, hitInfo);
     pld.rayOrigin = offsetPositionAlongNormal(hitInfo.worldPosition, hitInfo.worldNormalGeometry);
     pld.rayDirection = diffuseReflection(worldNormal, pld.rngState);
     pld.rayHitSky = false;
@@ -69,6 +71,7 @@ void main() {
     pld.props = props;
     pld.didRefract = false;  // only used for disney bsdf
     pld.eta = 0.0;  // only used for disney bsdf
+    propagateRayCone(hitInfo, lobeSpreadAngle(1.0));
 
     if (pld.insideDielectric) {
         pld.accumulatedDistance += length(hitInfo.worldPosition - gl_WorldRayOriginEXT);
@@ -21,22 +21,24 @@ void main() {
     uv = mod(uv, 1.0);
 
     if (props.bumpMapTexID >= 0) {
-        uv = bumpMapping(uv, normalize(gl_WorldRayDirectionEXT), hitInfo.tbn, textures[props.bumpMapTexID]);
+        uv = bumpMapping(uv, normalize(gl_WorldRayDirectionEXT), hitInfo.tbn, textures[props.bumpMapTexID], textureMipLevel(props.bumpMapTexID, hitInfo), props.bumpMapMinHeights != 0u);
     }
 
     vec3 worldNormal = hitInfo.worldNormal;
     if (props.normalMapTexID >= 0) {
-        vec3 tangentNormal = texture(textures[props.normalMapTexID], uv).rgb * 2 - 1;
+        vec3 tangentNormal = sampleNormalMap(props.normalMapTexID, uv, hitInfo);
         tangentNormal.y *= -1;
         worldNormal = normalize(hitInfo.tbn * tangentNormal);
     }
 
     #ifdef DEBUG_SHOW_NORMALS
         pld.color = hitInfo.worldNormal * 0.5 + 0.5;
+    #elif defined(DEBUG_SHOW_BUMP_FETCHES)
+        pld.color = bumpMappingFetchesColor();
     #else
         pld.color = props.albedo;
         if (props.textureID >= 0) {
-            vec4 texColor = texture(textures[props.textureID], uv);
+            vec4 texColor = textureLod(textures[props.textureID], uv, textureMipLevel(props.textureID, hitInfo));
             if (texColor.a < 0.999 && random(pld.rngState) > texColor.a) {
                 // transparency
                 skip(hitInfo);
@@ -48,7 +50,7 @@ void main() {
     #endif
 
     pld.albedo = pld.color;
-    pld.emission = props.emission;
+    pld.emission = sampleEmission(props, uv, hitInfo);
     pld.rayOrigin = offsetPositionAlongNormal(hitInfo.worldPosition, hitInfo.worldNormalGeometry);
     pld.rayDirection = fuzzyReflection(gl_WorldRayDirectionEXT, worldNormal, props.roughness, pld.rngState);
     pld.rayHitSky = false;
@@ -61,6 +63,7 @@ void main() {
     pld.props = props;
     pld.didRefract = false;  // only used for disney bsdf
     pld.eta = 0.0;  // only used for disney bsdf
+    propagateRayCone(hitInfo, lobeSpreadAngle(props.roughness));
 
     if (pld.insideDielectric) {
         pld.accumulatedDistance += length(hitInfo.worldPosition - gl_WorldRayOriginEXT);
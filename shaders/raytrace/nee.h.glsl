@@ -2,6 +2,7 @@
 #define REINA_NEE_H
 
 #include "shaderCommon.h.glsl"
+#include "environment.h.glsl"
 #include "raytrace.h"
 
 layout (push_constant) uniform PushConsts {
@@ -11,36 +12,63 @@ layout (push_constant) uniform PushConsts {
 struct InstanceData {
     mat4x4 transform;
     uint materialOffset;
-    uint cdfRangeStart;
-    uint cdfRangeEnd;
+    uint aliasRangeStart;  // of the instance's triangles in aliasTriangles
+    uint aliasRangeEnd;  // inclusive
     uint indexOffset;
     vec3 emission;
     float weight;
     float area;
     bool cullBackface;
-    vec2 padding;
+    uint vertexOffset;
+    uint indexFlags;
+    int emissionMapTexID;  // -1 without an emission map
+    uint texIndicesOffset;  // 0xFFFFFFFF without tex coords
+    uint texCoordsOffset;
+    uint padding;
 };
 
 layout (binding = 7, set = 0, scalar) buffer EmissiveMetadataBuffer {
     InstanceData emissiveMetadata[];
 };
 
-layout (binding = 8, set = 0) buffer CDFTrianglesBuffer {
-    float cdfTriangles[];
+layout (binding = 8, set = 0, scalar) buffer AliasTrianglesBuffer {
+    AliasEntry aliasTriangles[];
 };
 
-layout (binding = 9, set = 0) buffer CDFInstancesBuffer {
+layout (binding = 9, set = 0, scalar) buffer AliasInstancesBuffer {
     uint numInstances;
     float allInstancesArea;
-    float cdfInstances[];
+    AliasEntry aliasInstances[];
 };
 
+layout (binding = 14, set = 0, scalar) buffer LightBvhBuffer {
+    LightBvhNode lightBvhNodes[];
+};
+
+// A hash grid over world space that learns which emissive instances light each cell. Cells are also split by the
+// dominant axis of the shading normal, since the floor and the wall meeting it see different lights.
+layout (binding = 23, set = 0, scalar) buffer LightCacheBuffer {
+    uint lightCacheEnabled;
+    float lightCacheCellSize;
+    uint lightCacheCellCount;
+    LightCacheCell lightCacheCells[];
+};
+
+const uint LIGHT_CACHE_NONE = 0xFFFFFFFFu;
+const uint LIGHT_CACHE_PROBES = 4u;             // cells tried after the hashed one before giving up
+const uint LIGHT_CACHE_MAX_ATTEMPTS = 65536u;   // slots stop learning after this many shadow rays
+const float LIGHT_CACHE_MIX = 0.75;             // share of picks from the cell, the rest coming from the global table
+
 struct RandomEmissivePointOutput {
     vec3 point;
     vec3 normal;
     vec3 emission;
     float pdf;
     bool cullBackface;
+    float instanceProbability;  // of picking the emissive instance. Not set with the light BVH
+    uint instanceIdx;    // into emissiveMetadata
+    uint triangle;       // relative to the instance
+    vec3 barycentrics;   // of the point on the triangle
 };
 
 struct ShadowPayload {
@@ -49,78 +77,326 @@ struct ShadowPayload {
 
 layout(location = 1) rayPayloadEXT ShadowPayload shadowPld;
 
+// Picks an entry of an alias table uniformly. The threshold is compared against a second random number, since
+// reusing the fraction of the first would leave few bits for it in tables with many entries.
+uint pickAliasSlot(inout uint rngState, uint count) {
+    return min(uint(random(rngState) * float(count)), count - 1u);
+}
+
 uint pickEmissiveInstance(inout uint rngState) {
-    float u = random(rngState);
-    int lowerBound = 0;
-    int upperBound = int(numInstances) - 1;
-
-    while (lowerBound < upperBound) {
-        int mid = (lowerBound + upperBound) / 2;
-        if (u <= cdfInstances[mid]) {
-            upperBound = mid;
-        } else {
-            lowerBound = mid + 1;
+    uint slot = pickAliasSlot(rngState, numInstances);
+    return random(rngState) < aliasInstances[slot].threshold ? slot : aliasInstances[slot].alias;
+}
+
+// Returns the index of the triangle relative to the instance, so it indexes the instance's triangles
+uint pickEmissiveTriangle(inout uint rngState, uint instanceIdx) {
+    uint rangeStart = emissiveMetadata[instanceIdx].aliasRangeStart;
+    uint slot = pickAliasSlot(rngState, emissiveMetadata[instanceIdx].aliasRangeEnd - rangeStart + 1u);
+    AliasEntry entry = aliasTriangles[rangeStart + slot];
+    return random(rngState) < entry.threshold ? slot : entry.alias;
+}
+
+uint pcgHash(uint v) {
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Finds the light cache cell of the shading point, claiming a free one if claim is set. Returns LIGHT_CACHE_NONE if
+// the cell has no entry, or all the entries it may use are taken by other cells.
+uint findLightCacheCell(vec3 p, vec3 n, bool claim) {
+    ivec3 coords = ivec3(floor(p / lightCacheCellSize));
+    vec3 absNormal = abs(n);
+    uint axis = absNormal.x > absNormal.y ? (absNormal.x > absNormal.z ? 0u : 2u) : (absNormal.y > absNormal.z ? 1u : 2u);
+    uint facing = axis * 2u + (n[axis] < 0.0 ? 1u : 0u);
+
+    uint hash = pcgHash(uint(coords.x) ^ pcgHash(uint(coords.y) ^ pcgHash(uint(coords.z) ^ pcgHash(facing))));
+    uint checksum = max(pcgHash(hash ^ 0x68E31DA4u), 1u);  // 0 marks free entries
+
+    for (uint probe = 0u; probe < LIGHT_CACHE_PROBES; probe++) {
+        uint cell = (hash + probe) % lightCacheCellCount;
+        uint stored = lightCacheCells[cell].checksum;
+        if (stored == 0u && claim) {
+            stored = atomicCompSwap(lightCacheCells[cell].checksum, 0u, checksum);
+            stored = stored == 0u ? checksum : stored;
+        }
+
+        if (stored == checksum) {
+            return cell;
+        }
+        if (stored == 0u) {
+            return LIGHT_CACHE_NONE;  // cells are claimed in probe order, so the cell can't be further along
         }
     }
 
-    return lowerBound;
+    return LIGHT_CACHE_NONE;
 }
 
-uint pickEmissiveTriangle(inout uint rngState, uint instanceIdx) {
-    float u = random(rngState);
-    int lowerBound = int(emissiveMetadata[instanceIdx].cdfRangeStart);
-    int upperBound = int(emissiveMetadata[instanceIdx].cdfRangeEnd);
-
-    while (lowerBound < upperBound) {
-        int mid = (lowerBound + upperBound) / 2;
-        if (u <= cdfTriangles[mid]) {
-            upperBound = mid;
+// The expected light reaching the cell from a slot's instance: the share of shadow rays that reached it times its
+// average unshadowed contribution. Laplace smoothing keeps one unlucky shadow ray from ruling a light out.
+float lightCacheWeight(uint cell, uint slot) {
+    float attempts = float(lightCacheCells[cell].attempts[slot]);
+    float visible = float(lightCacheCells[cell].visible[slot]);
+    return (visible + 1.0) / (attempts + 2.0) * lightCacheCells[cell].contribution[slot];
+}
+
+// Picks an emissive instance by what the light cache learned in the shading point's cell, mixed with the global alias
+// table so every instance keeps a chance. Cells that haven't seen any light use the global table alone. Other
+// invocations may update the cell meanwhile, so it is read once and the probability is of the statistics read.
+uint pickCachedEmissiveInstance(inout uint rngState, vec3 p, vec3 n, out float probability) {
+    uint slotInstances[LIGHT_CACHE_SLOTS];
+    float weights[LIGHT_CACHE_SLOTS];
+    float weightSum = 0.0;
+
+    uint cell = findLightCacheCell(p, n, false);
+    for (uint slot = 0u; slot < LIGHT_CACHE_SLOTS; slot++) {
+        slotInstances[slot] = cell != LIGHT_CACHE_NONE ? lightCacheCells[cell].instances[slot] : 0u;
+        weights[slot] = slotInstances[slot] != 0u ? lightCacheWeight(cell, slot) : 0.0;
+        weightSum += weights[slot];
+    }
+
+    if (weightSum <= 0.0) {
+        uint instanceIdx = pickEmissiveInstance(rngState);
+        probability = aliasInstances[instanceIdx].probability;
+        return instanceIdx;
+    }
+
+    uint instanceIdx;
+    if (random(rngState) < LIGHT_CACHE_MIX) {
+        float u = random(rngState) * weightSum;
+        uint picked = 0u;
+        for (uint slot = 0u; slot < LIGHT_CACHE_SLOTS; slot++) {
+            if (weights[slot] > 0.0) {
+                picked = slot;  // the last slot with weight, if rounding leaves u past the end
+                if (u < weights[slot]) {
+                    break;
+                }
+                u -= weights[slot];
+            }
+        }
+        instanceIdx = slotInstances[picked] - 1u;
+    } else {
+        instanceIdx = pickEmissiveInstance(rngState);
+    }
+
+    float cachedWeight = 0.0;
+    for (uint slot = 0u; slot < LIGHT_CACHE_SLOTS; slot++) {
+        if (slotInstances[slot] == instanceIdx + 1u) {
+            cachedWeight += weights[slot];
+        }
+    }
+
+    probability = LIGHT_CACHE_MIX * cachedWeight / weightSum + (1.0 - LIGHT_CACHE_MIX) * aliasInstances[instanceIdx].probability;
+    return instanceIdx;
+}
+
+// Records a shadow ray from the shading point toward an emissive instance: whether it reached the light, and if so the
+// light's unshadowed contribution divided by the pdf of the point within the instance. Instances that find no free
+// slot aren't learned, but stay reachable through the global table.
+void learnLightCache(vec3 p, vec3 n, uint instanceIdx, bool reachedLight, float contribution) {
+    uint cell = findLightCacheCell(p, n, true);
+    if (cell == LIGHT_CACHE_NONE) {
+        return;
+    }
+
+    for (uint slot = 0u; slot < LIGHT_CACHE_SLOTS; slot++) {
+        uint stored = lightCacheCells[cell].instances[slot];
+        if (stored == 0u) {
+            stored = atomicCompSwap(lightCacheCells[cell].instances[slot], 0u, instanceIdx + 1u);
+            stored = stored == 0u ? instanceIdx + 1u : stored;
+        }
+
+        if (stored != instanceIdx + 1u) {
+            continue;
+        }
+
+        if (lightCacheCells[cell].attempts[slot] >= LIGHT_CACHE_MAX_ATTEMPTS) {
+            return;
+        }
+
+        atomicAdd(lightCacheCells[cell].attempts[slot], 1u);
+        if (reachedLight) {
+            uint count = atomicAdd(lightCacheCells[cell].visible[slot], 1u) + 1u;
+            // Not atomic, so racing updates may drop a sample from the average, which only slows the learning
+            float average = lightCacheCells[cell].contribution[slot];
+            lightCacheCells[cell].contribution[slot] = average + (contribution - average) / float(count);
+        }
+        return;
+    }
+}
+
+// cos(a - b), or 1 if a < b
+float cosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+    return cosA > cosB ? 1.0 : cosA * cosB + sinA * sinB;
+}
+
+// sin(a - b), or 0 if a < b
+float sinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+    return cosA > cosB ? 0.0 : sinA * cosB - cosA * sinB;
+}
+
+// Conservative estimate of the light from the triangles under a light BVH node reaching p, up to a constant. Mirrors
+// LightBvh::importance.
+float lightBvhImportance(LightBvhNode node, vec3 p, vec3 n) {
+    vec3 center = (node.boundsMin + node.boundsMax) / 2.0;
+    vec3 toPoint = p - center;
+    float centerDistanceSquared = dot(toPoint, toPoint);
+    // Inside or close to the bounds, the distance is clamped so the importance doesn't blow up
+    float distanceSquared = max(centerDistanceSquared, length(node.boundsMax - node.boundsMin) / 2.0);
+
+    // Angle from the cone's axis to the point, less the cone's own angle
+    vec3 wi = centerDistanceSquared > 0.0 ? normalize(toPoint) : vec3(0.0);
+    float cosThetaW = dot(node.axis, wi);
+    if (node.twoSided != 0u) {
+        cosThetaW = abs(cosThetaW);
+    }
+    float sinThetaW = sqrt(max(1.0 - cosThetaW * cosThetaW, 0.0));
+
+    // Angle the bounds subtend from the point, which the angles are also reduced by
+    float cosThetaB = -1.0;
+    float radiusSquared = dot(node.boundsMax - center, node.boundsMax - center);
+    bool inside = all(greaterThanEqual(p, node.boundsMin)) && all(lessThanEqual(p, node.boundsMax));
+    if (!inside && centerDistanceSquared > radiusSquared) {
+        cosThetaB = sqrt(max(1.0 - radiusSquared / centerDistanceSquared, 0.0));
+    }
+    float sinThetaB = sqrt(max(1.0 - cosThetaB * cosThetaB, 0.0));
+
+    float sinThetaO = sqrt(max(1.0 - node.cosThetaO * node.cosThetaO, 0.0));
+    float cosThetaX = cosSubClamped(sinThetaW, cosThetaW, sinThetaO, node.cosThetaO);
+    float sinThetaX = sinSubClamped(sinThetaW, cosThetaW, sinThetaO, node.cosThetaO);
+    float cosThetaP = cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+    if (cosThetaP <= node.cosThetaE) {
+        return 0.0;
+    }
+
+    float importance = node.power * cosThetaP / distanceSquared;
+
+    if (dot(n, n) > 0.0) {
+        float cosThetaI = abs(dot(wi, n));
+        float sinThetaI = sqrt(max(1.0 - cosThetaI * cosThetaI, 0.0));
+        importance *= cosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+    }
+
+    return max(importance, 0.0);
+}
+
+// Walks down the light BVH from the root, picking each child by its importance at the shading point and rescaling the
+// random number for the next level. Mirrors LightBvh::sample. Returns false if no triangle is important at the point.
+bool pickLightBvhTriangle(inout uint rngState, vec3 p, vec3 n, out uint instanceIdx, out uint triangle, out float pmf) {
+    pmf = 1.0;
+    if (lightBvhImportance(lightBvhNodes[0], p, n) <= 0.0) {
+        return false;
+    }
+
+    float u = min(random(rngState), 0.99999994);
+    uint node = 0u;
+    while (lightBvhNodes[node].triangle == LIGHT_BVH_INTERIOR) {
+        uint secondChild = lightBvhNodes[node].secondChild;
+        float firstImportance = lightBvhImportance(lightBvhNodes[node + 1u], p, n);
+        float secondImportance = lightBvhImportance(lightBvhNodes[secondChild], p, n);
+        if (firstImportance <= 0.0 && secondImportance <= 0.0) {
+            return false;
+        }
+
+        float firstProbability = firstImportance / (firstImportance + secondImportance);
+        if (u < firstProbability) {
+            u = min(u / firstProbability, 0.99999994);
+            pmf *= firstProbability;
+            node = node + 1u;
         } else {
-            lowerBound = mid + 1;
+            u = min((u - firstProbability) / (1.0 - firstProbability), 0.99999994);
+            pmf *= 1.0 - firstProbability;
+            node = secondChild;
         }
     }
 
-    return lowerBound;
+    instanceIdx = lightBvhNodes[node].secondChild;
+    triangle = lightBvhNodes[node].triangle;
+    return true;
 }
 
-vec3 randomPointOnTriangle(inout uint rngState, vec3 v0, vec3 v1, vec3 v2) {
+// Returns the barycentric coordinates of a uniformly distributed point on a triangle
+vec3 randomPointOnTriangle(inout uint rngState) {
     // source: chapter 16 of Ray Tracing Gems (Shirley 2019)
     float beta = 1 - sqrt(random(rngState));
     float gamma = (1 - beta) * random(rngState);
     float alpha = 1 - beta - gamma;
 
-    return alpha * v0 + beta * v1 + gamma * v2;
+    return vec3(alpha, beta, gamma);
 }
 
-RandomEmissivePointOutput randomEmissivePoint(inout uint rngState) {
-    uint instanceIdx = pickEmissiveInstance(rngState);
-    uint emissiveTriangleIndex = pickEmissiveTriangle(rngState, instanceIdx);
-
+// Returns the point with the given barycentric coordinates on an emissive triangle, with the pdf of picking the triangle
+// with selectionProbability and the point uniformly on it
+RandomEmissivePointOutput emissivePointOnTriangle(uint instanceIdx, uint emissiveTriangleIndex, vec3 barycentrics, float selectionProbability) {
     InstanceData instanceMetadata = emissiveMetadata[instanceIdx];
 
-    const uint indexOffset = instanceMetadata.indexOffset;
-
     // get the indices of the vertices of the triangle
-    const uint i0 = indices[3 * emissiveTriangleIndex + indexOffset + 0];
-    const uint i1 = indices[3 * emissiveTriangleIndex + indexOffset + 1];
-    const uint i2 = indices[3 * emissiveTriangleIndex + indexOffset + 2];
+    const uvec3 relativeIndices = loadTriangleIndices(instanceMetadata.indexOffset, emissiveTriangleIndex, instanceMetadata.indexFlags);
+    const uvec3 triangleIndices = instanceMetadata.vertexOffset + relativeIndices;
 
     // get the vertices of the triangle
-    vec3 v0 = vertices[i0].xyz;
-    vec3 v1 = vertices[i1].xyz;
-    vec3 v2 = vertices[i2].xyz;
+    vec3 v0 = vertices[triangleIndices.x];
+    vec3 v1 = vertices[triangleIndices.y];
+    vec3 v2 = vertices[triangleIndices.z];
 
     v0 = (instanceMetadata.transform * vec4(v0, 1.0)).xyz;
     v1 = (instanceMetadata.transform * vec4(v1, 1.0)).xyz;
     v2 = (instanceMetadata.transform * vec4(v2, 1.0)).xyz;
 
-    vec3 point = randomPointOnTriangle(rngState, v0, v1, v2);
-    vec3 normal = normalize(cross(v1 - v0, v2 - v0));
+    vec3 point = barycentrics.x * v0 + barycentrics.y * v1 + barycentrics.z * v2;
+    vec3 triangleCross = cross(v1 - v0, v2 - v0);
+    vec3 normal = normalize(triangleCross);
+
+    vec3 emission = instanceMetadata.emission;
+    if (instanceMetadata.emissionMapTexID >= 0) {
+        // Like the hit shaders, models without tex coords read the emission map at (0, 0)
+        vec2 uv = vec2(0.0);
+        if (instanceMetadata.texIndicesOffset != 0xFFFFFFFFu) {
+            const bool sharedTopology = (instanceMetadata.indexFlags & INDEX_FLAG_SHARED_TOPOLOGY) != 0u;
+            const uvec3 texIndices = instanceMetadata.texCoordsOffset
+                    + (sharedTopology ? relativeIndices : loadTriangleIndices(instanceMetadata.texIndicesOffset, emissiveTriangleIndex, instanceMetadata.indexFlags));
+            uv = barycentrics.x * texCoords[texIndices.x] + barycentrics.y * texCoords[texIndices.y] + barycentrics.z * texCoords[texIndices.z];
+        }
+        emission *= textureLod(textures[nonuniformEXT(instanceMetadata.emissionMapTexID)], mod(uv, 1.0), 0.0).rgb;
+    }
+
+    // The point is uniform on the triangle
+    float probability = selectionProbability / (0.5 * length(triangleCross));
+    return RandomEmissivePointOutput(point, normal, emission, probability, instanceMetadata.cullBackface, 0.0, instanceIdx, emissiveTriangleIndex, barycentrics);
+}
+
+// Picks a point on an emissive triangle. With the light BVH, the triangle is picked by its estimated contribution at the
+// shading point, and a pdf of 0 means no triangle could contribute there. Otherwise, the light cache may pick the
+// instance before its triangle is picked from the instance's alias table.
+RandomEmissivePointOutput randomEmissivePoint(inout uint rngState, vec3 shadingPoint, vec3 shadingNormal) {
+    uint instanceIdx;
+    uint emissiveTriangleIndex;
+    float selectionProbability;
+    if (pushConstants.lightBvh != 0u) {
+        if (!pickLightBvhTriangle(rngState, shadingPoint, shadingNormal, instanceIdx, emissiveTriangleIndex, selectionProbability)) {
+            return RandomEmissivePointOutput(vec3(0.0), vec3(0.0), vec3(0.0), 0.0, true, 0.0, 0u, 0u, vec3(0.0));
+        }
+
+        return emissivePointOnTriangle(instanceIdx, emissiveTriangleIndex, randomPointOnTriangle(rngState), selectionProbability);
+    }
+
+    float instanceProbability;
+    if (lightCacheEnabled != 0u) {
+        instanceIdx = pickCachedEmissiveInstance(rngState, shadingPoint, shadingNormal, instanceProbability);
+    } else {
+        instanceIdx = pickEmissiveInstance(rngState);
+        instanceProbability = aliasInstances[instanceIdx].probability;
+    }
 
-    float luminosity = 0.2126 * instanceMetadata.emission.r + 0.7152 * instanceMetadata.emission.g + 0.0722 * instanceMetadata.emission.b;
+    // Triangles are picked by their share of the instance's weight, which an emission map makes differ from their
+    // share of its area
+    emissiveTriangleIndex = pickEmissiveTriangle(rngState, instanceIdx);
+    selectionProbability = instanceProbability
+            * aliasTriangles[emissiveMetadata[instanceIdx].aliasRangeStart + emissiveTriangleIndex].probability;
 
-    float probability = (instanceMetadata.weight / pushConstants.totalEmissiveWeight) * (1 / instanceMetadata.area);
-    return RandomEmissivePointOutput(point, normal, instanceMetadata.emission, probability, instanceMetadata.cullBackface);
+    RandomEmissivePointOutput target = emissivePointOnTriangle(instanceIdx, emissiveTriangleIndex, randomPointOnTriangle(rngState), selectionProbability);
+    target.instanceProbability = instanceProbability;
+    return target;
 }
 
 bool shadowRayOccluded(vec3 origin, vec3 direction, float dist) {
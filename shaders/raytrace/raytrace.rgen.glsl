@@ -9,6 +9,7 @@
 #include "pdf.h.glsl"
 
 #include "brdfDisney.h.glsl"
+#include "restir.h.glsl"
 
 #include "raytrace.h"
 
@@ -40,25 +41,18 @@ vec2 randomGaussian(inout uint rngState) {
     return r * vec2(cos(theta), sin(theta));
 }
 
-vec4 directLight(InstanceProperties props, mat3 tbn, uint materialID, vec3 rayIn, vec3 rayOrigin, vec3 surfaceNormal, vec3 albedo, float eta, bool didRefract, inout uint rngState) {
-    RandomEmissivePointOutput target = randomEmissivePoint(rngState);
-    vec3 direction = normalize(target.point - rayOrigin);
-    float dist = length(target.point - rayOrigin);
-
-    float pdf = target.pdf * dist * dist / max(dot(target.normal, -direction), 0.0001);
-
-    if (shadowRayOccluded(rayOrigin, direction, dist)) {
-        return vec4(0, 0, 0, pdf);
-    }
-
-    vec3 brdf;
+// Evaluates the BRDF of a lambertian (0) or Disney (3) surface toward a light, and the density of sampling that
+// direction from the BRDF
+vec3 evalBrdf(InstanceProperties props, mat3 tbn, uint materialID, vec3 rayIn, vec3 surfaceNormal, vec3 albedo, float eta, bool didRefract, vec3 direction, out float pdfBRDF) {
+    vec3 brdf = vec3(0.0);
+    pdfBRDF = 0.0;
     if (materialID == 0) {
         brdf = albedo / k_pi;
+        pdfBRDF = pdfLambertian(surfaceNormal, direction);
     } else if (materialID == 3) {
         // vec3 diffuse(vec3 baseColor, vec3 n, vec3 wi, vec3 wo, vec3 h)
         vec3 h = normalize(direction + -rayIn);
 
-        float ignorePdf;
         brdf = evalDisney(
             tbn,
             albedo,
@@ -78,10 +72,24 @@ vec4 directLight(InstanceProperties props, mat3 tbn, uint materialID, vec3 rayIn
             -rayIn,
             direction,
             h,
-            ignorePdf
+            pdfBRDF
         );
     }
 
+    return brdf;
+}
+
+vec4 directLight(InstanceProperties props, mat3 tbn, uint materialID, vec3 rayIn, vec3 rayOrigin, vec3 surfaceNormal, vec3 albedo, float eta, bool didRefract, inout uint rngState) {
+    RandomEmissivePointOutput target = randomEmissivePoint(rngState, rayOrigin, surfaceNormal);
+    if (target.pdf <= 0.0) {
+        return vec4(0.0);
+    }
+
+    vec3 direction = normalize(target.point - rayOrigin);
+    float dist = length(target.point - rayOrigin);
+
+    float pdf = target.pdf * dist * dist / max(dot(target.normal, -direction), 0.0001);
+
     float cosThetai = dot(surfaceNormal, direction);
     cosThetai = target.cullBackface ? max(cosThetai, 0.0) : abs(cosThetai);
 
@@ -89,12 +97,97 @@ vec4 directLight(InstanceProperties props, mat3 tbn, uint materialID, vec3 rayIn
     geometryTermNumerator = target.cullBackface ? max(geometryTermNumerator, 0.0) : abs(geometryTermNumerator);
     float geometryTerm = geometryTermNumerator / (dist * dist);
 
+    bool occluded = shadowRayOccluded(rayOrigin, direction, dist);
+
+    if (lightCacheEnabled != 0u && pushConstants.lightBvh == 0u) {
+        // The instance's whole unshadowed contribution, estimated from this one point on it
+        float contribution = luminance(target.emission) * cosThetai * geometryTerm * target.instanceProbability / target.pdf;
+        learnLightCache(rayOrigin, surfaceNormal, target.instanceIdx, !occluded, contribution);
+    }
+
+    if (occluded) {
+        return vec4(0, 0, 0, pdf);
+    }
+
+    float ignorePdf;
+    vec3 brdf = evalBrdf(props, tbn, materialID, rayIn, surfaceNormal, albedo, eta, didRefract, direction, ignorePdf);
+
     vec3 light = target.emission * brdf * cosThetai * geometryTerm / target.pdf;
 
     return vec4(light, pdf);
 }
 
-vec3 traceSegments(Ray ray) {
+// The direct light from the emissive triangles at a primary hit, shaded with the sample its ReSTIR reservoir kept instead
+// of a new one. Spatial reuse doesn't check visibility, so the sample is shadow tested here.
+vec3 restirDirectLight(ivec2 pixel, InstanceProperties props, mat3 tbn, uint materialID, vec3 rayIn, vec3 rayOrigin, vec3 surfaceNormal, vec3 albedo, float eta, bool didRefract) {
+    Reservoir reservoir = loadHistoryReservoir(pixel);
+    if (reservoir.W <= 0.0) {
+        return vec3(0.0);
+    }
+
+    RandomEmissivePointOutput target = reservoirLight(reservoir);
+    vec3 direction = normalize(target.point - rayOrigin);
+    float dist = length(target.point - rayOrigin);
+
+    if (shadowRayOccluded(rayOrigin, direction, dist)) {
+        return vec3(0.0);
+    }
+
+    float ignorePdf;
+    vec3 brdf = evalBrdf(props, tbn, materialID, rayIn, surfaceNormal, albedo, eta, didRefract, direction, ignorePdf);
+
+    float cosThetai = dot(surfaceNormal, direction);
+    cosThetai = target.cullBackface ? max(cosThetai, 0.0) : abs(cosThetai);
+
+    float geometryTermNumerator = dot(target.normal, -direction);
+    geometryTermNumerator = target.cullBackface ? max(geometryTermNumerator, 0.0) : abs(geometryTermNumerator);
+    float geometryTerm = geometryTermNumerator / (dist * dist);
+
+    // W is the reciprocal of the sample's density, in the same area measure as directLight's target.pdf
+    return target.emission * brdf * cosThetai * geometryTerm * reservoir.W;
+}
+
+// Samples the environment map by importance, weighted against the BRDF sampling the same direction. Only lambertian
+// surfaces are one-sided; Disney surfaces may also transmit.
+vec3 environmentLight(InstanceProperties props, mat3 tbn, uint materialID, vec3 rayIn, vec3 rayOrigin, vec3 surfaceNormal, vec3 albedo, float eta, bool didRefract, inout uint rngState) {
+    EnvironmentSample env = sampleEnvironment(rngState);
+
+    float cosThetai = dot(surfaceNormal, env.direction);
+    cosThetai = materialID == 0 ? max(cosThetai, 0.0) : abs(cosThetai);
+    if (env.pdf <= 0.0 || cosThetai <= 0.0 || shadowRayOccluded(rayOrigin, env.direction, 10000.0)) {
+        return vec3(0.0);
+    }
+
+    float pdfBRDF;
+    vec3 brdf = evalBrdf(props, tbn, materialID, rayIn, surfaceNormal, albedo, eta, didRefract, env.direction, pdfBRDF);
+
+    return env.radiance * brdf * cosThetai / env.pdf * balanceHeuristic(env.pdf, pdfBRDF);
+}
+
+void traceRay(Ray ray) {
+    traceRayEXT(
+        tlas,                  // Top-level acceleration structure
+        gl_RayFlagsOpaqueEXT,  // Ray flags, here saying "treat all geometry as opaque"
+        0xFF,                  // 8-bit instance mask, here saying "trace against all instances"
+        0,                     // SBT record offset
+        0,                     // SBT record stride for offset
+        0,                     // Miss index
+        ray.origin,            // Ray origin
+        0.0,                   // Minimum t-value
+        ray.direction,         // Ray direction
+        10000.0,               // Maximum t-value
+        0                      // Location of payload
+    );
+}
+
+// Whether the hit takes next event estimation toward the emissive objects, which ReSTIR then does at primary hits
+bool hitSamplesEmissives() {
+    return !pld.skip && !pld.rayHitSky && !pld.insideDielectric && (pld.materialID == 0 || pld.materialID == 3)
+            && pushConstants.nextEventEstimation != 0u && pushConstants.totalEmissiveWeight > 0.0;
+}
+
+// useReservoir shades the direct light at the primary hit with the pixel's ReSTIR reservoir
+vec3 traceSegments(Ray ray, ivec2 pixel, bool useReservoir) {
     pld.insideDielectric = false;
     vec3 accumulatedRayColor = vec3(1.0);
     vec3 incomingLight = vec3(0.0);
@@ -103,23 +196,16 @@ vec3 traceSegments(Ray ray) {
     bool prevSkip = false;
     bool leftDielectric = false;
 
+    // Whether the environment was sampled directly at the previous hit, and the density of the direction the BRDF
+    // sampled there, which a ray reaching the sky is weighted with
+    bool prevSampledEnvironment = false;
+    float prevPdfBRDF = 0.0;
+
     for (int tracedSegments = 0; tracedSegments < pushConstants.maxBounces; tracedSegments++) {
         vec3 rayIn = ray.direction;  // wi is the old wo
 
         bool prevInsideDielectric = pld.insideDielectric;
-        traceRayEXT(
-            tlas,                  // Top-level acceleration structure
-            gl_RayFlagsOpaqueEXT,  // Ray flags, here saying "treat all geometry as opaque"
-            0xFF,                  // 8-bit instance mask, here saying "trace against all instances"
-            0,                     // SBT record offset
-            0,                     // SBT record stride for offset
-            0,                     // Miss index
-            ray.origin,            // Ray origin
-            0.0,                   // Minimum t-value
-            ray.direction,         // Ray direction
-            10000.0,               // Maximum t-value
-            0                      // Location of payload
-        );
+        traceRay(ray);
 
         bool leftDielectric = !pld.insideDielectric && prevInsideDielectric;
 
@@ -130,25 +216,32 @@ vec3 traceSegments(Ray ray) {
             continue;
         }
 
-        #ifdef DEBUG_SHOW_NORMALS
+        #if defined(DEBUG_SHOW_NORMALS) || defined(DEBUG_SHOW_BUMP_FETCHES)
             incomingLight += pld.albedo;
             break;
         #endif
 
         if (pld.rayHitSky) {
-            incomingLight += pld.color * accumulatedRayColor;
+            float weightSky = prevSampledEnvironment ? balanceHeuristic(prevPdfBRDF, environmentPdf(rayIn)) : 1.0;
+            incomingLight += pld.color * accumulatedRayColor * weightSky;
             break;
         }
 
+        bool sampledEnvironment = false;
         if (!pld.insideDielectric) {
             vec3 indirect = pld.emission.xyz;
-//            bool skipNEE = bool(pld.materialID != 0 && pld.materialID != 3);
-            bool skipNEE = true;
+            bool skipNEE = pushConstants.nextEventEstimation == 0u || bool(pld.materialID != 0 && pld.materialID != 3);
+            // Scenes lit only by the environment map have no emissive objects to sample
+            bool skipEmissives = skipNEE || pushConstants.totalEmissiveWeight <= 0.0;
 
             // vec4 directLight(int materialID, vec3 rayIn, vec3 rayOrigin, vec3 surfaceNormal, vec3 albedo, inout uint rngState)
-            vec4 direct = !skipNEE
-                ? directLight(pld.props, pld.tbn, pld.materialID, rayIn, pld.rayOrigin, pld.surfaceNormal, pld.albedo, pld.eta, pld.didRefract, pld.rngState)
-                : vec4(0.0, 0.0, 0.0, 0.0);
+            vec4 direct = vec4(0.0, 0.0, 0.0, 0.0);
+            if (!skipEmissives && useReservoir && tracedSegments == 0) {
+                // The first bounce takes both weights in full, so the pdf isn't needed
+                direct.rgb = restirDirectLight(pixel, pld.props, pld.tbn, pld.materialID, rayIn, pld.rayOrigin, pld.surfaceNormal, pld.albedo, pld.eta, pld.didRefract);
+            } else if (!skipEmissives) {
+                direct = directLight(pld.props, pld.tbn, pld.materialID, rayIn, pld.rayOrigin, pld.surfaceNormal, pld.albedo, pld.eta, pld.didRefract, pld.rngState);
+            }
 
             float pdfNEE = direct.w;
             float pdfBRDF = pld.pdf;
@@ -156,10 +249,14 @@ vec3 traceSegments(Ray ray) {
             float weightNEE = 0.0;
             float weightBRDF = 1.0;
 
-            if (!skipNEE) {
+            if (!skipEmissives) {
                 if (firstBounce || prevSkip || leftDielectric) {
                     weightNEE = 1.0;
                     weightBRDF = 1.0;
+                } else if (pdfNEE <= 0.0) {
+                    // The light BVH found no emissive triangle that could light this point
+                    weightNEE = 0.0;
+                    weightBRDF = 1.0;
                 } else if (tracedSegments + 1 == pushConstants.maxBounces) {  // last bounce
                     // todo: you can increase performance by not computing the direct lighting contribution when this case occurs
                     weightNEE = 0.0;
@@ -170,13 +267,20 @@ vec3 traceSegments(Ray ray) {
                 }
             }
 
-            prevSkip = skipNEE;
+            prevSkip = skipEmissives;
             vec3 combinedContribution = direct.rgb * weightNEE + indirect * weightBRDF;
 
+            sampledEnvironment = !skipNEE && environmentEnabled != 0u;
+            if (sampledEnvironment) {
+                combinedContribution += environmentLight(pld.props, pld.tbn, pld.materialID, rayIn, pld.rayOrigin, pld.surfaceNormal, pld.albedo, pld.eta, pld.didRefract, pld.rngState);
+            }
+
             incomingLight += combinedContribution * accumulatedRayColor;
             accumulatedRayColor *= pld.color;
         }
 
+        prevSampledEnvironment = sampledEnvironment;
+        prevPdfBRDF = pld.pdf;
         firstBounce = false;
     }
 
@@ -243,6 +347,11 @@ Ray getStartingRay(
     // Recompute the ray direction so that the ray goes through the focal point.
     vec3 newDirection = normalize(focalPoint - newOrigin);
 
+    // The ray cone starts as a point at the camera, widening by the angle one pixel subtends at the center of the
+    // image. invProjection[1][1] is tan(fovY / 2).
+    pld.coneWidth = 0.0;
+    pld.coneSpreadAngle = 2.0 * abs(invProjection[1][1]) / resolution.y;
+
     return Ray(newOrigin, newDirection);
 }
 
@@ -255,15 +364,33 @@ void main() {
         return;
     }
 
-    // State of the random number generator with an initial seed
+    // State of the random number generator with an initial seed. The ReSTIR passes seed it the same, so their primary
+    // rays hit where the first sample of the shading pass does.
     pld.rngState = uint((pushConstants.sampleBatch * resolution.y + pixel.y) * resolution.x + pixel.x);
 
+    if (pushConstants.restirPass == RESTIR_PASS_CANDIDATES) {
+        Ray startingRay = getStartingRay(vec2(pixel), vec2(resolution), pushConstants.invView, pushConstants.invProjection);
+        pld.insideDielectric = false;
+        traceRay(startingRay);
+
+        bool valid = hitSamplesEmissives();
+        RestirSurface surface = RestirSurface(pld.rayOrigin, pld.surfaceNormal, pld.materialID == 3, distance(startingRay.origin, pld.rayOrigin), valid);
+        restirInitialCandidates(pixel, resolution, surface);
+        return;
+    }
+
+    if (pushConstants.restirPass == RESTIR_PASS_SPATIAL) {
+        restirSpatialReuse(pixel, resolution);
+        return;
+    }
+
     int actualSamples = 0;
     vec3 summedPixelColor = vec3(0.0);
 
     for (int sampleIdx = 0; sampleIdx < pushConstants.samplesPerPixel; sampleIdx++) {
         Ray startingRay = getStartingRay(vec2(pixel), vec2(resolution), pushConstants.invView, pushConstants.invProjection);
-        vec3 color = clamp(traceSegments(startingRay), vec3(0), vec3(pushConstants.directClamp));
+        bool useReservoir = pushConstants.restirPass == RESTIR_PASS_SHADE && sampleIdx == 0;
+        vec3 color = clamp(traceSegments(startingRay, pixel, useReservoir), vec3(0), vec3(pushConstants.directClamp));
 
         // this is a hack. for some reason, some rays are returning NaN. no clue why.
         if (any(isnan(color))) {
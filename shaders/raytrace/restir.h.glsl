@@ -0,0 +1,283 @@
+#ifndef REINA_RESTIR_H
+#define REINA_RESTIR_H
+
+#include "shaderCommon.h.glsl"
+#include "nee.h.glsl"
+#include "brdfDisney.h.glsl"
+#include "raytrace.h"
+
+// Spatiotemporal reservoir resampling of the emissive triangles (Bitterli et al. 2020, "Spatiotemporal reservoir
+// resampling for real-time ray tracing with dynamic direct lighting"). Every pixel keeps one light sample for its
+// primary hit, picked from its own candidates and the samples of last frame and neighboring pixels, along with the
+// weight that keeps shading with it unbiased.
+
+// The primary hits of this frame: the position, and the distance from the camera or 0 without a surface to shade
+layout(binding = 15, set = 0, rgba32f) uniform image2D restirPositions;
+// The shading normal, and 1 for surfaces that may be lit from behind
+layout(binding = 16, set = 0, rgba16f) uniform image2D restirNormals;
+// The primary hits of the previous frame, which the history reservoirs were picked for
+layout(binding = 17, set = 0, rgba32f) uniform image2D restirHistoryPositions;
+layout(binding = 18, set = 0, rgba16f) uniform image2D restirHistoryNormals;
+// The reservoirs after temporal reuse: the emissive instance, the triangle, and the bits of barycentrics y and z
+layout(binding = 19, set = 0, rgba32ui) uniform uimage2D reservoirSamples;
+// W and M of the reservoirs after temporal reuse
+layout(binding = 20, set = 0, rg32f) uniform image2D reservoirWeights;
+// The reservoirs after spatial reuse, which are shaded and become the next frame's history
+layout(binding = 21, set = 0, rgba32ui) uniform uimage2D historySamples;
+layout(binding = 22, set = 0, rg32f) uniform image2D historyWeights;
+
+const float RESTIR_HISTORY_LIMIT = 20.0;  // the most candidates the history may count for, relative to this frame's
+const uint RESTIR_MAX_SPATIAL_NEIGHBORS = 8u;
+const float RESTIR_SPATIAL_RADIUS = 30.0;  // pixels
+
+struct RestirSurface {
+    vec3 position;
+    vec3 normal;
+    bool litFromBehind;    // Disney surfaces may transmit
+    float cameraDistance;  // from the camera
+    bool valid;            // false if the primary ray didn't hit a surface that takes next event estimation
+};
+
+struct Reservoir {
+    uint instanceIdx;    // into emissiveMetadata
+    uint triangle;       // relative to the instance
+    vec3 barycentrics;
+    float weightSum;     // of the candidates streamed in. Not stored
+    float M;             // how many candidates the sample was picked from
+    float W;             // unbiased contribution weight of the sample
+    float targetPdf;     // of the sample at the surface the reservoir is built for. Not stored
+};
+
+Reservoir emptyReservoir() {
+    return Reservoir(0u, 0u, vec3(0.0), 0.0, 0.0, 0.0, 0.0);
+}
+
+// Seeds the random numbers of a ReSTIR pass, apart from the streams the shading pass seeds
+uint restirSeed(ivec2 pixel, ivec2 resolution) {
+    uint frameSeed = pushConstants.restirFrame * 4u + pushConstants.restirPass;
+    return ((frameSeed * uint(resolution.y) + uint(pixel.y)) * uint(resolution.x) + uint(pixel.x)) ^ 0x9E3779B9u;
+}
+
+RestirSurface decodeSurface(vec4 position, vec4 normal) {
+    return RestirSurface(position.xyz, normal.xyz, normal.w > 0.5, position.w, position.w > 0.0);
+}
+
+RestirSurface loadSurface(ivec2 pixel) {
+    return decodeSurface(imageLoad(restirPositions, pixel), imageLoad(restirNormals, pixel));
+}
+
+RestirSurface loadHistorySurface(ivec2 pixel) {
+    return decodeSurface(imageLoad(restirHistoryPositions, pixel), imageLoad(restirHistoryNormals, pixel));
+}
+
+void storeSurface(ivec2 pixel, RestirSurface surface) {
+    imageStore(restirPositions, pixel, vec4(surface.position, surface.valid ? surface.cameraDistance : 0.0));
+    imageStore(restirNormals, pixel, vec4(surface.normal, surface.litFromBehind ? 1.0 : 0.0));
+}
+
+void storeHistorySurface(ivec2 pixel, RestirSurface surface) {
+    imageStore(restirHistoryPositions, pixel, vec4(surface.position, surface.valid ? surface.cameraDistance : 0.0));
+    imageStore(restirHistoryNormals, pixel, vec4(surface.normal, surface.litFromBehind ? 1.0 : 0.0));
+}
+
+Reservoir decodeReservoir(uvec4 lightSample, vec2 weights) {
+    vec2 barycentricsYZ = uintBitsToFloat(lightSample.zw);
+    vec3 barycentrics = vec3(1.0 - barycentricsYZ.x - barycentricsYZ.y, barycentricsYZ);
+    return Reservoir(lightSample.x, lightSample.y, barycentrics, 0.0, weights.y, weights.x, 0.0);
+}
+
+Reservoir loadReservoir(ivec2 pixel) {
+    return decodeReservoir(imageLoad(reservoirSamples, pixel), imageLoad(reservoirWeights, pixel).xy);
+}
+
+Reservoir loadHistoryReservoir(ivec2 pixel) {
+    return decodeReservoir(imageLoad(historySamples, pixel), imageLoad(historyWeights, pixel).xy);
+}
+
+void storeReservoir(ivec2 pixel, Reservoir reservoir) {
+    imageStore(reservoirSamples, pixel, uvec4(reservoir.instanceIdx, reservoir.triangle, floatBitsToUint(reservoir.barycentrics.yz)));
+    imageStore(reservoirWeights, pixel, vec4(reservoir.W, reservoir.M, 0.0, 0.0));
+}
+
+void storeHistoryReservoir(ivec2 pixel, Reservoir reservoir) {
+    imageStore(historySamples, pixel, uvec4(reservoir.instanceIdx, reservoir.triangle, floatBitsToUint(reservoir.barycentrics.yz)));
+    imageStore(historyWeights, pixel, vec4(reservoir.W, reservoir.M, 0.0, 0.0));
+}
+
+RandomEmissivePointOutput reservoirLight(Reservoir reservoir) {
+    return emissivePointOnTriangle(reservoir.instanceIdx, reservoir.triangle, reservoir.barycentrics, 1.0);
+}
+
+// The unshadowed light reaching the surface from a point on an emissive triangle, without the BRDF. Resampling by it
+// favors bright, close lights that face the surface.
+float restirTargetPdf(RestirSurface surface, RandomEmissivePointOutput light) {
+    vec3 toLight = light.point - surface.position;
+    float distSquared = dot(toLight, toLight);
+    if (distSquared <= 0.0) {
+        return 0.0;
+    }
+
+    vec3 direction = toLight * inversesqrt(distSquared);
+
+    float cosThetai = dot(surface.normal, direction);
+    cosThetai = surface.litFromBehind ? abs(cosThetai) : max(cosThetai, 0.0);
+
+    float cosThetaLight = dot(light.normal, -direction);
+    cosThetaLight = light.cullBackface ? max(cosThetaLight, 0.0) : abs(cosThetaLight);
+
+    return luminance(light.emission) * cosThetai * cosThetaLight / distSquared;
+}
+
+// Streams a candidate into the reservoir, which keeps it with probability weight / weightSum. The caller counts M.
+void updateReservoir(inout Reservoir reservoir, uint instanceIdx, uint triangle, vec3 barycentrics, float weight, float targetPdf, inout uint rngState) {
+    reservoir.weightSum += weight;
+    if (weight > 0.0 && random(rngState) * reservoir.weightSum <= weight) {
+        reservoir.instanceIdx = instanceIdx;
+        reservoir.triangle = triangle;
+        reservoir.barycentrics = barycentrics;
+        reservoir.targetPdf = targetPdf;
+    }
+}
+
+// Streams another reservoir's sample into this one, resampled by its target pdf at this reservoir's surface
+void combineReservoir(inout Reservoir reservoir, Reservoir other, RestirSurface surface, inout uint rngState) {
+    float targetPdf = other.W > 0.0 ? restirTargetPdf(surface, reservoirLight(other)) : 0.0;
+    updateReservoir(reservoir, other.instanceIdx, other.triangle, other.barycentrics, targetPdf * other.W * other.M, targetPdf, rngState);
+    reservoir.M += other.M;
+}
+
+// Whether samples stay good to reuse between the surfaces. Across depth or normal discontinuities they see other lights.
+bool similarSurfaces(RestirSurface surface, RestirSurface other) {
+    return other.valid
+            && dot(surface.normal, other.normal) > 0.9
+            && abs(surface.cameraDistance - other.cameraDistance) < 0.1 * surface.cameraDistance;
+}
+
+// Draws the initial candidates at the surface, keeps the one picked if it isn't shadowed, then reuses the history
+// reservoir that the surface reprojects to
+void restirInitialCandidates(ivec2 pixel, ivec2 resolution, RestirSurface surface) {
+    storeSurface(pixel, surface);
+    if (!surface.valid) {
+        storeReservoir(pixel, emptyReservoir());
+        return;
+    }
+
+    uint rngState = restirSeed(pixel, resolution);
+
+    Reservoir reservoir = emptyReservoir();
+    for (uint i = 0u; i < pushConstants.restirCandidates; i++) {
+        RandomEmissivePointOutput light = randomEmissivePoint(rngState, surface.position, surface.normal);
+        float targetPdf = light.pdf > 0.0 ? restirTargetPdf(surface, light) : 0.0;
+        float weight = light.pdf > 0.0 ? targetPdf / light.pdf : 0.0;
+        updateReservoir(reservoir, light.instanceIdx, light.triangle, light.barycentrics, weight, targetPdf, rngState);
+    }
+    reservoir.M = float(pushConstants.restirCandidates);
+    reservoir.W = reservoir.targetPdf > 0.0 ? reservoir.weightSum / (reservoir.M * reservoir.targetPdf) : 0.0;
+
+    // Shadowed samples are dropped before they spread to neighbors and later frames
+    if (reservoir.W > 0.0) {
+        vec3 toLight = reservoirLight(reservoir).point - surface.position;
+        float dist = length(toLight);
+        if (shadowRayOccluded(surface.position, toLight / dist, dist)) {
+            reservoir.W = 0.0;
+        }
+    }
+
+    vec4 clip = pushConstants.prevViewProjection * vec4(surface.position, 1.0);
+    if (pushConstants.restirFrame == 0u || clip.w <= 0.0) {
+        storeReservoir(pixel, reservoir);
+        return;
+    }
+
+    // The inverse of the flip in getStartingRay
+    vec2 ndc = clip.xy / clip.w;
+    ivec2 prevPixel = ivec2(floor(vec2((ndc.x + 1.0) * 0.5 * resolution.x, (1.0 - ndc.y) * 0.5 * resolution.y)));
+    if (any(lessThan(prevPixel, ivec2(0))) || any(greaterThanEqual(prevPixel, resolution))) {
+        storeReservoir(pixel, reservoir);
+        return;
+    }
+
+    RestirSurface prevSurface = loadHistorySurface(prevPixel);
+    if (!similarSurfaces(surface, prevSurface)) {
+        storeReservoir(pixel, reservoir);
+        return;
+    }
+
+    Reservoir prev = loadHistoryReservoir(prevPixel);
+    prev.M = min(prev.M, RESTIR_HISTORY_LIMIT * reservoir.M);
+
+    Reservoir combined = emptyReservoir();
+    combineReservoir(combined, reservoir, surface, rngState);
+    combineReservoir(combined, prev, surface, rngState);
+
+    // Only the reservoirs that could have drawn the sample count toward its weight, which keeps it unbiased
+    float Z = 0.0;
+    if (combined.targetPdf > 0.0) {
+        Z = reservoir.M;
+        if (restirTargetPdf(prevSurface, reservoirLight(combined)) > 0.0) {
+            Z += prev.M;
+        }
+    }
+    combined.W = Z > 0.0 ? combined.weightSum / (Z * combined.targetPdf) : 0.0;
+
+    storeReservoir(pixel, combined);
+}
+
+// Reuses the reservoirs of random pixels nearby with similar surfaces, writing the reservoirs to shade with. Also keeps
+// this frame's surfaces for the next frame to reproject onto.
+void restirSpatialReuse(ivec2 pixel, ivec2 resolution) {
+    RestirSurface surface = loadSurface(pixel);
+    storeHistorySurface(pixel, surface);
+    if (!surface.valid) {
+        storeHistoryReservoir(pixel, emptyReservoir());
+        return;
+    }
+
+    uint rngState = restirSeed(pixel, resolution);
+
+    Reservoir center = loadReservoir(pixel);
+    Reservoir combined = emptyReservoir();
+    combineReservoir(combined, center, surface, rngState);
+
+    RestirSurface neighborSurfaces[RESTIR_MAX_SPATIAL_NEIGHBORS];
+    float neighborM[RESTIR_MAX_SPATIAL_NEIGHBORS];
+    uint reused = 0u;
+
+    uint neighborCount = min(pushConstants.restirSpatialNeighbors, RESTIR_MAX_SPATIAL_NEIGHBORS);
+    for (uint i = 0u; i < neighborCount; i++) {
+        float angle = 2.0 * k_pi * random(rngState);
+        float radius = RESTIR_SPATIAL_RADIUS * sqrt(random(rngState));
+        ivec2 neighbor = pixel + ivec2(round(radius * vec2(cos(angle), sin(angle))));
+        if (neighbor == pixel || any(lessThan(neighbor, ivec2(0))) || any(greaterThanEqual(neighbor, resolution))) {
+            continue;
+        }
+
+        RestirSurface neighborSurface = loadSurface(neighbor);
+        if (!similarSurfaces(surface, neighborSurface)) {
+            continue;
+        }
+
+        Reservoir neighborReservoir = loadReservoir(neighbor);
+        combineReservoir(combined, neighborReservoir, surface, rngState);
+
+        neighborSurfaces[reused] = neighborSurface;
+        neighborM[reused] = neighborReservoir.M;
+        reused++;
+    }
+
+    float Z = 0.0;
+    if (combined.targetPdf > 0.0) {
+        Z = center.M;
+        RandomEmissivePointOutput light = reservoirLight(combined);
+        for (uint i = 0u; i < reused; i++) {
+            if (restirTargetPdf(neighborSurfaces[i], light) > 0.0) {
+                Z += neighborM[i];
+            }
+        }
+    }
+    combined.W = Z > 0.0 ? combined.weightSum / (Z * combined.targetPdf) : 0.0;
+
+    storeHistoryReservoir(pixel, combined);
+}
+
+#endif  // REINA_RESTIR_H
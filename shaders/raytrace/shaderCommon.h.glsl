@@ -2,19 +2,46 @@
 #define REINA_SHADER_COMMON_H
 
 #extension GL_EXT_scalar_block_layout : require
+#extension GL_EXT_nonuniform_qualifier : require
 
 #include "raytrace.h"
 
 layout(binding = 1, set = 0) uniform accelerationStructureEXT tlas;
 
 layout(binding = 2, set = 0, scalar) buffer Vertices {
-    vec4 vertices[];
+    vec3 vertices[];
 };
 
+// Every model's index streams, packed two per uint (low half first) for models flagged INDEX_FLAG_16_BIT
 layout(binding = 3, set = 0, scalar) buffer Indices {
     uint indices[];
 };
 
+layout (binding = 10, set = 0, scalar) buffer TexCoordsBuffer {
+    vec2 texCoords[];
+};
+
+// Read by the hit shaders, and by next event estimation for emission maps
+layout(binding = 13, set = 0) uniform sampler2D textures[];
+
+uint loadIndex(uint streamOffset, uint i, uint indexFlags) {
+    if ((indexFlags & INDEX_FLAG_16_BIT) == 0u) {
+        return indices[streamOffset + i];
+    }
+
+    uint word = indices[streamOffset + i / 2];
+    return (i & 1u) == 0u ? (word & 0xFFFFu) : (word >> 16);
+}
+
+// Returns the indices of a triangle's corners, relative to the start of the model's stream
+uvec3 loadTriangleIndices(uint streamOffset, uint triangle, uint indexFlags) {
+    return uvec3(
+            loadIndex(streamOffset, 3 * triangle + 0, indexFlags),
+            loadIndex(streamOffset, 3 * triangle + 1, indexFlags),
+            loadIndex(streamOffset, 3 * triangle + 2, indexFlags)
+    );
+}
+
 struct HitPayload {
     vec3 albedo;        // The albedo of the surface.
     vec3 color;         // The reflectivity of the surface.
@@ -32,6 +59,8 @@ struct HitPayload {
     mat3 tbn;           // World to tangent space matrix
     float eta;          // Refractive index of the material. Used for disney dielectric component.
     bool didRefract;    // For disney dielectric component. True if the ray was refracted, false if it was reflected.
+    float coneWidth;    // Width of the ray cone at the ray origin, used to pick texture LODs.
+    float coneSpreadAngle;  // Angle the ray cone widens by per unit of distance. Starts at the angle of a pixel.
     InstanceProperties props;
 };
 
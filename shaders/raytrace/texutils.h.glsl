@@ -1,10 +1,45 @@
 #ifndef REINA_TEXUTILS_H
 #define REINA_TEXUTILS_H
 
-vec2 bumpMapping(vec2 uv, vec3 rayIn, mat3 T, sampler2D heightMap) {
+#ifdef DEBUG_SHOW_BUMP_FETCHES
+    uint bumpMappingFetches = 0u;  // height map fetches of the last bumpMapping call
+
+    // Blue for none, through green, to red for 64 or more
+    vec3 bumpMappingFetchesColor() {
+        const float t = clamp(float(bumpMappingFetches) / 64.0, 0.0, 1.0);
+        return t < 0.5 ? mix(vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), t * 2.0) : mix(vec3(0.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0), t * 2.0 - 1.0);
+    }
+
+    #define COUNT_BUMP_FETCH() bumpMappingFetches++
+#else
+    #define COUNT_BUMP_FETCH()
+#endif
+
+// Rounding slack for hardware decoding of the block compressed min heights
+const float MIN_HEIGHT_BIAS = 1.0 / 512.0;
+
+// The height under a ray at a depth along it, where it is at uv - depth * P
+float bumpHeightAt(sampler2D heightMap, vec2 uv, vec2 P, float depth, float lod, float heightScale) {
+    COUNT_BUMP_FETCH();
+    return textureLod(heightMap, uv - depth * P, lod).r * heightScale;
+}
+
+// lod is the mip level to read the height map at; ray tracing shaders have no derivatives to pick it implicitly.
+// When minHeights is set, G of the height map holds min heights (see reina::graphics::storeMinHeights), and the ray
+// walks down a quadtree of them instead of marching in layers: it skips the cells it passes above, and descends where it
+// may not, to the level the heights are read at. There it tests the surface at the cell's exit, and refines the crossing
+// inside the cell once it finds one. Other maps, like KTX2 files and textures whose mips were filtered as color, march
+// in layers, as does the rest of a ray the walk runs out of steps on.
+vec2 bumpMapping(vec2 uv, vec3 rayIn, mat3 T, sampler2D heightMap, float lod, bool minHeights) {
     const float heightScale = 0.2;
     const float minLayers   =  64.0;
     const float maxLayers   = 512.0;
+    const int   maxSkips    =  64;
+    const int   refineSteps =   4;
+
+    #ifdef DEBUG_SHOW_BUMP_FETCHES
+        bumpMappingFetches = 0u;
+    #endif
 
     // 1. world → tangent, view vector
     vec3 V = normalize(transpose(T) * -rayIn);
@@ -18,27 +53,100 @@ vec2 bumpMapping(vec2 uv, vec3 rayIn, mat3 T, sampler2D heightMap) {
     vec2 P       = V.xy / V.z * heightScale;
     vec2 deltaUV = P / numLayers;
 
-    // 4. layer‐by‐layer search
-    vec2  currUV   = uv;
-    float depthSum = 0.0;
-    float h        = texture(heightMap, currUV).r * heightScale;
+    // 4. walk the min heights. At depth s the ray is at uv - s * P, which is tracked in level 0 texels, unwrapped so
+    //    cell exits stay continuous. The walk starts at the level whose cells the whole ray fits in
+    const ivec2 baseSize  = textureSize(heightMap, 0);
+    const int   topLevel  = textureQueryLevels(heightMap) - 1;
+    const int   stopLevel = clamp(int(ceil(lod)), 0, topLevel);
+    const vec2  origin    = fract(uv) * vec2(baseSize);
+    const vec2  direction = -P * vec2(baseSize);
+    const float reach     = max(abs(direction.x), abs(direction.y));
+    const float nudge     = 1e-3 / max(reach, 1e-6);  // a thousandth of a texel
+
+    float depth = 0.0;
+    int level = clamp(int(ceil(log2(max(reach * heightScale, 1.0)))), stopLevel, topLevel);
+    for (int i = 0; minHeights && i < maxSkips && level >= stopLevel && depth < heightScale; i++) {
+        const vec2 position = origin + direction * depth;
+        const vec2 wrapped = mod(position, vec2(baseSize));
+        const ivec2 levelSize = max(baseSize >> level, ivec2(1));
+        const ivec2 cell = min(ivec2(wrapped) >> level, levelSize - 1);
+
+        COUNT_BUMP_FETCH();
+        const float minHeight = (texelFetch(heightMap, cell, level).g - MIN_HEIGHT_BIAS) * heightScale;
+
+        // The last cell of a level also owns the leftover texels of odd sizes
+        const vec2 cellLow  = position - wrapped + vec2(cell << level);
+        const vec2 cellHigh = position - wrapped + vec2(mix(vec2((cell + 1) << level), vec2(baseSize), equal(cell, levelSize - 1)));
+        const vec2 exits    = mix((cellLow - position) / direction, (cellHigh - position) / direction, greaterThan(direction, vec2(0.0)));
+        const float exitDepth = depth + min(direction.x != 0.0 ? exits.x : 1e30, direction.y != 0.0 ? exits.y : 1e30);
+
+        // Above the whole cell, so on to the next one, which may be under a coarser cell the ray is above too
+        if (minHeight >= exitDepth) {
+            depth = exitDepth + nudge;
+            level = min(level + 1, topLevel);
+            continue;
+        }
+
+        depth = max(depth, minHeight);
+        if (level > stopLevel) {
+            level--;
+            continue;
+        }
+
+        // The ray may meet the surface in this cell. If it's below it at the exit, the crossing is between there and
+        // here, where it's above, and is refined with the Illinois variant of regula falsi
+        float below = bumpHeightAt(heightMap, uv, P, exitDepth, lod, heightScale) - exitDepth;
+        if (below <= 0.0) {
+            float next = exitDepth;
+            float above = max(bumpHeightAt(heightMap, uv, P, depth, lod, heightScale) - depth, 0.0);
+            int side = 0;
+            for (int step = 0; step < refineSteps && above > 0.0; step++) {
+                const float middle = mix(depth, next, above / (above - below));
+                const float height = bumpHeightAt(heightMap, uv, P, middle, lod, heightScale) - middle;
+                if (height > 0.0) {
+                    depth = middle;
+                    above = height;
+                    below *= side > 0 ? 0.5 : 1.0;
+                    side = 1;
+                } else {
+                    next = middle;
+                    below = height;
+                    above *= side < 0 ? 0.5 : 1.0;
+                    side = -1;
+                }
+            }
+            return uv - mix(depth, next, above / max(above - below, 1e-9)) * P;
+        }
+
+        depth = exitDepth + nudge;
+        level = min(level + 1, topLevel);
+    }
+    depth = min(depth, heightScale);
+
+    // 5. layer‐by‐layer search from there
+    vec2  currUV   = uv - depth * P;
+    float depthSum = depth;
+    float h        = textureLod(heightMap, currUV, lod).r * heightScale;
+    COUNT_BUMP_FETCH();
 
     while (depthSum < h) {
         currUV   -= deltaUV;
         depthSum += layerDepth;
-        h         = texture(heightMap, currUV).r * heightScale;
+        h         = textureLod(heightMap, currUV, lod).r * heightScale;
+        COUNT_BUMP_FETCH();
     }
 
-    // 5. linear interp between last two samples
+    // 6. linear interp between last two samples. weight is how far the crossing is from the last one
     vec2 prevUV      = currUV + deltaUV;
-    float hPrev      = texture(heightMap, prevUV).r * heightScale;
+    float hPrev      = textureLod(heightMap, prevUV, lod).r * heightScale;
+    COUNT_BUMP_FETCH();
     float sumPrev    = depthSum - layerDepth;
     float after      =  h        - depthSum;
     float before     =  hPrev    - sumPrev;
     float weight     = after / (after - before);
 
-    return mix(prevUV, currUV, weight);
+    return mix(currUV, prevUV, weight);
 }
 
 
-#endif
\ No newline at end of file
+#endif
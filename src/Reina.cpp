@@ -4,6 +4,7 @@
 #include "tools/Clock.h"
 
 #include <stdexcept>
+#include <string>
 
 #include <glm/glm.hpp>
 #include <glm/ext/matrix_transform.hpp>
@@ -84,21 +85,52 @@ Reina::Reina(){
     cmdBuffer = reina::core::CmdBuffer{logicalDevice, commandPool, false, true};
     cmdBuffer.endWaitSubmit(logicalDevice, graphicsQueue);  // since the command buffer automatically begins upon creation, and we don't want that in this specific case
 
-//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/main1_sponza/NewSponza_Main_glTF_003.gltf");
-//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/sphere/sphere.glb");
-//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/cute/cute.glb");
-//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/mushroom_house/mushroom_house.glb");
-    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/mushroom_house/mushroom_house_grass_test.glb");
-//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/car/car.glb");
-//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/ferrari/fixed.glb");
-//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/sponza_modified/sponza.glb");
-//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/empty/empty.glb");
-//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/2CylinderEngine/2CylinderEngine.glb");
-//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/Corset/Corset.glb");
-//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/Lantern/Lantern.glb");
-//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/car_scene_mini/car_scene_mini.glb");
-//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/FlightHelmet/FlightHelmet.gltf");
-//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/avocado/avocados.glb");
+    glm::vec3 pos = glm::vec3(-1.6899, 0.317017, 1.6386);
+    glm::vec3 lookAt = glm::vec3(0, 0.962f, 0);
+    float fov = glm::radians(25.0f);
+
+    reina::scene::SceneOptions sceneOptions{
+            .nativeObjLoader = config.at_path("geometry.obj_loader").value<std::string>().value() == "native",
+            .optimizeMeshes = config.at_path("geometry.optimize_meshes").value<bool>().value(),
+            .generateLods = config.at_path("geometry.lod.enabled").value<bool>().value(),
+            .lodMaxErrorPixels = config.at_path("geometry.lod.max_error_pixels").value<float>().value(),
+            .compressTextures = config.at_path("textures.block_compression").value<bool>().value(),
+            .buildLightBvh = config.at_path("sampling.light_bvh").value<bool>().value()
+    };
+    if (config.at_path("geometry.cache.enabled").value<bool>().value()) {
+        sceneOptions.geometryCacheDirectory = config.at_path("geometry.cache.directory").value<std::string>().value();
+    }
+    uint32_t textureBudgetMiB = config.at_path("textures.memory_budget_mib").value<uint32_t>().value();
+    if (textureBudgetMiB > 0) {
+        sceneOptions.textureBudgetBytes = static_cast<size_t>(textureBudgetMiB) * 1024 * 1024;
+    }
+    if (config.at_path("environment.enabled").value<bool>().value()) {
+        sceneOptions.environmentMap = config.at_path("environment.path").value<std::string>().value();
+        sceneOptions.environmentIntensity = config.at_path("environment.intensity").value<float>().value();
+    }
+    if (config.at_path("textures.mip_cache.enabled").value<bool>().value()) {
+        sceneOptions.mipCacheDirectory = config.at_path("textures.mip_cache.directory").value<std::string>().value();
+    }
+    if (sceneOptions.generateLods) {
+        // LODs are chosen once for the starting camera, so moving closer afterward can reveal simplified geometry
+        sceneOptions.lodViewpoint = reina::scene::LodViewpoint{pos, fov, renderHeight};
+    }
+
+//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/main1_sponza/NewSponza_Main_glTF_003.gltf", sceneOptions);
+//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/sphere/sphere.glb", sceneOptions);
+//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/cute/cute.glb", sceneOptions);
+//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/mushroom_house/mushroom_house.glb", sceneOptions);
+    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/mushroom_house/mushroom_house_grass_test.glb", sceneOptions);
+//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/car/car.glb", sceneOptions);
+//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/ferrari/fixed.glb", sceneOptions);
+//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/sponza_modified/sponza.glb", sceneOptions);
+//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/empty/empty.glb", sceneOptions);
+//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/2CylinderEngine/2CylinderEngine.glb", sceneOptions);
+//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/Corset/Corset.glb", sceneOptions);
+//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/Lantern/Lantern.glb", sceneOptions);
+//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/car_scene_mini/car_scene_mini.glb", sceneOptions);
+//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/FlightHelmet/FlightHelmet.gltf", sceneOptions);
+//    scene = reina::scene::gltf::loadScene(logicalDevice, physicalDevice, commandPool, graphicsQueue, "scenes/avocado/avocados.glb", sceneOptions);
 
 //    scene = reina::scene::Scene();
 //    uint32_t wallTexID = scene.defineTexture("textures/cornell_texture.png");
@@ -124,26 +156,53 @@ Reina::Reina(){
                     reina::core::Binding{3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, static_cast<VkShaderStageFlagBits>(VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR)},
                     reina::core::Binding{4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR},
                     reina::core::Binding{5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR},
-                    reina::core::Binding{6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR},
                     reina::core::Binding{7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, static_cast<VkShaderStageFlagBits>(VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR)},
                     reina::core::Binding{8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR},
                     reina::core::Binding{9, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR},
-                    reina::core::Binding{10, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR},
-                    reina::core::Binding{11, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR},
-                    reina::core::Binding{12, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR},
-                    reina::core::Binding{13, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, static_cast<uint32_t>(scene.getTextures().size()), VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR},
+                    reina::core::Binding{10, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, static_cast<VkShaderStageFlagBits>(VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR)},
+                    reina::core::Binding{11, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, static_cast<VkShaderStageFlagBits>(VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR)},
+                    reina::core::Binding{12, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, static_cast<VkShaderStageFlagBits>(VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR)},
+                    reina::core::Binding{13, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, static_cast<uint32_t>(scene.getTextures().size()), static_cast<VkShaderStageFlagBits>(VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR)},
+                    reina::core::Binding{14, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR},
+                    reina::core::Binding{15, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR},
+                    reina::core::Binding{16, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR},
+                    reina::core::Binding{17, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR},
+                    reina::core::Binding{18, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR},
+                    reina::core::Binding{19, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR},
+                    reina::core::Binding{20, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR},
+                    reina::core::Binding{21, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR},
+                    reina::core::Binding{22, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR},
+                    reina::core::Binding{23, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR},
             }
     };
 
-    glm::vec3 pos = glm::vec3(-1.6899, 0.317017, 1.6386);
-    glm::vec3 lookAt = glm::vec3(0, 0.962f, 0);
-    camera = reina::graphics::Camera{renderWindow, glm::radians(25.0f), aspectRatio, pos, glm::normalize(lookAt - pos)};
+    camera = reina::graphics::Camera{renderWindow, fov, aspectRatio, pos, glm::normalize(lookAt - pos)};
 
     originalSamplesPerPixel = config.at_path("sampling.samples_per_pixel").value<uint32_t>().value();
 
+    if (config.at_path("animation.turntable.enabled").value<bool>().value()) {
+        uint32_t instanceIndex = config.at_path("animation.turntable.instance").value<uint32_t>().value();
+
+        // Checked here so a bad config fails at startup with the setting's name instead of from the render loop
+        if (instanceIndex >= scene.getInstanceCount()) {
+            throw std::runtime_error("Config error: animation.turntable.instance is " + std::to_string(instanceIndex)
+                                     + ", but the scene has " + std::to_string(scene.getInstanceCount()) + " instances");
+        }
+        if (scene.isInstanceEmissive(instanceIndex)) {
+            throw std::runtime_error("Config error: animation.turntable.instance " + std::to_string(instanceIndex)
+                                     + " is emissive, and emissive instances can't be moved");
+        }
+
+        turntableInstance = instanceIndex;
+        turntableBaseTransform = scene.getInstanceTransform(turntableInstance.value());
+        turntableRadiansPerSecond = glm::radians(config.at_path("animation.turntable.degrees_per_second").value<float>().value());
+    }
+    restir = config.at_path("sampling.restir.enabled").value<bool>().value();
+
     RtPushConsts defaultPushConstants = {
             .invView = camera.getInverseView(),
             .invProjection = camera.getInverseProjection(),
+            .prevViewProjection = glm::mat4(1.0f),  // no history to reproject onto yet
             .sampleBatch = 0,
             .totalEmissiveWeight = 0,
             .focusDist = config.at_path("camera.dof.focus_dist").value<float>().value(),
@@ -151,7 +210,13 @@ Reina::Reina(){
             .directClamp = config.at_path("sampling.direct_clamp").value<float>().value(),
             .indirectClamp = config.at_path("sampling.indirect_clamp").value<float>().value(),
             .samplesPerPixel = config.at_path("sampling.samples_per_pixel").value<uint32_t>().value(),
-            .maxBounces = config.at_path("sampling.max_bounces").value<uint32_t>().value()
+            .maxBounces = config.at_path("sampling.max_bounces").value<uint32_t>().value(),
+            .nextEventEstimation = config.at_path("sampling.next_event_estimation").value<bool>().value() ? 1u : 0u,
+            .lightBvh = config.at_path("sampling.light_bvh").value<bool>().value() ? 1u : 0u,
+            .restirPass = RESTIR_PASS_OFF,
+            .restirFrame = 0,
+            .restirCandidates = config.at_path("sampling.restir.initial_candidates").value<uint32_t>().value(),
+            .restirSpatialNeighbors = config.at_path("sampling.restir.spatial_neighbors").value<uint32_t>().value()
     };
     rtPushConsts = reina::core::PushConstants{defaultPushConstants, VK_SHADER_STAGE_RAYGEN_BIT_KHR};
 
@@ -180,6 +245,7 @@ Reina::Reina(){
     };
 
     fragmentImageSampler = vktools::createSampler(logicalDevice);
+    textureSampler = vktools::createTextureSampler(logicalDevice, physicalDevice);
 
     tonemapPushConsts = reina::core::PushConstants{
         TonemappingPushConsts{config.at_path("postprocessing.tonemap.exposure").value<float>().value()},
@@ -238,6 +304,62 @@ Reina::Reina(){
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
     };
 
+    // Without ReSTIR the shaders never touch these, but the descriptors still need images
+    uint32_t restirWidth = restir ? renderWidth : 1;
+    uint32_t restirHeight = restir ? renderHeight : 1;
+    restirPositions = reina::graphics::Image{
+            logicalDevice, physicalDevice, restirWidth, restirHeight, VK_FORMAT_R32G32B32A32_SFLOAT,
+            VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    };
+    restirNormals = reina::graphics::Image{
+            logicalDevice, physicalDevice, restirWidth, restirHeight, VK_FORMAT_R16G16B16A16_SFLOAT,
+            VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    };
+    restirHistoryPositions = reina::graphics::Image{
+            logicalDevice, physicalDevice, restirWidth, restirHeight, VK_FORMAT_R32G32B32A32_SFLOAT,
+            VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    };
+    restirHistoryNormals = reina::graphics::Image{
+            logicalDevice, physicalDevice, restirWidth, restirHeight, VK_FORMAT_R16G16B16A16_SFLOAT,
+            VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    };
+    reservoirSamples = reina::graphics::Image{
+            logicalDevice, physicalDevice, restirWidth, restirHeight, VK_FORMAT_R32G32B32A32_UINT,
+            VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    };
+    reservoirWeights = reina::graphics::Image{
+            logicalDevice, physicalDevice, restirWidth, restirHeight, VK_FORMAT_R32G32_SFLOAT,
+            VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    };
+    historySamples = reina::graphics::Image{
+            logicalDevice, physicalDevice, restirWidth, restirHeight, VK_FORMAT_R32G32B32A32_UINT,
+            VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    };
+    historyWeights = reina::graphics::Image{
+            logicalDevice, physicalDevice, restirWidth, restirHeight, VK_FORMAT_R32G32_SFLOAT,
+            VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    };
+
+    // The reservoirs carry over between frames, so they are moved to the general layout once instead of every frame
+    reina::core::CmdBuffer restirCmdBuffer{logicalDevice, commandPool, false};
+    for (reina::graphics::Image* image : {&restirPositions, &restirNormals, &restirHistoryPositions, &restirHistoryNormals,
+                                          &reservoirSamples, &reservoirWeights, &historySamples, &historyWeights}) {
+        image->transition(restirCmdBuffer.getHandle(), VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
+    }
+    restirCmdBuffer.endWaitSubmit(logicalDevice, graphicsQueue);
+    restirCmdBuffer.destroy(logicalDevice);
+
+    bool lightCacheEnabled = config.at_path("sampling.light_cache.enabled").value<bool>().value();
+    if (lightCacheEnabled && config.at_path("sampling.light_bvh").value<bool>().value()) {
+        std::cout << "The light cache is ignored since the light BVH picks the emissive triangles\n";
+        lightCacheEnabled = false;
+    }
+    lightCache = reina::graphics::LightCache{
+            logicalDevice, physicalDevice, commandPool, graphicsQueue, lightCacheEnabled,
+            config.at_path("sampling.light_cache.cell_size").value<float>().value(),
+            config.at_path("sampling.light_cache.cells").value<uint32_t>().value()
+    };
+
     bloomPushConsts = reina::core::PushConstants{
         BloomPushConsts{
             config.at_path("postprocessing.bloom.radius").value<float>().value(),
@@ -308,6 +430,15 @@ void Reina::renderLoop() {
             pushConstantsStruct.sampleBatch = 0;  // reset the image
         }
 
+        if (turntableInstance.has_value()) {
+            turntableAngle += turntableRadiansPerSecond * clock.getTimeDelta();
+            glm::vec3 pivot = glm::vec3(turntableBaseTransform[3]);
+            glm::mat4 spin = glm::translate(glm::mat4(1.0f), pivot)
+                    * glm::rotate(glm::mat4(1.0f), static_cast<float>(turntableAngle), glm::vec3(0, 1, 0))
+                    * glm::translate(glm::mat4(1.0f), -pivot);
+            scene.setInstanceTransform(turntableInstance.value(), spin * turntableBaseTransform);
+        }
+
         if (camera.isAcceptingInput()) {
             rtPushConsts.getPushConstants().samplesPerPixel = 1;
         } else {
@@ -333,6 +464,11 @@ void Reina::renderLoop() {
             texture.transition(cmdBuffer.getHandle(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
         }
 
+        // Moved instances are refit before any ray is traced, and the image accumulated before they moved is stale
+        if (scene.updateTlas(logicalDevice, cmdBufferHandle)) {
+            rtPushConsts.getPushConstants().sampleBatch = 0;
+        }
+
         traceRays();
 
         clock.markCategory("Bloom");
@@ -395,16 +531,26 @@ void Reina::writeDescriptorSets() {
     rtDescriptorSet.writeBinding(logicalDevice, 0, rtImage, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE);
     rtDescriptorSet.writeBinding(logicalDevice, 1, scene.getTlas());
     rtDescriptorSet.writeBinding(logicalDevice, 2, scene.getModels().getVerticesBuffer());
-    rtDescriptorSet.writeBinding(logicalDevice, 3, scene.getModels().getOffsetIndicesBuffer());
+    rtDescriptorSet.writeBinding(logicalDevice, 3, scene.getModels().getIndicesBuffer());
     rtDescriptorSet.writeBinding(logicalDevice, 4, scene.getInstancePropertiesBuffer());
     rtDescriptorSet.writeBinding(logicalDevice, 5, scene.getModels().getTbnsBuffer());
-    rtDescriptorSet.writeBinding(logicalDevice, 6, scene.getModels().getOffsetTbnsIndicesBuffer());
     rtDescriptorSet.writeBinding(logicalDevice, 7, scene.getInstances().getEmissiveMetadataBuffer());
-    rtDescriptorSet.writeBinding(logicalDevice, 8, scene.getInstances().getCdfTrianglesBuffer());
-    rtDescriptorSet.writeBinding(logicalDevice, 9, scene.getInstances().getCdfInstancesBuffer());
+    rtDescriptorSet.writeBinding(logicalDevice, 8, scene.getInstances().getAliasTrianglesBuffer());
+    rtDescriptorSet.writeBinding(logicalDevice, 9, scene.getInstances().getAliasInstancesBuffer());
     rtDescriptorSet.writeBinding(logicalDevice, 10, scene.getModels().getTexCoordsBuffer());
-    rtDescriptorSet.writeBinding(logicalDevice, 11, scene.getModels().getOffsetTexIndicesBuffer());
-    rtDescriptorSet.writeBinding(logicalDevice, 13, scene.getTextures(), VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL, fragmentImageSampler);
+    rtDescriptorSet.writeBinding(logicalDevice, 11, scene.getEnvironmentMap().getSamplingBuffer());
+    rtDescriptorSet.writeBinding(logicalDevice, 12, scene.getEnvironmentMap().getImage(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, textureSampler);
+    rtDescriptorSet.writeBinding(logicalDevice, 13, scene.getTextures(), VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL, textureSampler);
+    rtDescriptorSet.writeBinding(logicalDevice, 14, scene.getInstances().getLightBvhBuffer());
+    rtDescriptorSet.writeBinding(logicalDevice, 15, restirPositions, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE);
+    rtDescriptorSet.writeBinding(logicalDevice, 16, restirNormals, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE);
+    rtDescriptorSet.writeBinding(logicalDevice, 17, restirHistoryPositions, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE);
+    rtDescriptorSet.writeBinding(logicalDevice, 18, restirHistoryNormals, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE);
+    rtDescriptorSet.writeBinding(logicalDevice, 19, reservoirSamples, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE);
+    rtDescriptorSet.writeBinding(logicalDevice, 20, reservoirWeights, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE);
+    rtDescriptorSet.writeBinding(logicalDevice, 21, historySamples, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE);
+    rtDescriptorSet.writeBinding(logicalDevice, 22, historyWeights, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE);
+    rtDescriptorSet.writeBinding(logicalDevice, 23, lightCache.getBuffer());
 
     blurXDescriptorSet.writeBinding(logicalDevice, 0, rtImage, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE);
     blurXDescriptorSet.writeBinding(logicalDevice, 1, pingImage, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE);
@@ -428,9 +574,44 @@ void Reina::traceRays() {
     vkCmdBindPipeline(cmdBuffer.getHandle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, rtPipeline.pipeline);
     rtDescriptorSet.bind(cmdBuffer.getHandle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, rtPipeline.pipelineLayout);
 
-    rtPushConsts.push(cmdBuffer.getHandle(), rtPipeline.pipelineLayout);
-    rtPushConsts.getPushConstants().sampleBatch++;
+    RtPushConsts& pushConstants = rtPushConsts.getPushConstants();
+
+    if (!restir) {
+        rtPushConsts.push(cmdBuffer.getHandle(), rtPipeline.pipelineLayout);
+        pushConstants.sampleBatch++;
+        dispatchRays();
+        return;
+    }
+
+    // Each pass reads what the one before wrote, and the candidates pass reads the previous frame's history
+    VkMemoryBarrier restirBarrier{
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+    };
+
+    for (uint32_t pass : {RESTIR_PASS_CANDIDATES, RESTIR_PASS_SPATIAL, RESTIR_PASS_SHADE}) {
+        vkCmdPipelineBarrier(
+                cmdBuffer.getHandle(),
+                VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+                VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+                0,
+                1, &restirBarrier,
+                0, nullptr,
+                0, nullptr
+        );
+
+        pushConstants.restirPass = pass;
+        rtPushConsts.push(cmdBuffer.getHandle(), rtPipeline.pipelineLayout);
+        dispatchRays();
+    }
+
+    pushConstants.sampleBatch++;
+    pushConstants.restirFrame++;
+    pushConstants.prevViewProjection = glm::inverse(pushConstants.invProjection) * glm::inverse(pushConstants.invView);
+}
 
+void Reina::dispatchRays() {
     // todo: there's no reason for the shader stage regions to be in the loop. this should be defined in createRtPipeline
     VkStridedDeviceAddressRegionKHR sbtRayGenRegion, sbtMissRegion, sbtHitRegion, sbtCallableRegion;
     VkDeviceAddress sbtStartAddress = sbtBuffer.getDeviceAddress(logicalDevice);
@@ -647,6 +828,15 @@ Reina::~Reina() {
     blurXShader.destroy(logicalDevice);
     blurXDescriptorSet.destroy(logicalDevice);
     pongImage.destroy(logicalDevice);
+    restirPositions.destroy(logicalDevice);
+    restirNormals.destroy(logicalDevice);
+    restirHistoryPositions.destroy(logicalDevice);
+    restirHistoryNormals.destroy(logicalDevice);
+    reservoirSamples.destroy(logicalDevice);
+    reservoirWeights.destroy(logicalDevice);
+    historySamples.destroy(logicalDevice);
+    historyWeights.destroy(logicalDevice);
+    lightCache.destroy(logicalDevice);
     blurYShader.destroy(logicalDevice);
     blurYDescriptorSet.destroy(logicalDevice);
     combineShader.destroy(logicalDevice);
@@ -659,6 +849,7 @@ Reina::~Reina() {
     stagingBuffer.destroy(logicalDevice);
 
     vkDestroySampler(logicalDevice, fragmentImageSampler, nullptr);
+    vkDestroySampler(logicalDevice, textureSampler, nullptr);
     cmdBuffer.destroy(logicalDevice);
     vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
     rtDescriptorSet.destroy(logicalDevice);
@@ -10,6 +10,7 @@
 #include "core/CmdBuffer.h"
 #include "window/Window.h"
 #include "graphics/Camera.h"
+#include "graphics/LightCache.h"
 #include "tools/SaveManager.h"
 #include "scene/Scene.h"
 
@@ -26,6 +27,7 @@ public:
 private:
     void writeDescriptorSets();
     void traceRays();
+    void dispatchRays();
     void applyBloom();
     void applyTonemapping();
     void draw(uint32_t& imageIndex);
@@ -57,6 +59,7 @@ private:
     reina::graphics::Shader tonemapShader;
     vktools::SyncObjects syncObjects;
     VkSampler fragmentImageSampler;
+    VkSampler textureSampler;
     VkRenderPass renderPass;
     vktools::PipelineInfo rtPipeline;
     vktools::PipelineInfo rasterPipeline;
@@ -64,6 +67,25 @@ private:
     reina::graphics::Image pingImage;
     reina::graphics::Image pongImage;
 
+    // ReSTIR's primary hits and reservoirs, described in restir.h.glsl. 1x1 placeholders when ReSTIR is disabled
+    bool restir = false;
+    reina::graphics::Image restirPositions;
+    reina::graphics::Image restirNormals;
+    reina::graphics::Image restirHistoryPositions;
+    reina::graphics::Image restirHistoryNormals;
+    reina::graphics::Image reservoirSamples;
+    reina::graphics::Image reservoirWeights;
+    reina::graphics::Image historySamples;
+    reina::graphics::Image historyWeights;
+
+    reina::graphics::LightCache lightCache;
+
+    // Spins one instance about the world up axis through its origin, for checking the TLAS update path
+    std::optional<size_t> turntableInstance;
+    glm::mat4 turntableBaseTransform = glm::mat4(1.0f);
+    float turntableRadiansPerSecond = 0;
+    double turntableAngle = 0;
+
     reina::graphics::Shader blurXShader;
     reina::core::DescriptorSet blurXDescriptorSet;
     vktools::PipelineInfo blurXPipeline;
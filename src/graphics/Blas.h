@@ -8,12 +8,21 @@
 #include "../scene/Models.h"
 #include "../core/Buffer.h"
 
-// todo: accumulate all BLASes then build them all at once for faster performance
 namespace reina::graphics {
+    /**
+     * A bottom level acceleration structure over one model. BLASes are built together by a BlasBuilder.
+     */
     class Blas {
     public:
         Blas() = default;
-        Blas(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue, const reina::scene::Models& models, const reina::scene::ModelRange& modelRange, bool shouldCompact);
+
+        /**
+         * @param logicalDevice The Vulkan logical device
+         * @param models The models, with their buffers built
+         * @param modelRange The model to query
+         * @return The size a BLAS of the model takes before compaction, without building it
+         */
+        [[nodiscard]] static VkDeviceSize queryBuildSize(VkDevice logicalDevice, const reina::scene::Models& models, const reina::scene::ModelRange& modelRange);
 
         [[nodiscard]] VkAccelerationStructureKHR getHandle() const;
         [[nodiscard]] const reina::core::Buffer& getBuffer() const;
@@ -22,15 +31,14 @@ namespace reina::graphics {
         void destroy(VkDevice logicalDevice);
 
     private:
+        friend class BlasBuilder;
+
+        Blas(const reina::core::Buffer& blasBuffer, VkAccelerationStructureKHR blas);
+
         /**
-         * Compacts the BLAS.
-         * @param logicalDevice The Vulkan logical device
-         * @param physicalDevice The Vulkan physical device
-         * @param cmdPool A command pool
-         * @param queue A queue
-         * @return The size of the compacted BLAS.
+         * @return The triangles of the model as the geometry of a BLAS build
          */
-        VkDeviceSize compact(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue);
+        static VkAccelerationStructureGeometryKHR triangleGeometry(VkDevice logicalDevice, const reina::scene::Models& models, const reina::scene::ModelRange& modelRange);
 
         reina::core::Buffer blasBuffer;
         VkAccelerationStructureKHR blas = VK_NULL_HANDLE;
@@ -0,0 +1,281 @@
+#include "BlasBuilder.h"
+
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+
+#include "../core/CmdBuffer.h"
+#include "../tools/vktools.h"
+
+namespace {
+    VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    VkDeviceSize scratchOffsetAlignment(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDeviceAccelerationStructurePropertiesKHR asProps{
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR
+        };
+
+        VkPhysicalDeviceProperties2 physicalDeviceProperties{
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+                .pNext = &asProps
+        };
+
+        vkGetPhysicalDeviceProperties2(physicalDevice, &physicalDeviceProperties);
+        return std::max<VkDeviceSize>(asProps.minAccelerationStructureScratchOffsetAlignment, 1);
+    }
+
+    // Makes the builds and copies after the barrier wait for the acceleration structure writes before it
+    void buildBarrier(VkCommandBuffer cmdBuffer) {
+        VkMemoryBarrier barrier{
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                .srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+                .dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR
+        };
+
+        vkCmdPipelineBarrier(
+                cmdBuffer,
+                VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                0, 1, &barrier, 0, nullptr, 0, nullptr
+        );
+    }
+
+    reina::core::Buffer accelerationStructureBuffer(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkDeviceSize size) {
+        return reina::core::Buffer{
+                logicalDevice, physicalDevice, size,
+                VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+        };
+    }
+}
+
+reina::graphics::BlasBuilder::BlasBuilder(const reina::scene::Models& models, VkDeviceSize scratchBudget)
+        : models(models), scratchBudget(scratchBudget) {}
+
+size_t reina::graphics::BlasBuilder::add(const reina::scene::ModelRange& modelRange) {
+    modelRanges.push_back(modelRange);
+    return modelRanges.size() - 1;
+}
+
+std::vector<reina::graphics::Blas> reina::graphics::BlasBuilder::build(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue, bool shouldCompact) {
+    if (!models.areBuffersBuilt()) {
+        throw std::runtime_error("Could not create BLAS; model buffers are not built");
+    }
+
+    size_t count = modelRanges.size();
+    if (count == 0) {
+        return {};
+    }
+
+    PFN_vkGetAccelerationStructureBuildSizesKHR vkGetAccelerationStructureBuildSizesKHR = nullptr;
+    vktools::loadVkFunc(logicalDevice, "vkGetAccelerationStructureBuildSizesKHR", vkGetAccelerationStructureBuildSizesKHR);
+    PFN_vkCreateAccelerationStructureKHR vkCreateAccelerationStructureKHR = nullptr;
+    vktools::loadVkFunc(logicalDevice, "vkCreateAccelerationStructureKHR", vkCreateAccelerationStructureKHR);
+    PFN_vkCmdBuildAccelerationStructuresKHR vkCmdBuildAccelerationStructuresKHR = nullptr;
+    vktools::loadVkFunc(logicalDevice, "vkCmdBuildAccelerationStructuresKHR", vkCmdBuildAccelerationStructuresKHR);
+
+    VkBuildAccelerationStructureFlagsKHR flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR
+            | (shouldCompact ? VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR : static_cast<VkBuildAccelerationStructureFlagsKHR>(0));
+    VkDeviceSize scratchAlignment = scratchOffsetAlignment(physicalDevice);
+
+    // Step 1. Size and create every BLAS. The build infos point into these vectors, so they are never resized after
+    std::vector<VkAccelerationStructureGeometryKHR> geometries(count);
+    std::vector<VkAccelerationStructureBuildRangeInfoKHR> buildRanges(count);
+    std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> buildRangePtrs(count);
+    std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildInfos(count);
+    std::vector<VkDeviceSize> scratchSizes(count);
+    std::vector<reina::core::Buffer> blasBuffers(count);
+    std::vector<VkAccelerationStructureKHR> handles(count, VK_NULL_HANDLE);
+    VkDeviceSize builtBytes = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const reina::scene::ModelRange& modelRange = modelRanges[i];
+        geometries[i] = Blas::triangleGeometry(logicalDevice, models, modelRange);
+
+        buildRanges[i] = VkAccelerationStructureBuildRangeInfoKHR{
+                .primitiveCount = modelRange.indexCount,
+                .primitiveOffset = static_cast<uint32_t>(modelRange.indexOffset * sizeof(uint32_t)),
+                .firstVertex = modelRange.firstVertex,
+                .transformOffset = 0
+        };
+        buildRangePtrs[i] = &buildRanges[i];
+
+        buildInfos[i] = VkAccelerationStructureBuildGeometryInfoKHR{
+                .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+                .type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+                .flags = flags,
+                .mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+                .geometryCount = 1,
+                .pGeometries = &geometries[i]
+        };
+
+        VkAccelerationStructureBuildSizesInfoKHR buildSizes{
+                .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR
+        };
+        vkGetAccelerationStructureBuildSizesKHR(
+                logicalDevice,
+                VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
+                &buildInfos[i],
+                &buildRanges[i].primitiveCount,
+                &buildSizes
+        );
+
+        blasBuffers[i] = accelerationStructureBuffer(logicalDevice, physicalDevice, buildSizes.accelerationStructureSize);
+
+        VkAccelerationStructureCreateInfoKHR createInfo{
+                .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+                .buffer = blasBuffers[i].getHandle(),
+                .size = buildSizes.accelerationStructureSize,
+                .type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR
+        };
+        vkCreateAccelerationStructureKHR(logicalDevice, &createInfo, nullptr, &handles[i]);
+
+        buildInfos[i].dstAccelerationStructure = handles[i];
+        scratchSizes[i] = alignUp(buildSizes.buildScratchSize, scratchAlignment);
+        builtBytes += buildSizes.accelerationStructureSize;
+    }
+
+    // Step 2. Split the builds into batches that fit the scratch budget. Each build of a batch gets its own slice of the
+    // scratch arena, so the builds of a batch can run at the same time
+    std::vector<size_t> batchStarts{0};
+    VkDeviceSize batchScratch = 0;
+    VkDeviceSize arenaSize = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (batchScratch > 0 && batchScratch + scratchSizes[i] > scratchBudget) {
+            batchStarts.push_back(i);
+            batchScratch = 0;
+        }
+
+        batchScratch += scratchSizes[i];
+        arenaSize = std::max(arenaSize, batchScratch);
+    }
+    batchStarts.push_back(count);
+
+    // The arena is padded so its start can be aligned, since the buffer itself only has the alignment of its memory
+    reina::core::Buffer scratchArena{
+            logicalDevice, physicalDevice, arenaSize + scratchAlignment,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    };
+    VkDeviceAddress arenaAddress = alignUp(scratchArena.getDeviceAddress(logicalDevice), scratchAlignment);
+
+    // Step 3. Record every batch into one submission. Batches reuse the arena, so each waits for the one before it
+    reina::core::CmdBuffer cmdBuffer{logicalDevice, cmdPool, true};
+    VkCommandBuffer cmdBufferHandle = cmdBuffer.getHandle();
+
+    for (size_t batch = 0; batch + 1 < batchStarts.size(); batch++) {
+        size_t begin = batchStarts[batch];
+        size_t end = batchStarts[batch + 1];
+
+        VkDeviceSize offset = 0;
+        for (size_t i = begin; i < end; i++) {
+            buildInfos[i].scratchData.deviceAddress = arenaAddress + offset;
+            offset += scratchSizes[i];
+        }
+
+        if (batch > 0) {
+            buildBarrier(cmdBufferHandle);
+        }
+
+        vkCmdBuildAccelerationStructuresKHR(cmdBufferHandle, static_cast<uint32_t>(end - begin), &buildInfos[begin], &buildRangePtrs[begin]);
+    }
+
+    // One query for the compacted sizes of all the BLASes, after the last batch is built
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    if (shouldCompact) {
+        VkQueryPoolCreateInfo queryPoolCreateInfo{
+                .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                .queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+                .queryCount = static_cast<uint32_t>(count)
+        };
+        vkCreateQueryPool(logicalDevice, &queryPoolCreateInfo, nullptr, &queryPool);
+
+        PFN_vkCmdWriteAccelerationStructuresPropertiesKHR vkCmdWriteAccelerationStructuresPropertiesKHR = nullptr;
+        vktools::loadVkFunc(logicalDevice, "vkCmdWriteAccelerationStructuresPropertiesKHR", vkCmdWriteAccelerationStructuresPropertiesKHR);
+
+        buildBarrier(cmdBufferHandle);
+        vkCmdResetQueryPool(cmdBufferHandle, queryPool, 0, static_cast<uint32_t>(count));
+        vkCmdWriteAccelerationStructuresPropertiesKHR(
+                cmdBufferHandle, static_cast<uint32_t>(count), handles.data(),
+                VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, queryPool, 0
+        );
+    }
+
+    cmdBuffer.endWaitSubmit(logicalDevice, queue);
+    scratchArena.destroy(logicalDevice);
+
+    size_t batchCount = batchStarts.size() - 1;
+    std::vector<reina::graphics::Blas> blases;
+    blases.reserve(count);
+
+    if (!shouldCompact) {
+        cmdBuffer.destroy(logicalDevice);
+        for (size_t i = 0; i < count; i++) {
+            blases.push_back(Blas{blasBuffers[i], handles[i]});
+        }
+
+        std::cout << "BLAS build: " << count << " BLASes in " << batchCount << " batches ("
+                  << static_cast<double>(arenaSize) / (1024.0 * 1024.0) << " MiB scratch)\n";
+
+        modelRanges.clear();
+        return blases;
+    }
+
+    // Step 4. Copy every BLAS into one of its compacted size, all in one submission
+    std::vector<VkDeviceSize> compactSizes(count);
+    vkGetQueryPoolResults(logicalDevice, queryPool, 0, static_cast<uint32_t>(count),
+                          compactSizes.size() * sizeof(VkDeviceSize), compactSizes.data(), sizeof(VkDeviceSize),
+                          VK_QUERY_RESULT_WAIT_BIT | VK_QUERY_RESULT_64_BIT);
+    vkDestroyQueryPool(logicalDevice, queryPool, nullptr);
+
+    PFN_vkCmdCopyAccelerationStructureKHR vkCmdCopyAccelerationStructureKHR = nullptr;
+    vktools::loadVkFunc(logicalDevice, "vkCmdCopyAccelerationStructureKHR", vkCmdCopyAccelerationStructureKHR);
+
+    cmdBuffer.begin();
+
+    VkDeviceSize compactedBytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        reina::core::Buffer compactBuffer = accelerationStructureBuffer(logicalDevice, physicalDevice, compactSizes[i]);
+
+        VkAccelerationStructureCreateInfoKHR createInfo{
+                .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+                .buffer = compactBuffer.getHandle(),
+                .size = compactSizes[i],
+                .type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR
+        };
+
+        VkAccelerationStructureKHR compactHandle;
+        vkCreateAccelerationStructureKHR(logicalDevice, &createInfo, nullptr, &compactHandle);
+
+        VkCopyAccelerationStructureInfoKHR copyInfo{
+                .sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR,
+                .src = handles[i],
+                .dst = compactHandle,
+                .mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR
+        };
+        vkCmdCopyAccelerationStructureKHR(cmdBufferHandle, &copyInfo);
+
+        blases.push_back(Blas{compactBuffer, compactHandle});
+        compactedBytes += compactSizes[i];
+    }
+
+    cmdBuffer.endWaitSubmit(logicalDevice, queue);
+    cmdBuffer.destroy(logicalDevice);
+
+    for (size_t i = 0; i < count; i++) {
+        Blas{blasBuffers[i], handles[i]}.destroy(logicalDevice);
+    }
+
+    double percentDiff = builtBytes > 0 ? static_cast<double>(builtBytes - compactedBytes) / static_cast<double>(builtBytes) * 100.0 : 0.0;
+    std::cout << "BLAS build: " << count << " BLASes in " << batchCount << " batches ("
+              << static_cast<double>(arenaSize) / (1024.0 * 1024.0) << " MiB scratch); compaction reduced size by "
+              << percentDiff << "% (" << static_cast<double>(builtBytes) / (1024.0 * 1024.0) << " MiB to "
+              << static_cast<double>(compactedBytes) / (1024.0 * 1024.0) << " MiB)\n\n";
+
+    modelRanges.clear();
+    return blases;
+}
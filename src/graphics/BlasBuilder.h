@@ -0,0 +1,45 @@
+#ifndef REINA_VK_BLASBUILDER_H
+#define REINA_VK_BLASBUILDER_H
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+#include "Blas.h"
+#include "../scene/Models.h"
+
+namespace reina::graphics {
+    /**
+     * Builds many BLASes with a few submissions instead of waiting on each one. The builds are split into batches whose
+     * scratch memory fits a budget, and every batch shares one scratch arena sized to the largest batch. The compacted
+     * sizes of all BLASes are read with one query, and all the compaction copies go in one submission.
+     */
+    class BlasBuilder {
+    public:
+        /**
+         * @param models The models, with their buffers built
+         * @param scratchBudget The most scratch memory a batch of builds may use. A model needing more is built alone
+         */
+        explicit BlasBuilder(const reina::scene::Models& models, VkDeviceSize scratchBudget = 256ull * 1024 * 1024);
+
+        /**
+         * Queues a BLAS over a model to be built by build()
+         * @param modelRange The model
+         * @return The index of the BLAS in the vector build() returns
+         */
+        size_t add(const reina::scene::ModelRange& modelRange);
+
+        /**
+         * Builds all the queued BLASes and clears the queue.
+         * @param shouldCompact Whether to compact the BLASes after they are built
+         * @return The BLASes, in the order they were added
+         */
+        [[nodiscard]] std::vector<reina::graphics::Blas> build(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue, bool shouldCompact);
+
+    private:
+        const reina::scene::Models& models;
+        VkDeviceSize scratchBudget;
+        std::vector<reina::scene::ModelRange> modelRanges;
+    };
+}
+
+#endif //REINA_VK_BLASBUILDER_H
@@ -0,0 +1,595 @@
+#include "BlockCompression.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "../tools/ThreadPool.h"
+
+namespace {
+    constexpr size_t RGBA8_BYTES = 4;
+    constexpr uint32_t BLOCK_DIM = 4;
+    constexpr uint32_t BLOCK_TEXELS = BLOCK_DIM * BLOCK_DIM;
+    constexpr size_t BLOCK_BYTES = 16;  // BC5 keeps two BC4 channels of 8 bytes each, BC7 is 16 bytes too
+    constexpr size_t BLOCKS_PER_TASK = 64;
+
+    // Interpolation weights of 4-bit BC7 indices, out of 64
+    constexpr std::array<uint32_t, 16> BC7_WEIGHTS = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+    constexpr uint32_t BC7_MODE = 6;
+
+    // Endpoint offsets tried around the initial endpoints of a BC4 channel
+    constexpr int BC4_SEARCH_RADIUS = 2;
+
+    using Block = std::array<std::array<uint8_t, 4>, BLOCK_TEXELS>;
+
+    uint32_t blocksAcross(uint32_t size) {
+        return (size + BLOCK_DIM - 1) / BLOCK_DIM;
+    }
+
+    /**
+     * Writes bits least significant first into zeroed memory, as BC blocks are laid out
+     */
+    struct BitWriter {
+        uint8_t* out;
+        uint32_t position = 0;
+
+        void write(uint32_t value, uint32_t bits) {
+            for (uint32_t i = 0; i < bits; i++, position++) {
+                out[position / 8] |= static_cast<uint8_t>(((value >> i) & 1u) << (position % 8));
+            }
+        }
+    };
+
+    struct BitReader {
+        const uint8_t* in;
+        uint32_t position = 0;
+
+        uint32_t read(uint32_t bits) {
+            uint32_t value = 0;
+            for (uint32_t i = 0; i < bits; i++, position++) {
+                value |= static_cast<uint32_t>((in[position / 8] >> (position % 8)) & 1u) << i;
+            }
+            return value;
+        }
+    };
+
+    /**
+     * Gathers the 4x4 block at block coordinates (bx, by) of an RGBA8 level, repeating the edge texels past the end
+     */
+    Block loadBlock(const uint8_t* level, uint32_t width, uint32_t height, uint32_t bx, uint32_t by) {
+        Block block;
+        for (uint32_t y = 0; y < BLOCK_DIM; y++) {
+            uint32_t srcY = std::min(by * BLOCK_DIM + y, height - 1);
+            for (uint32_t x = 0; x < BLOCK_DIM; x++) {
+                uint32_t srcX = std::min(bx * BLOCK_DIM + x, width - 1);
+                std::memcpy(block[y * BLOCK_DIM + x].data(), level + (static_cast<size_t>(srcY) * width + srcX) * RGBA8_BYTES, RGBA8_BYTES);
+            }
+        }
+        return block;
+    }
+
+    // BC4
+
+    void bc4Palette(uint8_t e0, uint8_t e1, float palette[8]) {
+        palette[0] = e0;
+        palette[1] = e1;
+        if (e0 > e1) {
+            for (int i = 1; i <= 6; i++) {
+                palette[i + 1] = static_cast<float>((7 - i) * e0 + i * e1) / 7.0f;
+            }
+        } else {
+            for (int i = 1; i <= 4; i++) {
+                palette[i + 1] = static_cast<float>((5 - i) * e0 + i * e1) / 5.0f;
+            }
+            palette[6] = 0.0f;
+            palette[7] = 255.0f;
+        }
+    }
+
+    /**
+     * Picks the nearest palette entry for every value, or with conservative the nearest one that isn't above it
+     * @return The squared error, or the largest float if a conservative fit has no entry for some value
+     */
+    float bc4Fit(const uint8_t values[BLOCK_TEXELS], uint8_t e0, uint8_t e1, bool conservative, uint8_t indices[BLOCK_TEXELS]) {
+        float palette[8];
+        bc4Palette(e0, e1, palette);
+
+        float error = 0.0f;
+        for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+            float bestError = std::numeric_limits<float>::max();
+            for (uint8_t p = 0; p < 8; p++) {
+                float diff = palette[p] - static_cast<float>(values[i]);
+                if (conservative && diff > 0.0f) {
+                    continue;
+                }
+                if (diff * diff < bestError) {
+                    bestError = diff * diff;
+                    indices[i] = p;
+                }
+            }
+            if (bestError == std::numeric_limits<float>::max()) {
+                return bestError;
+            }
+            error += bestError;
+        }
+        return error;
+    }
+
+    /**
+     * @param conservative Whether every value must decode to at most itself. The initial endpoints always allow it,
+     * since the lowest value is in their palette.
+     */
+    void encodeBC4(const uint8_t values[BLOCK_TEXELS], uint8_t* out, bool conservative = false) {
+        uint8_t low = 255, high = 0;
+        uint8_t innerLow = 255, innerHigh = 0;  // ignoring 0 and 255, which the six value mode has exactly
+        for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+            low = std::min(low, values[i]);
+            high = std::max(high, values[i]);
+            if (values[i] != 0 && values[i] != 255) {
+                innerLow = std::min(innerLow, values[i]);
+                innerHigh = std::max(innerHigh, values[i]);
+            }
+        }
+        if (innerLow > innerHigh) {
+            innerLow = innerHigh = low;
+        }
+
+        uint8_t bestE0 = high, bestE1 = low;
+        uint8_t bestIndices[BLOCK_TEXELS];
+        float bestError = bc4Fit(values, bestE0, bestE1, conservative, bestIndices);
+
+        // The eight value mode needs e0 > e1 and the six value mode e0 <= e1, so each candidate stays in its mode
+        auto search = [&](int e0, int e1, bool eightValues) {
+            for (int d0 = -BC4_SEARCH_RADIUS; d0 <= BC4_SEARCH_RADIUS; d0++) {
+                for (int d1 = -BC4_SEARCH_RADIUS; d1 <= BC4_SEARCH_RADIUS; d1++) {
+                    int c0 = std::clamp(e0 + d0, 0, 255);
+                    int c1 = std::clamp(e1 + d1, 0, 255);
+                    if ((c0 > c1) != eightValues) {
+                        continue;
+                    }
+
+                    uint8_t indices[BLOCK_TEXELS];
+                    float error = bc4Fit(values, static_cast<uint8_t>(c0), static_cast<uint8_t>(c1), conservative, indices);
+                    if (error < bestError) {
+                        bestError = error;
+                        bestE0 = static_cast<uint8_t>(c0);
+                        bestE1 = static_cast<uint8_t>(c1);
+                        std::copy(std::begin(indices), std::end(indices), bestIndices);
+                    }
+                }
+            }
+        };
+
+        if (bestError > 0.0f) {
+            search(high, low, true);
+            search(innerLow, innerHigh, false);
+        }
+
+        std::memset(out, 0, 8);
+        BitWriter writer{out};
+        writer.write(bestE0, 8);
+        writer.write(bestE1, 8);
+        for (uint8_t index : bestIndices) {
+            writer.write(index, 3);
+        }
+    }
+
+    void decodeBC4(const uint8_t* in, float values[BLOCK_TEXELS]) {
+        BitReader reader{in};
+        auto e0 = static_cast<uint8_t>(reader.read(8));
+        auto e1 = static_cast<uint8_t>(reader.read(8));
+
+        float palette[8];
+        bc4Palette(e0, e1, palette);
+        for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+            values[i] = palette[reader.read(3)];
+        }
+    }
+
+    // BC7 mode 6
+
+    struct Bc7Candidate {
+        uint32_t quantized[2][4];  // 7-bit endpoints
+        uint32_t pBits[2];
+        uint8_t indices[BLOCK_TEXELS];
+        uint64_t error = std::numeric_limits<uint64_t>::max();
+    };
+
+    uint32_t bc7Interpolate(uint32_t e0, uint32_t e1, uint32_t index) {
+        return ((64 - BC7_WEIGHTS[index]) * e0 + BC7_WEIGHTS[index] * e1 + 32) >> 6;
+    }
+
+    /**
+     * Quantizes float endpoints with the given p-bits and picks each texel's index by projecting it onto the
+     * endpoint line, checking the neighboring indices too
+     */
+    Bc7Candidate bc7Fit(const Block& block, const float endpoints[2][4], uint32_t p0, uint32_t p1) {
+        Bc7Candidate candidate;
+        candidate.pBits[0] = p0;
+        candidate.pBits[1] = p1;
+
+        int decoded[2][4];
+        for (int e = 0; e < 2; e++) {
+            for (int c = 0; c < 4; c++) {
+                float q = std::round((endpoints[e][c] - static_cast<float>(candidate.pBits[e])) / 2.0f);
+                candidate.quantized[e][c] = static_cast<uint32_t>(std::clamp(q, 0.0f, 127.0f));
+                decoded[e][c] = static_cast<int>((candidate.quantized[e][c] << 1) | candidate.pBits[e]);
+            }
+        }
+
+        int direction[4];
+        int lengthSquared = 0;
+        for (int c = 0; c < 4; c++) {
+            direction[c] = decoded[1][c] - decoded[0][c];
+            lengthSquared += direction[c] * direction[c];
+        }
+
+        candidate.error = 0;
+        for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+            int projected = 0;
+            for (int c = 0; c < 4; c++) {
+                projected += (static_cast<int>(block[i][c]) - decoded[0][c]) * direction[c];
+            }
+
+            float weight = lengthSquared > 0 ? 64.0f * static_cast<float>(projected) / static_cast<float>(lengthSquared) : 0.0f;
+            auto guess = static_cast<int>(std::lower_bound(BC7_WEIGHTS.begin(), BC7_WEIGHTS.end(), static_cast<uint32_t>(std::clamp(weight, 0.0f, 64.0f))) - BC7_WEIGHTS.begin());
+
+            uint64_t bestError = std::numeric_limits<uint64_t>::max();
+            for (int index = std::max(guess - 1, 0); index <= std::min(guess + 1, 15); index++) {
+                uint64_t error = 0;
+                for (int c = 0; c < 4; c++) {
+                    int diff = static_cast<int>(bc7Interpolate(decoded[0][c], decoded[1][c], index)) - block[i][c];
+                    error += static_cast<uint64_t>(diff * diff);
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    candidate.indices[i] = static_cast<uint8_t>(index);
+                }
+            }
+            candidate.error += bestError;
+        }
+
+        return candidate;
+    }
+
+    /**
+     * Endpoints at the ends of the principal axis of the block's texels
+     */
+    void bc7PrincipalEndpoints(const Block& block, float endpoints[2][4]) {
+        float mean[4] = {};
+        for (const auto& texel : block) {
+            for (int c = 0; c < 4; c++) {
+                mean[c] += static_cast<float>(texel[c]) / BLOCK_TEXELS;
+            }
+        }
+
+        float covariance[4][4] = {};
+        for (const auto& texel : block) {
+            for (int a = 0; a < 4; a++) {
+                for (int b = 0; b < 4; b++) {
+                    covariance[a][b] += (static_cast<float>(texel[a]) - mean[a]) * (static_cast<float>(texel[b]) - mean[b]);
+                }
+            }
+        }
+
+        // Power iteration converges to the eigenvector with the largest eigenvalue
+        float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        for (int iteration = 0; iteration < 8; iteration++) {
+            float next[4] = {};
+            for (int a = 0; a < 4; a++) {
+                for (int b = 0; b < 4; b++) {
+                    next[a] += covariance[a][b] * axis[b];
+                }
+            }
+
+            float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+            if (length < 1e-6f) {
+                break;
+            }
+            for (int c = 0; c < 4; c++) {
+                axis[c] = next[c] / length;
+            }
+        }
+
+        float minT = std::numeric_limits<float>::max();
+        float maxT = std::numeric_limits<float>::lowest();
+        for (const auto& texel : block) {
+            float t = 0.0f;
+            for (int c = 0; c < 4; c++) {
+                t += (static_cast<float>(texel[c]) - mean[c]) * axis[c];
+            }
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+
+        for (int c = 0; c < 4; c++) {
+            endpoints[0][c] = std::clamp(mean[c] + minT * axis[c], 0.0f, 255.0f);
+            endpoints[1][c] = std::clamp(mean[c] + maxT * axis[c], 0.0f, 255.0f);
+        }
+    }
+
+    /**
+     * Solves for the endpoints that minimize the squared error with the indices fixed
+     * @return false if all texels use the same weight, so the system is singular
+     */
+    bool bc7LeastSquares(const Block& block, const uint8_t indices[BLOCK_TEXELS], float endpoints[2][4]) {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[4] = {}, bx[4] = {};
+        for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+            float w = static_cast<float>(BC7_WEIGHTS[indices[i]]) / 64.0f;
+            aa += (1.0f - w) * (1.0f - w);
+            ab += (1.0f - w) * w;
+            bb += w * w;
+            for (int c = 0; c < 4; c++) {
+                ax[c] += (1.0f - w) * block[i][c];
+                bx[c] += w * block[i][c];
+            }
+        }
+
+        float determinant = aa * bb - ab * ab;
+        if (std::abs(determinant) < 1e-6f) {
+            return false;
+        }
+
+        for (int c = 0; c < 4; c++) {
+            endpoints[0][c] = std::clamp((bb * ax[c] - ab * bx[c]) / determinant, 0.0f, 255.0f);
+            endpoints[1][c] = std::clamp((aa * bx[c] - ab * ax[c]) / determinant, 0.0f, 255.0f);
+        }
+        return true;
+    }
+
+    void encodeBC7(const Block& block, uint8_t* out) {
+        // An endpoint's p-bit is shared by all of its channels, so only odd endpoints can decode to an alpha of 255.
+        // Opaque blocks must stay exactly opaque, since the shaders treat any lower alpha as stochastic transparency.
+        bool opaque = std::ranges::all_of(block, [](const auto& texel) { return texel[3] == 255; });
+
+        float endpoints[2][4];
+        bc7PrincipalEndpoints(block, endpoints);
+
+        Bc7Candidate best;
+        for (int pass = 0; pass < 2; pass++) {
+            for (uint32_t p0 = opaque ? 1 : 0; p0 < 2; p0++) {
+                for (uint32_t p1 = opaque ? 1 : 0; p1 < 2; p1++) {
+                    Bc7Candidate candidate = bc7Fit(block, endpoints, p0, p1);
+                    if (candidate.error < best.error) {
+                        best = candidate;
+                    }
+                }
+            }
+
+            if (best.error == 0 || !bc7LeastSquares(block, best.indices, endpoints)) {
+                break;
+            }
+        }
+
+        // The anchor texel's index has an implicit leading zero bit, which swapping the endpoints guarantees
+        if (best.indices[0] >= 8) {
+            std::swap(best.quantized[0], best.quantized[1]);
+            std::swap(best.pBits[0], best.pBits[1]);
+            for (uint8_t& index : best.indices) {
+                index = static_cast<uint8_t>(15 - index);
+            }
+        }
+
+        std::memset(out, 0, 16);
+        BitWriter writer{out};
+        writer.write(1u << BC7_MODE, BC7_MODE + 1);
+        for (int c = 0; c < 4; c++) {
+            writer.write(best.quantized[0][c], 7);
+            writer.write(best.quantized[1][c], 7);
+        }
+        writer.write(best.pBits[0], 1);
+        writer.write(best.pBits[1], 1);
+        for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+            writer.write(best.indices[i], i == 0 ? 3 : 4);
+        }
+    }
+
+    Block decodeBC7(const uint8_t* in) {
+        BitReader reader{in};
+        if (reader.read(BC7_MODE + 1) != 1u << BC7_MODE) {
+            throw std::runtime_error("Only BC7 mode 6 blocks can be decoded");
+        }
+
+        uint32_t endpoints[2][4];
+        for (int c = 0; c < 4; c++) {
+            endpoints[0][c] = reader.read(7) << 1;
+            endpoints[1][c] = reader.read(7) << 1;
+        }
+        uint32_t p0 = reader.read(1);
+        uint32_t p1 = reader.read(1);
+        for (int c = 0; c < 4; c++) {
+            endpoints[0][c] |= p0;
+            endpoints[1][c] |= p1;
+        }
+
+        Block block;
+        for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+            uint32_t index = reader.read(i == 0 ? 3 : 4);
+            for (int c = 0; c < 4; c++) {
+                block[i][c] = static_cast<uint8_t>(bc7Interpolate(endpoints[0][c], endpoints[1][c], index));
+            }
+        }
+        return block;
+    }
+
+    void encodeBlock(const Block& block, reina::graphics::BlockFormat format, uint8_t* out) {
+        uint8_t channel[BLOCK_TEXELS];
+        auto extract = [&](int c) {
+            for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+                channel[i] = block[i][c];
+            }
+        };
+
+        switch (format) {
+            case reina::graphics::BlockFormat::BC5:
+                extract(0);
+                encodeBC4(channel, out);
+                extract(1);
+                encodeBC4(channel, out + 8);
+                break;
+            case reina::graphics::BlockFormat::BC7:
+                encodeBC7(block, out);
+                break;
+            case reina::graphics::BlockFormat::NONE:
+                throw std::runtime_error("Cannot compress to an uncompressed format");
+        }
+    }
+}
+
+reina::graphics::BlockFormat reina::graphics::blockFormatFor(reina::graphics::MipFilter filter) {
+    switch (filter) {
+        case MipFilter::COLOR:
+            return BlockFormat::BC7;
+        case MipFilter::NORMAL:
+            return BlockFormat::BC5;
+        case MipFilter::LINEAR:
+            return BlockFormat::BC5;
+    }
+    return BlockFormat::NONE;
+}
+
+const char* reina::graphics::blockFormatName(reina::graphics::BlockFormat format) {
+    switch (format) {
+        case BlockFormat::NONE:
+            return "RGBA8";
+        case BlockFormat::BC5:
+            return "BC5";
+        case BlockFormat::BC7:
+            return "BC7";
+    }
+    return "unknown";
+}
+
+size_t reina::graphics::textureLevelOffset(uint32_t width, uint32_t height, uint32_t level, reina::graphics::BlockFormat format) {
+    if (format == BlockFormat::NONE) {
+        return mipLevelOffset(width, height, level);
+    }
+
+    size_t offset = 0;
+    for (uint32_t i = 0; i < level; i++) {
+        offset += static_cast<size_t>(blocksAcross(std::max(width >> i, 1u))) * blocksAcross(std::max(height >> i, 1u)) * BLOCK_BYTES;
+    }
+    return offset;
+}
+
+std::vector<uint8_t> reina::graphics::compressMipChain(std::span<const uint8_t> chain, uint32_t width, uint32_t height, reina::graphics::BlockFormat format,
+                                                      reina::graphics::MipFilter filter) {
+    uint32_t levels = mipLevelCount(width, height);
+    if (format == BlockFormat::NONE) {
+        throw std::runtime_error("Cannot compress to an uncompressed format");
+    }
+    if (chain.size() < mipLevelOffset(width, height, levels)) {
+        throw std::runtime_error("Mip chain is too small to compress");
+    }
+
+    std::vector<uint8_t> compressed(textureLevelOffset(width, height, levels, format));
+
+    // Calls fn(level, levelWidth, levelHeight, bx, by, blockData) for every block of every level on the shared thread pool
+    auto forEachBlock = [&](auto&& fn) {
+        for (uint32_t level = 0; level < levels; level++) {
+            uint32_t levelWidth = std::max(width >> level, 1u);
+            uint32_t levelHeight = std::max(height >> level, 1u);
+            uint32_t blocksX = blocksAcross(levelWidth);
+            uint32_t blocksY = blocksAcross(levelHeight);
+            uint8_t* dst = compressed.data() + textureLevelOffset(width, height, level, format);
+
+            reina::tools::ThreadPool::shared().parallelFor(static_cast<size_t>(blocksX) * blocksY, [&](size_t i) {
+                auto bx = static_cast<uint32_t>(i % blocksX);
+                auto by = static_cast<uint32_t>(i / blocksX);
+                fn(level, levelWidth, levelHeight, bx, by, dst + i * BLOCK_BYTES);
+            }, BLOCKS_PER_TASK);
+        }
+    };
+
+    forEachBlock([&](uint32_t level, uint32_t levelWidth, uint32_t levelHeight, uint32_t bx, uint32_t by, uint8_t* blockData) {
+        const uint8_t* src = chain.data() + mipLevelOffset(width, height, level);
+        encodeBlock(loadBlock(src, levelWidth, levelHeight, bx, by), format, blockData);
+    });
+
+    // The min heights must bound the heights the shader reads, which are the decoded R rather than the R it was
+    // compressed from, so they are rebuilt from the decoded R and then compressed without rounding any of them up
+    if (filter == MipFilter::LINEAR && format == BlockFormat::BC5) {
+        std::vector<uint8_t> heights(chain.begin(), chain.begin() + static_cast<std::ptrdiff_t>(mipLevelOffset(width, height, levels)));
+
+        forEachBlock([&](uint32_t level, uint32_t levelWidth, uint32_t levelHeight, uint32_t bx, uint32_t by, uint8_t* blockData) {
+            float values[BLOCK_TEXELS];
+            decodeBC4(blockData, values);
+
+            uint8_t* dst = heights.data() + mipLevelOffset(width, height, level);
+            for (uint32_t y = 0; y < BLOCK_DIM && by * BLOCK_DIM + y < levelHeight; y++) {
+                for (uint32_t x = 0; x < BLOCK_DIM && bx * BLOCK_DIM + x < levelWidth; x++) {
+                    size_t texel = (static_cast<size_t>(by) * BLOCK_DIM + y) * levelWidth + bx * BLOCK_DIM + x;
+                    dst[texel * RGBA8_BYTES] = static_cast<uint8_t>(std::floor(values[y * BLOCK_DIM + x]));
+                }
+            }
+        });
+
+        storeMinHeights(heights, width, height);
+
+        forEachBlock([&](uint32_t level, uint32_t levelWidth, uint32_t levelHeight, uint32_t bx, uint32_t by, uint8_t* blockData) {
+            Block block = loadBlock(heights.data() + mipLevelOffset(width, height, level), levelWidth, levelHeight, bx, by);
+            uint8_t minima[BLOCK_TEXELS];
+            for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+                minima[i] = block[i][1];
+            }
+            encodeBC4(minima, blockData + 8, true);
+        });
+    }
+
+    return compressed;
+}
+
+double reina::graphics::compressionError(std::span<const uint8_t> original, std::span<const uint8_t> compressed, uint32_t width, uint32_t height, reina::graphics::BlockFormat format) {
+    uint32_t blocksX = blocksAcross(width);
+    uint32_t blocksY = blocksAcross(height);
+    int channels = format == BlockFormat::BC5 ? 2 : 4;
+
+    double squaredError = 0.0;
+    for (uint32_t by = 0; by < blocksY; by++) {
+        for (uint32_t bx = 0; bx < blocksX; bx++) {
+            const uint8_t* blockData = compressed.data() + (static_cast<size_t>(by) * blocksX + bx) * BLOCK_BYTES;
+
+            float decoded[BLOCK_TEXELS][4] = {};
+            if (format == BlockFormat::BC7) {
+                Block block = decodeBC7(blockData);
+                for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+                    for (int c = 0; c < 4; c++) {
+                        decoded[i][c] = block[i][c];
+                    }
+                }
+            } else {
+                for (int c = 0; c < channels; c++) {
+                    float values[BLOCK_TEXELS];
+                    decodeBC4(blockData + c * 8, values);
+                    for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+                        decoded[i][c] = values[i];
+                    }
+                }
+            }
+
+            // Texels past the edge of the level only repeat the edge, so they aren't counted
+            for (uint32_t y = 0; y < BLOCK_DIM && by * BLOCK_DIM + y < height; y++) {
+                for (uint32_t x = 0; x < BLOCK_DIM && bx * BLOCK_DIM + x < width; x++) {
+                    const uint8_t* texel = original.data() + ((static_cast<size_t>(by) * BLOCK_DIM + y) * width + bx * BLOCK_DIM + x) * RGBA8_BYTES;
+                    for (int c = 0; c < channels; c++) {
+                        double diff = decoded[y * BLOCK_DIM + x][c] - static_cast<double>(texel[c]);
+                        squaredError += diff * diff;
+                    }
+                }
+            }
+        }
+    }
+
+    return squaredError / (static_cast<double>(width) * height * channels);
+}
+
+double reina::graphics::psnr(double meanSquaredError) {
+    if (meanSquaredError <= 0.0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+}
@@ -0,0 +1,75 @@
+#ifndef REINA_VK_BLOCKCOMPRESSION_H
+#define REINA_VK_BLOCKCOMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Mipmaps.h"
+
+namespace reina::graphics {
+    /**
+     * The layout of a texture's texels on the GPU
+     */
+    enum class BlockFormat : uint32_t {
+        NONE,  // uncompressed RGBA8
+        BC5,   // RG in 16 bytes per 4x4 block, for normal maps (z is rebuilt in the shaders) and height maps with min heights
+        BC7    // RGBA in 16 bytes per 4x4 block, for color
+    };
+
+    /**
+     * @return The format that keeps the channels a mip filter's textures use
+     */
+    [[nodiscard]] BlockFormat blockFormatFor(MipFilter filter);
+
+    /**
+     * @return The name of a format, for logging
+     */
+    [[nodiscard]] const char* blockFormatName(BlockFormat format);
+
+    /**
+     * @param width The width of level 0
+     * @param height The height of level 0
+     * @param level The mip level
+     * @param format The format of the chain
+     * @return The byte offset of a level in a tightly packed chain. Levels of compressed chains are whole blocks.
+     */
+    [[nodiscard]] size_t textureLevelOffset(uint32_t width, uint32_t height, uint32_t level, BlockFormat format);
+
+    /**
+     * Compresses every level of an RGBA8 mip chain on the shared thread pool. Texels past the edge of levels that
+     * aren't a multiple of 4 wide or high repeat the edge.
+     *
+     * BC5 tries both endpoint modes of each channel and refine the endpoints by a small search. BC7 only uses mode 6 (one RGBA
+     * subset with 4-bit indices), fitting the endpoints along the principal axis of each block and refining them by
+     * least squares. Blocks that are fully opaque keep an alpha of exactly 255.
+     *
+     * Height maps compressed to BC5 get their min heights rebuilt from the compressed heights, and encoded so that
+     * none decodes higher than it is.
+     * @param chain A tightly packed RGBA8 chain, like generateMips fills
+     * @param width The width of level 0
+     * @param height The height of level 0
+     * @param format The format to compress to; not NONE
+     * @param filter The filter the chain was generated with
+     * @return The compressed chain, textureLevelOffset(width, height, mipLevelCount(width, height), format) bytes
+     */
+    [[nodiscard]] std::vector<uint8_t> compressMipChain(std::span<const uint8_t> chain, uint32_t width, uint32_t height, BlockFormat format,
+                                                        MipFilter filter);
+
+    /**
+     * Decodes a compressed level and compares it to the texels it was compressed from
+     * @param original The RGBA8 texels of the level
+     * @param compressed The blocks of the level
+     * @param format The format of the blocks; not NONE
+     * @return The mean squared error over the channels the format keeps, in 8-bit units
+     */
+    [[nodiscard]] double compressionError(std::span<const uint8_t> original, std::span<const uint8_t> compressed, uint32_t width, uint32_t height, BlockFormat format);
+
+    /**
+     * @return The peak signal to noise ratio in dB of 8-bit data with the given mean squared error
+     */
+    [[nodiscard]] double psnr(double meanSquaredError);
+}
+
+#endif //REINA_VK_BLOCKCOMPRESSION_H
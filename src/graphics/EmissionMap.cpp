@@ -0,0 +1,151 @@
+#include "EmissionMap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include <stb_image.h>
+
+#include "Ktx2.h"
+#include "../tools/MappedFile.h"
+
+namespace {
+    constexpr int RGBA8_BYTES = 4;
+
+    float cross(glm::vec2 a, glm::vec2 b) {
+        return a.x * b.y - a.y * b.x;
+    }
+
+    int64_t wrap(int64_t texel, uint32_t size) {
+        int64_t wrapped = texel % static_cast<int64_t>(size);
+        return wrapped < 0 ? wrapped + size : wrapped;
+    }
+}
+
+reina::graphics::EmissionMap::EmissionMap(const reina::graphics::ImageSource& source) {
+    reina::tools::MappedFile file;
+    std::span<const std::byte> bytes;
+    bool flip = false;
+    if (const auto* filepath = std::get_if<std::string>(&source.data)) {
+        file = reina::tools::MappedFile{*filepath};
+        bytes = file.bytes();
+        flip = true;
+    } else {
+        bytes = std::get<std::span<const std::byte>>(source.data);
+    }
+
+    if (isKtx2(bytes)) {
+        *this = EmissionMap{1, 1, {1.0f}};
+        return;
+    }
+
+    int width, height, channels;
+    stbi_set_flip_vertically_on_load_thread(flip);
+    stbi_uc* pixels = stbi_load_from_memory(
+            reinterpret_cast<const stbi_uc*>(bytes.data()), static_cast<int>(bytes.size()),
+            &width, &height, &channels, RGBA8_BYTES
+    );
+    if (pixels == nullptr) {
+        throw std::runtime_error("Failed to decode emission map: " + std::string(stbi_failure_reason()));
+    }
+
+    std::vector<float> luminance(static_cast<size_t>(width) * height);
+    for (size_t i = 0; i < luminance.size(); i++) {
+        const stbi_uc* texel = pixels + i * RGBA8_BYTES;
+        luminance[i] = (0.2126f * texel[0] + 0.7152f * texel[1] + 0.0722f * texel[2]) / 255.0f;
+    }
+    stbi_image_free(pixels);
+
+    *this = EmissionMap{static_cast<uint32_t>(width), static_cast<uint32_t>(height), std::move(luminance)};
+}
+
+reina::graphics::EmissionMap::EmissionMap(uint32_t width, uint32_t height, std::vector<float> luminance) {
+    if (luminance.size() != static_cast<size_t>(width) * height || luminance.empty()) {
+        throw std::runtime_error("Emission map luminance doesn't match its size");
+    }
+
+    levels.push_back(Level{width, height, std::move(luminance)});
+
+    // Each texel averages the 2x2 texels under it, the last row and column also taking the leftovers of odd sizes
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        const Level& src = levels.back();
+        Level dst{std::max(src.width / 2, 1u), std::max(src.height / 2, 1u), {}};
+        dst.luminance.resize(static_cast<size_t>(dst.width) * dst.height);
+
+        for (uint32_t y = 0; y < dst.height; y++) {
+            uint32_t yEnd = y == dst.height - 1 ? src.height : 2 * y + 2;
+            for (uint32_t x = 0; x < dst.width; x++) {
+                uint32_t xEnd = x == dst.width - 1 ? src.width : 2 * x + 2;
+
+                float sum = 0.0f;
+                uint32_t count = 0;
+                for (uint32_t srcY = std::min(2 * y, src.height - 1); srcY < yEnd; srcY++) {
+                    for (uint32_t srcX = std::min(2 * x, src.width - 1); srcX < xEnd; srcX++) {
+                        sum += src.luminance[static_cast<size_t>(srcY) * src.width + srcX];
+                        count++;
+                    }
+                }
+                dst.luminance[static_cast<size_t>(y) * dst.width + x] = sum / static_cast<float>(count);
+            }
+        }
+
+        levels.push_back(std::move(dst));
+    }
+}
+
+float reina::graphics::EmissionMap::averageOver(glm::vec2 uv0, glm::vec2 uv1, glm::vec2 uv2) const {
+    if (levels.empty()) {
+        return 1.0f;
+    }
+
+    glm::vec2 low = glm::min(glm::min(uv0, uv1), uv2);
+    glm::vec2 high = glm::max(glm::max(uv0, uv1), uv2);
+
+    float span = std::max((high.x - low.x) * static_cast<float>(levels[0].width), (high.y - low.y) * static_cast<float>(levels[0].height));
+    auto levelIndex = static_cast<size_t>(std::max(std::ceil(std::log2(std::max(span, 1.0f) / RASTER_TEXELS)), 0.0f));
+
+    // A triangle that is still too large at the 1x1 level covers the texture many times over
+    if (levelIndex >= levels.size() - 1) {
+        return levels.back().luminance[0];
+    }
+
+    const Level& level = levels[levelIndex];
+    glm::vec2 size{static_cast<float>(level.width), static_cast<float>(level.height)};
+    auto read = [&](int64_t x, int64_t y) {
+        return level.luminance[static_cast<size_t>(wrap(y, level.height)) * level.width + static_cast<size_t>(wrap(x, level.width))];
+    };
+
+    glm::vec2 p0 = uv0 * size;
+    glm::vec2 p1 = uv1 * size;
+    glm::vec2 p2 = uv2 * size;
+    float doubleArea = cross(p1 - p0, p2 - p0);
+
+    float sum = 0.0f;
+    uint32_t count = 0;
+    if (doubleArea != 0.0f) {
+        // Texel centers are at half integers. Edge functions are flipped for clockwise triangles, so inside is >= 0.
+        float orientation = doubleArea > 0.0f ? 1.0f : -1.0f;
+        auto xBegin = static_cast<int64_t>(std::ceil(low.x * size.x - 0.5f));
+        auto xEnd = static_cast<int64_t>(std::floor(high.x * size.x - 0.5f));
+        auto yBegin = static_cast<int64_t>(std::ceil(low.y * size.y - 0.5f));
+        auto yEnd = static_cast<int64_t>(std::floor(high.y * size.y - 0.5f));
+
+        for (int64_t y = yBegin; y <= yEnd; y++) {
+            for (int64_t x = xBegin; x <= xEnd; x++) {
+                glm::vec2 center{static_cast<float>(x) + 0.5f, static_cast<float>(y) + 0.5f};
+                if (cross(p1 - p0, center - p0) * orientation >= 0.0f && cross(p2 - p1, center - p1) * orientation >= 0.0f
+                    && cross(p0 - p2, center - p2) * orientation >= 0.0f) {
+                    sum += read(x, y);
+                    count++;
+                }
+            }
+        }
+    }
+
+    if (count == 0) {
+        glm::vec2 centroid = (p0 + p1 + p2) / 3.0f;
+        return read(static_cast<int64_t>(std::floor(centroid.x)), static_cast<int64_t>(std::floor(centroid.y)));
+    }
+    return sum / static_cast<float>(count);
+}
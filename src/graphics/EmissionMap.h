@@ -0,0 +1,51 @@
+#ifndef REINA_VK_EMISSIONMAP_H
+#define REINA_VK_EMISSIONMAP_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/vec2.hpp>
+
+#include "Image.h"
+
+namespace reina::graphics {
+    /**
+     * The luminance of an emission texture, kept on the CPU so emissive triangles can be weighted by the light they
+     * give off. Texels are read like the shaders read them, as stored without decoding gamma. Row 0 is at v = 0.
+     */
+    class EmissionMap {
+    public:
+        // Triangles are rasterized at the finest level where they span at most this many texels across
+        static constexpr float RASTER_TEXELS = 32.0f;
+
+        EmissionMap() = default;
+
+        /**
+         * Decodes the image like loadImages does, so images from files are flipped vertically and images from memory
+         * are not. KTX2 containers aren't decoded and give a luminance of 1 everywhere.
+         * @param source The image
+         */
+        explicit EmissionMap(const ImageSource& source);
+
+        /**
+         * @param luminance width * height texels, row 0 first
+         */
+        EmissionMap(uint32_t width, uint32_t height, std::vector<float> luminance);
+
+        /**
+         * Averages the luminance over a triangle in UV space, over the texel centers it covers. Triangles that cover no
+         * texel center read the texel under their centroid. UVs wrap around like the sampler does.
+         */
+        [[nodiscard]] float averageOver(glm::vec2 uv0, glm::vec2 uv1, glm::vec2 uv2) const;
+
+    private:
+        struct Level {
+            uint32_t width;
+            uint32_t height;
+            std::vector<float> luminance;
+        };
+
+        std::vector<Level> levels;  // box filtered, largest first
+    };
+}
+
+#endif //REINA_VK_EMISSIONMAP_H
@@ -0,0 +1,173 @@
+#include "EnvironmentMap.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+
+#include <glm/gtc/packing.hpp>
+#include <stb_image.h>
+
+#include "../core/CmdBuffer.h"
+#include "../tools/ThreadPool.h"
+
+namespace {
+    constexpr float PI = 3.14159265358979f;
+    constexpr float HALF_MAX = 65504.0f;  // the largest finite float16
+
+    float luminance(const float* rgb) {
+        return 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2];
+    }
+
+    /**
+     * Turns running sums into a CDF that ends at exactly 1, or a uniform CDF if the sums are all 0
+     */
+    void normalizeCdf(std::span<float> cdf) {
+        float total = cdf.back();
+        for (size_t i = 0; i < cdf.size(); i++) {
+            cdf[i] = total > 0.0f ? cdf[i] / total : static_cast<float>(i + 1) / static_cast<float>(cdf.size());
+        }
+        cdf.back() = 1.0f;
+    }
+}
+
+std::vector<float> reina::graphics::buildEnvironmentCdfs(std::span<const float> rgb, uint32_t width, uint32_t height) {
+    std::vector<float> cdfs(static_cast<size_t>(height) + static_cast<size_t>(width) * height);
+    std::span<float> marginal(cdfs.data(), height);
+    std::vector<float> rowSums(height);
+
+    reina::tools::ThreadPool::shared().parallelFor(height, [&](size_t row) {
+        float sinTheta = std::sin(PI * (static_cast<float>(row) + 0.5f) / static_cast<float>(height));
+        std::span<float> conditional(cdfs.data() + height + row * width, width);
+
+        // Sums are kept in double since rows of a bright sun can differ by many orders of magnitude
+        double sum = 0.0;
+        for (uint32_t col = 0; col < width; col++) {
+            sum += std::max(luminance(rgb.data() + (row * width + col) * 3), 0.0f) * sinTheta;
+            conditional[col] = static_cast<float>(sum);
+        }
+
+        rowSums[row] = static_cast<float>(sum);
+        normalizeCdf(conditional);
+    }, 16);
+
+    double sum = 0.0;
+    for (uint32_t row = 0; row < height; row++) {
+        sum += rowSums[row];
+        marginal[row] = static_cast<float>(sum);
+    }
+    normalizeCdf(marginal);
+
+    return cdfs;
+}
+
+reina::graphics::EnvironmentMap::EnvironmentMap(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue,
+                                                const std::optional<std::filesystem::path>& filepath, float intensity) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    uint32_t width = 1;
+    uint32_t height = 1;
+    std::vector<float> rgb = {0.0f, 0.0f, 0.0f};
+
+    if (filepath.has_value()) {
+        int imageWidth, imageHeight, channels;
+        stbi_set_flip_vertically_on_load_thread(false);
+        float* pixels = stbi_loadf(filepath->string().c_str(), &imageWidth, &imageHeight, &channels, 3);
+        if (pixels == nullptr) {
+            throw std::runtime_error("Could not load environment map at path: " + filepath->string() + " (" + stbi_failure_reason() + ")");
+        }
+
+        width = static_cast<uint32_t>(imageWidth);
+        height = static_cast<uint32_t>(imageHeight);
+        rgb.assign(pixels, pixels + static_cast<size_t>(width) * height * 3);
+        stbi_image_free(pixels);
+        enabled = true;
+    }
+
+    // RGB float16 formats are rarely sampleable, so alpha is padded in
+    std::vector<uint16_t> halves(static_cast<size_t>(width) * height * 4);
+    reina::tools::ThreadPool::shared().parallelFor(static_cast<size_t>(width) * height, [&](size_t i) {
+        for (int channel = 0; channel < 3; channel++) {
+            halves[i * 4 + channel] = glm::packHalf1x16(std::clamp(rgb[i * 3 + channel], 0.0f, HALF_MAX));
+        }
+        halves[i * 4 + 3] = glm::packHalf1x16(1.0f);
+    }, 4096);
+
+    std::vector<float> cdfs = buildEnvironmentCdfs(rgb, width, height);
+
+    // Header, then the CDFs. The layout matches EnvironmentSamplingBuffer in environment.h.glsl.
+    std::vector<uint8_t> packedBuffer;
+    auto append = [&](const void* data, size_t size) {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        packedBuffer.insert(packedBuffer.end(), bytes, bytes + size);
+    };
+    uint32_t enabledFlag = enabled ? 1 : 0;
+    append(&enabledFlag, sizeof(uint32_t));
+    append(&width, sizeof(uint32_t));
+    append(&height, sizeof(uint32_t));
+    append(&intensity, sizeof(float));
+    append(cdfs.data(), cdfs.size() * sizeof(float));
+
+    samplingBuffer = reina::core::Buffer{
+            logicalDevice, physicalDevice, packedBuffer,
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+    };
+
+    VkDeviceSize imageBytes = halves.size() * sizeof(uint16_t);
+    reina::core::Buffer stagingBuffer{
+            logicalDevice, physicalDevice, imageBytes,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            0,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+    };
+
+    void* mapped;
+    vkMapMemory(logicalDevice, stagingBuffer.getDeviceMemory(), 0, imageBytes, 0, &mapped);
+    std::memcpy(mapped, halves.data(), imageBytes);
+    vkUnmapMemory(logicalDevice, stagingBuffer.getDeviceMemory());
+
+    image = Image{
+            logicalDevice, physicalDevice, width, height, VK_FORMAT_R16G16B16A16_SFLOAT,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    };
+
+    reina::core::CmdBuffer cmdBuffer{logicalDevice, cmdPool, true};
+    image.transition(cmdBuffer.getHandle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+    image.copyFromBuffer(cmdBuffer.getHandle(), stagingBuffer.getHandle(), 0);
+    // The shaders must see the copy, so this transition starts from the copy's layout instead of an undefined one
+    image.transition(cmdBuffer.getHandle(),
+                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
+    cmdBuffer.endWaitSubmit(logicalDevice, queue);
+    cmdBuffer.destroy(logicalDevice);
+    stagingBuffer.destroy(logicalDevice);
+
+    if (enabled) {
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << "Loaded environment map " << filepath->string() << " (" << width << "x" << height << ", "
+                  << static_cast<double>(imageBytes + packedBuffer.size()) / (1024.0 * 1024.0) << " MiB with sampling tables) in "
+                  << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+    }
+}
+
+bool reina::graphics::EnvironmentMap::isEnabled() const {
+    return enabled;
+}
+
+const reina::graphics::Image& reina::graphics::EnvironmentMap::getImage() const {
+    return image;
+}
+
+const reina::core::Buffer& reina::graphics::EnvironmentMap::getSamplingBuffer() const {
+    return samplingBuffer;
+}
+
+void reina::graphics::EnvironmentMap::destroy(VkDevice logicalDevice) {
+    image.destroy(logicalDevice);
+    samplingBuffer.destroy(logicalDevice);
+}
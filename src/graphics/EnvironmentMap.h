@@ -0,0 +1,60 @@
+#ifndef REINA_VK_ENVIRONMENTMAP_H
+#define REINA_VK_ENVIRONMENTMAP_H
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "Image.h"
+#include "../core/Buffer.h"
+
+namespace reina::graphics {
+    /**
+     * An equirectangular HDR image that lights the scene from infinitely far away, and the tables that importance
+     * sample it. Row 0 of the image is straight up (+y), and u = 0.5 faces +x.
+     */
+    class EnvironmentMap {
+    public:
+        EnvironmentMap() = default;
+
+        /**
+         * Loads the image as float16 and builds its sampling tables. Without a filepath, a black placeholder is made so
+         * the descriptors are always valid, and the shaders keep their gradient sky.
+         * @param filepath The .hdr (or any format stb_image reads) file, or std::nullopt for no environment map
+         * @param intensity The factor the radiance is scaled by
+         */
+        EnvironmentMap(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue,
+                       const std::optional<std::filesystem::path>& filepath, float intensity);
+
+        [[nodiscard]] bool isEnabled() const;
+        [[nodiscard]] const Image& getImage() const;
+
+        /**
+         * @return The header (enabled, width, height, intensity), the marginal CDF over rows and each row's conditional
+         * CDF over its texels, as environment.h.glsl reads them
+         */
+        [[nodiscard]] const reina::core::Buffer& getSamplingBuffer() const;
+
+        void destroy(VkDevice logicalDevice);
+
+    private:
+        bool enabled = false;
+        Image image;
+        reina::core::Buffer samplingBuffer;
+    };
+
+    /**
+     * Builds the piecewise-constant 2D distribution of an equirectangular image, proportional to each texel's luminance
+     * times the sine of its polar angle (the solid angle it covers). Rows without energy get uniform conditional CDFs,
+     * and an image without any energy is sampled uniformly.
+     * @param rgb The linear texels, three floats each, row 0 first
+     * @return The marginal CDF over the height rows, followed by height conditional CDFs over the width texels of each
+     * row. Each CDF omits its leading 0 and ends at exactly 1.
+     */
+    [[nodiscard]] std::vector<float> buildEnvironmentCdfs(std::span<const float> rgb, uint32_t width, uint32_t height);
+}
+
+#endif //REINA_VK_ENVIRONMENTMAP_H
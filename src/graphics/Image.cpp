@@ -1,17 +1,258 @@
 #include "Image.h"
 
 #include <stdexcept>
+#include <cstring>
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
 #include "../tools/vktools.h"
+#include "../tools/ThreadPool.h"
+#include "../tools/MappedFile.h"
+#include "../tools/Hash.h"
+#include "BlockCompression.h"
+#include "Ktx2.h"
+#include "Mipmaps.h"
+
+namespace {
+    constexpr uint32_t RGBA8_BYTES = 4;
+    constexpr uint32_t NO_IMAGE = static_cast<uint32_t>(-1);
+    constexpr VkDeviceSize STAGING_ALIGNMENT = 16;  // the largest block size, so every level's copy is aligned
+
+    /**
+     * The encoded bytes of a source. Images from files are memory mapped, and flipped vertically when decoded, so their
+     * first row is the bottom one. KTX2 containers are flipped to the same order, from whichever way KTXorientation
+     * says their rows go.
+     */
+    struct EncodedImage {
+        reina::tools::MappedFile file;
+        std::span<const std::byte> bytes;
+        bool flip = false;
+        reina::graphics::MipFilter filter = reina::graphics::MipFilter::COLOR;
+        reina::graphics::BlockFormat format = reina::graphics::BlockFormat::NONE;
+        uint64_t bytesHash = 0;
+    };
+
+    /**
+     * The levels of an image, either generated here, memory mapped from the mip cache, or pre-encoded in a KTX2
+     * container
+     */
+    struct DecodedImage {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        VkFormat vkFormat = VK_FORMAT_R8G8B8A8_UNORM;
+        reina::graphics::BlockFormat format = reina::graphics::BlockFormat::NONE;  // of generated chains
+        bool preEncoded = false;  // from a KTX2 container
+        double meanSquaredError = 0.0;
+        std::vector<uint8_t> generated;
+        std::optional<reina::graphics::CachedMips> cached;
+        std::vector<std::span<const uint8_t>> levels;  // largest first
+        std::vector<VkDeviceSize> stagingOffsets;  // of each level
+
+        [[nodiscard]] size_t sizeBytes() const {
+            size_t total = 0;
+            for (std::span<const uint8_t> level : levels) {
+                total += level.size();
+            }
+            return total;
+        }
+    };
+
+    VkFormat vkFormatOf(reina::graphics::BlockFormat format) {
+        switch (format) {
+            case reina::graphics::BlockFormat::BC5:
+                return VK_FORMAT_BC5_UNORM_BLOCK;
+            case reina::graphics::BlockFormat::BC7:
+                return VK_FORMAT_BC7_UNORM_BLOCK;  // Like RGBA8, the texels already have gamma applied
+            case reina::graphics::BlockFormat::NONE:
+                break;
+        }
+        return VK_FORMAT_R8G8B8A8_UNORM;  // Do not use gamma correction since it is already assumed to have it
+    }
+
+    bool canSampleFiltered(VkPhysicalDevice physicalDevice, VkFormat format) {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+        VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+        return (properties.optimalTilingFeatures & required) == required;
+    }
+
+    /**
+     * Points the levels of a decoded image at its tightly packed chain
+     */
+    void splitChain(DecodedImage& decoded, std::span<const uint8_t> chain) {
+        uint32_t levelCount = reina::graphics::mipLevelCount(decoded.width, decoded.height);
+        for (uint32_t level = 0; level < levelCount; level++) {
+            size_t begin = reina::graphics::textureLevelOffset(decoded.width, decoded.height, level, decoded.format);
+            size_t end = reina::graphics::textureLevelOffset(decoded.width, decoded.height, level + 1, decoded.format);
+            decoded.levels.push_back(chain.subspan(begin, end - begin));
+        }
+    }
+
+    DecodedImage decode(const EncodedImage& encoded, const reina::graphics::MipCache& mipCache) {
+        DecodedImage decoded;
+
+        // Pre-encoded levels are uploaded as stored, at most with their rows flipped
+        if (reina::graphics::isKtx2(encoded.bytes)) {
+            reina::graphics::Ktx2Texture texture = reina::graphics::parseKtx2(encoded.bytes);
+            decoded.width = texture.width;
+            decoded.height = texture.height;
+            decoded.vkFormat = texture.format;
+            decoded.preEncoded = true;
+
+            // Levels already in the wanted row order are used in place; the others are flipped into a copy
+            if (encoded.flip == texture.rowsUp) {
+                for (std::span<const std::byte> level : texture.levels) {
+                    decoded.levels.emplace_back(reinterpret_cast<const uint8_t*>(level.data()), level.size());
+                }
+                return decoded;
+            }
+
+            decoded.generated = reina::graphics::flipKtx2(texture);
+            size_t offset = 0;
+            for (std::span<const std::byte> level : texture.levels) {
+                decoded.levels.emplace_back(decoded.generated.data() + offset, level.size());
+                offset += level.size();
+            }
+            return decoded;
+        }
+
+        decoded.format = encoded.format;
+        decoded.vkFormat = vkFormatOf(encoded.format);
+
+        decoded.cached = mipCache.load(encoded.bytesHash, encoded.flip, encoded.filter, encoded.format);
+        if (decoded.cached.has_value()) {
+            decoded.width = decoded.cached->width;
+            decoded.height = decoded.cached->height;
+            decoded.meanSquaredError = decoded.cached->meanSquaredError;
+            splitChain(decoded, decoded.cached->chain);
+            return decoded;
+        }
+
+        int width, height, channels;
+
+        // The flip flag is per thread, since several threads decode at once
+        stbi_set_flip_vertically_on_load_thread(encoded.flip);
+        stbi_uc* pixels = stbi_load_from_memory(
+                reinterpret_cast<const stbi_uc*>(encoded.bytes.data()),
+                static_cast<int>(encoded.bytes.size()),
+                &width, &height, &channels, RGBA8_BYTES
+        );
+        if (pixels == nullptr) {
+            throw std::runtime_error("Failed to decode image: " + std::string(stbi_failure_reason()));
+        }
+
+        decoded.width = static_cast<uint32_t>(width);
+        decoded.height = static_cast<uint32_t>(height);
+        decoded.generated.resize(reina::graphics::mipLevelOffset(decoded.width, decoded.height, reina::graphics::mipLevelCount(decoded.width, decoded.height)));
+        std::memcpy(decoded.generated.data(), pixels, static_cast<size_t>(width) * static_cast<size_t>(height) * RGBA8_BYTES);
+        stbi_image_free(pixels);
+
+        reina::graphics::generateMips(decoded.generated, decoded.width, decoded.height, encoded.filter);
+
+        if (encoded.format != reina::graphics::BlockFormat::NONE) {
+            std::vector<uint8_t> compressed = reina::graphics::compressMipChain(decoded.generated, decoded.width, decoded.height, encoded.format, encoded.filter);
+            decoded.meanSquaredError = reina::graphics::compressionError(
+                    std::span<const uint8_t>(decoded.generated).first(static_cast<size_t>(width) * static_cast<size_t>(height) * RGBA8_BYTES),
+                    compressed, decoded.width, decoded.height, encoded.format
+            );
+            decoded.generated = std::move(compressed);
+        }
+        splitChain(decoded, decoded.generated);
+
+        mipCache.store(encoded.bytesHash, encoded.flip, encoded.filter, encoded.format, decoded.width, decoded.height, decoded.meanSquaredError, decoded.generated);
+        return decoded;
+    }
+
+    /**
+     * Groups items whose keys are equal. Hashes only pick the candidates; equal() decides.
+     * @return For each item, the index of the first item equal to it
+     */
+    template<typename Equal>
+    std::vector<uint32_t> findDuplicates(std::span<const uint64_t> hashes, Equal equal) {
+        std::vector<uint32_t> firstOf(hashes.size());
+        std::unordered_map<uint64_t, std::vector<uint32_t>> candidates;
+
+        for (uint32_t i = 0; i < hashes.size(); i++) {
+            std::vector<uint32_t>& bucket = candidates[hashes[i]];
+            auto match = std::ranges::find_if(bucket, [&](uint32_t other) { return equal(i, other); });
+
+            if (match != bucket.end()) {
+                firstOf[i] = *match;
+            } else {
+                firstOf[i] = i;
+                bucket.push_back(i);
+            }
+        }
+
+        return firstOf;
+    }
+
+    struct BudgetFit {
+        size_t bytes = 0;  // of the images' remaining levels
+        size_t downscaled = 0;  // images that lost levels
+    };
+
+    /**
+     * Drops the largest levels of images, least weight per byte first, until they fit in the budget or are all down to
+     * their smallest level. An image's next level is a quarter of the bytes, so each drop makes it a more expensive
+     * choice the next time.
+     * @param uniqueDecoded The images to fit
+     * @param weights The weight of each of those images
+     */
+    BudgetFit fitToBudget(std::vector<DecodedImage>& decoded, std::span<const uint32_t> uniqueDecoded, std::span<const double> weights, size_t budget) {
+        struct Candidate {
+            double weightPerByte;
+            uint32_t image;  // index into uniqueDecoded
+
+            bool operator>(const Candidate& other) const {
+                return weightPerByte > other.weightPerByte;
+            }
+        };
+
+        BudgetFit fit;
+        std::priority_queue<Candidate, std::vector<Candidate>, std::greater<>> candidates;
+        for (uint32_t i = 0; i < uniqueDecoded.size(); i++) {
+            const DecodedImage& image = decoded[uniqueDecoded[i]];
+            fit.bytes += image.sizeBytes();
+            if (image.levels.size() > 1) {
+                candidates.push({weights[i] / static_cast<double>(image.levels[0].size()), i});
+            }
+        }
+
+        std::vector<bool> dropped(uniqueDecoded.size(), false);
+        while (fit.bytes > budget && !candidates.empty()) {
+            uint32_t i = candidates.top().image;
+            candidates.pop();
+
+            DecodedImage& image = decoded[uniqueDecoded[i]];
+            fit.bytes -= image.levels[0].size();
+            image.levels.erase(image.levels.begin());
+            image.width = std::max(image.width >> 1, 1u);
+            image.height = std::max(image.height >> 1, 1u);
+            dropped[i] = true;
+
+            if (image.levels.size() > 1) {
+                candidates.push({weights[i] / static_cast<double>(image.levels[0].size()), i});
+            }
+        }
+
+        fit.downscaled = std::ranges::count(dropped, true);
+        return fit;
+    }
+}
 
 reina::graphics::Image::Image(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue, const std::string& filepath) {
     // read image with stb: https://solarianprogrammer.com/2019/06/10/c-programming-reading-writing-images-stb_image-libraries/
     int imageWidth, imageHeight, channels;
 
-    stbi_set_flip_vertically_on_load(true);
+    stbi_set_flip_vertically_on_load_thread(true);
     uint8_t* imgData = stbi_load(filepath.c_str(), &imageWidth, &imageHeight, &channels, 4);
 
     if (imgData == nullptr) {
@@ -25,7 +266,7 @@ reina::graphics::Image::Image(VkDevice logicalDevice, VkPhysicalDevice physicalD
 reina::graphics::Image::Image(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool,
                               VkQueue queue, std::byte* imageData, size_t imageLengthBytes) {
     int imageWidth, imageHeight, channels;
-    stbi_set_flip_vertically_on_load(false);
+    stbi_set_flip_vertically_on_load_thread(false);
     uint8_t* imgData = stbi_load_from_memory(
             reinterpret_cast<const stbi_uc*>(imageData),
             static_cast<int>(imageLengthBytes),
@@ -63,21 +304,7 @@ void reina::graphics::Image::load(VkDevice logicalDevice, VkPhysicalDevice physi
     reina::core::CmdBuffer cmdBuffer{logicalDevice, cmdPool, true};
 
     transition(cmdBuffer.getHandle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
-    VkBufferImageCopy region{
-            .bufferOffset = 0,
-            .bufferRowLength = 0,
-            .bufferImageHeight = 0,
-            .imageSubresource{
-                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                    .mipLevel = 0,
-                    .baseArrayLayer = 0,
-                    .layerCount = 1
-            },
-            .imageOffset = {0, 0, 0},
-            .imageExtent = {width, height, 1}
-    };
-
-    vkCmdCopyBufferToImage(cmdBuffer.getHandle(), stagingBuffer.getHandle(), image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    copyFromBuffer(cmdBuffer.getHandle(), stagingBuffer.getHandle(), 0);
 
     cmdBuffer.endWaitSubmit(logicalDevice, queue);
 
@@ -86,8 +313,8 @@ void reina::graphics::Image::load(VkDevice logicalDevice, VkPhysicalDevice physi
 }
 
 
-reina::graphics::Image::Image(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags properties)
-        : width(width), height(height), image(VK_NULL_HANDLE), imageView(VK_NULL_HANDLE), imageMemory(VK_NULL_HANDLE) {
+reina::graphics::Image::Image(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, uint32_t mipLevels)
+        : width(width), height(height), mipLevels(mipLevels), image(VK_NULL_HANDLE), imageView(VK_NULL_HANDLE), imageMemory(VK_NULL_HANDLE) {
     createImage(logicalDevice, physicalDevice, width, height, format, VK_IMAGE_TILING_OPTIMAL, usage, properties);
     createImageView(logicalDevice, format);
 }
@@ -106,7 +333,7 @@ void reina::graphics::Image::createImage(VkDevice logicalDevice, VkPhysicalDevic
                     .height = height,
                     .depth = 1
             },
-            .mipLevels = 1,
+            .mipLevels = mipLevels,
             .arrayLayers = 1,
             .samples = VK_SAMPLE_COUNT_1_BIT,
             .tiling = tiling,
@@ -133,6 +360,7 @@ void reina::graphics::Image::createImage(VkDevice logicalDevice, VkPhysicalDevic
     }
 
     vkBindImageMemory(logicalDevice, image, imageMemory, 0);
+    memoryBytes = memRequirements.size;
 }
 
 void reina::graphics::Image::createImageView(VkDevice logicalDevice, VkFormat imageFormat) {
@@ -144,7 +372,7 @@ void reina::graphics::Image::createImageView(VkDevice logicalDevice, VkFormat im
             .subresourceRange = {
                     .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
                     .baseMipLevel = 0,
-                    .levelCount = 1,
+                    .levelCount = mipLevels,
                     .baseArrayLayer = 0,
                     .layerCount = 1
             }
@@ -163,12 +391,25 @@ VkImageView reina::graphics::Image::getImageView() const {
     return imageView;
 }
 
+uint32_t reina::graphics::Image::getMipLevels() const {
+    return mipLevels;
+}
+
+VkDeviceSize reina::graphics::Image::getMemoryBytes() const {
+    return memoryBytes;
+}
+
 void reina::graphics::Image::transition(VkCommandBuffer cmdBuffer, VkImageLayout newLayout, VkAccessFlags newAccessMask, VkPipelineStageFlags newPipelineStages) {
-    VkImageMemoryBarrier rayTracingToGeneralBarrier{
+    transition(cmdBuffer, layout, accessMask, pipelineStages, newLayout, newAccessMask, newPipelineStages);
+}
+
+void reina::graphics::Image::transition(VkCommandBuffer cmdBuffer, VkImageLayout oldLayout, VkAccessFlags oldAccessMask, VkPipelineStageFlags oldPipelineStages,
+                                        VkImageLayout newLayout, VkAccessFlags newAccessMask, VkPipelineStageFlags newPipelineStages) {
+    VkImageMemoryBarrier barrier{
             .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-            .srcAccessMask = accessMask,
+            .srcAccessMask = oldAccessMask,
             .dstAccessMask = newAccessMask,
-            .oldLayout = layout,
+            .oldLayout = oldLayout,
             .newLayout = newLayout,
             .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
             .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
@@ -176,7 +417,7 @@ void reina::graphics::Image::transition(VkCommandBuffer cmdBuffer, VkImageLayout
             .subresourceRange = {
                     .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
                     .baseMipLevel = 0,
-                    .levelCount = 1,
+                    .levelCount = mipLevels,
                     .baseArrayLayer = 0,
                     .layerCount = 1
             }
@@ -184,12 +425,12 @@ void reina::graphics::Image::transition(VkCommandBuffer cmdBuffer, VkImageLayout
 
     vkCmdPipelineBarrier(
             cmdBuffer,
-            pipelineStages,
+            oldPipelineStages,
             newPipelineStages,
             0,
             0, nullptr,
             0, nullptr,
-            1, &rayTracingToGeneralBarrier
+            1, &barrier
     );
 }
 
@@ -220,3 +461,274 @@ void reina::graphics::Image::copyToBuffer(VkCommandBuffer cmdBuffer, VkBuffer ds
             1, &region
     );
 }
+
+void reina::graphics::Image::copyFromBuffer(VkCommandBuffer cmdBuffer, VkBuffer srcBuffer, VkDeviceSize offset, uint32_t mipLevel) {
+    VkBufferImageCopy region{
+            .bufferOffset = offset,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource{
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = mipLevel,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1
+            },
+            .imageOffset = {0, 0, 0},
+            .imageExtent = {std::max(width >> mipLevel, 1u), std::max(height >> mipLevel, 1u), 1}
+    };
+
+    vkCmdCopyBufferToImage(cmdBuffer, srcBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+}
+
+reina::graphics::LoadedImages reina::graphics::loadImages(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue,
+                                                          std::span<const reina::graphics::ImageSource> sources, const reina::graphics::MipCache& mipCache, bool blockCompress,
+                                                          std::optional<VkDeviceSize> memoryBudget) {
+    if (sources.empty()) {
+        return {};
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    reina::tools::ThreadPool& pool = reina::tools::ThreadPool::shared();
+
+    // Devices without BC support (e.g. some mobile GPUs) keep those textures uncompressed
+    auto targetFormat = [&](MipFilter filter) {
+        BlockFormat format = blockCompress ? blockFormatFor(filter) : BlockFormat::NONE;
+        return format != BlockFormat::NONE && canSampleFiltered(physicalDevice, vkFormatOf(format)) ? format : BlockFormat::NONE;
+    };
+    BlockFormat formatOfFilter[] = {targetFormat(MipFilter::COLOR), targetFormat(MipFilter::NORMAL), targetFormat(MipFilter::LINEAR)};
+    if (blockCompress && std::ranges::count(formatOfFilter, BlockFormat::NONE) > 0) {
+        std::cerr << "Warning: the device can't sample every block compressed texture format; those textures are uploaded uncompressed\n";
+    }
+
+    // Hash the encoded bytes, so sources that are byte-for-byte the same are only decoded once
+    std::vector<EncodedImage> encoded(sources.size());
+    std::vector<uint64_t> encodedHashes(sources.size());
+    pool.parallelFor(sources.size(), [&](size_t i) {
+        if (const auto* filepath = std::get_if<std::string>(&sources[i].data)) {
+            try {
+                encoded[i].file = reina::tools::MappedFile{*filepath};
+            } catch (const std::exception& e) {
+                throw std::runtime_error("Could not load image at path: " + *filepath + " (" + e.what() + ")");
+            }
+            encoded[i].bytes = encoded[i].file.bytes();
+            encoded[i].flip = true;
+        } else {
+            encoded[i].bytes = std::get<std::span<const std::byte>>(sources[i].data);
+        }
+        encoded[i].filter = sources[i].mipFilter;
+        encoded[i].format = formatOfFilter[static_cast<uint32_t>(encoded[i].filter)];
+
+        encoded[i].bytesHash = reina::tools::hash64(encoded[i].bytes.data(), encoded[i].bytes.size());
+        encodedHashes[i] = reina::tools::hashCombine(encoded[i].bytesHash, (static_cast<uint64_t>(encoded[i].filter) << 1) | (encoded[i].flip ? 1u : 0u));
+    });
+
+    std::vector<uint32_t> sameEncoding = findDuplicates(encodedHashes, [&](uint32_t a, uint32_t b) {
+        return encoded[a].flip == encoded[b].flip && encoded[a].filter == encoded[b].filter && std::ranges::equal(encoded[a].bytes, encoded[b].bytes);
+    });
+
+    std::vector<uint32_t> toDecode;
+    for (uint32_t i = 0; i < sources.size(); i++) {
+        if (sameEncoding[i] == i) {
+            toDecode.push_back(i);
+        }
+    }
+
+    // Different encodings (e.g. the same PNG saved twice with different settings) can still decode to the same pixels.
+    // Level 0, the format and the filter determine the whole chain, so only those are compared.
+    std::vector<DecodedImage> decoded(toDecode.size());
+    std::vector<uint64_t> pixelHashes(toDecode.size());
+    pool.parallelFor(toDecode.size(), [&](size_t i) {
+        try {
+            decoded[i] = decode(encoded[toDecode[i]], mipCache);
+        } catch (const std::exception& e) {
+            if (const auto* filepath = std::get_if<std::string>(&sources[toDecode[i]].data)) {
+                throw std::runtime_error("Could not load image at path: " + *filepath + " (" + e.what() + ")");
+            }
+            throw;
+        }
+
+        std::span<const uint8_t> level0 = decoded[i].levels[0];
+        pixelHashes[i] = reina::tools::hashCombine(
+                reina::tools::hash64(level0.data(), level0.size(), static_cast<uint64_t>(encoded[toDecode[i]].filter)),
+                (static_cast<uint64_t>(decoded[i].width) << 32) | decoded[i].height
+        );
+    });
+
+    std::vector<uint32_t> samePixels = findDuplicates(pixelHashes, [&](uint32_t a, uint32_t b) {
+        return decoded[a].width == decoded[b].width && decoded[a].height == decoded[b].height && decoded[a].vkFormat == decoded[b].vkFormat
+               && decoded[a].levels.size() == decoded[b].levels.size() && encoded[toDecode[a]].filter == encoded[toDecode[b]].filter
+               && std::ranges::equal(decoded[a].levels[0], decoded[b].levels[0]);
+    });
+
+    for (uint32_t i = 0; i < decoded.size(); i++) {
+        if (decoded[i].preEncoded && !canSampleFiltered(physicalDevice, decoded[i].vkFormat)) {
+            throw std::runtime_error("The device can't sample the format (VkFormat " + std::to_string(decoded[i].vkFormat) + ") of KTX2 texture " + std::to_string(toDecode[i]));
+        }
+    }
+
+    size_t cacheHits = std::ranges::count_if(decoded, [](const DecodedImage& image) { return image.cached.has_value(); });
+    size_t preEncoded = std::ranges::count_if(decoded, [](const DecodedImage& image) { return image.preEncoded; });
+    auto decodeEnd = std::chrono::high_resolution_clock::now();
+
+    std::vector<uint32_t> imageOfDecoded(decoded.size(), NO_IMAGE);
+    std::vector<uint32_t> uniqueDecoded;
+    for (uint32_t i = 0; i < decoded.size(); i++) {
+        if (samePixels[i] == i) {
+            imageOfDecoded[i] = static_cast<uint32_t>(uniqueDecoded.size());
+            uniqueDecoded.push_back(i);
+        } else {
+            imageOfDecoded[i] = imageOfDecoded[samePixels[i]];
+        }
+    }
+
+    LoadedImages result;
+    result.imageIndices.resize(sources.size());
+
+    // Only chains generated with the LINEAR filter carry min heights. KTX2 levels are used as stored, whatever is in G
+    for (uint32_t i : uniqueDecoded) {
+        result.minHeights.push_back(!decoded[i].preEncoded && encoded[toDecode[i]].filter == MipFilter::LINEAR);
+    }
+
+    std::vector<uint32_t> decodedOfSource(sources.size(), NO_IMAGE);
+    for (uint32_t i = 0; i < toDecode.size(); i++) {
+        decodedOfSource[toDecode[i]] = i;
+    }
+
+    size_t totalBytes = 0;
+    std::vector<double> imageWeights(uniqueDecoded.size(), 0.0);
+    for (uint32_t i = 0; i < sources.size(); i++) {
+        uint32_t decodedIndex = decodedOfSource[sameEncoding[i]];
+        result.imageIndices[i] = imageOfDecoded[decodedIndex];
+        totalBytes += decoded[decodedIndex].sizeBytes();
+        imageWeights[result.imageIndices[i]] += sources[i].weight;
+    }
+
+    size_t uniqueBytes = 0;
+    for (uint32_t i : uniqueDecoded) {
+        uniqueBytes += decoded[i].sizeBytes();
+    }
+
+    BudgetFit fit{uniqueBytes, 0};
+    if (memoryBudget.has_value() && uniqueBytes > memoryBudget.value()) {
+        fit = fitToBudget(decoded, uniqueDecoded, imageWeights, memoryBudget.value());
+        if (fit.bytes > memoryBudget.value()) {
+            std::cerr << "Warning: textures take " << static_cast<double>(fit.bytes) / (1024.0 * 1024.0) << " MiB even at their smallest mip level, over the budget of "
+                      << static_cast<double>(memoryBudget.value()) / (1024.0 * 1024.0) << " MiB\n";
+        }
+    }
+
+    // Every level of every unique image gets a slice of one staging buffer. Slices start at a multiple of the largest
+    // block size, so each copy is aligned as required.
+    VkDeviceSize stagingSize = 0;
+    for (uint32_t i : uniqueDecoded) {
+        for (std::span<const uint8_t> level : decoded[i].levels) {
+            stagingSize = (stagingSize + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+            decoded[i].stagingOffsets.push_back(stagingSize);
+            stagingSize += level.size();
+        }
+    }
+
+    reina::core::Buffer stagingBuffer{
+            logicalDevice, physicalDevice, stagingSize,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            0,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+    };
+
+    void* mapped;
+    vkMapMemory(logicalDevice, stagingBuffer.getDeviceMemory(), 0, stagingSize, 0, &mapped);
+    pool.parallelFor(uniqueDecoded.size(), [&](size_t i) {
+        const DecodedImage& image = decoded[uniqueDecoded[i]];
+        for (size_t level = 0; level < image.levels.size(); level++) {
+            std::memcpy(static_cast<std::byte*>(mapped) + image.stagingOffsets[level], image.levels[level].data(), image.levels[level].size());
+        }
+    });
+    vkUnmapMemory(logicalDevice, stagingBuffer.getDeviceMemory());
+
+    result.images.reserve(uniqueDecoded.size());
+    for (uint32_t i : uniqueDecoded) {
+        result.images.emplace_back(
+                logicalDevice, physicalDevice, decoded[i].width, decoded[i].height,
+                decoded[i].vkFormat,
+                VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                static_cast<uint32_t>(decoded[i].levels.size())
+        );
+    }
+
+    reina::core::CmdBuffer cmdBuffer{logicalDevice, cmdPool, true};
+    for (size_t i = 0; i < result.images.size(); i++) {
+        const DecodedImage& image = decoded[uniqueDecoded[i]];
+        result.images[i].transition(cmdBuffer.getHandle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        for (uint32_t level = 0; level < image.levels.size(); level++) {
+            result.images[i].copyFromBuffer(cmdBuffer.getHandle(), stagingBuffer.getHandle(), image.stagingOffsets[level], level);
+        }
+    }
+    cmdBuffer.endWaitSubmit(logicalDevice, queue);
+    cmdBuffer.destroy(logicalDevice);
+    stagingBuffer.destroy(logicalDevice);
+
+    VkDeviceSize allocatedBytes = 0;
+    for (const Image& image : result.images) {
+        allocatedBytes += image.getMemoryBytes();
+    }
+
+    // Quality against memory per format, over the unique images. The error is averaged over texels, so large textures
+    // weigh more.
+    struct FormatStats {
+        size_t count = 0;
+        size_t bytes = 0;
+        size_t uncompressedBytes = 0;
+        double squaredError = 0.0;
+        double texels = 0.0;
+        double worstError = 0.0;
+    };
+    FormatStats formatStats[3];
+    FormatStats ktx2Stats;
+    for (uint32_t i : uniqueDecoded) {
+        const DecodedImage& image = decoded[i];
+        FormatStats& stats = image.preEncoded ? ktx2Stats : formatStats[static_cast<uint32_t>(image.format)];
+        stats.count++;
+        stats.bytes += image.sizeBytes();
+        stats.uncompressedBytes += mipLevelOffset(image.width, image.height, static_cast<uint32_t>(image.levels.size()));
+        stats.squaredError += image.meanSquaredError * image.width * image.height;
+        stats.texels += static_cast<double>(image.width) * image.height;
+        stats.worstError = std::max(stats.worstError, image.meanSquaredError);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Loaded " << sources.size() << " textures in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms: decode and mip "
+              << std::chrono::duration<double, std::milli>(decodeEnd - start).count() << " ms on " << pool.getThreadCount() + 1 << " threads ("
+              << cacheHits << " of " << decoded.size() << " mip chains from cache, " << preEncoded << " pre-encoded KTX2), upload "
+              << std::chrono::duration<double, std::milli>(end - decodeEnd).count() << " ms in one submission\n"
+              << "Texture deduplication: " << result.images.size() << " unique images, " << sources.size() - toDecode.size()
+              << " identical encodings and " << toDecode.size() - result.images.size() << " identical decoded images shared; "
+              << static_cast<double>(uniqueBytes) / (1024.0 * 1024.0) << " MiB with mips, saved "
+              << static_cast<double>(totalBytes - uniqueBytes) / (1024.0 * 1024.0) << " MiB\n";
+    if (memoryBudget.has_value()) {
+        std::cout << "Texture budget: " << static_cast<double>(memoryBudget.value()) / (1024.0 * 1024.0) << " MiB, " << fit.downscaled << " of "
+                  << result.images.size() << " images downscaled from " << static_cast<double>(uniqueBytes) / (1024.0 * 1024.0) << " to "
+                  << static_cast<double>(fit.bytes) / (1024.0 * 1024.0) << " MiB\n";
+    }
+    std::cout << "Texture memory: " << static_cast<double>(allocatedBytes) / (1024.0 * 1024.0) << " MiB allocated on the device for "
+              << result.images.size() << " images\n";
+    for (BlockFormat format : {BlockFormat::BC7, BlockFormat::BC5, BlockFormat::NONE}) {
+        const FormatStats& stats = formatStats[static_cast<uint32_t>(format)];
+        if (stats.count == 0) {
+            continue;
+        }
+
+        std::cout << "  " << blockFormatName(format) << ": " << stats.count << " textures, " << static_cast<double>(stats.bytes) / (1024.0 * 1024.0)
+                  << " MiB (" << static_cast<double>(stats.uncompressedBytes) / (1024.0 * 1024.0) << " MiB as RGBA8)";
+        if (format != BlockFormat::NONE) {
+            std::cout << ", PSNR " << psnr(stats.squaredError / stats.texels) << " dB, worst texture " << psnr(stats.worstError) << " dB";
+        }
+        std::cout << "\n";
+    }
+    if (ktx2Stats.count > 0) {
+        std::cout << "  KTX2: " << ktx2Stats.count << " pre-encoded textures, " << static_cast<double>(ktx2Stats.bytes) / (1024.0 * 1024.0)
+                  << " MiB (" << static_cast<double>(ktx2Stats.uncompressedBytes) / (1024.0 * 1024.0) << " MiB as RGBA8)\n";
+    }
+
+    return result;
+}
@@ -2,9 +2,16 @@
 #define REINA_VK_IMAGE_H
 
 #include <vulkan/vulkan.h>
+#include <cstddef>
+#include <optional>
+#include <span>
 #include <string>
+#include <variant>
 #include <vector>
 
+#include "MipCache.h"
+#include "Mipmaps.h"
+
 namespace reina::graphics {
     class Image {
     public:
@@ -12,14 +19,32 @@ namespace reina::graphics {
         Image(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue, const std::string& filepath);
         Image(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool,
               VkQueue queue, std::byte *imageData, size_t imageLengthBytes);
-        Image(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags memProps);
+        Image(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags memProps, uint32_t mipLevels = 1);
 
         [[nodiscard]] VkImage getImage() const;
         [[nodiscard]] VkImageView getImageView() const;
+        [[nodiscard]] uint32_t getMipLevels() const;
+        [[nodiscard]] VkDeviceSize getMemoryBytes() const;
 
         void transition(VkCommandBuffer cmdBuffer, VkImageLayout newLayout, VkAccessFlags newAccessMask, VkPipelineStageFlags newPipelineStages);
+
+        /**
+         * Records a transition out of a known layout, which makes the new access wait for the old one. transition()
+         * above always starts from VK_IMAGE_LAYOUT_UNDEFINED, which may discard the contents.
+         */
+        void transition(VkCommandBuffer cmdBuffer, VkImageLayout oldLayout, VkAccessFlags oldAccessMask, VkPipelineStageFlags oldPipelineStages,
+                        VkImageLayout newLayout, VkAccessFlags newAccessMask, VkPipelineStageFlags newPipelineStages);
         void copyToBuffer(VkCommandBuffer cmdBuffer, VkBuffer dstBuffer);
 
+        /**
+         * Records a copy of tightly packed texels into the image, which must be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+         * @param cmdBuffer The command buffer to record to
+         * @param srcBuffer The buffer holding the texels
+         * @param offset The byte offset of the texels in srcBuffer
+         * @param mipLevel The level to copy to
+         */
+        void copyFromBuffer(VkCommandBuffer cmdBuffer, VkBuffer srcBuffer, VkDeviceSize offset, uint32_t mipLevel = 0);
+
         void destroy(VkDevice logicalDevice);
     private:
         void load(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue, uint8_t* imgData, int imageWidth, int imageHeight);
@@ -28,6 +53,8 @@ namespace reina::graphics {
         void createImageView(VkDevice logicalDevice, VkFormat imageFormat);
 
         uint32_t width = 0, height = 0;
+        uint32_t mipLevels = 1;
+        VkDeviceSize memoryBytes = 0;
 
         VkImage image = VK_NULL_HANDLE;
         VkDeviceMemory imageMemory = VK_NULL_HANDLE;
@@ -37,6 +64,50 @@ namespace reina::graphics {
         VkAccessFlags accessMask = static_cast<VkAccessFlags>(0);
         VkPipelineStageFlags pipelineStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
     };
+
+    /**
+     * An image to load: a filepath, or an encoded image (PNG, JPEG, etc.) in memory, and how to filter its mip chain
+     */
+    struct ImageSource {
+        std::variant<std::string, std::span<const std::byte>> data;
+        MipFilter mipFilter = MipFilter::COLOR;
+        float weight = 1.0f;  // how much the image's resolution matters under a memory budget
+    };
+
+    struct LoadedImages {
+        std::vector<Image> images;  // one per unique image
+        std::vector<uint32_t> imageIndices;  // for each source, the index of its image in images
+        std::vector<bool> minHeights;  // for each image, whether G of its chain holds min heights (see storeMinHeights)
+    };
+
+    /**
+     * Decodes the images and generates their full mip chains in parallel on the shared thread pool, then uploads all
+     * levels of all of them through one staging buffer with a single submission. Like the Image constructors, images
+     * from files are flipped vertically and images from memory are not. Chains found in the mip cache are used as is
+     * instead of being decoded, filtered and compressed again, and generated chains are stored to it.
+     *
+     * With block compression, color textures are stored as BC7, normal maps as BC5 (x and y only) and bump maps as BC5
+     * (heights and min heights), unless the device can't sample that format. The PSNR and memory of each format are
+     * logged.
+     *
+     * KTX2 sources are already encoded, so their levels are copied to the staging buffer straight from the source
+     * bytes, which for files are memory mapped. They are never flipped, filtered or compressed again.
+     *
+     * Sources with identical encoded bytes and filters are decoded once, and sources that decode to identical pixels
+     * with the same filter share one image. Hashes only find the candidates; the bytes are always compared.
+     *
+     * Over the memory budget, images are downscaled by dropping their largest mip levels, which are already filtered.
+     * The level dropped next is always the one with the least weight per byte, where an image shared by several sources
+     * has their combined weight. Every image keeps at least its smallest level. The device memory allocated is logged.
+     * @param sources The images to load
+     * @param mipCache The cache of generated mip chains, which may be disabled
+     * @param blockCompress Whether to block compress the images
+     * @param memoryBudget The most bytes the images' texels may take, or std::nullopt for no limit
+     * @return The images, left in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, and which one each source uses
+     */
+    [[nodiscard]] LoadedImages loadImages(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue,
+                                          std::span<const ImageSource> sources, const MipCache& mipCache, bool blockCompress,
+                                          std::optional<VkDeviceSize> memoryBudget);
 }
 
 #endif //REINA_VK_IMAGE_H
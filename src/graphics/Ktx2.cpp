@@ -0,0 +1,265 @@
+#include "Ktx2.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace {
+    constexpr std::array<uint8_t, 12> KTX2_IDENTIFIER = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+    struct Header {
+        uint32_t vkFormat;
+        uint32_t typeSize;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t layerCount;
+        uint32_t faceCount;
+        uint32_t levelCount;
+        uint32_t supercompressionScheme;
+
+        uint32_t dfdByteOffset;
+        uint32_t dfdByteLength;
+        uint32_t kvdByteOffset;
+        uint32_t kvdByteLength;
+        // followed by the 64-bit supercompression global data offset and length, unused without supercompression
+    };
+
+    // The identifier, header and supercompression global data index come before the level index
+    constexpr size_t LEVEL_INDEX_OFFSET = 80;
+
+    struct LevelIndexEntry {
+        uint64_t byteOffset;
+        uint64_t byteLength;
+        uint64_t uncompressedByteLength;
+    };
+
+    struct FormatInfo {
+        VkFormat stored;
+        VkFormat created;
+        uint32_t blockDim;  // 1 for uncompressed formats
+        uint32_t blockBytes;
+    };
+
+    constexpr FormatInfo SUPPORTED_FORMATS[] = {
+            {VK_FORMAT_R8_UNORM, VK_FORMAT_R8_UNORM, 1, 1},
+            {VK_FORMAT_R8_SRGB, VK_FORMAT_R8_UNORM, 1, 1},
+            {VK_FORMAT_R8G8_UNORM, VK_FORMAT_R8G8_UNORM, 1, 2},
+            {VK_FORMAT_R8G8_SRGB, VK_FORMAT_R8G8_UNORM, 1, 2},
+            {VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM, 1, 4},
+            {VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_R8G8B8A8_UNORM, 1, 4},
+            {VK_FORMAT_BC1_RGB_UNORM_BLOCK, VK_FORMAT_BC1_RGB_UNORM_BLOCK, 4, 8},
+            {VK_FORMAT_BC1_RGB_SRGB_BLOCK, VK_FORMAT_BC1_RGB_UNORM_BLOCK, 4, 8},
+            {VK_FORMAT_BC1_RGBA_UNORM_BLOCK, VK_FORMAT_BC1_RGBA_UNORM_BLOCK, 4, 8},
+            {VK_FORMAT_BC1_RGBA_SRGB_BLOCK, VK_FORMAT_BC1_RGBA_UNORM_BLOCK, 4, 8},
+            {VK_FORMAT_BC2_UNORM_BLOCK, VK_FORMAT_BC2_UNORM_BLOCK, 4, 16},
+            {VK_FORMAT_BC2_SRGB_BLOCK, VK_FORMAT_BC2_UNORM_BLOCK, 4, 16},
+            {VK_FORMAT_BC3_UNORM_BLOCK, VK_FORMAT_BC3_UNORM_BLOCK, 4, 16},
+            {VK_FORMAT_BC3_SRGB_BLOCK, VK_FORMAT_BC3_UNORM_BLOCK, 4, 16},
+            {VK_FORMAT_BC4_UNORM_BLOCK, VK_FORMAT_BC4_UNORM_BLOCK, 4, 8},
+            {VK_FORMAT_BC5_UNORM_BLOCK, VK_FORMAT_BC5_UNORM_BLOCK, 4, 16},
+            {VK_FORMAT_BC7_UNORM_BLOCK, VK_FORMAT_BC7_UNORM_BLOCK, 4, 16},
+            {VK_FORMAT_BC7_SRGB_BLOCK, VK_FORMAT_BC7_UNORM_BLOCK, 4, 16},
+    };
+
+    template<typename T>
+    T read(std::span<const std::byte> bytes, size_t offset) {
+        if (offset + sizeof(T) > bytes.size()) {
+            throw std::runtime_error("KTX2 file is truncated");
+        }
+
+        T value;
+        std::memcpy(&value, bytes.data() + offset, sizeof(T));
+        return value;
+    }
+
+    /**
+     * @return Whether the KTXorientation entry of the key/value data says rows go up. Without one, they go down.
+     */
+    bool readRowsUp(std::span<const std::byte> bytes, const Header& header) {
+        if (static_cast<uint64_t>(header.kvdByteOffset) + header.kvdByteLength > bytes.size()) {
+            throw std::runtime_error("KTX2 key/value data is out of bounds");
+        }
+
+        std::span<const std::byte> keyValues = bytes.subspan(header.kvdByteOffset, header.kvdByteLength);
+        constexpr std::string_view ORIENTATION_KEY{"KTXorientation\0", 15};
+
+        // Each entry is its length, then the NUL terminated key and the value, padded to 4 bytes
+        size_t offset = 0;
+        while (offset + sizeof(uint32_t) <= keyValues.size()) {
+            auto length = read<uint32_t>(keyValues, offset);
+            offset += sizeof(uint32_t);
+            if (length > keyValues.size() - offset) {
+                throw std::runtime_error("KTX2 key/value entry is truncated");
+            }
+
+            std::string_view entry{reinterpret_cast<const char*>(keyValues.data() + offset), length};
+            if (entry.starts_with(ORIENTATION_KEY)) {
+                // The value is one letter per axis, x first: "rd" or "ru" for 2D images
+                std::string_view value = entry.substr(ORIENTATION_KEY.size());
+                return value.size() >= 2 && value[1] == 'u';
+            }
+
+            offset += (length + 3) & ~3u;
+        }
+
+        return false;
+    }
+
+    /**
+     * Flips the first rows of a 4x4 block upside down, leaving the rest as they are
+     * @param block The block, in the layout of format
+     * @param rows How many rows of the block are in the image, 1 to 4
+     */
+    void flipBlock(std::byte* block, VkFormat format, uint32_t rows) {
+        // BC1 color indices: a byte for each row after the two endpoints
+        auto flipColor = [rows](std::byte* color) {
+            std::reverse(color + 4, color + 4 + rows);
+        };
+        // BC4 indices: 12 bits for each row in the 48 bits after the two endpoints
+        auto flipSingleChannel = [rows](std::byte* channel) {
+            uint64_t indices = 0;
+            std::memcpy(&indices, channel + 2, 6);
+
+            uint64_t flipped = indices;
+            for (uint32_t y = 0; y < rows; y++) {
+                uint64_t row = (indices >> (12 * y)) & 0xFFF;
+                uint32_t to = rows - 1 - y;
+                flipped = (flipped & ~(0xFFFull << (12 * to))) | (row << (12 * to));
+            }
+            std::memcpy(channel + 2, &flipped, 6);
+        };
+
+        switch (format) {
+            case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+                flipColor(block);
+                break;
+            case VK_FORMAT_BC2_UNORM_BLOCK:
+                // Explicit alpha: two bytes for each row, then a BC1 block
+                for (uint32_t y = 0; y < rows / 2; y++) {
+                    std::swap_ranges(block + 2 * y, block + 2 * y + 2, block + 2 * (rows - 1 - y));
+                }
+                flipColor(block + 8);
+                break;
+            case VK_FORMAT_BC3_UNORM_BLOCK:
+                flipSingleChannel(block);
+                flipColor(block + 8);
+                break;
+            case VK_FORMAT_BC4_UNORM_BLOCK:
+                flipSingleChannel(block);
+                break;
+            case VK_FORMAT_BC5_UNORM_BLOCK:
+                flipSingleChannel(block);
+                flipSingleChannel(block + 8);
+                break;
+            default:
+                throw std::runtime_error("KTX2 vkFormat " + std::to_string(format) + " blocks can't be flipped; store the texture with KTXorientation \"ru\" instead");
+        }
+    }
+}
+
+bool reina::graphics::isKtx2(std::span<const std::byte> bytes) {
+    return bytes.size() >= KTX2_IDENTIFIER.size() && std::memcmp(bytes.data(), KTX2_IDENTIFIER.data(), KTX2_IDENTIFIER.size()) == 0;
+}
+
+reina::graphics::Ktx2Texture reina::graphics::parseKtx2(std::span<const std::byte> bytes) {
+    if (!isKtx2(bytes)) {
+        throw std::runtime_error("Not a KTX2 file");
+    }
+
+    auto header = read<Header>(bytes, KTX2_IDENTIFIER.size());
+
+    if (header.vkFormat == 0) {
+        throw std::runtime_error("KTX2 file holds Basis Universal data, which needs transcoding and is not supported");
+    }
+    if (header.supercompressionScheme != 0) {
+        throw std::runtime_error("KTX2 supercompression scheme " + std::to_string(header.supercompressionScheme) + " is not supported");
+    }
+    if (header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 || header.pixelWidth == 0 || header.pixelHeight == 0) {
+        throw std::runtime_error("Only single 2D KTX2 images are supported");
+    }
+
+    const FormatInfo* format = std::ranges::find_if(SUPPORTED_FORMATS, [&](const FormatInfo& info) {
+        return static_cast<uint32_t>(info.stored) == header.vkFormat;
+    });
+    if (format == std::end(SUPPORTED_FORMATS)) {
+        throw std::runtime_error("KTX2 vkFormat " + std::to_string(header.vkFormat) + " is not supported");
+    }
+
+    // A level count of 0 asks the loader to generate mips, which compressed data can't have; only the base level is used
+    uint32_t levelCount = std::max(header.levelCount, 1u);
+    if (levelCount > static_cast<uint32_t>(std::bit_width(std::max(header.pixelWidth, header.pixelHeight)))) {
+        throw std::runtime_error("KTX2 file has more levels than a full mip chain");
+    }
+
+    Ktx2Texture texture{format->created, header.pixelWidth, header.pixelHeight, {}, readRowsUp(bytes, header)};
+    texture.levels.reserve(levelCount);
+
+    for (uint32_t level = 0; level < levelCount; level++) {
+        auto entry = read<LevelIndexEntry>(bytes, LEVEL_INDEX_OFFSET + level * sizeof(LevelIndexEntry));
+
+        uint32_t width = std::max(header.pixelWidth >> level, 1u);
+        uint32_t height = std::max(header.pixelHeight >> level, 1u);
+        uint64_t expectedBytes = static_cast<uint64_t>((width + format->blockDim - 1) / format->blockDim)
+                                 * ((height + format->blockDim - 1) / format->blockDim) * format->blockBytes;
+
+        if (entry.byteLength != expectedBytes || entry.byteOffset + entry.byteLength > bytes.size()) {
+            throw std::runtime_error("KTX2 level " + std::to_string(level) + " has an invalid size or offset");
+        }
+
+        texture.levels.push_back(bytes.subspan(entry.byteOffset, entry.byteLength));
+    }
+
+    return texture;
+}
+
+std::vector<uint8_t> reina::graphics::flipKtx2(const Ktx2Texture& texture) {
+    const FormatInfo* format = std::ranges::find_if(SUPPORTED_FORMATS, [&](const FormatInfo& info) {
+        return info.created == texture.format;
+    });
+    if (format == std::end(SUPPORTED_FORMATS)) {
+        throw std::runtime_error("KTX2 vkFormat " + std::to_string(texture.format) + " is not supported");
+    }
+
+    size_t totalBytes = 0;
+    for (std::span<const std::byte> level : texture.levels) {
+        totalBytes += level.size();
+    }
+
+    std::vector<uint8_t> flipped(totalBytes);
+    size_t offset = 0;
+    for (uint32_t level = 0; level < texture.levels.size(); level++) {
+        uint32_t width = std::max(texture.width >> level, 1u);
+        uint32_t height = std::max(texture.height >> level, 1u);
+        if (format->blockDim > 1 && height > format->blockDim && height % format->blockDim != 0) {
+            throw std::runtime_error("KTX2 level " + std::to_string(level) + " is " + std::to_string(height)
+                                     + " texels tall, so its blocks can't be flipped; store the texture with KTXorientation \"ru\" instead");
+        }
+
+        // Uncompressed rows are rows of 1x1 blocks
+        size_t rowBytes = static_cast<size_t>((width + format->blockDim - 1) / format->blockDim) * format->blockBytes;
+        size_t rowCount = (height + format->blockDim - 1) / format->blockDim;
+        std::span<const std::byte> source = texture.levels[level];
+        auto* destination = reinterpret_cast<std::byte*>(flipped.data() + offset);
+
+        for (size_t row = 0; row < rowCount; row++) {
+            std::memcpy(destination + row * rowBytes, source.data() + (rowCount - 1 - row) * rowBytes, rowBytes);
+        }
+
+        if (format->blockDim > 1) {
+            uint32_t rowsInBlock = std::min(height, format->blockDim);
+            for (size_t block = 0; block < source.size() / format->blockBytes; block++) {
+                flipBlock(destination + block * format->blockBytes, texture.format, rowsInBlock);
+            }
+        }
+
+        offset += source.size();
+    }
+
+    return flipped;
+}
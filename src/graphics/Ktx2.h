@@ -0,0 +1,49 @@
+#ifndef REINA_VK_KTX2_H
+#define REINA_VK_KTX2_H
+
+#include <vulkan/vulkan.h>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace reina::graphics {
+    /**
+     * A 2D texture in a KTX2 container whose levels can be copied to the GPU as stored. The levels point into the bytes
+     * the texture was parsed from.
+     */
+    struct Ktx2Texture {
+        VkFormat format;  // the format to create the image with
+        uint32_t width;
+        uint32_t height;
+        std::vector<std::span<const std::byte>> levels;  // largest first
+        bool rowsUp = false;  // the first row is the bottom one, as KTXorientation "ru" says; rows go down by default
+    };
+
+    /**
+     * @return Whether the bytes start with the KTX2 file identifier
+     */
+    [[nodiscard]] bool isKtx2(std::span<const std::byte> bytes);
+
+    /**
+     * Parses a KTX2 container without decoding it. Only single 2D images without supercompression are supported, in
+     * R8, RG8, RGBA8 or BC1 to BC7 formats. sRGB formats are created as their UNORM counterparts, since the shaders
+     * treat every texture as already gamma encoded.
+     *
+     * Basis Universal payloads (vkFormat 0, e.g. from KHR_texture_basisu) need transcoding and are rejected.
+     * @param bytes The container
+     * @return The texture
+     */
+    [[nodiscard]] Ktx2Texture parseKtx2(std::span<const std::byte> bytes);
+
+    /**
+     * Copies the levels of a texture upside down. Block compressed levels reverse their rows of blocks and the rows
+     * inside every block, which needs each level to be a whole number of blocks tall or a single block row. BC6H and
+     * BC7 blocks can't be flipped without decoding them, since their partitions aren't symmetric.
+     * @param texture The texture
+     * @return The flipped levels, packed one after another in the order of texture.levels
+     */
+    [[nodiscard]] std::vector<uint8_t> flipKtx2(const Ktx2Texture& texture);
+}
+
+#endif //REINA_VK_KTX2_H
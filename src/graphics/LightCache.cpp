@@ -0,0 +1,51 @@
+#include "LightCache.h"
+
+#include <iostream>
+#include <vector>
+
+#include "../../polyglot/raytrace.h"
+
+reina::graphics::LightCache::LightCache(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue,
+                                        bool enabled, float cellSize, uint32_t cellCount)
+        : enabled(enabled) {
+    if (!enabled || cellCount == 0) {
+        this->enabled = false;
+        cellCount = 1;
+    }
+
+    // Header, then the cells, all zero since no cell is claimed yet. The layout matches LightCacheBuffer in nee.h.glsl.
+    std::vector<uint8_t> packedBuffer;
+    auto append = [&](const void* data, size_t size) {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        packedBuffer.insert(packedBuffer.end(), bytes, bytes + size);
+    };
+    uint32_t enabledFlag = this->enabled ? 1 : 0;
+    append(&enabledFlag, sizeof(uint32_t));
+    append(&cellSize, sizeof(float));
+    append(&cellCount, sizeof(uint32_t));
+    packedBuffer.resize(packedBuffer.size() + static_cast<size_t>(cellCount) * sizeof(LightCacheCell), 0);
+
+    // Only the shaders read and write the cells, so they stay in device local memory
+    buffer = reina::core::Buffer{
+            logicalDevice, physicalDevice, cmdPool, queue, packedBuffer,
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
+    };
+
+    if (this->enabled) {
+        std::cout << "Light cache: " << cellCount << " cells of " << cellSize << " units ("
+                  << static_cast<double>(packedBuffer.size()) / (1024.0 * 1024.0) << " MiB)\n";
+    }
+}
+
+bool reina::graphics::LightCache::isEnabled() const {
+    return enabled;
+}
+
+const reina::core::Buffer& reina::graphics::LightCache::getBuffer() const {
+    return buffer;
+}
+
+void reina::graphics::LightCache::destroy(VkDevice logicalDevice) {
+    buffer.destroy(logicalDevice);
+}
@@ -0,0 +1,45 @@
+#ifndef REINA_VK_LIGHTCACHE_H
+#define REINA_VK_LIGHTCACHE_H
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+
+#include "../core/Buffer.h"
+
+namespace reina::graphics {
+    /**
+     * A world-space hash grid that learns which emissive instances light each cell from the shadow rays of next event
+     * estimation, and then picks lights by it (see nee.h.glsl). It helps scenes where most lights are occluded from most
+     * points, which picking by power alone keeps sending shadow rays toward.
+     *
+     * The statistics live only on the device and accumulate over frames, so they assume the lights don't move.
+     */
+    class LightCache {
+    public:
+        LightCache() = default;
+
+        /**
+         * Makes an empty hash grid. When disabled, a placeholder with one cell is made so the descriptors are always
+         * valid, and the shaders pick lights from the global alias table.
+         * @param cellSize The edge length of a cell, in world units
+         * @param cellCount The number of entries in the hash table
+         */
+        LightCache(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue,
+                   bool enabled, float cellSize, uint32_t cellCount);
+
+        [[nodiscard]] bool isEnabled() const;
+
+        /**
+         * @return The header (enabled, cell size, cell count) and the cells, as nee.h.glsl reads them
+         */
+        [[nodiscard]] const reina::core::Buffer& getBuffer() const;
+
+        void destroy(VkDevice logicalDevice);
+
+    private:
+        bool enabled = false;
+        reina::core::Buffer buffer;
+    };
+}
+
+#endif //REINA_VK_LIGHTCACHE_H
@@ -0,0 +1,72 @@
+#include "MipCache.h"
+
+#include <cstring>
+#include <iostream>
+
+#include "../tools/Hash.h"
+
+namespace {
+    struct PayloadHeader {
+        uint32_t width;
+        uint32_t height;
+        uint32_t levels;
+        uint32_t filter;
+        uint32_t format;
+        uint32_t reserved;
+        double meanSquaredError;
+    };
+}
+
+reina::graphics::MipCache::MipCache(const std::filesystem::path& directory)
+        : cache(reina::tools::DiskCache{directory, "MIPS", FORMAT_VERSION}) {}
+
+bool reina::graphics::MipCache::isEnabled() const {
+    return cache.has_value();
+}
+
+uint64_t reina::graphics::MipCache::entryKey(uint64_t encodedHash, bool flip, reina::graphics::MipFilter filter, reina::graphics::BlockFormat format) {
+    uint64_t options = (static_cast<uint64_t>(format) << 33) | (static_cast<uint64_t>(filter) << 1) | (flip ? 1u : 0u);
+    return reina::tools::hashCombine(encodedHash, options);
+}
+
+std::optional<reina::graphics::CachedMips> reina::graphics::MipCache::load(uint64_t encodedHash, bool flip, reina::graphics::MipFilter filter, reina::graphics::BlockFormat format) const {
+    if (!isEnabled()) {
+        return std::nullopt;
+    }
+
+    std::optional<reina::tools::CacheEntry> entry = cache->load(entryKey(encodedHash, flip, filter, format), encodedHash);
+    if (!entry.has_value()) {
+        return std::nullopt;
+    }
+
+    std::span<const std::byte> payload = entry->payload;
+
+    PayloadHeader header{};
+    if (payload.size() < sizeof(PayloadHeader)) {
+        return std::nullopt;
+    }
+    memcpy(&header, payload.data(), sizeof(PayloadHeader));
+
+    size_t chainBytes = textureLevelOffset(header.width, header.height, header.levels, format);
+    if (header.levels != mipLevelCount(header.width, header.height) || header.filter != static_cast<uint32_t>(filter)
+        || header.format != static_cast<uint32_t>(format) || payload.size() != sizeof(PayloadHeader) + chainBytes) {
+        std::cerr << "Warning: ignoring corrupt mip cache entry " << std::hex << encodedHash << std::dec << "\n";
+        return std::nullopt;
+    }
+
+    std::span<const uint8_t> chain{reinterpret_cast<const uint8_t*>(payload.data() + sizeof(PayloadHeader)), chainBytes};
+    return CachedMips{std::move(entry.value()), header.width, header.height, header.meanSquaredError, chain};
+}
+
+void reina::graphics::MipCache::store(uint64_t encodedHash, bool flip, reina::graphics::MipFilter filter, reina::graphics::BlockFormat format,
+                                      uint32_t width, uint32_t height, double meanSquaredError, std::span<const uint8_t> chain) const {
+    if (!isEnabled()) {
+        return;
+    }
+
+    PayloadHeader header{width, height, mipLevelCount(width, height), static_cast<uint32_t>(filter), static_cast<uint32_t>(format), 0, meanSquaredError};
+    cache->store(entryKey(encodedHash, flip, filter, format), encodedHash, {
+            std::as_bytes(std::span<const PayloadHeader>(&header, 1)),
+            std::as_bytes(chain)
+    });
+}
@@ -0,0 +1,59 @@
+#ifndef REINA_VK_MIPCACHE_H
+#define REINA_VK_MIPCACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+#include "../tools/DiskCache.h"
+#include "BlockCompression.h"
+#include "Mipmaps.h"
+
+namespace reina::graphics {
+    /**
+     * A mip chain read from the mip cache. The texels point into the memory mapped cache file, so they are only valid
+     * while this object is alive.
+     */
+    struct CachedMips {
+        reina::tools::CacheEntry entry;
+        uint32_t width;
+        uint32_t height;
+        double meanSquaredError;  // of level 0 after block compression; 0 for uncompressed chains
+        std::span<const uint8_t> chain;  // tightly packed levels in the requested format, largest first
+    };
+
+    /**
+     * An on-disk cache of decoded textures and their generated, possibly block compressed mip chains, so repeat loads
+     * skip decoding, filtering and compressing. Entries are keyed on the hash of the encoded image, whether it is
+     * flipped, the mip filter and the block format.
+     */
+    class MipCache {
+    public:
+        static constexpr uint32_t FORMAT_VERSION = 4;
+
+        MipCache() = default;
+        explicit MipCache(const std::filesystem::path& directory);
+
+        [[nodiscard]] bool isEnabled() const;
+
+        /**
+         * @param encodedHash The hash of the encoded image
+         * @param flip Whether the image is flipped vertically when decoded
+         * @param filter The filter the chain was generated with
+         * @param format The format the chain was compressed to
+         * @return The cached chain, or std::nullopt on a cache miss
+         */
+        [[nodiscard]] std::optional<CachedMips> load(uint64_t encodedHash, bool flip, MipFilter filter, BlockFormat format) const;
+
+        void store(uint64_t encodedHash, bool flip, MipFilter filter, BlockFormat format, uint32_t width, uint32_t height,
+                   double meanSquaredError, std::span<const uint8_t> chain) const;
+
+    private:
+        [[nodiscard]] static uint64_t entryKey(uint64_t encodedHash, bool flip, MipFilter filter, BlockFormat format);
+
+        std::optional<reina::tools::DiskCache> cache;
+    };
+}
+
+#endif //REINA_VK_MIPCACHE_H
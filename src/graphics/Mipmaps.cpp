@@ -0,0 +1,203 @@
+#include "Mipmaps.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    constexpr size_t RGBA8_BYTES = 4;
+
+    float srgbToLinear(float c) {
+        return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    float linearToSrgb(float c) {
+        return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    }
+
+    uint8_t toUnorm8(float v) {
+        return static_cast<uint8_t>(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+
+    const std::array<float, 256>& srgbTable() {
+        static const std::array<float, 256> table = []() {
+            std::array<float, 256> result{};
+            for (size_t i = 0; i < result.size(); i++) {
+                result[i] = srgbToLinear(static_cast<float>(i) / 255.0f);
+            }
+            return result;
+        }();
+        return table;
+    }
+
+    /**
+     * Averages the up to four texels at the given pointers
+     */
+    void filterTexel(const uint8_t* const* texels, reina::graphics::MipFilter filter, uint8_t* out) {
+        float sum[4] = {};
+
+        switch (filter) {
+            case reina::graphics::MipFilter::COLOR: {
+                const std::array<float, 256>& toLinear = srgbTable();
+                for (int i = 0; i < 4; i++) {
+                    sum[0] += toLinear[texels[i][0]];
+                    sum[1] += toLinear[texels[i][1]];
+                    sum[2] += toLinear[texels[i][2]];
+                    sum[3] += static_cast<float>(texels[i][3]) / 255.0f;
+                }
+                for (int c = 0; c < 3; c++) {
+                    out[c] = toUnorm8(linearToSrgb(sum[c] / 4.0f));
+                }
+                out[3] = toUnorm8(sum[3] / 4.0f);
+                break;
+            }
+            case reina::graphics::MipFilter::NORMAL: {
+                for (int i = 0; i < 4; i++) {
+                    for (int c = 0; c < 4; c++) {
+                        sum[c] += static_cast<float>(texels[i][c]) / 255.0f;
+                    }
+                }
+
+                float n[3] = {sum[0] / 2.0f - 1.0f, sum[1] / 2.0f - 1.0f, sum[2] / 2.0f - 1.0f};
+                float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                if (length < 1e-6f) {
+                    // Opposing normals cancel out; fall back to the unperturbed normal
+                    n[0] = 0.0f;
+                    n[1] = 0.0f;
+                    n[2] = 1.0f;
+                    length = 1.0f;
+                }
+                for (int c = 0; c < 3; c++) {
+                    out[c] = toUnorm8(n[c] / length * 0.5f + 0.5f);
+                }
+                out[3] = toUnorm8(sum[3] / 4.0f);
+                break;
+            }
+            case reina::graphics::MipFilter::LINEAR: {
+                for (int c = 0; c < 4; c++) {
+                    uint32_t total = 0;
+                    for (int i = 0; i < 4; i++) {
+                        total += texels[i][c];
+                    }
+                    out[c] = static_cast<uint8_t>((total + 2) / 4);
+                }
+                break;
+            }
+        }
+    }
+}
+
+uint32_t reina::graphics::mipLevelCount(uint32_t width, uint32_t height) {
+    return static_cast<uint32_t>(std::bit_width(std::max({width, height, 1u})));
+}
+
+size_t reina::graphics::mipLevelOffset(uint32_t width, uint32_t height, uint32_t level) {
+    size_t offset = 0;
+    for (uint32_t i = 0; i < level; i++) {
+        offset += static_cast<size_t>(std::max(width >> i, 1u)) * std::max(height >> i, 1u) * RGBA8_BYTES;
+    }
+    return offset;
+}
+
+void reina::graphics::generateMips(std::span<uint8_t> chain, uint32_t width, uint32_t height, reina::graphics::MipFilter filter) {
+    uint32_t levels = mipLevelCount(width, height);
+    if (chain.size() < mipLevelOffset(width, height, levels)) {
+        throw std::runtime_error("Mip chain buffer is too small");
+    }
+
+    for (uint32_t level = 1; level < levels; level++) {
+        uint32_t srcWidth = std::max(width >> (level - 1), 1u);
+        uint32_t srcHeight = std::max(height >> (level - 1), 1u);
+        uint32_t dstWidth = std::max(width >> level, 1u);
+        uint32_t dstHeight = std::max(height >> level, 1u);
+
+        const uint8_t* src = chain.data() + mipLevelOffset(width, height, level - 1);
+        uint8_t* dst = chain.data() + mipLevelOffset(width, height, level);
+
+        for (uint32_t y = 0; y < dstHeight; y++) {
+            uint32_t y0 = std::min(2 * y, srcHeight - 1);
+            uint32_t y1 = std::min(2 * y + 1, srcHeight - 1);
+
+            for (uint32_t x = 0; x < dstWidth; x++) {
+                uint32_t x0 = std::min(2 * x, srcWidth - 1);
+                uint32_t x1 = std::min(2 * x + 1, srcWidth - 1);
+
+                const uint8_t* texels[4] = {
+                        src + (static_cast<size_t>(y0) * srcWidth + x0) * RGBA8_BYTES,
+                        src + (static_cast<size_t>(y0) * srcWidth + x1) * RGBA8_BYTES,
+                        src + (static_cast<size_t>(y1) * srcWidth + x0) * RGBA8_BYTES,
+                        src + (static_cast<size_t>(y1) * srcWidth + x1) * RGBA8_BYTES
+                };
+                filterTexel(texels, filter, dst + (static_cast<size_t>(y) * dstWidth + x) * RGBA8_BYTES);
+            }
+        }
+    }
+
+    if (filter == MipFilter::LINEAR) {
+        storeMinHeights(chain, width, height);
+    }
+}
+
+void reina::graphics::storeMinHeights(std::span<uint8_t> chain, uint32_t width, uint32_t height) {
+    uint32_t levels = mipLevelCount(width, height);
+    if (chain.size() < mipLevelOffset(width, height, levels)) {
+        throw std::runtime_error("Mip chain buffer is too small");
+    }
+
+    // Along other axes, uv maps to texels of each level at a slightly different scale than the ownership halves them
+    int radiusX = std::has_single_bit(width) ? 1 : 2;
+    int radiusY = std::has_single_bit(height) ? 1 : 2;
+
+    // The minimum R over each texel of the current level and its descendants
+    std::vector<uint8_t> minima(static_cast<size_t>(width) * height);
+    std::vector<uint8_t> coarser;
+
+    for (uint32_t level = 0; level < levels; level++) {
+        uint32_t levelWidth = std::max(width >> level, 1u);
+        uint32_t levelHeight = std::max(height >> level, 1u);
+        uint8_t* texels = chain.data() + mipLevelOffset(width, height, level);
+
+        if (level == 0) {
+            for (size_t i = 0; i < minima.size(); i++) {
+                minima[i] = texels[i * RGBA8_BYTES];
+            }
+        } else {
+            uint32_t srcWidth = std::max(width >> (level - 1), 1u);
+            uint32_t srcHeight = std::max(height >> (level - 1), 1u);
+
+            coarser.assign(static_cast<size_t>(levelWidth) * levelHeight, 255);
+            for (uint32_t y = 0; y < levelHeight; y++) {
+                uint32_t yEnd = y == levelHeight - 1 ? srcHeight : std::min(2 * y + 2, srcHeight);
+                for (uint32_t x = 0; x < levelWidth; x++) {
+                    uint32_t xEnd = x == levelWidth - 1 ? srcWidth : std::min(2 * x + 2, srcWidth);
+
+                    uint8_t& minimum = coarser[static_cast<size_t>(y) * levelWidth + x];
+                    minimum = texels[(static_cast<size_t>(y) * levelWidth + x) * RGBA8_BYTES];
+                    for (uint32_t srcY = std::min(2 * y, srcHeight - 1); srcY < yEnd; srcY++) {
+                        for (uint32_t srcX = std::min(2 * x, srcWidth - 1); srcX < xEnd; srcX++) {
+                            minimum = std::min(minimum, minima[static_cast<size_t>(srcY) * srcWidth + srcX]);
+                        }
+                    }
+                }
+            }
+            std::swap(minima, coarser);
+        }
+
+        for (uint32_t y = 0; y < levelHeight; y++) {
+            for (uint32_t x = 0; x < levelWidth; x++) {
+                uint8_t minimum = 255;
+                for (int dy = -radiusY; dy <= radiusY; dy++) {
+                    auto neighbourY = static_cast<uint32_t>((static_cast<int64_t>(y) + dy + radiusY * levelHeight) % levelHeight);
+                    for (int dx = -radiusX; dx <= radiusX; dx++) {
+                        auto neighbourX = static_cast<uint32_t>((static_cast<int64_t>(x) + dx + radiusX * levelWidth) % levelWidth);
+                        minimum = std::min(minimum, minima[static_cast<size_t>(neighbourY) * levelWidth + neighbourX]);
+                    }
+                }
+                texels[(static_cast<size_t>(y) * levelWidth + x) * RGBA8_BYTES + 1] = minimum;
+            }
+        }
+    }
+}
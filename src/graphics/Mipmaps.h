@@ -0,0 +1,56 @@
+#ifndef REINA_VK_MIPMAPS_H
+#define REINA_VK_MIPMAPS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace reina::graphics {
+    /**
+     * How the texels of a level are averaged into the next one
+     */
+    enum class MipFilter : uint32_t {
+        COLOR,   // RGB is sRGB encoded and averaged in linear space; alpha is averaged as is
+        NORMAL,  // RGB is a unit vector mapped to [0, 1], renormalized after averaging
+        LINEAR   // height maps: every channel is averaged as is, then G is replaced by minimum heights (see storeMinHeights)
+    };
+
+    /**
+     * @return The number of levels in a full mip chain, down to 1x1
+     */
+    [[nodiscard]] uint32_t mipLevelCount(uint32_t width, uint32_t height);
+
+    /**
+     * @param width The width of level 0
+     * @param height The height of level 0
+     * @param level The mip level
+     * @return The byte offset of a level in a tightly packed RGBA8 chain
+     */
+    [[nodiscard]] size_t mipLevelOffset(uint32_t width, uint32_t height, uint32_t level);
+
+    /**
+     * Fills levels 1 and up of a tightly packed RGBA8 mip chain from level 0 with a 2x2 box filter. Odd sizes clamp
+     * the filter to the edge of the level above.
+     * @param chain The chain, mipLevelOffset(width, height, mipLevelCount(width, height)) bytes starting with level 0
+     * @param width The width of level 0
+     * @param height The height of level 0
+     * @param filter How to average the texels
+     */
+    void generateMips(std::span<uint8_t> chain, uint32_t width, uint32_t height, MipFilter filter);
+
+    /**
+     * Stores a min height pyramid in G of every level of a chain whose R holds heights, which lets bumpMapping skip
+     * the parts of a ray that pass above the surface and narrow the rest down to the texel where it meets the surface,
+     * instead of marching it in layers. G of a texel at level L is at most the R of every texel at
+     * levels L and below that bilinear sampling may read anywhere inside it. Texel x of level L owns texels 2x and
+     * 2x + 1 of level L - 1, the last texel also owning the leftover texel of odd sizes. The minimum over a texel's
+     * descendants is then widened by its neighbours, one texel each way along power of two axes and two along others,
+     * wrapping around the edges as the sampler repeats.
+     * @param chain A tightly packed RGBA8 chain, like generateMips fills
+     * @param width The width of level 0
+     * @param height The height of level 0
+     */
+    void storeMinHeights(std::span<uint8_t> chain, uint32_t width, uint32_t height);
+}
+
+#endif //REINA_VK_MIPMAPS_H
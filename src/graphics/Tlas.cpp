@@ -0,0 +1,213 @@
+#include "Tlas.h"
+
+#include <cstring>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#include "../core/CmdBuffer.h"
+
+namespace {
+    VkTransformMatrixKHR vkTransform(const glm::mat4& transform) {
+        // VkTransformMatrixKHR is the top three rows in row major order
+        glm::mat4x4 transposed = glm::transpose(transform);
+        VkTransformMatrixKHR result;
+        memcpy(&result, &transposed, sizeof(VkTransformMatrixKHR));
+        return result;
+    }
+}
+
+reina::graphics::Tlas::Tlas(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue,
+                            const std::vector<reina::scene::Instance>& instances) {
+
+    PFN_vkGetAccelerationStructureDeviceAddressKHR vkGetAccelerationStructureDeviceAddressKHR = nullptr;
+    vktools::loadVkFunc(logicalDevice, "vkGetAccelerationStructureDeviceAddressKHR", vkGetAccelerationStructureDeviceAddressKHR);
+
+    vkInstances.reserve(instances.size());
+    for (const auto& instance : instances) {
+        VkAccelerationStructureDeviceAddressInfoKHR addressInfo{
+                .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
+                .accelerationStructure = instance.getBlas().getHandle()
+        };
+        VkDeviceAddress blasAddress = vkGetAccelerationStructureDeviceAddressKHR(logicalDevice, &addressInfo);
+
+        VkAccelerationStructureInstanceKHR vkInstance{
+                .transform = vkTransform(instance.getTransform()),
+                .instanceCustomIndex = instance.getInstancePropertiesID(),
+                .mask = 0xFF,
+                .instanceShaderBindingTableRecordOffset = instance.getMaterialOffset(),
+                .flags = 0,
+                .accelerationStructureReference = blasAddress
+        };
+        vkInstances.push_back(vkInstance);
+    }
+
+    // The instance buffer stays host visible so moved instances can be written straight into it
+    instanceBuffer = reina::core::Buffer{
+            logicalDevice, physicalDevice,
+            vkInstances,
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+            VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+            VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+    };
+
+    VkAccelerationStructureGeometryInstancesDataKHR instancesData{
+            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR,
+            .arrayOfPointers = VK_FALSE, // Contiguous array (not pointers)
+            .data = {.deviceAddress = instanceBuffer.getDeviceAddress(logicalDevice)}
+    };
+
+    geometry = VkAccelerationStructureGeometryKHR{
+            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+            .geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR,
+            .geometry = {.instances = instancesData},
+            .flags = VK_GEOMETRY_OPAQUE_BIT_KHR
+    };
+
+    // Query build sizes
+    VkAccelerationStructureBuildGeometryInfoKHR sizeQueryInfo = buildInfo(VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR);
+    VkAccelerationStructureBuildSizesInfoKHR buildSizes{
+            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR
+    };
+
+    PFN_vkGetAccelerationStructureBuildSizesKHR vkGetAccelerationStructureBuildSizesKHR = nullptr;
+    vktools::loadVkFunc(logicalDevice, "vkGetAccelerationStructureBuildSizesKHR", vkGetAccelerationStructureBuildSizesKHR);
+
+    auto instanceCount = static_cast<uint32_t>(vkInstances.size());
+    vkGetAccelerationStructureBuildSizesKHR(
+            logicalDevice,
+            VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
+            &sizeQueryInfo,
+            &instanceCount,
+            &buildSizes
+    );
+
+    // Create TLAS buffer
+    tlas.buffer = reina::core::Buffer{
+            logicalDevice, physicalDevice,
+            buildSizes.accelerationStructureSize,
+            VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    };
+
+    // Create acceleration structure
+    VkAccelerationStructureCreateInfoKHR createInfo{
+            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+            .buffer = tlas.buffer.getHandle(),
+            .size = buildSizes.accelerationStructureSize,
+            .type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR
+    };
+
+    PFN_vkCreateAccelerationStructureKHR vkCreateAccelerationStructureKHR = nullptr;
+    vktools::loadVkFunc(logicalDevice, "vkCreateAccelerationStructureKHR", vkCreateAccelerationStructureKHR);
+
+    vkCreateAccelerationStructureKHR(logicalDevice, &createInfo, nullptr, &tlas.accelerationStructure);
+
+    // The scratch buffer is kept for the updates, so it fits whichever of the two needs more
+    scratchBuffer = reina::core::Buffer{
+            logicalDevice, physicalDevice, std::max(buildSizes.buildScratchSize, buildSizes.updateScratchSize),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    };
+
+    // Build TLAS
+    VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo{
+            .primitiveCount = instanceCount,
+            .primitiveOffset = 0,
+            .firstVertex = 0,
+            .transformOffset = 0
+    };
+    const VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &buildRangeInfo;
+
+    VkAccelerationStructureBuildGeometryInfoKHR tlasBuildInfo = buildInfo(VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR);
+    tlasBuildInfo.scratchData.deviceAddress = scratchBuffer.getDeviceAddress(logicalDevice);
+
+    // Submit the build command
+    reina::core::CmdBuffer cmdBuffer{logicalDevice, cmdPool, true};
+
+    PFN_vkCmdBuildAccelerationStructuresKHR vkCmdBuildAccelerationStructuresKHR = nullptr;
+    vktools::loadVkFunc(logicalDevice, "vkCmdBuildAccelerationStructuresKHR", vkCmdBuildAccelerationStructuresKHR);
+    vkCmdBuildAccelerationStructuresKHR(cmdBuffer.getHandle(), 1, &tlasBuildInfo, &pBuildRangeInfo);
+
+    cmdBuffer.endWaitSubmit(logicalDevice, queue);
+    cmdBuffer.destroy(logicalDevice);
+}
+
+VkAccelerationStructureBuildGeometryInfoKHR reina::graphics::Tlas::buildInfo(VkBuildAccelerationStructureModeKHR mode) const {
+    bool isUpdate = mode == VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+
+    return VkAccelerationStructureBuildGeometryInfoKHR{
+            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+            .type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+            .flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR,
+            .mode = mode,
+            .srcAccelerationStructure = isUpdate ? tlas.accelerationStructure : VK_NULL_HANDLE,
+            .dstAccelerationStructure = tlas.accelerationStructure,
+            .geometryCount = 1,
+            .pGeometries = &geometry
+    };
+}
+
+void reina::graphics::Tlas::setInstanceTransform(size_t instanceIndex, const glm::mat4& transform) {
+    vkInstances.at(instanceIndex).transform = vkTransform(transform);
+    dirty = true;
+}
+
+bool reina::graphics::Tlas::update(VkDevice logicalDevice, VkCommandBuffer cmdBuffer) {
+    if (!dirty) {
+        return false;
+    }
+    dirty = false;
+
+    void* data;
+    vkMapMemory(logicalDevice, instanceBuffer.getDeviceMemory(), 0, instanceBuffer.getSize(), 0, &data);
+    memcpy(data, vkInstances.data(), vkInstances.size() * sizeof(VkAccelerationStructureInstanceKHR));
+    vkUnmapMemory(logicalDevice, instanceBuffer.getDeviceMemory());
+
+    VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo{
+            .primitiveCount = static_cast<uint32_t>(vkInstances.size()),
+            .primitiveOffset = 0,
+            .firstVertex = 0,
+            .transformOffset = 0
+    };
+    const VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &buildRangeInfo;
+
+    VkAccelerationStructureBuildGeometryInfoKHR updateInfo = buildInfo(VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR);
+    updateInfo.scratchData.deviceAddress = scratchBuffer.getDeviceAddress(logicalDevice);
+
+    PFN_vkCmdBuildAccelerationStructuresKHR vkCmdBuildAccelerationStructuresKHR = nullptr;
+    vktools::loadVkFunc(logicalDevice, "vkCmdBuildAccelerationStructuresKHR", vkCmdBuildAccelerationStructuresKHR);
+    vkCmdBuildAccelerationStructuresKHR(cmdBuffer, 1, &updateInfo, &pBuildRangeInfo);
+
+    // The rays traced after the update must see it
+    VkMemoryBarrier barrier{
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+            .dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR
+    };
+
+    vkCmdPipelineBarrier(
+            cmdBuffer,
+            VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+            VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+            0, 1, &barrier, 0, nullptr, 0, nullptr
+    );
+
+    return true;
+}
+
+const vktools::AccStructureInfo& reina::graphics::Tlas::getAccStructureInfo() const {
+    return tlas;
+}
+
+void reina::graphics::Tlas::destroy(VkDevice logicalDevice) {
+    PFN_vkDestroyAccelerationStructureKHR vkDestroyAccelerationStructureKHR = nullptr;
+    vktools::loadVkFunc(logicalDevice, "vkDestroyAccelerationStructureKHR", vkDestroyAccelerationStructureKHR);
+
+    vkDestroyAccelerationStructureKHR(logicalDevice, tlas.accelerationStructure, nullptr);
+    tlas.buffer.destroy(logicalDevice);
+    scratchBuffer.destroy(logicalDevice);
+    instanceBuffer.destroy(logicalDevice);
+}
@@ -0,0 +1,60 @@
+#ifndef REINA_VK_TLAS_H
+#define REINA_VK_TLAS_H
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <glm/mat4x4.hpp>
+
+#include "../core/Buffer.h"
+#include "../scene/Instance.h"
+#include "../tools/vktools.h"
+
+namespace reina::graphics {
+    /**
+     * The top level acceleration structure over the instances of a scene. It is built with ALLOW_UPDATE and keeps its
+     * instance buffer and scratch memory, so moved instances are refit in place each frame instead of rebuilding it.
+     *
+     * A refit keeps the structure of the first build, so tracing slows down as instances move far from where they
+     * started. Turntables and other motion within a bounded region are what it suits.
+     */
+    class Tlas {
+    public:
+        Tlas() = default;
+        Tlas(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue, const std::vector<reina::scene::Instance>& instances);
+
+        /**
+         * Moves an instance. The acceleration structure is changed by the next update().
+         * @param instanceIndex The index of the instance in the vector the TLAS was built from
+         * @param transform The new object to world transform
+         */
+        void setInstanceTransform(size_t instanceIndex, const glm::mat4& transform);
+
+        /**
+         * Records a refit over the moved instances, followed by a barrier so ray tracing after it sees the result. The
+         * instance buffer is written from the host immediately, so the device must be done with the previous frame.
+         * @param cmdBuffer A command buffer in the recording state
+         * @return Whether any instance moved since the last update. Nothing is recorded otherwise.
+         */
+        bool update(VkDevice logicalDevice, VkCommandBuffer cmdBuffer);
+
+        [[nodiscard]] const vktools::AccStructureInfo& getAccStructureInfo() const;
+
+        void destroy(VkDevice logicalDevice);
+
+    private:
+        /**
+         * @return The build info of the TLAS over the instance buffer, without its scratch memory
+         */
+        [[nodiscard]] VkAccelerationStructureBuildGeometryInfoKHR buildInfo(VkBuildAccelerationStructureModeKHR mode) const;
+
+        std::vector<VkAccelerationStructureInstanceKHR> vkInstances;
+        VkAccelerationStructureGeometryKHR geometry{};
+        bool dirty = false;
+
+        vktools::AccStructureInfo tlas;
+        reina::core::Buffer instanceBuffer;
+        reina::core::Buffer scratchBuffer;  // sized for both the build and an update
+    };
+}
+
+#endif //REINA_VK_TLAS_H
@@ -0,0 +1,58 @@
+#include "AliasTable.h"
+
+#include <stdexcept>
+#include <vector>
+
+void reina::scene::buildAliasTable(std::span<const float> weights, std::span<AliasEntry> table) {
+    if (weights.size() != table.size()) {
+        throw std::runtime_error("Alias table doesn't match the number of weights");
+    }
+    if (weights.empty()) {
+        return;
+    }
+
+    double totalWeight = 0;
+    for (float weight : weights) {
+        totalWeight += weight;
+    }
+    if (totalWeight <= 0.0) {
+        throw std::runtime_error("Cannot build an alias table with a total weight of 0");
+    }
+
+    // Each weight is scaled so the average is 1. Entries below that are filled up by an entry above it, which is then
+    // left with less, until every entry holds exactly 1.
+    std::vector<double> scaled(weights.size());
+    std::vector<uint32_t> small;
+    std::vector<uint32_t> large;
+    for (uint32_t i = 0; i < weights.size(); i++) {
+        double probability = weights[i] / totalWeight;
+        table[i].probability = static_cast<float>(probability);
+        scaled[i] = probability * static_cast<double>(weights.size());
+        (scaled[i] < 1.0 ? small : large).push_back(i);
+    }
+
+    while (!small.empty() && !large.empty()) {
+        uint32_t less = small.back();
+        small.pop_back();
+        uint32_t more = large.back();
+
+        table[less].threshold = static_cast<float>(scaled[less]);
+        table[less].alias = more;
+
+        scaled[more] -= 1.0 - scaled[less];
+        if (scaled[more] < 1.0) {
+            large.pop_back();
+            small.push_back(more);
+        }
+    }
+
+    // What's left is 1 up to rounding error
+    for (uint32_t i : large) {
+        table[i].threshold = 1.0f;
+        table[i].alias = i;
+    }
+    for (uint32_t i : small) {
+        table[i].threshold = 1.0f;
+        table[i].alias = i;
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef REINA_VK_ALIASTABLE_H
+#define REINA_VK_ALIASTABLE_H
+
+#include <span>
+
+#include "../../polyglot/raytrace.h"
+
+namespace reina::scene {
+    /**
+     * Builds a table that samples entries proportionally to their weights in constant time with Vose's method. An entry
+     * is picked uniformly, then kept with probability threshold or swapped for its alias.
+     * @param weights The weights of the entries. They must be non-negative and are normalized by their sum.
+     * @param table Where the entries are written, which is as long as weights. Aliases are indices into the table.
+     */
+    void buildAliasTable(std::span<const float> weights, std::span<AliasEntry> table);
+}
+
+#endif //REINA_VK_ALIASTABLE_H
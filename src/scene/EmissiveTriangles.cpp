@@ -0,0 +1,93 @@
+#include "EmissiveTriangles.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <glm/glm.hpp>
+
+#include "../graphics/EmissionMap.h"
+#include "../tools/Hash.h"
+#include "../tools/ThreadPool.h"
+
+reina::scene::EmissiveTriangles reina::scene::EmissiveTriangles::compute(const reina::scene::ModelView& objData, glm::mat3 linear, const reina::graphics::EmissionMap* emissionMap) {
+    // The cross product of two transformed edges is the cofactor matrix times the cross product of the edges, so areas
+    // are found without transforming any vertices
+    glm::mat3 cofactor{glm::cross(linear[1], linear[2]), glm::cross(linear[2], linear[0]), glm::cross(linear[0], linear[1])};
+    float inverseScale = 1.0f / areaScale(linear);
+
+    // Rasterizing the UV triangles over the emission map is the expensive part, so the triangles are weighed in
+    // parallel. Models without UVs read the emission map at (0, 0) like the shaders do.
+    std::vector<float> triangleAreas(objData.indices.size() / 3);
+    std::vector<float> triangleLuminance(objData.indices.size() / 3, 1.0f);
+    bool hasUVs = !objData.texIndices.empty();
+    auto vertex = [&](uint32_t index) {
+        return glm::vec3(objData.vertices[index * 3], objData.vertices[index * 3 + 1], objData.vertices[index * 3 + 2]);
+    };
+    reina::tools::ThreadPool::shared().parallelFor(triangleAreas.size(), [&](size_t triangle) {
+        glm::vec3 v0 = vertex(objData.indices[triangle * 3]);
+        glm::vec3 ab = vertex(objData.indices[triangle * 3 + 1]) - v0;
+        glm::vec3 ac = vertex(objData.indices[triangle * 3 + 2]) - v0;
+        triangleAreas[triangle] = glm::length(cofactor * glm::cross(ab, ac)) / 2 * inverseScale;
+
+        if (emissionMap != nullptr) {
+            glm::vec2 uvs[3] = {glm::vec2(0.0f), glm::vec2(0.0f), glm::vec2(0.0f)};
+            for (size_t corner = 0; hasUVs && corner < 3; corner++) {
+                uint32_t texIndex = objData.texIndices[triangle * 3 + corner];
+                uvs[corner] = glm::vec2(objData.texCoords[texIndex * 2], objData.texCoords[texIndex * 2 + 1]);
+            }
+            triangleLuminance[triangle] = emissionMap->averageOver(uvs[0], uvs[1], uvs[2]);
+        }
+    }, emissionMap != nullptr ? 64 : 4096);
+
+    // weight each triangle with absolute values
+    EmissiveTriangles result;
+    result.probabilities = std::vector<float>(triangleAreas.size());
+    double totalArea = 0;
+    double totalWeight = 0;
+    for (size_t i = 0; i < triangleAreas.size(); i++) {
+        totalArea += triangleAreas[i];
+        result.probabilities[i] = triangleAreas[i] * triangleLuminance[i];
+        totalWeight += result.probabilities[i];
+    }
+    result.area = static_cast<float>(totalArea);
+
+    // An emission map that is black everywhere leaves the instance with nothing to sample
+    if (totalWeight == 0.0 && emissionMap != nullptr && totalArea > 0.0) {
+        result.probabilities.clear();
+        return result;
+    }
+
+    if (totalWeight == 0.0) {
+        throw std::runtime_error("Cannot calculate triangle probabilities for a mesh because the cumulative area is 0");
+    }
+
+    // normalize so the probabilities sum to 1
+    for (float& value : result.probabilities) {
+        value = static_cast<float>(value / totalWeight);
+    }
+
+    result.weight = static_cast<float>(totalWeight);
+    return result;
+}
+
+float reina::scene::EmissiveTriangles::areaScale(glm::mat3 linear) {
+    // A singular transform's shape can't be separated from its scale, so it keeps the areas as they are
+    float determinant = std::abs(glm::determinant(linear));
+    return determinant > 0.0f ? std::cbrt(determinant * determinant) : 1.0f;
+}
+
+reina::scene::EmissiveShapeKey::EmissiveShapeKey(uint32_t objectID, int emissionMapTexID, glm::mat3 linear) : objectID(objectID), emissionMapTexID(emissionMapTexID) {
+    constexpr float QUANTIZATION = 65536.0f;
+
+    glm::mat3 metric = glm::transpose(linear) * linear / EmissiveTriangles::areaScale(linear);
+    size_t i = 0;
+    for (int column = 0; column < 3; column++) {
+        for (int row = 0; row <= column; row++) {
+            shape[i++] = std::llround(metric[column][row] * QUANTIZATION);
+        }
+    }
+}
+
+size_t reina::scene::EmissiveShapeKeyHash::operator()(const EmissiveShapeKey& key) const {
+    uint64_t hash = reina::tools::hashCombine(key.objectID, static_cast<uint32_t>(key.emissionMapTexID));
+    return reina::tools::hashCombine(hash, reina::tools::hash64(key.shape.data(), sizeof(key.shape)));
+}
@@ -0,0 +1,61 @@
+#ifndef REINA_VK_EMISSIVETRIANGLES_H
+#define REINA_VK_EMISSIVETRIANGLES_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/mat3x3.hpp>
+
+#include "ModelData.h"
+
+namespace reina::graphics {
+    class EmissionMap;
+}
+
+namespace reina::scene {
+    /**
+     * How the light of an emissive model is spread over its triangles. Areas only depend on the transform through
+     * transpose(L) * L of its linear part L, and scaling that scales every area alike, so instances of a model whose
+     * transforms differ by a rotation, translation or uniform scale share one.
+     */
+    struct EmissiveTriangles {
+        std::vector<float> probabilities;  // of picking each triangle when sampling an instance
+        float area = 0;  // at an area scale of 1
+        float weight = 0;  // area times the emission map's luminance at an area scale of 1
+
+        /**
+         * Weights each triangle by its area times its emitted luminance, which an emission map varies over the
+         * triangle. The areas are divided by areaScale(linear).
+         * @param linear The linear part of the instance's transform
+         * @param emissionMap The luminance of the emission map, or nullptr for none
+         */
+        static EmissiveTriangles compute(const reina::scene::ModelView& objData, glm::mat3 linear, const reina::graphics::EmissionMap* emissionMap);
+
+        /**
+         * @return How much a transform with this linear part scales areas after its shape, cbrt(det(transpose(L) * L))
+         */
+        static float areaScale(glm::mat3 linear);
+    };
+
+    /**
+     * Instances with equal keys spread their emission over their triangles alike. The shape of a transform is
+     * transpose(L) * L of its linear part L divided by EmissiveTriangles::areaScale, which is the identity for any
+     * rotation and uniform scale. It is quantized so rounding errors in the transforms don't split instances apart.
+     */
+    struct EmissiveShapeKey {
+        uint32_t objectID;
+        int emissionMapTexID;
+        std::array<int64_t, 6> shape;  // the upper triangle of the symmetric matrix
+
+        EmissiveShapeKey(uint32_t objectID, int emissionMapTexID, glm::mat3 linear);
+
+        bool operator==(const EmissiveShapeKey& other) const = default;
+    };
+
+    struct EmissiveShapeKeyHash {
+        size_t operator()(const EmissiveShapeKey& key) const;
+    };
+}
+
+#endif //REINA_VK_EMISSIVETRIANGLES_H
@@ -0,0 +1,165 @@
+#include "GeometryCache.h"
+
+#include <cstring>
+#include <iostream>
+
+#include "ModelData.h"
+#include "../tools/Hash.h"
+
+namespace {
+    constexpr size_t STREAM_ALIGNMENT = 16;
+    constexpr size_t STREAM_COUNT = 6;
+
+    struct PayloadHeader {
+        uint32_t modelCount;
+        uint32_t reserved;
+    };
+
+    struct ModelRecord {
+        uint32_t meshID;
+        uint32_t reserved;
+        uint64_t counts[STREAM_COUNT];  // element counts of vertices, indices, tbns, tbnsIndices, texCoords, texIndices
+    };
+
+    size_t alignUp(size_t value) {
+        return (value + STREAM_ALIGNMENT - 1) & ~(STREAM_ALIGNMENT - 1);
+    }
+
+    template<typename T>
+    std::span<const std::byte> asBytes(const std::vector<T>& vec) {
+        return std::as_bytes(std::span<const T>{vec.data(), vec.size()});
+    }
+
+    template<typename T>
+    bool readStream(std::span<const std::byte> payload, size_t& offset, uint64_t count, std::span<const T>& out) {
+        // Compared in elements, so a corrupt count can't overflow the byte size. The padding after the previous
+        // stream can take offset past the end.
+        if (offset > payload.size() || count > (payload.size() - offset) / sizeof(T)) {
+            return false;
+        }
+        size_t byteSize = count * sizeof(T);
+
+        // Streams are aligned to STREAM_ALIGNMENT within the page aligned mapping, so they can be used in place
+        out = std::span<const T>(reinterpret_cast<const T*>(payload.data() + offset), count);
+        offset = alignUp(offset + byteSize);
+        return true;
+    }
+}
+
+reina::scene::GeometryCache::GeometryCache(const std::filesystem::path& directory)
+        : cache(reina::tools::DiskCache{directory, "GEOM", FORMAT_VERSION}) {}
+
+bool reina::scene::GeometryCache::isEnabled() const {
+    return cache.has_value();
+}
+
+uint64_t reina::scene::GeometryCache::entryKey(const std::string& sourcePath, uint32_t importOptions) {
+    std::error_code ec;
+    std::string absolutePath = std::filesystem::weakly_canonical(sourcePath, ec).string();
+    if (ec) {
+        absolutePath = sourcePath;
+    }
+
+    return reina::tools::hash64(absolutePath.data(), absolutePath.size(), importOptions);
+}
+
+std::optional<reina::scene::CachedGeometry> reina::scene::GeometryCache::load(const std::string& sourcePath, uint32_t importOptions, uint64_t sourceHash) const {
+    if (!isEnabled()) {
+        return std::nullopt;
+    }
+
+    std::optional<reina::tools::CacheEntry> entry = cache->load(entryKey(sourcePath, importOptions), sourceHash);
+    if (!entry.has_value()) {
+        return std::nullopt;
+    }
+
+    std::span<const std::byte> payload = entry->payload;
+
+    PayloadHeader header{};
+    if (payload.size() < sizeof(PayloadHeader)) {
+        return std::nullopt;
+    }
+    memcpy(&header, payload.data(), sizeof(PayloadHeader));
+
+    size_t recordsOffset = sizeof(PayloadHeader);
+    size_t offset = alignUp(recordsOffset + header.modelCount * sizeof(ModelRecord));
+    if (offset > payload.size()) {
+        std::cerr << "Warning: ignoring corrupt geometry cache entry for " << sourcePath << "\n";
+        return std::nullopt;
+    }
+
+    std::vector<CachedModel> models(header.modelCount);
+    for (uint32_t i = 0; i < header.modelCount; i++) {
+        ModelRecord record{};
+        memcpy(&record, payload.data() + recordsOffset + i * sizeof(ModelRecord), sizeof(ModelRecord));
+
+        ModelView& data = models[i].view;
+        models[i].meshID = record.meshID;
+
+        bool ok = readStream(payload, offset, record.counts[0], data.vertices)
+                && readStream(payload, offset, record.counts[1], data.indices)
+                && readStream(payload, offset, record.counts[2], data.tbns)
+                && readStream(payload, offset, record.counts[3], data.tbnsIndices)
+                && readStream(payload, offset, record.counts[4], data.texCoords)
+                && readStream(payload, offset, record.counts[5], data.texIndices);
+
+        if (!ok) {
+            std::cerr << "Warning: ignoring corrupt geometry cache entry for " << sourcePath << "\n";
+            return std::nullopt;
+        }
+    }
+
+    return CachedGeometry{std::move(entry.value()), std::move(models)};
+}
+
+void reina::scene::GeometryCache::store(const std::string& sourcePath, uint32_t importOptions, uint64_t sourceHash, const std::vector<ImportedModel>& models) const {
+    if (!isEnabled()) {
+        return;
+    }
+
+    PayloadHeader header{static_cast<uint32_t>(models.size()), 0};
+
+    std::vector<ModelRecord> records(models.size());
+    for (size_t i = 0; i < models.size(); i++) {
+        const ModelData& data = models[i].modelData;
+        records[i] = ModelRecord{
+                .meshID = models[i].meshID,
+                .reserved = 0,
+                .counts = {
+                        data.vertices.size(), data.indices.size(), data.tbns.size(),
+                        data.tbnsIndices.size(), data.texCoords.size(), data.texIndices.size()
+                }
+        };
+    }
+
+    static const std::byte zeros[STREAM_ALIGNMENT]{};
+    std::vector<std::span<const std::byte>> sections;
+    size_t offset = 0;
+
+    auto addSection = [&](std::span<const std::byte> section) {
+        sections.push_back(section);
+        offset += section.size();
+
+        size_t padding = alignUp(offset) - offset;
+        if (padding != 0) {
+            sections.emplace_back(zeros, padding);
+            offset += padding;
+        }
+    };
+
+    sections.push_back(std::as_bytes(std::span<const PayloadHeader>{&header, 1}));
+    offset += sizeof(PayloadHeader);
+    addSection(asBytes(records));
+
+    for (const ImportedModel& model : models) {
+        const ModelData& data = model.modelData;
+        addSection(asBytes(data.vertices));
+        addSection(asBytes(data.indices));
+        addSection(asBytes(data.tbns));
+        addSection(asBytes(data.tbnsIndices));
+        addSection(asBytes(data.texCoords));
+        addSection(asBytes(data.texIndices));
+    }
+
+    cache->store(entryKey(sourcePath, importOptions), sourceHash, sections);
+}
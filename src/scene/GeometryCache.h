@@ -0,0 +1,61 @@
+#ifndef REINA_VK_GEOMETRYCACHE_H
+#define REINA_VK_GEOMETRYCACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../tools/DiskCache.h"
+#include "ModelData.h"
+
+namespace reina::scene {
+    struct CachedModel {
+        uint32_t meshID;
+        ModelView view;
+    };
+
+    /**
+     * Models read from the geometry cache. The views point into the memory mapped cache file, so they are only valid
+     * while this object is alive.
+     */
+    struct CachedGeometry {
+        reina::tools::CacheEntry entry;
+        std::vector<CachedModel> models;
+    };
+
+    /**
+     * An on-disk cache of imported geometry. Entries hold the final ModelData streams of every model in a source file
+     * so repeat loads skip importing (Assimp, accessor iteration, tangent generation) entirely.
+     *
+     * Entries are keyed on the source path and import options, and are invalidated when the hash of the source file
+     * contents changes or when FORMAT_VERSION is bumped.
+     */
+    class GeometryCache {
+    public:
+        static constexpr uint32_t FORMAT_VERSION = 2;
+
+        GeometryCache() = default;
+        explicit GeometryCache(const std::filesystem::path& directory);
+
+        [[nodiscard]] bool isEnabled() const;
+
+        /**
+         * @param sourcePath The filepath of the source model or scene
+         * @param importOptions Options that affect the imported geometry. Different options are cached separately.
+         * @param sourceHash The hash of the source contents
+         * @return The cached models in the order they were stored, or std::nullopt on a cache miss
+         */
+        [[nodiscard]] std::optional<CachedGeometry> load(const std::string& sourcePath, uint32_t importOptions, uint64_t sourceHash) const;
+
+        void store(const std::string& sourcePath, uint32_t importOptions, uint64_t sourceHash, const std::vector<ImportedModel>& models) const;
+
+    private:
+        [[nodiscard]] static uint64_t entryKey(const std::string& sourcePath, uint32_t importOptions);
+
+        std::optional<reina::tools::DiskCache> cache;
+    };
+}
+
+#endif //REINA_VK_GEOMETRYCACHE_H
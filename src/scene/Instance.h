@@ -2,39 +2,52 @@
 #define RAYGUN_VK_INSTANCE_H
 
 #include "../graphics/Blas.h"
+#include "../graphics/EmissionMap.h"
 #include "Models.h"
+#include "EmissiveTriangles.h"
 
+#include <memory>
+#include <glm/mat3x3.hpp>
 #include <glm/mat4x4.hpp>
 
 namespace reina::scene {
     class Instance {
     public:
-        Instance(const reina::graphics::Blas& blas, glm::vec3 emission, reina::scene::ModelRange modelRange, const reina::scene::ModelData& modelData, uint32_t instancePropertiesID, uint32_t materialOffset, bool cullBackface, glm::mat4x4 transform = glm::mat4x4(1.0f));
+        /**
+         * @param emissionMapTexID The texture the emission is scaled by, or -1 for none
+         * @param emissiveTriangles How the emission is spread over the triangles of the model under this transform's
+         *  shape, or nullptr if the instance doesn't emit
+         */
+        Instance(const reina::graphics::Blas& blas, glm::vec3 emission, reina::scene::ModelRange modelRange, uint32_t objectID, uint32_t instancePropertiesID, uint32_t materialOffset, bool cullBackface, glm::mat4x4 transform = glm::mat4x4(1.0f),
+                 int emissionMapTexID = -1, std::shared_ptr<const EmissiveTriangles> emissiveTriangles = nullptr);
 
         [[nodiscard]] const reina::graphics::Blas& getBlas() const;
         [[nodiscard]] glm::mat4x4 getTransform() const;
+        [[nodiscard]] uint32_t getObjectID() const;
         [[nodiscard]] uint32_t getInstancePropertiesID() const;
         [[nodiscard]] uint32_t getMaterialOffset() const;
         [[nodiscard]] float getArea() const;
-        [[nodiscard]] const std::vector<float>& getCDF() const;
+        [[nodiscard]] const std::vector<float>& getTriangleProbabilities() const;
+        [[nodiscard]] const EmissiveTriangles* getEmissiveTriangles() const;
         [[nodiscard]] bool isEmissive() const;
         [[nodiscard]] glm::vec3 getEmission() const;
+        [[nodiscard]] int getEmissionMapTexID() const;
         [[nodiscard]] reina::scene::ModelRange getModelRange() const;
         [[nodiscard]] float getWeight() const;
         [[nodiscard]] bool isCullBackface() const;
 
     private:
-        void computeCDF(const reina::scene::ModelData& objData, float brightness);
-
         reina::scene::ModelRange modelRange;
         const reina::graphics::Blas& blas;
+        uint32_t objectID = 0;
         uint32_t instancePropertiesID = 0;
         uint32_t materialOffset = 0;
         glm::mat4x4 transform = glm::mat4x4(1.0f);
-        std::vector<float> cdf;
+        std::shared_ptr<const EmissiveTriangles> emissiveTriangles;
         float area = 0;
         float weight = 0;
         glm::vec3 emission;
+        int emissionMapTexID = -1;
         bool cullBackface;
     };
 }
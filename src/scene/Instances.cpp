@@ -1,116 +1,126 @@
 #include "Instances.h"
+#include "AliasTable.h"
+
+#include "../tools/ThreadPool.h"
 
 #include <unordered_map>
 #include <cstring>
 #include <stdexcept>
 
-reina::scene::Instances::Instances(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, const std::vector<reina::scene::Instance>& instances) : instances(instances) {
+reina::scene::Instances::Instances(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, const std::vector<reina::scene::Instance>& instances, const Models& models, bool buildLightBvh)
+        : instances(instances) {
     computeSamplingDataEmissives();
-    createBuffers(logicalDevice, physicalDevice);
-}
-
-static bool compareFloatVectors(const std::vector<float>& vec1, const std::vector<float>& vec2) {
-    const float tolerance = std::numeric_limits<float>::epsilon();
-
-    if (vec1.size() != vec2.size()) {
-        return false;
-    }
-
-    for (size_t i = 0; i < vec1.size(); ++i) {
-        if (std::fabs(vec1[i] - vec2[i]) > tolerance) {
-            return false;
-        }
-    }
-
-    return true;
-}
-
-std::unordered_map<size_t, size_t> reina::scene::Instances::computeEmissiveDuplicates(const std::vector<int>& emissiveInstancesIndices) {
-    // todo: performance in this function may be optimized
-    std::unordered_map<size_t, size_t> duplicateMapping;
-
-    for (size_t idxI = 0; idxI < emissiveInstancesIndices.size(); idxI++) {
-        int i = emissiveInstancesIndices[idxI];
-
-        for (size_t idxJ = idxI + 1; idxJ < emissiveInstancesIndices.size(); idxJ++) {
-            int j = emissiveInstancesIndices[idxJ];
-
-            if (!compareFloatVectors(instances[i].getCDF(), instances[j].getCDF())) {
-                continue;
-            }
-
-            // Only set the canonical index if not already assigned.
-            if (duplicateMapping.find(j) == duplicateMapping.end()) {
-                duplicateMapping[j] = i;
-            }
-        }
+    if (buildLightBvh) {
+        this->buildLightBvh(models);
     }
-
-    return duplicateMapping;
+    createBuffers(logicalDevice, physicalDevice);
 }
 
 void reina::scene::Instances::computeSamplingDataEmissives() {
     if (instances.empty()) {
-        cdfTriangles = {};
+        aliasTriangles = {};
         emissiveInstancesData = {};
     }
 
-    std::vector<int> emissiveInstanceIndices{};
+    emissiveInstanceIndices = {};
     for (int i = 0; i < instances.size(); i++) {
         if (instances[i].isEmissive()) {
             emissiveInstanceIndices.push_back(i);
         }
     }
 
-    std::unordered_map<size_t, size_t> duplicates = computeEmissiveDuplicates(emissiveInstanceIndices);
+    // Instances that share their emissive triangles share their alias table, which is keyed by the first instance that
+    // uses it
+    std::unordered_map<const EmissiveTriangles*, size_t> firstUsers;
 
-    cdfTriangles = std::vector<float>(0);
     emissiveInstancesData = std::vector<InstanceData>(emissiveInstanceIndices.size());
+    std::vector<int> uniqueInstanceIndices;  // whose tables are built; duplicates point at theirs
+    size_t aliasTrianglesSize = 0;
 
     for (int instanceIdxIdx = 0; instanceIdxIdx < emissiveInstanceIndices.size(); instanceIdxIdx++) {
         int instanceIdx = emissiveInstanceIndices[instanceIdxIdx];
-        bool isDuplicate = duplicates.contains(instanceIdxIdx);
-
         const reina::scene::Instance& instance = instances[instanceIdx];
         InstanceData& instanceData = emissiveInstancesData[instanceIdxIdx];
 
         instanceData.transform = instance.getTransform();
         instanceData.materialOffset = instance.getMaterialOffset();
         instanceData.indexOffset = instance.getModelRange().indexOffset;
+        instanceData.vertexOffset = instance.getModelRange().firstVertex;
+        instanceData.indexFlags = instance.getModelRange().indexFlags;
         instanceData.emission = instance.getEmission();
         instanceData.weight = instance.getWeight();
         instanceData.area = instance.getArea();
         instanceData.cullBackface = instance.isCullBackface();
-
-        if (isDuplicate) {
-            const InstanceData& duplicateOf = emissiveInstancesData[duplicates.at(instanceIdx)];
-            instanceData.cdfRangeStart = duplicateOf.cdfRangeStart;
-            instanceData.cdfRangeEnd = duplicateOf.cdfRangeEnd;
+        instanceData.emissionMapTexID = instance.getEmissionMapTexID();
+        instanceData.texIndicesOffset = instance.getModelRange().texIndexOffset;
+        instanceData.texCoordsOffset = instance.getModelRange().firstTexCoord;
+
+        auto [firstUser, isFirst] = firstUsers.try_emplace(instance.getEmissiveTriangles(), instanceIdxIdx);
+        if (!isFirst) {
+            const InstanceData& duplicateOf = emissiveInstancesData[firstUser->second];
+            instanceData.aliasRangeStart = duplicateOf.aliasRangeStart;
+            instanceData.aliasRangeEnd = duplicateOf.aliasRangeEnd;
             continue;
         }
 
-        const std::vector<float>& cdf = instance.getCDF();
-
-        instanceData.cdfRangeStart = cdfTriangles.size();
-        instanceData.cdfRangeEnd = instanceData.cdfRangeStart + cdf.size() - 1;
+        instanceData.aliasRangeStart = aliasTrianglesSize;
+        instanceData.aliasRangeEnd = instanceData.aliasRangeStart + instance.getTriangleProbabilities().size() - 1;
+        aliasTrianglesSize += instance.getTriangleProbabilities().size();
+        uniqueInstanceIndices.push_back(instanceIdxIdx);
+    }
 
-        cdfTriangles.reserve(instance.getCDF().size());
-        cdfTriangles.insert(cdfTriangles.end(), cdf.begin(), cdf.end());
+    // Each instance's table only depends on its own triangles, so they are built in parallel
+    aliasTriangles = std::vector<AliasEntry>(aliasTrianglesSize);
+    reina::tools::ThreadPool::shared().parallelFor(uniqueInstanceIndices.size(), [&](size_t i) {
+        const InstanceData& instanceData = emissiveInstancesData[uniqueInstanceIndices[i]];
+        const std::vector<float>& probabilities = instances[emissiveInstanceIndices[uniqueInstanceIndices[i]]].getTriangleProbabilities();
+        buildAliasTable(probabilities, std::span<AliasEntry>(aliasTriangles).subspan(instanceData.aliasRangeStart, probabilities.size()));
+    });
+
+    std::vector<float> instanceWeights(emissiveInstanceIndices.size());
+    double totalWeight = 0;
+    for (size_t i = 0; i < instanceWeights.size(); i++) {
+        instanceWeights[i] = instances[emissiveInstanceIndices[i]].getWeight();
+        totalWeight += instanceWeights[i];
     }
 
-    cdfInstances = std::vector<float>(emissiveInstanceIndices.size());
+    aliasInstances = std::vector<AliasEntry>(instanceWeights.size());
+    buildAliasTable(instanceWeights, aliasInstances);
+    emissiveInstancesArea = static_cast<float>(totalWeight);
+}
 
-    float cumulativeArea = 0;
-    for (int i = 0; i < cdfInstances.size(); i++) {
-        int instanceIdx = emissiveInstanceIndices[i];
-        cumulativeArea += instances[instanceIdx].getWeight();
-        cdfInstances[i] = cumulativeArea;
+void reina::scene::Instances::buildLightBvh(const Models& models) {
+    std::vector<size_t> firstTriangles(emissiveInstanceIndices.size() + 1, 0);
+    for (size_t i = 0; i < emissiveInstanceIndices.size(); i++) {
+        firstTriangles[i + 1] = firstTriangles[i] + instances[emissiveInstanceIndices[i]].getTriangleProbabilities().size();
     }
 
-    for (float& val : cdfInstances) {
-        val /= cumulativeArea;
-    }
-    emissiveInstancesArea = cumulativeArea;
+    // Each instance's triangles are transformed into world space in parallel
+    std::vector<LightTriangle> triangles(firstTriangles.back());
+    reina::tools::ThreadPool::shared().parallelFor(emissiveInstanceIndices.size(), [&](size_t i) {
+        const Instance& instance = instances[emissiveInstanceIndices[i]];
+        const ModelView model = models.getModelData(instance.getObjectID());
+        const std::vector<float>& probabilities = instance.getTriangleProbabilities();
+
+        auto worldVertex = [&](uint32_t index) {
+            glm::vec4 vertex{model.vertices[index * 3], model.vertices[index * 3 + 1], model.vertices[index * 3 + 2], 1.0f};
+            return glm::vec3(instance.getTransform() * vertex);
+        };
+
+        for (uint32_t triangle = 0; triangle < probabilities.size(); triangle++) {
+            triangles[firstTriangles[i] + triangle] = LightTriangle{
+                    .v0 = worldVertex(model.indices[triangle * 3]),
+                    .v1 = worldVertex(model.indices[triangle * 3 + 1]),
+                    .v2 = worldVertex(model.indices[triangle * 3 + 2]),
+                    .power = instance.getWeight() * probabilities[triangle],
+                    .emissiveInstance = static_cast<uint32_t>(i),
+                    .triangle = triangle,
+                    .twoSided = !instance.isCullBackface()
+            };
+        }
+    });
+
+    lightBvh = LightBvh{triangles};
 }
 
 const std::vector<reina::scene::Instance>& reina::scene::Instances::getInstances() const {
@@ -122,28 +132,31 @@ void reina::scene::Instances::createBuffers(VkDevice logicalDevice, VkPhysicalDe
     VkMemoryAllocateFlags allocFlags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
     VkMemoryPropertyFlags memFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
 
-    if (cdfTriangles.empty()) {
-        throw std::runtime_error("Scene must have at least one emissive object");
+    // Scenes lit only by the environment map have no emissive objects. The buffers get a placeholder entry so they can
+    // still be bound, and the zero total weight tells the shaders not to sample them.
+    if (aliasTriangles.empty()) {
+        aliasTriangles = {AliasEntry{1.0f, 0, 1.0f}};
+        emissiveInstancesData = {InstanceData{}};
     }
 
-    cdfTrianglesBuffer = reina::core::Buffer{
-            logicalDevice, physicalDevice, cdfTriangles,
+    aliasTrianglesBuffer = reina::core::Buffer{
+            logicalDevice, physicalDevice, aliasTriangles,
             usage, allocFlags, memFlags
     };
 
     std::vector<uint8_t> packedBuffer;
 
-    auto count = static_cast<uint32_t>(cdfInstances.size());
+    auto count = static_cast<uint32_t>(aliasInstances.size());
     auto* countPtr = reinterpret_cast<uint8_t*>(&count);
     packedBuffer.insert(packedBuffer.end(), countPtr, countPtr + sizeof(uint32_t));
 
     auto* areaPtr = reinterpret_cast<uint8_t*>(&emissiveInstancesArea);
     packedBuffer.insert(packedBuffer.end(), areaPtr, areaPtr + sizeof(float));
 
-    auto* cdfDataPtr = reinterpret_cast<uint8_t*>(cdfInstances.data());
-    packedBuffer.insert(packedBuffer.end(), cdfDataPtr, cdfDataPtr + cdfInstances.size() * sizeof(float));
+    auto* aliasDataPtr = reinterpret_cast<uint8_t*>(aliasInstances.data());
+    packedBuffer.insert(packedBuffer.end(), aliasDataPtr, aliasDataPtr + aliasInstances.size() * sizeof(AliasEntry));
 
-    cdfInstancesBuffer = reina::core::Buffer{
+    aliasInstancesBuffer = reina::core::Buffer{
         logicalDevice, physicalDevice, packedBuffer,
         usage, allocFlags, memFlags
     };
@@ -152,26 +165,46 @@ void reina::scene::Instances::createBuffers(VkDevice logicalDevice, VkPhysicalDe
         logicalDevice, physicalDevice, emissiveInstancesData,
         usage, allocFlags, memFlags
     };
+
+    // Like the other buffers, an empty light BVH is bound with a placeholder node. The shaders only read it when the
+    // light BVH is enabled and there are emissive instances.
+    std::vector<LightBvhNode> lightBvhNodes = lightBvh.getNodes();
+    if (lightBvhNodes.empty()) {
+        lightBvhNodes = {LightBvhNode{}};
+    }
+    lightBvhBuffer = reina::core::Buffer{
+        logicalDevice, physicalDevice, lightBvhNodes,
+        usage, allocFlags, memFlags
+    };
 }
 
 void reina::scene::Instances::destroy(VkDevice logicalDevice) {
-    cdfTrianglesBuffer.destroy(logicalDevice);
+    aliasTrianglesBuffer.destroy(logicalDevice);
     emissiveMetadataBuffer.destroy(logicalDevice);
-    cdfInstancesBuffer.destroy(logicalDevice);
+    aliasInstancesBuffer.destroy(logicalDevice);
+    lightBvhBuffer.destroy(logicalDevice);
 }
 
 const reina::core::Buffer& reina::scene::Instances::getEmissiveMetadataBuffer() const {
     return emissiveMetadataBuffer;
 }
 
-const reina::core::Buffer& reina::scene::Instances::getCdfTrianglesBuffer() const {
-    return cdfTrianglesBuffer;
+const reina::core::Buffer& reina::scene::Instances::getAliasTrianglesBuffer() const {
+    return aliasTrianglesBuffer;
 }
 
-const reina::core::Buffer& reina::scene::Instances::getCdfInstancesBuffer() const {
-    return cdfInstancesBuffer;
+const reina::core::Buffer& reina::scene::Instances::getAliasInstancesBuffer() const {
+    return aliasInstancesBuffer;
 }
 
 float reina::scene::Instances::getEmissiveInstancesWeight() const {
     return emissiveInstancesArea;
 }
+
+const reina::core::Buffer& reina::scene::Instances::getLightBvhBuffer() const {
+    return lightBvhBuffer;
+}
+
+const reina::scene::LightBvh& reina::scene::Instances::getLightBvh() const {
+    return lightBvh;
+}
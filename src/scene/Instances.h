@@ -2,8 +2,11 @@
 #define REINA_VK_INSTANCES_H
 
 #include "Instance.h"
+#include "LightBvh.h"
+#include "Models.h"
 
 #include "../core/Buffer.h"
+#include "../../polyglot/raytrace.h"
 
 #include <map>
 #include <optional>
@@ -16,60 +19,76 @@ namespace reina::scene {
         // todo: put this in a polyglot file
         glm::mat4x4 transform;
         uint32_t materialOffset;
-        uint32_t cdfRangeStart;
-        uint32_t cdfRangeEnd;
+        uint32_t aliasRangeStart;  // of the instance's triangles in the triangle alias table
+        uint32_t aliasRangeEnd;  // inclusive
         uint32_t indexOffset;
         glm::vec3 emission;
         float weight;
         float area;
         bool cullBackface;
-        glm::vec2 padding;
+        uint32_t vertexOffset;
+        uint32_t indexFlags;
+        int emissionMapTexID;  // -1 without an emission map
+        uint32_t texIndicesOffset;  // -1 without tex coords
+        uint32_t texCoordsOffset;
+        uint32_t padding;  // keeps the size a multiple of 16, which the shaders read it with
     };
 
     class Instances {
     public:
         Instances() = default;
-        explicit Instances(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, const std::vector<reina::scene::Instance>& instances);
+        /**
+         * @param models The models of the instances, whose geometry the light BVH is built over
+         * @param buildLightBvh Whether to build the light BVH. Without it, the light BVH buffer holds a placeholder.
+         */
+        Instances(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, const std::vector<reina::scene::Instance>& instances, const Models& models, bool buildLightBvh);
 
         [[nodiscard]] const std::vector<reina::scene::Instance>& getInstances() const;
 
         [[nodiscard]] const reina::core::Buffer& getEmissiveMetadataBuffer() const;
-        [[nodiscard]] const reina::core::Buffer& getCdfTrianglesBuffer() const;
-        [[nodiscard]] const reina::core::Buffer& getCdfInstancesBuffer() const;
+        [[nodiscard]] const reina::core::Buffer& getAliasTrianglesBuffer() const;
+        [[nodiscard]] const reina::core::Buffer& getAliasInstancesBuffer() const;
+        [[nodiscard]] const reina::core::Buffer& getLightBvhBuffer() const;
+        [[nodiscard]] const LightBvh& getLightBvh() const;
         [[nodiscard]] float getEmissiveInstancesWeight() const;
 
         void destroy(VkDevice logicalDevice);
 
     private:
         /**
-         * @return Pairs of duplicates in the instances vector. Larger index is always the key.
-         */
-        std::unordered_map<size_t, size_t> computeEmissiveDuplicates(const std::vector<int>& emissiveInstancesIndices);
-
-        /**
-         * Constructs the buffers given the initialized cdfTriangles and emissiveInstancesData member variables
+         * Constructs the buffers given the initialized aliasTriangles and emissiveInstancesData member variables
          */
         void createBuffers(VkDevice logicalDevice, VkPhysicalDevice physicalDevice);
 
         /**
          * Does the following:
-         * - Analyzes all instances and puts their CDFs in the cdfTriangles vector
+         * - Analyzes all instances and builds alias tables of their triangles in the aliasTriangles vector
+         * - Builds the alias table of the emissive instances in aliasInstances
          * - Populates emissiveInstancesData
-         * - Removes any duplicate data and has the InstanceData.cdfRangeStart and InstanceData.cdfRangeEnd point to
-         *    the correct place.
+         * - Builds one table for the instances that share their EmissiveTriangles and has the
+         *    InstanceData.aliasRangeStart and InstanceData.aliasRangeEnd of each point to the correct place.
          */
         void computeSamplingDataEmissives();
 
+        /**
+         * Builds the light BVH over the triangles of the emissive instances in world space. Must be called after
+         * computeSamplingDataEmissives.
+         */
+        void buildLightBvh(const Models& models);
+
         float emissiveInstancesArea = 0;
 
         std::vector<reina::scene::Instance> instances;
-        std::vector<float> cdfTriangles;
-        std::vector<float> cdfInstances;
+        std::vector<AliasEntry> aliasTriangles;
+        std::vector<AliasEntry> aliasInstances;
         std::vector<InstanceData> emissiveInstancesData;
+        std::vector<int> emissiveInstanceIndices;  // into instances, of each entry of emissiveInstancesData
+        LightBvh lightBvh;
 
         reina::core::Buffer emissiveMetadataBuffer;
-        reina::core::Buffer cdfTrianglesBuffer;
-        reina::core::Buffer cdfInstancesBuffer;
+        reina::core::Buffer aliasTrianglesBuffer;
+        reina::core::Buffer aliasInstancesBuffer;
+        reina::core::Buffer lightBvhBuffer;
     };
 }
 
@@ -0,0 +1,370 @@
+#include "LightBvh.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <glm/glm.hpp>
+
+#include "../tools/ThreadPool.h"
+
+namespace {
+    constexpr float PI = 3.14159265358979f;
+    constexpr int BINS = 12;
+    constexpr size_t PARALLEL_BUILD_TRIANGLES = 16384;  // subtrees at least this large build their children in parallel
+
+    float safeSqrt(float x) {
+        return std::sqrt(std::max(x, 0.0f));
+    }
+
+    float safeAcos(float x) {
+        return std::acos(std::clamp(x, -1.0f, 1.0f));
+    }
+
+    // cos(a - b), or 1 if a < b
+    float cosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+        return cosA > cosB ? 1.0f : cosA * cosB + sinA * sinB;
+    }
+
+    // sin(a - b), or 0 if a < b
+    float sinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+        return cosA > cosB ? 0.0f : sinA * cosB - cosA * sinB;
+    }
+
+    /**
+     * The part of a LightBvhNode that is merged while building
+     */
+    struct LightBounds {
+        glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::infinity());
+        glm::vec3 boundsMax = glm::vec3(-std::numeric_limits<float>::infinity());
+        glm::vec3 axis = glm::vec3(0.0f);
+        float cosThetaO = 1.0f;
+        float cosThetaE = 1.0f;
+        float power = 0.0f;
+        bool twoSided = false;
+        bool empty = true;
+
+        LightBounds() = default;
+
+        explicit LightBounds(const reina::scene::LightTriangle& triangle)
+                : boundsMin(glm::min(glm::min(triangle.v0, triangle.v1), triangle.v2)),
+                  boundsMax(glm::max(glm::max(triangle.v0, triangle.v1), triangle.v2)),
+                  axis(glm::normalize(glm::cross(triangle.v1 - triangle.v0, triangle.v2 - triangle.v0))),
+                  cosThetaO(1.0f), cosThetaE(0.0f),  // diffuse emitters light the whole hemisphere around the normal
+                  power(triangle.power), twoSided(triangle.twoSided), empty(false) {}
+
+        void merge(const LightBounds& other) {
+            if (other.empty) {
+                return;
+            }
+            if (empty) {
+                *this = other;
+                return;
+            }
+
+            boundsMin = glm::min(boundsMin, other.boundsMin);
+            boundsMax = glm::max(boundsMax, other.boundsMax);
+            mergeCone(other.axis, other.cosThetaO);
+            cosThetaE = std::min(cosThetaE, other.cosThetaE);
+            power += other.power;
+            twoSided = twoSided || other.twoSided;
+        }
+
+        // The smallest cone around both cones, which is the whole sphere if they point apart
+        void mergeCone(glm::vec3 otherAxis, float otherCosTheta) {
+            float thetaA = safeAcos(cosThetaO);
+            float thetaB = safeAcos(otherCosTheta);
+            float thetaD = safeAcos(glm::dot(axis, otherAxis));
+
+            if (std::min(thetaD + thetaB, PI) <= thetaA) {
+                return;
+            }
+            if (std::min(thetaD + thetaA, PI) <= thetaB) {
+                axis = otherAxis;
+                cosThetaO = otherCosTheta;
+                return;
+            }
+
+            float thetaO = (thetaA + thetaD + thetaB) / 2;
+            glm::vec3 rotationAxis = glm::cross(axis, otherAxis);
+            if (thetaO >= PI || glm::dot(rotationAxis, rotationAxis) == 0.0f) {
+                cosThetaO = -1.0f;
+                return;
+            }
+
+            // Rotate the axis toward the other one by the difference between the angles, with Rodrigues' formula
+            float thetaR = thetaO - thetaA;
+            glm::vec3 k = glm::normalize(rotationAxis);
+            axis = glm::normalize(axis * std::cos(thetaR) + glm::cross(k, axis) * std::sin(thetaR));
+            cosThetaO = std::cos(thetaO);
+        }
+
+        [[nodiscard]] float surfaceArea() const {
+            glm::vec3 d = boundsMax - boundsMin;
+            return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+        }
+
+        /**
+         * Cost of a child with the surface area orientation heuristic, from the power, the solid angle the emission
+         * spreads over and the surface area
+         */
+        [[nodiscard]] float cost(glm::vec3 parentExtent, int axisIndex) const {
+            float thetaO = safeAcos(cosThetaO);
+            float thetaE = safeAcos(cosThetaE);
+            float thetaW = std::min(thetaO + thetaE, PI);
+            float sinThetaO = safeSqrt(1.0f - cosThetaO * cosThetaO);
+            float solidAngle = 2.0f * PI * (1.0f - cosThetaO)
+                    + PI / 2.0f * (2.0f * thetaW * sinThetaO - std::cos(thetaO - 2.0f * thetaW) - 2.0f * thetaO * sinThetaO + cosThetaO);
+
+            // Splits across thin extents are penalized, since they would make long, thin children
+            float maxExtent = std::max({parentExtent.x, parentExtent.y, parentExtent.z});
+            float regularization = parentExtent[axisIndex] > 0.0f ? maxExtent / parentExtent[axisIndex] : 1.0f;
+            return power * solidAngle * regularization * surfaceArea();
+        }
+
+        [[nodiscard]] LightBvhNode toNode() const {
+            return LightBvhNode{
+                    .boundsMin = boundsMin,
+                    .power = power,
+                    .boundsMax = boundsMax,
+                    .cosThetaO = cosThetaO,
+                    .axis = axis,
+                    .cosThetaE = cosThetaE,
+                    .secondChild = 0,
+                    .triangle = LIGHT_BVH_INTERIOR,
+                    .twoSided = twoSided ? 1u : 0u
+            };
+        }
+    };
+
+    struct BuildTriangle {
+        LightBounds bounds;
+        glm::vec3 centroid;
+        uint32_t emissiveInstance;
+        uint32_t triangle;
+    };
+
+    /**
+     * Builds the subtree over the triangles into nodes, starting at nodeIndex. A subtree over n triangles takes 2n - 1
+     * nodes, so where each child goes is known before it is built.
+     */
+    void buildSubtree(std::span<BuildTriangle> triangles, std::vector<LightBvhNode>& nodes, size_t nodeIndex) {
+        if (triangles.size() == 1) {
+            LightBvhNode leaf = triangles[0].bounds.toNode();
+            leaf.secondChild = triangles[0].emissiveInstance;
+            leaf.triangle = triangles[0].triangle;
+            nodes[nodeIndex] = leaf;
+            return;
+        }
+
+        LightBounds total;
+        glm::vec3 centroidMin{std::numeric_limits<float>::infinity()};
+        glm::vec3 centroidMax{-std::numeric_limits<float>::infinity()};
+        for (const BuildTriangle& triangle : triangles) {
+            total.merge(triangle.bounds);
+            centroidMin = glm::min(centroidMin, triangle.centroid);
+            centroidMax = glm::max(centroidMax, triangle.centroid);
+        }
+
+        // Bin the centroids along each axis and pick the cheapest split between bins
+        float bestCost = std::numeric_limits<float>::infinity();
+        int bestAxis = -1;
+        int bestSplit = 0;
+        glm::vec3 extent = total.boundsMax - total.boundsMin;
+        for (int axisIndex = 0; axisIndex < 3; axisIndex++) {
+            float centroidExtent = centroidMax[axisIndex] - centroidMin[axisIndex];
+            if (centroidExtent <= 0.0f) {
+                continue;
+            }
+
+            std::array<LightBounds, BINS> bins;
+            for (const BuildTriangle& triangle : triangles) {
+                int bin = std::min(static_cast<int>(BINS * (triangle.centroid[axisIndex] - centroidMin[axisIndex]) / centroidExtent), BINS - 1);
+                bins[bin].merge(triangle.bounds);
+            }
+
+            std::array<float, BINS - 1> belowCosts{};
+            LightBounds below;
+            for (int split = 0; split < BINS - 1; split++) {
+                below.merge(bins[split]);
+                belowCosts[split] = below.empty ? 0.0f : below.cost(extent, axisIndex);
+            }
+
+            LightBounds above;
+            for (int split = BINS - 2; split >= 0; split--) {
+                above.merge(bins[split + 1]);
+                float cost = belowCosts[split] + (above.empty ? 0.0f : above.cost(extent, axisIndex));
+                if (cost < bestCost && !below.empty && !above.empty) {
+                    bestCost = cost;
+                    bestAxis = axisIndex;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        size_t middle;
+        if (bestAxis >= 0) {
+            float centroidExtent = centroidMax[bestAxis] - centroidMin[bestAxis];
+            auto above = std::partition(triangles.begin(), triangles.end(), [&](const BuildTriangle& triangle) {
+                int bin = std::min(static_cast<int>(BINS * (triangle.centroid[bestAxis] - centroidMin[bestAxis]) / centroidExtent), BINS - 1);
+                return bin <= bestSplit;
+            });
+            middle = above - triangles.begin();
+        } else {
+            middle = 0;
+        }
+
+        // Triangles with the same centroid, or bins that only fill one side, are split in half by count
+        if (middle == 0 || middle == triangles.size()) {
+            middle = triangles.size() / 2;
+        }
+
+        nodes[nodeIndex] = total.toNode();
+        size_t firstChild = nodeIndex + 1;
+        size_t secondChild = nodeIndex + 2 * middle;
+        nodes[nodeIndex].secondChild = static_cast<uint32_t>(secondChild);
+
+        std::span<BuildTriangle> firstTriangles = triangles.subspan(0, middle);
+        std::span<BuildTriangle> secondTriangles = triangles.subspan(middle);
+        if (triangles.size() >= PARALLEL_BUILD_TRIANGLES) {
+            reina::tools::ThreadPool::shared().parallelFor(2, [&](size_t child) {
+                if (child == 0) {
+                    buildSubtree(firstTriangles, nodes, firstChild);
+                } else {
+                    buildSubtree(secondTriangles, nodes, secondChild);
+                }
+            });
+        } else {
+            buildSubtree(firstTriangles, nodes, firstChild);
+            buildSubtree(secondTriangles, nodes, secondChild);
+        }
+    }
+}
+
+reina::scene::LightBvh::LightBvh(std::span<const LightTriangle> triangles) {
+    std::vector<BuildTriangle> buildTriangles;
+    buildTriangles.reserve(triangles.size());
+    for (const LightTriangle& triangle : triangles) {
+        if (triangle.power <= 0.0f) {
+            continue;
+        }
+
+        buildTriangles.push_back(BuildTriangle{
+                .bounds = LightBounds{triangle},
+                .centroid = (triangle.v0 + triangle.v1 + triangle.v2) / 3.0f,
+                .emissiveInstance = triangle.emissiveInstance,
+                .triangle = triangle.triangle
+        });
+    }
+
+    if (buildTriangles.empty()) {
+        return;
+    }
+
+    nodes = std::vector<LightBvhNode>(2 * buildTriangles.size() - 1);
+    buildSubtree(buildTriangles, nodes, 0);
+}
+
+const std::vector<LightBvhNode>& reina::scene::LightBvh::getNodes() const {
+    return nodes;
+}
+
+float reina::scene::LightBvh::importance(const LightBvhNode& node, glm::vec3 p, glm::vec3 n) {
+    glm::vec3 center = (node.boundsMin + node.boundsMax) / 2.0f;
+    glm::vec3 toPoint = p - center;
+    float centerDistanceSquared = glm::dot(toPoint, toPoint);
+    // Inside or close to the bounds, the distance is clamped so the importance doesn't blow up
+    float distanceSquared = std::max(centerDistanceSquared, glm::length(node.boundsMax - node.boundsMin) / 2.0f);
+
+    // Angle from the cone's axis to the point, less the cone's own angle
+    glm::vec3 wi = centerDistanceSquared > 0.0f ? glm::normalize(toPoint) : glm::vec3(0.0f);
+    float cosThetaW = glm::dot(node.axis, wi);
+    if (node.twoSided != 0u) {
+        cosThetaW = std::abs(cosThetaW);
+    }
+    float sinThetaW = safeSqrt(1.0f - cosThetaW * cosThetaW);
+
+    // Angle the bounds subtend from the point, which the angles are also reduced by
+    float cosThetaB = -1.0f;
+    float radiusSquared = glm::dot(node.boundsMax - center, node.boundsMax - center);
+    bool inside = glm::all(glm::greaterThanEqual(p, node.boundsMin)) && glm::all(glm::lessThanEqual(p, node.boundsMax));
+    if (!inside && centerDistanceSquared > radiusSquared) {
+        cosThetaB = safeSqrt(1.0f - radiusSquared / centerDistanceSquared);
+    }
+    float sinThetaB = safeSqrt(1.0f - cosThetaB * cosThetaB);
+
+    float sinThetaO = safeSqrt(1.0f - node.cosThetaO * node.cosThetaO);
+    float cosThetaX = cosSubClamped(sinThetaW, cosThetaW, sinThetaO, node.cosThetaO);
+    float sinThetaX = sinSubClamped(sinThetaW, cosThetaW, sinThetaO, node.cosThetaO);
+    float cosThetaP = cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+    if (cosThetaP <= node.cosThetaE) {
+        return 0.0f;
+    }
+
+    float importance = node.power * cosThetaP / distanceSquared;
+
+    if (glm::dot(n, n) > 0.0f) {
+        float cosThetaI = std::abs(glm::dot(wi, n));
+        float sinThetaI = safeSqrt(1.0f - cosThetaI * cosThetaI);
+        importance *= cosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+    }
+
+    return std::max(importance, 0.0f);
+}
+
+std::optional<reina::scene::LightBvhSample> reina::scene::LightBvh::sample(glm::vec3 p, glm::vec3 n, float u) const {
+    if (nodes.empty() || importance(nodes[0], p, n) <= 0.0f) {
+        return std::nullopt;
+    }
+
+    uint32_t node = 0;
+    float pmf = 1.0f;
+    while (nodes[node].triangle == LIGHT_BVH_INTERIOR) {
+        float firstImportance = importance(nodes[node + 1], p, n);
+        float secondImportance = importance(nodes[nodes[node].secondChild], p, n);
+        if (firstImportance <= 0.0f && secondImportance <= 0.0f) {
+            return std::nullopt;
+        }
+
+        float firstProbability = firstImportance / (firstImportance + secondImportance);
+        if (u < firstProbability) {
+            u = std::min(u / firstProbability, 0x1.fffffep-1f);
+            pmf *= firstProbability;
+            node = node + 1;
+        } else {
+            u = std::min((u - firstProbability) / (1.0f - firstProbability), 0x1.fffffep-1f);
+            pmf *= 1.0f - firstProbability;
+            node = nodes[node].secondChild;
+        }
+    }
+
+    return LightBvhSample{node, nodes[node].secondChild, nodes[node].triangle, pmf};
+}
+
+float reina::scene::LightBvh::pmf(glm::vec3 p, glm::vec3 n, uint32_t leaf) const {
+    // Interior nodes are passed through, never picked
+    if (leaf >= nodes.size() || nodes[leaf].triangle == LIGHT_BVH_INTERIOR || importance(nodes[0], p, n) <= 0.0f) {
+        return 0.0f;
+    }
+
+    uint32_t node = 0;
+    float pmf = 1.0f;
+    while (node != leaf) {
+        if (nodes[node].triangle != LIGHT_BVH_INTERIOR) {
+            return 0.0f;
+        }
+
+        float firstImportance = importance(nodes[node + 1], p, n);
+        float secondImportance = importance(nodes[nodes[node].secondChild], p, n);
+        if (firstImportance <= 0.0f && secondImportance <= 0.0f) {
+            return 0.0f;
+        }
+
+        // The leaves under the first child are the nodes before the second child
+        bool inFirst = leaf < nodes[node].secondChild;
+        pmf *= (inFirst ? firstImportance : secondImportance) / (firstImportance + secondImportance);
+        node = inFirst ? node + 1 : nodes[node].secondChild;
+    }
+
+    return pmf;
+}
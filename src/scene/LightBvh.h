@@ -0,0 +1,77 @@
+#ifndef REINA_VK_LIGHTBVH_H
+#define REINA_VK_LIGHTBVH_H
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+#include <glm/vec3.hpp>
+
+#include "../../polyglot/raytrace.h"
+
+namespace reina::scene {
+    /**
+     * An emissive triangle in world space
+     */
+    struct LightTriangle {
+        glm::vec3 v0;
+        glm::vec3 v1;
+        glm::vec3 v2;
+        float power;  // the instance's weight times the triangle's probability within it
+        uint32_t emissiveInstance;  // index into the emissive instances
+        uint32_t triangle;  // index into the instance's triangles
+        bool twoSided;
+    };
+
+    struct LightBvhSample {
+        uint32_t leaf;  // node index
+        uint32_t emissiveInstance;
+        uint32_t triangle;
+        float pmf;  // of picking this leaf at the shading point
+    };
+
+    /**
+     * A bounding volume hierarchy over the emissive triangles that picks one by its estimated contribution at a shading
+     * point instead of by power alone (Conty Estevez and Kulla 2018, "Importance Sampling of Many Lights with Adaptive
+     * Tree Splitting"). Each node bounds the positions, the normals as a cone and the power of the triangles under it.
+     *
+     * Nodes are stored depth first with one triangle per leaf, so a node's first child directly follows it and the
+     * leaves under a node are the indices before its second child.
+     */
+    class LightBvh {
+    public:
+        LightBvh() = default;
+
+        /**
+         * Builds the tree with the surface area orientation heuristic. Triangles without power are left out.
+         */
+        explicit LightBvh(std::span<const LightTriangle> triangles);
+
+        [[nodiscard]] const std::vector<LightBvhNode>& getNodes() const;
+
+        /**
+         * The CPU reference of pickLightBvhTriangle in nee.h.glsl. Walks down from the root and picks each child with
+         * probability proportional to its importance, reusing u for the next level after rescaling it.
+         * @param p The shading point
+         * @param n The shading normal, or zero to not bound the cosine at the shading point
+         * @param u A uniform random number in [0, 1)
+         * @return std::nullopt if no triangle is important at the point
+         */
+        [[nodiscard]] std::optional<LightBvhSample> sample(glm::vec3 p, glm::vec3 n, float u) const;
+
+        /**
+         * @return The probability that sample picks the leaf at the point
+         */
+        [[nodiscard]] float pmf(glm::vec3 p, glm::vec3 n, uint32_t leaf) const;
+
+        /**
+         * Conservative estimate of the light from the triangles under a node reaching the point, up to a constant
+         */
+        [[nodiscard]] static float importance(const LightBvhNode& node, glm::vec3 p, glm::vec3 n);
+
+    private:
+        std::vector<LightBvhNode> nodes;
+    };
+}
+
+#endif //REINA_VK_LIGHTBVH_H
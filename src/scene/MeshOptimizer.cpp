@@ -0,0 +1,263 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+#include "../tools/Hash.h"
+#include "../tools/ThreadPool.h"
+
+namespace {
+    constexpr uint32_t NO_ENTRY = std::numeric_limits<uint32_t>::max();
+    constexpr size_t FIFO_CACHE_SIZE = 32;
+    constexpr size_t POSITION_STRIDE = 3 * sizeof(float);
+    constexpr size_t CACHE_LINE_SIZE = 64;
+    constexpr uint32_t MORTON_BITS = 10;
+
+    struct FifoCache {
+        uint32_t entries[FIFO_CACHE_SIZE];
+        size_t head = 0;
+
+        FifoCache() {
+            std::fill(std::begin(entries), std::end(entries), NO_ENTRY);
+        }
+
+        // Returns true on a hit, and inserts the key on a miss
+        bool access(uint32_t key) {
+            if (std::find(std::begin(entries), std::end(entries), key) != std::end(entries)) {
+                return true;
+            }
+
+            entries[head] = key;
+            head = (head + 1) % FIFO_CACHE_SIZE;
+            return false;
+        }
+    };
+
+    /**
+     * A stream of fixed size elements, e.g. the positions of a model. A vertex may be made of several streams that are
+     * welded together.
+     */
+    struct Attribute {
+        const std::byte* data;
+        size_t elementSize;
+
+        [[nodiscard]] const std::byte* element(uint32_t i) const {
+            return data + static_cast<size_t>(i) * elementSize;
+        }
+    };
+
+    template<typename T>
+    Attribute makeAttribute(std::span<const T> data, size_t componentsPerElement) {
+        return Attribute{reinterpret_cast<const std::byte*>(data.data()), componentsPerElement * sizeof(T)};
+    }
+
+    /**
+     * Maps every element to the first element that is bitwise identical to it across all attributes
+     * @param count The number of elements
+     * @param attributes The streams the elements are made of
+     * @return The remap
+     */
+    std::vector<uint32_t> weld(size_t count, std::span<const Attribute> attributes) {
+        std::vector<uint32_t> remap(count);
+
+        // Open addressing with linear probing; the table is at least twice as large as the element count
+        size_t tableSize = std::bit_ceil(std::max<size_t>(count * 2, 16));
+        std::vector<uint32_t> table(tableSize, NO_ENTRY);
+
+        for (uint32_t i = 0; i < count; i++) {
+            uint64_t hash = 0;
+            for (const Attribute& attribute : attributes) {
+                hash = reina::tools::hashCombine(hash, reina::tools::hash64(attribute.element(i), attribute.elementSize));
+            }
+
+            size_t slot = hash & (tableSize - 1);
+            while (true) {
+                uint32_t existing = table[slot];
+                if (existing == NO_ENTRY) {
+                    table[slot] = i;
+                    remap[i] = i;
+                    break;
+                }
+
+                bool equal = std::ranges::all_of(attributes, [&](const Attribute& attribute) {
+                    return std::memcmp(attribute.element(i), attribute.element(existing), attribute.elementSize) == 0;
+                });
+                if (equal) {
+                    remap[i] = existing;
+                    break;
+                }
+
+                slot = (slot + 1) & (tableSize - 1);
+            }
+        }
+
+        return remap;
+    }
+
+    uint32_t expandBits(uint32_t v) {
+        v = (v * 0x00010001u) & 0xFF0000FFu;
+        v = (v * 0x00000101u) & 0x0F00F00Fu;
+        v = (v * 0x00000011u) & 0xC30C30C3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    }
+
+    /**
+     * @return The triangles sorted along a Morton curve through their centroids
+     */
+    std::vector<uint32_t> mortonTriangleOrder(std::span<const float> positions, std::span<const uint32_t> indices) {
+        size_t triangleCount = indices.size() / 3;
+
+        auto position = [&](uint32_t i) {
+            return glm::vec3(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+        };
+
+        glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+        for (uint32_t idx : indices) {
+            boundsMin = glm::min(boundsMin, position(idx));
+            boundsMax = glm::max(boundsMax, position(idx));
+        }
+
+        glm::vec3 extent = boundsMax - boundsMin;
+        float scale = static_cast<float>((1u << MORTON_BITS) - 1) / std::max({extent.x, extent.y, extent.z, 1e-20f});
+
+        std::vector<uint32_t> codes(triangleCount);
+        reina::tools::ThreadPool::shared().parallelFor(triangleCount, [&](size_t tri) {
+            glm::vec3 centroid = (position(indices[tri * 3]) + position(indices[tri * 3 + 1]) + position(indices[tri * 3 + 2])) / 3.0f;
+            glm::vec3 cell = (centroid - boundsMin) * scale;
+            codes[tri] = (expandBits(static_cast<uint32_t>(cell.x)) << 2)
+                         | (expandBits(static_cast<uint32_t>(cell.y)) << 1)
+                         | expandBits(static_cast<uint32_t>(cell.z));
+        }, 4096);
+
+        std::vector<uint32_t> order(triangleCount);
+        std::iota(order.begin(), order.end(), 0u);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return codes[a] < codes[b]; });
+        return order;
+    }
+
+    /**
+     * Writes a stream's indices in the new triangle order, renumbering the elements by first use and copying the used
+     * elements into out. If the stream has no data, the indices are only reordered.
+     */
+    template<typename T>
+    void compactStream(std::span<const uint32_t> triangleOrder, std::span<const uint32_t> indices, const std::vector<uint32_t>& remap,
+                       std::span<const T> data, size_t componentsPerElement, std::vector<T>& out, std::vector<uint32_t>& outIndices) {
+        // A stream that isn't indexed per triangle corner can't be reordered with the triangles
+        if (indices.size() != triangleOrder.size() * 3) {
+            outIndices.assign(indices.begin(), indices.end());
+            out.assign(data.begin(), data.end());
+            return;
+        }
+
+        outIndices.resize(triangleOrder.size() * 3);
+
+        if (data.empty()) {
+            for (size_t tri = 0; tri < triangleOrder.size(); tri++) {
+                std::copy_n(indices.begin() + triangleOrder[tri] * 3, 3, outIndices.begin() + tri * 3);
+            }
+            return;
+        }
+
+        std::vector<uint32_t> newIndex(data.size() / componentsPerElement, NO_ENTRY);
+        out.clear();
+        out.reserve(data.size());
+
+        for (size_t tri = 0; tri < triangleOrder.size(); tri++) {
+            for (size_t corner = 0; corner < 3; corner++) {
+                uint32_t element = remap[indices[triangleOrder[tri] * 3 + corner]];
+                if (newIndex[element] == NO_ENTRY) {
+                    newIndex[element] = static_cast<uint32_t>(out.size() / componentsPerElement);
+                    auto first = data.begin() + static_cast<size_t>(element) * componentsPerElement;
+                    out.insert(out.end(), first, first + componentsPerElement);
+                }
+                outIndices[tri * 3 + corner] = newIndex[element];
+            }
+        }
+
+        out.shrink_to_fit();
+    }
+}
+
+reina::scene::MeshLocality reina::scene::measureLocality(std::span<const uint32_t> indices) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return MeshLocality{0, 0};
+    }
+
+    // Two FIFO caches: one of vertices, and one of the cache lines the float3 positions of those vertices live in
+    FifoCache vertexCache;
+    FifoCache lineCache;
+    size_t vertexMisses = 0;
+    size_t lineMisses = 0;
+
+    for (uint32_t idx : indices) {
+        vertexMisses += vertexCache.access(idx) ? 0 : 1;
+        lineMisses += lineCache.access(static_cast<uint32_t>(idx * POSITION_STRIDE / CACHE_LINE_SIZE)) ? 0 : 1;
+    }
+
+    return MeshLocality{
+            .acmr = static_cast<double>(vertexMisses) / static_cast<double>(triangleCount),
+            .positionLinesPerTriangle = static_cast<double>(lineMisses) / static_cast<double>(triangleCount)
+    };
+}
+
+reina::scene::ModelData reina::scene::optimizeMesh(const reina::scene::ModelView& model, reina::scene::MeshOptimizeStats& stats) {
+    size_t vertexCount = model.vertices.size() / 3;
+    bool hasTBNs = !model.tbns.empty();
+    bool hasTexCoords = !model.texCoords.empty();
+
+    // Whole vertices can only be welded if every stream is indexed the same way and has one element per vertex
+    bool sharedTopology = std::ranges::equal(model.tbnsIndices, model.indices)
+                          && (!hasTexCoords || std::ranges::equal(model.texIndices, model.indices))
+                          && (!hasTBNs || model.tbns.size() == vertexCount)
+                          && (!hasTexCoords || model.texCoords.size() / 2 == vertexCount);
+
+    stats.verticesBefore = vertexCount;
+    stats.before = measureLocality(model.indices);
+
+    Attribute positions = makeAttribute(model.vertices, 3);
+    Attribute tbns = makeAttribute(model.tbns, 1);
+    Attribute texCoords = makeAttribute(model.texCoords, 2);
+
+    std::vector<uint32_t> triangleOrder = mortonTriangleOrder(model.vertices, model.indices);
+
+    ModelData result;
+    if (sharedTopology) {
+        std::vector<Attribute> attributes{positions};
+        if (hasTBNs) {
+            attributes.push_back(tbns);
+        }
+        if (hasTexCoords) {
+            attributes.push_back(texCoords);
+        }
+
+        std::vector<uint32_t> remap = weld(vertexCount, attributes);
+
+        // The remap and index order are the same for every stream, so each one compacts identically
+        std::vector<uint32_t> unused;
+        compactStream(triangleOrder, model.indices, remap, model.vertices, 3, result.vertices, result.indices);
+        compactStream(triangleOrder, model.indices, remap, model.tbns, 1, result.tbns, unused);
+        compactStream(triangleOrder, model.indices, remap, model.texCoords, 2, result.texCoords, unused);
+
+        result.tbnsIndices = result.indices;
+        result.texIndices = result.indices;
+    } else {
+        std::vector<uint32_t> positionRemap = weld(vertexCount, std::span<const Attribute>(&positions, 1));
+        std::vector<uint32_t> tbnRemap = hasTBNs ? weld(model.tbns.size(), std::span<const Attribute>(&tbns, 1)) : std::vector<uint32_t>{};
+        std::vector<uint32_t> texCoordRemap = hasTexCoords ? weld(model.texCoords.size() / 2, std::span<const Attribute>(&texCoords, 1)) : std::vector<uint32_t>{};
+
+        compactStream(triangleOrder, model.indices, positionRemap, model.vertices, 3, result.vertices, result.indices);
+        compactStream(triangleOrder, model.tbnsIndices, tbnRemap, model.tbns, 1, result.tbns, result.tbnsIndices);
+        compactStream(triangleOrder, model.texIndices, texCoordRemap, model.texCoords, 2, result.texCoords, result.texIndices);
+    }
+
+    stats.verticesAfter = result.vertices.size() / 3;
+    stats.after = measureLocality(result.indices);
+
+    return result;
+}
@@ -0,0 +1,44 @@
+#ifndef REINA_VK_MESHOPTIMIZER_H
+#define REINA_VK_MESHOPTIMIZER_H
+
+#include <cstddef>
+#include <span>
+
+#include "ModelData.h"
+
+namespace reina::scene {
+    // Lower is better for both
+    struct MeshLocality {
+        double acmr;                      // vertices fetched per triangle through a 32 entry FIFO cache
+        double positionLinesPerTriangle;  // 64-byte lines of vertices[] fetched per triangle through a 32 line FIFO cache
+    };
+
+    struct MeshOptimizeStats {
+        size_t verticesBefore;
+        size_t verticesAfter;
+        MeshLocality before;
+        MeshLocality after;
+    };
+
+    /**
+     * Welds bitwise identical vertices, sorts the triangles along a Morton curve through their centroids, and then
+     * renumbers the vertices in the order the triangles first use them, so neighboring triangles fetch neighboring
+     * vertices. Unreferenced vertices are dropped.
+     *
+     * When the model shares one index stream between positions, TBNs and UVs, whole vertices are welded and the result
+     * still shares its index stream. Otherwise each stream is welded on its own.
+     *
+     * @param model The model to optimize
+     * @param stats Vertex counts and locality metrics before and after
+     * @return The optimized model
+     */
+    [[nodiscard]] ModelData optimizeMesh(const ModelView& model, MeshOptimizeStats& stats);
+
+    /**
+     * @param indices A triangle list
+     * @return Locality metrics of the index order
+     */
+    [[nodiscard]] MeshLocality measureLocality(std::span<const uint32_t> indices);
+}
+
+#endif //REINA_VK_MESHOPTIMIZER_H
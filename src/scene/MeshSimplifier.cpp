@@ -0,0 +1,314 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+    // Collapses that turn a triangle's normal by more than about 78 degrees are rejected, since they fold the surface
+    constexpr double MIN_NORMAL_COSINE = 0.2;
+
+    /**
+     * A symmetric 4x4 matrix that sums the squared distances to a set of planes
+     */
+    struct Quadric {
+        // xx, xy, xz, xw, yy, yz, yw, zz, zw, ww
+        double m[10] = {};
+
+        static Quadric fromPlane(double a, double b, double c, double d) {
+            Quadric q;
+            q.m[0] = a * a; q.m[1] = a * b; q.m[2] = a * c; q.m[3] = a * d;
+            q.m[4] = b * b; q.m[5] = b * c; q.m[6] = b * d;
+            q.m[7] = c * c; q.m[8] = c * d;
+            q.m[9] = d * d;
+            return q;
+        }
+
+        Quadric& operator+=(const Quadric& other) {
+            for (int i = 0; i < 10; i++) {
+                m[i] += other.m[i];
+            }
+            return *this;
+        }
+
+        [[nodiscard]] double evaluate(glm::vec3 p) const {
+            double x = p.x, y = p.y, z = p.z;
+            double error = m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x
+                           + m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y
+                           + m[7] * z * z + 2 * m[8] * z
+                           + m[9];
+            return std::max(error, 0.0);
+        }
+    };
+
+    struct Collapse {
+        double cost;
+        uint32_t from;
+        uint32_t to;
+        uint32_t fromVersion;
+        uint32_t toVersion;
+
+        bool operator>(const Collapse& other) const {
+            return cost > other.cost;
+        }
+    };
+
+    uint64_t edgeKey(uint32_t a, uint32_t b) {
+        return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+    }
+
+    class Simplifier {
+    public:
+        Simplifier(const reina::scene::ModelView& model)
+                : positions(model.vertices), indices(model.indices.begin(), model.indices.end()) {
+            size_t vertexCount = positions.size() / 3;
+            size_t triangleCount = indices.size() / 3;
+
+            triangleAlive.assign(triangleCount, true);
+            aliveTriangles = triangleCount;
+            vertexTriangles.resize(vertexCount);
+            quadrics.resize(vertexCount);
+            locked.assign(vertexCount, false);
+            removed.assign(vertexCount, false);
+            versions.assign(vertexCount, 0);
+
+            std::unordered_map<uint64_t, uint32_t> edgeUses;
+            edgeUses.reserve(triangleCount * 2);
+
+            for (uint32_t tri = 0; tri < triangleCount; tri++) {
+                for (int corner = 0; corner < 3; corner++) {
+                    uint32_t a = indices[tri * 3 + corner];
+                    uint32_t b = indices[tri * 3 + (corner + 1) % 3];
+                    vertexTriangles[a].push_back(tri);
+                    edgeUses[edgeKey(a, b)]++;
+                }
+
+                glm::vec3 p0 = position(indices[tri * 3]);
+                glm::vec3 normal = glm::cross(position(indices[tri * 3 + 1]) - p0, position(indices[tri * 3 + 2]) - p0);
+                float length = glm::length(normal);
+                if (length > 0.0f) {
+                    normal = normal / length;
+                    Quadric plane = Quadric::fromPlane(normal.x, normal.y, normal.z, -glm::dot(normal, p0));
+                    for (int corner = 0; corner < 3; corner++) {
+                        quadrics[indices[tri * 3 + corner]] += plane;
+                    }
+                }
+            }
+
+            // Attribute seams split vertices, so the edges along them are only used once like open borders are
+            for (const auto& [key, uses] : edgeUses) {
+                if (uses != 2) {
+                    locked[key >> 32] = true;
+                    locked[key & 0xFFFFFFFFu] = true;
+                }
+            }
+
+            for (const auto& [key, uses] : edgeUses) {
+                pushEdge(static_cast<uint32_t>(key >> 32), static_cast<uint32_t>(key & 0xFFFFFFFFu));
+            }
+        }
+
+        void simplify(size_t targetTriangles, double maxCost) {
+            while (aliveTriangles > targetTriangles && !heap.empty()) {
+                Collapse collapse = heap.top();
+                if (collapse.cost > maxCost) {
+                    break;
+                }
+                heap.pop();
+
+                bool stale = removed[collapse.from] || removed[collapse.to]
+                             || versions[collapse.from] != collapse.fromVersion || versions[collapse.to] != collapse.toVersion;
+                if (stale || !canCollapse(collapse.from, collapse.to)) {
+                    continue;
+                }
+
+                apply(collapse.from, collapse.to);
+                largestCost = std::max(largestCost, collapse.cost);
+            }
+        }
+
+        [[nodiscard]] reina::scene::SimplifiedMesh result(const reina::scene::ModelView& model) const {
+            constexpr uint32_t UNUSED = 0xFFFFFFFFu;
+            std::vector<uint32_t> newIndex(positions.size() / 3, UNUSED);
+
+            reina::scene::ModelData data;
+            data.indices.reserve(aliveTriangles * 3);
+
+            for (size_t tri = 0; tri < triangleAlive.size(); tri++) {
+                if (!triangleAlive[tri]) {
+                    continue;
+                }
+
+                for (int corner = 0; corner < 3; corner++) {
+                    uint32_t vertex = indices[tri * 3 + corner];
+                    if (newIndex[vertex] == UNUSED) {
+                        newIndex[vertex] = static_cast<uint32_t>(data.vertices.size() / 3);
+                        data.vertices.insert(data.vertices.end(), model.vertices.begin() + vertex * 3, model.vertices.begin() + vertex * 3 + 3);
+                        if (!model.tbns.empty()) {
+                            data.tbns.push_back(model.tbns[vertex]);
+                        }
+                        if (!model.texCoords.empty()) {
+                            data.texCoords.insert(data.texCoords.end(), model.texCoords.begin() + vertex * 2, model.texCoords.begin() + vertex * 2 + 2);
+                        }
+                    }
+                    data.indices.push_back(newIndex[vertex]);
+                }
+            }
+
+            data.tbnsIndices = data.indices;
+            data.texIndices = data.indices;
+
+            return reina::scene::SimplifiedMesh{std::move(data), static_cast<float>(std::sqrt(largestCost))};
+        }
+
+    private:
+        [[nodiscard]] glm::vec3 position(uint32_t vertex) const {
+            return glm::vec3(positions[vertex * 3], positions[vertex * 3 + 1], positions[vertex * 3 + 2]);
+        }
+
+        [[nodiscard]] bool contains(uint32_t tri, uint32_t vertex) const {
+            return indices[tri * 3] == vertex || indices[tri * 3 + 1] == vertex || indices[tri * 3 + 2] == vertex;
+        }
+
+        [[nodiscard]] std::vector<uint32_t> neighbors(uint32_t vertex) const {
+            std::vector<uint32_t> result;
+            for (uint32_t tri : vertexTriangles[vertex]) {
+                if (!triangleAlive[tri]) {
+                    continue;
+                }
+                for (int corner = 0; corner < 3; corner++) {
+                    uint32_t other = indices[tri * 3 + corner];
+                    if (other != vertex && std::find(result.begin(), result.end(), other) == result.end()) {
+                        result.push_back(other);
+                    }
+                }
+            }
+            return result;
+        }
+
+        void pushEdge(uint32_t a, uint32_t b) {
+            Quadric combined = quadrics[a];
+            combined += quadrics[b];
+
+            // Collapse in whichever direction is cheaper and allowed; locked vertices can't move
+            std::optional<Collapse> best;
+            if (!locked[a]) {
+                best = Collapse{combined.evaluate(position(b)), a, b, versions[a], versions[b]};
+            }
+            if (!locked[b]) {
+                double cost = combined.evaluate(position(a));
+                if (!best.has_value() || cost < best->cost) {
+                    best = Collapse{cost, b, a, versions[b], versions[a]};
+                }
+            }
+
+            if (best.has_value()) {
+                heap.push(*best);
+            }
+        }
+
+        [[nodiscard]] bool canCollapse(uint32_t from, uint32_t to) const {
+            // Link condition: an interior edge has exactly two opposite vertices. More than that and the collapse would
+            // pinch the surface into a non-manifold shape.
+            std::vector<uint32_t> fromNeighbors = neighbors(from);
+            std::vector<uint32_t> toNeighbors = neighbors(to);
+            size_t shared = std::ranges::count_if(fromNeighbors, [&](uint32_t v) {
+                return std::find(toNeighbors.begin(), toNeighbors.end(), v) != toNeighbors.end();
+            });
+            if (shared > 2) {
+                return false;
+            }
+
+            glm::vec3 target = position(to);
+            for (uint32_t tri : vertexTriangles[from]) {
+                if (!triangleAlive[tri] || contains(tri, to)) {
+                    continue;
+                }
+
+                glm::vec3 corners[3];
+                glm::vec3 moved[3];
+                for (int corner = 0; corner < 3; corner++) {
+                    uint32_t vertex = indices[tri * 3 + corner];
+                    corners[corner] = position(vertex);
+                    moved[corner] = vertex == from ? target : corners[corner];
+                }
+
+                glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                double beforeLength = glm::length(before);
+                double afterLength = glm::length(after);
+                if (afterLength <= 0.0 || glm::dot(before, after) < MIN_NORMAL_COSINE * beforeLength * afterLength) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        void apply(uint32_t from, uint32_t to) {
+            for (uint32_t tri : vertexTriangles[from]) {
+                if (!triangleAlive[tri]) {
+                    continue;
+                }
+
+                if (contains(tri, to)) {
+                    triangleAlive[tri] = false;
+                    aliveTriangles--;
+                    continue;
+                }
+
+                for (int corner = 0; corner < 3; corner++) {
+                    if (indices[tri * 3 + corner] == from) {
+                        indices[tri * 3 + corner] = to;
+                    }
+                }
+                vertexTriangles[to].push_back(tri);
+            }
+
+            std::erase_if(vertexTriangles[to], [&](uint32_t tri) { return !triangleAlive[tri]; });
+            std::vector<uint32_t>().swap(vertexTriangles[from]);
+
+            quadrics[to] += quadrics[from];
+            removed[from] = true;
+            versions[to]++;
+
+            for (uint32_t neighbor : neighbors(to)) {
+                pushEdge(to, neighbor);
+            }
+        }
+
+        std::span<const float> positions;
+        std::vector<uint32_t> indices;
+        std::vector<bool> triangleAlive;
+        size_t aliveTriangles = 0;
+
+        std::vector<std::vector<uint32_t>> vertexTriangles;
+        std::vector<Quadric> quadrics;
+        std::vector<bool> locked;
+        std::vector<bool> removed;
+        std::vector<uint32_t> versions;
+
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> heap;
+        double largestCost = 0;
+    };
+}
+
+std::optional<reina::scene::SimplifiedMesh> reina::scene::simplifyMesh(const reina::scene::ModelView& model, size_t targetTriangles, float maxError) {
+    size_t vertexCount = model.vertices.size() / 3;
+    bool hasTBNs = !model.tbns.empty();
+    bool hasTexCoords = !model.texCoords.empty();
+
+    // Each vertex must carry all of its attributes, since the kept endpoint of a collapse keeps its TBN and UV
+    bool sharedTopology = std::ranges::equal(model.tbnsIndices, model.indices)
+                          && (!hasTexCoords || std::ranges::equal(model.texIndices, model.indices))
+                          && (!hasTBNs || model.tbns.size() == vertexCount)
+                          && (!hasTexCoords || model.texCoords.size() / 2 == vertexCount);
+    if (!sharedTopology) {
+        return std::nullopt;
+    }
+
+    Simplifier simplifier{model};
+    simplifier.simplify(targetTriangles, static_cast<double>(maxError) * maxError);
+    return simplifier.result(model);
+}
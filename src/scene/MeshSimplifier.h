@@ -0,0 +1,29 @@
+#ifndef REINA_VK_MESHSIMPLIFIER_H
+#define REINA_VK_MESHSIMPLIFIER_H
+
+#include <cstddef>
+#include <optional>
+
+#include "ModelData.h"
+
+namespace reina::scene {
+    struct SimplifiedMesh {
+        ModelData modelData;
+        float error;  // object space distance bound from the quadrics; the square root of the largest collapse cost
+    };
+
+    /**
+     * Simplifies a mesh with quadric error edge collapses (Garland and Heckbert 1997, "Surface Simplification Using
+     * Quadric Error Metrics"). Edges collapse onto one of their endpoints, so the remaining vertices keep their TBNs and
+     * UVs unchanged. Vertices on open borders, attribute seams and non-manifold edges are locked, so the mesh outline
+     * and its UV layout don't tear.
+     *
+     * @param model The model to simplify. Its positions, TBNs and UVs must share one index stream.
+     * @param targetTriangles Collapsing stops once the mesh has at most this many triangles
+     * @param maxError Collapsing also stops before the error would exceed this, even if the target isn't reached
+     * @return The simplified mesh, or std::nullopt if the model doesn't share its index stream
+     */
+    [[nodiscard]] std::optional<SimplifiedMesh> simplifyMesh(const ModelView& model, size_t targetTriangles, float maxError);
+}
+
+#endif //REINA_VK_MESHSIMPLIFIER_H
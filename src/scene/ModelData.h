@@ -0,0 +1,43 @@
+#ifndef REINA_VK_MODELDATA_H
+#define REINA_VK_MODELDATA_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace reina::scene {
+    /**
+     * A non-owning view of a model's streams. Used to ingest models without copying them into a ModelData first, e.g.
+     * straight from a memory mapped geometry cache entry.
+     */
+    struct ModelView {
+        std::span<const float> vertices;
+        std::span<const uint32_t> indices;
+        std::span<const glm::mat3> tbns;
+        std::span<const uint32_t> tbnsIndices;
+        std::span<const float> texCoords;
+        std::span<const uint32_t> texIndices;
+    };
+
+    struct ModelData {
+        std::vector<float> vertices;  // xyz positions, three floats per vertex
+        std::vector<uint32_t> indices;
+        std::vector<glm::mat3> tbns;
+        std::vector<uint32_t> tbnsIndices;
+        std::vector<float> texCoords;
+        std::vector<uint32_t> texIndices;
+
+        [[nodiscard]] ModelView view() const;
+    };
+
+    /**
+     * A model produced by an importer, along with the ID of the mesh it was imported from
+     */
+    struct ImportedModel {
+        uint32_t meshID;
+        ModelData modelData;
+    };
+}
+
+#endif //REINA_VK_MODELDATA_H
@@ -1,14 +1,69 @@
 #include "Models.h"
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
 #include <stdexcept>
 #include <cmath>
+#include <algorithm>
+#include <limits>
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <iostream>
+#include <chrono>
+
+#include <filesystem>
+
+#include "../tools/Hash.h"
+#include "../../polyglot/raytrace.h"
+#include "VertexEncoding.h"
+#include "../tools/ThreadPool.h"
+#include "obj/objloader.h"
+
+namespace {
+    // Models with fewer triangles aren't worth simplifying, and simplification stops at MIN_LOD_TRIANGLES
+    constexpr size_t MIN_LOD_SOURCE_TRIANGLES = 4096;
+    constexpr size_t MIN_LOD_TRIANGLES = 256;
+    constexpr size_t MAX_LOD_LEVELS = 6;
+
+    // A level that removes less than this fraction of the previous level's triangles has stalled, usually because the
+    // remaining vertices are locked on seams, and is discarded
+    constexpr double MIN_LOD_REDUCTION = 0.2;
+
+    // Caps the error of a single level relative to the model's bounding radius, so levels stay recognizable
+    constexpr float MAX_LOD_ERROR_FRACTION = 0.05f;
+
+    constexpr unsigned int OBJ_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_JoinIdenticalVertices | aiProcess_CalcTangentSpace | aiProcess_FlipUVs;
+
+    // Cache key for geometry imported by the native OBJ loader, so it is not mixed up with Assimp imports
+    constexpr unsigned int NATIVE_OBJ_IMPORT_OPTIONS = 1;
+
+    // Set in the cache key of geometry that was optimized before it was stored. Above every flag OBJ_IMPORT_FLAGS uses
+    constexpr uint32_t OPTIMIZED_IMPORT_OPTION = 1u << 31;
+
+    // Unlike clear() or assigning {}, swapping with an empty vector frees the allocation
+    template<typename T>
+    void releaseVector(std::vector<T>& vec) {
+        std::vector<T>().swap(vec);
+    }
+
+    // The number of uints an index stream takes in the index buffer
+    uint32_t indexStreamWords(size_t count, bool is16Bit) {
+        return static_cast<uint32_t>(is16Bit ? (count + 1) / 2 : count);
+    }
+
+    // Writes an index stream into the index buffer, two indices per uint with the first in the low half if 16-bit
+    void packIndexStream(std::span<const uint32_t> src, bool is16Bit, uint32_t* dst) {
+        if (!is16Bit) {
+            std::copy(src.begin(), src.end(), dst);
+            return;
+        }
+
+        for (size_t i = 0; i < src.size(); i += 2) {
+            uint32_t high = i + 1 < src.size() ? src[i + 1] : 0;
+            dst[i / 2] = (src[i] & 0xFFFFu) | (high << 16);
+        }
+    }
+}
 
 reina::scene::Models::Models(const std::vector<std::string>& modelFilepaths) {
     // Copy the data to allVertices and allIndicesOffset
@@ -18,77 +73,273 @@ reina::scene::Models::Models(const std::vector<std::string>& modelFilepaths) {
 }
 
 uint32_t reina::scene::Models::addModel(const std::string& filepath) {
-    return addModel(getObjData(filepath));
+    auto start = std::chrono::high_resolution_clock::now();
+
+    bool native = useNativeObjLoader && std::filesystem::path(filepath).extension() == ".obj";
+
+    uint64_t sourceHash = 0;
+    std::optional<CachedGeometry> cached;
+    if (geometryCache.isEnabled()) {
+        sourceHash = reina::tools::hashFile(filepath);
+        cached = geometryCache.load(filepath, geometryCacheOptions(native ? NATIVE_OBJ_IMPORT_OPTIONS : OBJ_IMPORT_FLAGS), sourceHash);
+        // A file the native loader failed on was stored by its Assimp fallback
+        if (!cached.has_value() && native) {
+            cached = geometryCache.load(filepath, geometryCacheOptions(OBJ_IMPORT_FLAGS), sourceHash);
+        }
+    }
+
+    uint32_t modelID;
+    std::string source;
+    if (cached.has_value() && cached->models.size() == 1) {
+        // Pack straight from the mapped cache file, which was optimized before it was stored if optimization is on
+        modelID = addModel(cached->models.front().view, true);
+        source = "geometry cache";
+    } else {
+        // The native loader falls back to Assimp, so the geometry is stored under the key of the loader that made it
+        std::vector<ImportedModel> imported;
+        imported.push_back(ImportedModel{0, importModel(filepath, native)});
+        source = native ? "native OBJ loader" : "Assimp";
+        optimizeModels(imported);
+        geometryCache.store(filepath, geometryCacheOptions(native ? NATIVE_OBJ_IMPORT_OPTIONS : OBJ_IMPORT_FLAGS), sourceHash, imported);
+        modelID = addModel(std::move(imported.front().modelData), true);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Loaded " << filepath << " (" << source << ") in "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+
+    return modelID;
+}
+
+reina::scene::ModelData reina::scene::Models::importModel(const std::string& filepath, bool& native) {
+    if (native) {
+        try {
+            return reina::scene::obj::loadObj(filepath);
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: native OBJ loader failed for " << filepath << ", falling back to Assimp: " << e.what() << "\n";
+            native = false;
+        }
+    }
+
+    return getObjData(filepath);
+}
+
+uint32_t reina::scene::Models::addModel(reina::scene::ModelData&& objData, bool optimized) {
+    // objData is destroyed when this returns, so the caller's copy is released as soon as it is packed
+    ModelData owned = std::move(objData);
+    return addModel(owned.view(), optimized);
 }
 
-uint32_t reina::scene::Models::addModel(const reina::scene::ModelData& objData) {
+uint32_t reina::scene::Models::addModel(const reina::scene::ModelView& objData, bool optimized) {
     if (areBuffersBuilt()) {
         throw std::runtime_error("Could not add model; buffers are already built");
     }
 
-    size_t vertexOffset = allVertices.size();
-    size_t tbnsOffset = allTBNs.size() / 9;
-    size_t texOffset = allTexCoords.size();
-    size_t indexOffset = allIndicesOffset.size();
-    size_t tbnsIndicesOffset = allTBNsIndicesOffset.size();
-    size_t texIndexOffset = allTexIndicesOffset.size();
+    if (!optimizeMeshes || optimized) {
+        uint32_t modelID = packModel(objData);
+        if (lodsEnabled) {
+            generateLods(objData, modelID);
+        }
+        return modelID;
+    }
+
+    ModelData optimizedData = optimizeWithStats(objData);
+
+    uint32_t modelID = packModel(optimizedData.view());
+    if (lodsEnabled) {
+        generateLods(optimizedData.view(), modelID);
+    }
+    return modelID;
+}
 
-    allVertices.resize(allVertices.size() + objData.vertices.size());
-    allTBNs.resize(allTBNs.size() + objData.tbns.size() * 9);
-    allTexCoords.resize(allTexCoords.size() + objData.texCoords.size());
-    allIndicesOffset.resize(allIndicesOffset.size() + objData.indices.size());
-    allTexIndicesOffset.resize(allTexIndicesOffset.size() + objData.texIndices.size());
-    allTBNsIndicesOffset.resize(allTBNsIndicesOffset.size() + objData.tbnsIndices.size());
-    allIndicesNonOffset.resize(allIndicesNonOffset.size() + objData.indices.size());
+void reina::scene::Models::optimizeModels(std::vector<reina::scene::ImportedModel>& models) {
+    if (!optimizeMeshes) {
+        return;
+    }
 
-    const ModelData& objectData = objData;
+    for (ImportedModel& model : models) {
+        model.modelData = optimizeWithStats(model.modelData.view());
+    }
+}
 
-    modelRanges.push_back(ModelRange{
-            .firstVertex = static_cast<uint32_t>(vertexOffset / 4),
-            .firstNormal = static_cast<uint32_t>(tbnsOffset),
-            .indexOffset = static_cast<uint32_t>(indexOffset),
-            .tbnsIndexOffset = static_cast<uint32_t>(tbnsIndicesOffset),
-            .texIndexOffset = objectData.texCoords.empty() ? static_cast<uint32_t>(-1) : static_cast<uint32_t>(texIndexOffset),
-            .indexCount = static_cast<uint32_t>(objectData.indices.size() / 3),
-            .tbnsIndexCount = static_cast<uint32_t>(objectData.indices.size() / 3),
-            .texIndexCount = static_cast<uint32_t>(objectData.texIndices.size() / 3),
-    });
+uint32_t reina::scene::Models::geometryCacheOptions(uint32_t importOptions) const {
+    return optimizeMeshes ? importOptions | OPTIMIZED_IMPORT_OPTION : importOptions;
+}
 
-    modelData.push_back(objData);
+reina::scene::ModelData reina::scene::Models::optimizeWithStats(const reina::scene::ModelView& model) {
+    MeshOptimizeStats stats{};
+    ModelData optimized = optimizeMesh(model, stats);
+
+    // Locality metrics are summed weighted by triangle count so they can be averaged over the scene
+    auto triangles = static_cast<double>(model.indices.size() / 3);
+    optimizeTotals.verticesBefore += stats.verticesBefore;
+    optimizeTotals.verticesAfter += stats.verticesAfter;
+    optimizeTotals.before.acmr += stats.before.acmr * triangles;
+    optimizeTotals.before.positionLinesPerTriangle += stats.before.positionLinesPerTriangle * triangles;
+    optimizeTotals.after.acmr += stats.after.acmr * triangles;
+    optimizeTotals.after.positionLinesPerTriangle += stats.after.positionLinesPerTriangle * triangles;
+    optimizedTriangles += model.indices.size() / 3;
+
+    return optimized;
+}
 
-    // Copy vertices
-    std::copy(objectData.vertices.begin(), objectData.vertices.end(), allVertices.begin() + static_cast<long long>(vertexOffset));
-    std::copy(objectData.texCoords.begin(), objectData.texCoords.end(), allTexCoords.begin() + static_cast<long long>(texOffset));
+void reina::scene::Models::generateLods(const reina::scene::ModelView& model, uint32_t modelID) {
+    size_t triangles = model.indices.size() / 3;
+    if (triangles < MIN_LOD_SOURCE_TRIANGLES) {
+        return;
+    }
 
-    for (size_t idx = 0; idx < objectData.tbns.size(); idx++) {
-        const glm::mat3 &m = objectData.tbns[idx];
+    float maxError = boundingSpheres[modelID].w * MAX_LOD_ERROR_FRACTION;
+
+    // Each level is simplified from the one before it, so the errors add up, and each may only use what the levels
+    // before it left of maxError
+    std::optional<SimplifiedMesh> previous;
+    float error = 0;
+    while (lodChains[modelID].size() <= MAX_LOD_LEVELS && triangles / 2 >= MIN_LOD_TRIANGLES && error < maxError) {
+        ModelView source = previous.has_value() ? previous->modelData.view() : model;
+        std::optional<SimplifiedMesh> simplified = simplifyMesh(source, triangles / 2, maxError - error);
+        if (!simplified.has_value() || error + simplified->error > maxError) {
+            break;
+        }
 
-        // Compute the start of the i‑th matrix within allTBNs:
-        size_t base = (tbnsOffset + idx) * 9;
+        size_t simplifiedTriangles = simplified->modelData.indices.size() / 3;
+        if (static_cast<double>(simplifiedTriangles) > static_cast<double>(triangles) * (1.0 - MIN_LOD_REDUCTION)) {
+            break;
+        }
 
-        // Column‑major: for each column, then each row:
-        for (int col = 0; col < 3; col++) {
-            for (int row = 0; row < 3; row++) {
-                allTBNs[base + col * 3 + row] = m[col][row];
-            }
+        error += simplified->error;
+        // packModel grows lodChains, so the level's ID is taken before indexing it
+        uint32_t levelID = packModel(simplified->modelData.view());
+        lodChains[modelID].push_back(LodLevel{levelID, error});
+
+        triangles = simplifiedTriangles;
+        lodTriangles += simplifiedTriangles;
+        previous = std::move(simplified);
+    }
+}
+
+uint32_t reina::scene::Models::packModel(const reina::scene::ModelView& objData) {
+    bool hasTexCoords = !objData.texCoords.empty();
+
+    // Most importers weld vertices, in which case the position, TBN and UV indices are all the same stream and only
+    // one copy needs to be stored
+    bool sharedTopology = std::ranges::equal(objData.tbnsIndices, objData.indices)
+                          && (!hasTexCoords || std::ranges::equal(objData.texIndices, objData.indices));
+
+    // Indices are relative to the model, so small models fit in 16 bits
+    size_t maxElements = std::max({objData.vertices.size() / 3, objData.tbns.size(), objData.texCoords.size() / 2});
+    bool is16Bit = maxElements <= 0x10000;
+
+    uint32_t indexOffset = indexBufferWords;
+    indexBufferWords += indexStreamWords(objData.indices.size(), is16Bit);
+
+    uint32_t tbnsIndexOffset = indexOffset;
+    uint32_t texIndexOffset = hasTexCoords ? indexOffset : static_cast<uint32_t>(-1);
+    if (!sharedTopology) {
+        tbnsIndexOffset = indexBufferWords;
+        indexBufferWords += indexStreamWords(objData.tbnsIndices.size(), is16Bit);
+
+        if (hasTexCoords) {
+            texIndexOffset = indexBufferWords;
+            indexBufferWords += indexStreamWords(objData.texIndices.size(), is16Bit);
         }
     }
 
-    // Copy indices with proper offset
-    for (uint32_t idx : objectData.indices) {
-        allIndicesOffset[indexOffset] = idx + (vertexOffset / 4);
-        allIndicesNonOffset[indexOffset++] = idx;
+    // The old layout kept position indices twice (offset and not) next to offset TBN and UV indices
+    unsharedIndexBytes += (2 * objData.indices.size() + objData.tbnsIndices.size() + objData.texIndices.size()) * sizeof(uint32_t);
+
+    modelRanges.push_back(ModelRange{
+            .firstVertex = static_cast<uint32_t>(allVertices.size() / 3),
+            .firstNormal = static_cast<uint32_t>(allTBNs.size()),
+            .firstTexCoord = static_cast<uint32_t>(allTexCoords.size() / 2),
+            .indexOffset = indexOffset,
+            .tbnsIndexOffset = tbnsIndexOffset,
+            .texIndexOffset = texIndexOffset,
+            .indexCount = static_cast<uint32_t>(objData.indices.size() / 3),
+            .tbnsIndexCount = static_cast<uint32_t>(objData.tbnsIndices.size() / 3),
+            .texIndexCount = static_cast<uint32_t>(objData.texIndices.size() / 3),
+            .indexFlags = (sharedTopology ? INDEX_FLAG_SHARED_TOPOLOGY : 0u) | (is16Bit ? INDEX_FLAG_16_BIT : 0u)
+    });
+    hostIndexRanges.push_back(HostIndexRange{allIndices.size(), allTBNsIndices.size(), allTexIndices.size()});
+
+    // Append straight into the packed streams; with reserve() called beforehand none of these reallocate
+    allVertices.insert(allVertices.end(), objData.vertices.begin(), objData.vertices.end());
+    allTexCoords.insert(allTexCoords.end(), objData.texCoords.begin(), objData.texCoords.end());
+    allIndices.insert(allIndices.end(), objData.indices.begin(), objData.indices.end());
+
+    // TBNs are stored as 8-byte octahedral frames instead of a 36-byte mat3
+    size_t firstTBN = allTBNs.size();
+    allTBNs.resize(firstTBN + objData.tbns.size());
+    reina::tools::ThreadPool::shared().parallelFor(objData.tbns.size(), [&](size_t i) {
+        allTBNs[firstTBN + i] = encodeTBN(objData.tbns[i]);
+    }, 4096);
+
+    if (!sharedTopology) {
+        allTBNsIndices.insert(allTBNsIndices.end(), objData.tbnsIndices.begin(), objData.tbnsIndices.end());
+        allTexIndices.insert(allTexIndices.end(), objData.texIndices.begin(), objData.texIndices.end());
+    }
+
+    glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+    for (size_t i = 0; i + 2 < objData.vertices.size(); i += 3) {
+        glm::vec3 p{objData.vertices[i], objData.vertices[i + 1], objData.vertices[i + 2]};
+        boundsMin = glm::min(boundsMin, p);
+        boundsMax = glm::max(boundsMax, p);
+    }
+
+    glm::vec3 center = objData.vertices.empty() ? glm::vec3(0) : (boundsMin + boundsMax) * 0.5f;
+    float radius = 0;
+    for (size_t i = 0; i + 2 < objData.vertices.size(); i += 3) {
+        radius = std::max(radius, glm::length(glm::vec3{objData.vertices[i], objData.vertices[i + 1], objData.vertices[i + 2]} - center));
     }
+    boundingSpheres.emplace_back(center, radius);
+
+    uint32_t modelID = static_cast<uint32_t>(modelRanges.size() - 1);
+    lodChains.push_back({LodLevel{modelID, 0.0f}});
+    return modelID;
+}
 
-    for (uint32_t idx : objectData.tbnsIndices) {
-        allTBNsIndicesOffset[tbnsIndicesOffset++] = idx + tbnsOffset;
+void reina::scene::Models::reserve(std::span<const reina::scene::ModelView> upcoming) {
+    // TBN and UV index streams are usually shared with the position indices, so they aren't reserved
+    size_t vertices = 0, tbns = 0, texCoords = 0, indices = 0;
+    for (const ModelView& model : upcoming) {
+        vertices += model.vertices.size();
+        tbns += model.tbns.size();
+        texCoords += model.texCoords.size();
+        indices += model.indices.size();
     }
 
-    for (uint32_t idx : objectData.texIndices) {
-        allTexIndicesOffset[texIndexOffset++] = idx == 0xFFFFFFFFu ? idx : idx + (texOffset / 2);
+    allVertices.reserve(allVertices.size() + vertices);
+    allTBNs.reserve(allTBNs.size() + tbns);
+    allTexCoords.reserve(allTexCoords.size() + texCoords);
+    allIndices.reserve(allIndices.size() + indices);
+    modelRanges.reserve(modelRanges.size() + upcoming.size());
+    boundingSpheres.reserve(boundingSpheres.size() + upcoming.size());
+    lodChains.reserve(lodChains.size() + upcoming.size());
+    hostIndexRanges.reserve(hostIndexRanges.size() + upcoming.size());
+}
+
+void reina::scene::Models::releaseHostData() {
+    if (!areBuffersBuilt()) {
+        throw std::runtime_error("Cannot release host geometry before the buffers are built");
     }
 
-    return static_cast<uint32_t>(modelRanges.size() - 1);
+    releaseVector(allVertices);
+    releaseVector(allTBNs);
+    releaseVector(allTexCoords);
+    releaseVector(allIndices);
+    releaseVector(allTBNsIndices);
+    releaseVector(allTexIndices);
+    releaseVector(hostIndexRanges);
+
+    releasedHostData = true;
+}
+
+size_t reina::scene::Models::getHostDataBytes() const {
+    return allVertices.capacity() * sizeof(float)
+           + allTBNs.capacity() * sizeof(PackedTBN)
+           + allTexCoords.capacity() * sizeof(float)
+           + (allIndices.capacity() + allTBNsIndices.capacity() + allTexIndices.capacity()) * sizeof(uint32_t);
 }
 
 void reina::scene::Models::buildBuffers(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue) {
@@ -104,20 +355,67 @@ void reina::scene::Models::buildBuffers(VkDevice logicalDevice, VkPhysicalDevice
 
     VkMemoryAllocateFlags allocFlags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
 
+    if (optimizedTriangles > 0) {
+        auto triangles = static_cast<double>(optimizedTriangles);
+        std::cout << "Mesh optimization: " << optimizeTotals.verticesBefore << " -> " << optimizeTotals.verticesAfter << " vertices, "
+                  << "ACMR " << optimizeTotals.before.acmr / triangles << " -> " << optimizeTotals.after.acmr / triangles << ", "
+                  << "position cache lines per triangle " << optimizeTotals.before.positionLinesPerTriangle / triangles
+                  << " -> " << optimizeTotals.after.positionLinesPerTriangle / triangles << "\n";
+    }
+
+    if (lodTriangles > 0) {
+        size_t baseModels = std::ranges::count_if(lodChains, [](const std::vector<LodLevel>& chain) { return chain.size() > 1; });
+        std::cout << "Mesh LODs: " << lodTriangles << " triangles in simplified levels of " << baseModels << " models\n";
+    }
+
+    // Pack every model's index streams into one buffer at the offsets chosen in addModel
+    std::vector<uint32_t> packedIndices(std::max(indexBufferWords, 1u));
+    size_t sharedModels = 0;
+    size_t models16Bit = 0;
+    for (size_t i = 0; i < modelRanges.size(); i++) {
+        const ModelRange& range = modelRanges[i];
+        const HostIndexRange& hostRange = hostIndexRanges[i];
+        bool is16Bit = range.indexFlags & INDEX_FLAG_16_BIT;
+
+        packIndexStream(std::span<const uint32_t>(allIndices).subspan(hostRange.indices, range.indexCount * 3), is16Bit, packedIndices.data() + range.indexOffset);
+
+        if (range.indexFlags & INDEX_FLAG_SHARED_TOPOLOGY) {
+            sharedModels++;
+        } else {
+            packIndexStream(std::span<const uint32_t>(allTBNsIndices).subspan(hostRange.tbnsIndices, range.tbnsIndexCount * 3), is16Bit, packedIndices.data() + range.tbnsIndexOffset);
+            if (range.texIndexOffset != static_cast<uint32_t>(-1)) {
+                packIndexStream(std::span<const uint32_t>(allTexIndices).subspan(hostRange.texIndices, range.texIndexCount * 3), is16Bit, packedIndices.data() + range.texIndexOffset);
+            }
+        }
+
+        if (is16Bit) {
+            models16Bit++;
+        }
+    }
+
+    size_t indexBytes = static_cast<size_t>(indexBufferWords) * sizeof(uint32_t);
+    std::cout << "Index buffer: " << static_cast<double>(indexBytes) / (1024.0 * 1024.0) << " MiB, down from "
+              << static_cast<double>(unsharedIndexBytes) / (1024.0 * 1024.0) << " MiB as separate 32-bit streams ("
+              << sharedModels << "/" << modelRanges.size() << " models share topology, "
+              << models16Bit << "/" << modelRanges.size() << " use 16-bit indices)\n";
+
+    // Positions used to be vec4s and TBNs full mat3s
+    size_t vertexBytes = allVertices.size() * sizeof(float) + allTBNs.size() * sizeof(PackedTBN);
+    size_t unpackedVertexBytes = allVertices.size() / 3 * sizeof(glm::vec4) + allTBNs.size() * sizeof(glm::mat3);
+    std::cout << "Vertex streams: " << static_cast<double>(vertexBytes) / (1024.0 * 1024.0) << " MiB, down from "
+              << static_cast<double>(unpackedVertexBytes) / (1024.0 * 1024.0) << " MiB unquantized\n";
+
     verticesBufferSize = allVertices.size();
     verticesBuffer = reina::core::Buffer{logicalDevice, physicalDevice, cmdPool, queue, allVertices, usage, allocFlags};
-    offsetIndicesBuffer = reina::core::Buffer{logicalDevice, physicalDevice, cmdPool, queue, allIndicesOffset, usage, allocFlags};
-    nonOffsetIndicesBuffer = reina::core::Buffer{logicalDevice, physicalDevice, cmdPool, queue, allIndicesNonOffset, usage, allocFlags};
+    indicesBuffer = reina::core::Buffer{logicalDevice, physicalDevice, cmdPool, queue, packedIndices, usage, allocFlags};
     tbnsBuffer = reina::core::Buffer{logicalDevice, physicalDevice, cmdPool, queue, allTBNs, usage, allocFlags};
-    offsetTbnsIndicesBuffer = reina::core::Buffer{logicalDevice, physicalDevice, cmdPool, queue, allTBNsIndicesOffset, usage, allocFlags};
     texCoordsBuffer = reina::core::Buffer{logicalDevice, physicalDevice, cmdPool, queue, allTexCoords.empty() ? std::vector<float>{0} : allTexCoords, usage, allocFlags};
-    offsetTexIndicesBuffer = reina::core::Buffer{logicalDevice, physicalDevice, cmdPool, queue, allTexIndicesOffset, usage, allocFlags};
 }
 
 reina::scene::ModelData reina::scene::Models::getObjData(const std::string& filepath) {
     Assimp::Importer importer;
 
-    const aiScene* scene = importer.ReadFile(filepath, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_JoinIdenticalVertices | aiProcess_CalcTangentSpace | aiProcess_FlipUVs);
+    const aiScene* scene = importer.ReadFile(filepath, OBJ_IMPORT_FLAGS);
     if (!scene || !scene->HasMeshes()) {
         throw std::runtime_error("Failed to load model with Assimp: " + std::string(importer.GetErrorString()));
     }
@@ -136,7 +434,6 @@ reina::scene::ModelData reina::scene::Models::getObjData(const std::string& file
         objVertices.push_back(v.x);
         objVertices.push_back(v.y);
         objVertices.push_back(v.z);
-        objVertices.push_back(1.0f);
 
         if (mesh->HasNormals()) {
             const aiVector3D& n = mesh->mNormals[i];
@@ -182,20 +479,45 @@ const reina::core::Buffer& reina::scene::Models::getVerticesBuffer() const {
     return verticesBuffer;
 }
 
-const reina::core::Buffer& reina::scene::Models::getOffsetIndicesBuffer() const {
-    return offsetIndicesBuffer;
+const reina::core::Buffer& reina::scene::Models::getIndicesBuffer() const {
+    return indicesBuffer;
 }
 
-const reina::core::Buffer& reina::scene::Models::getNonOffsetIndicesBuffer() const {
-    return nonOffsetIndicesBuffer;
+reina::scene::ModelView reina::scene::ModelData::view() const {
+    return ModelView{vertices, indices, tbns, tbnsIndices, texCoords, texIndices};
 }
 
-const reina::scene::ModelData& reina::scene::Models::getModelData(uint32_t index) const {
+reina::scene::ModelView reina::scene::Models::getModelData(uint32_t index) const {
     if (index >= modelRanges.size()) {
         throw std::runtime_error("Index " + std::to_string(index) + " out of range for models");
+    } if (releasedHostData) {
+        throw std::runtime_error("Cannot get model data; host geometry has been released");
+    }
+
+    // Each model's streams end where the next model's begin
+    bool last = index + 1 == modelRanges.size();
+    const ModelRange& range = modelRanges[index];
+
+    const HostIndexRange& hostRange = hostIndexRanges[index];
+
+    size_t vertexEnd = last ? allVertices.size() / 3 : modelRanges[index + 1].firstVertex;
+    size_t texCoordEnd = last ? allTexCoords.size() / 2 : modelRanges[index + 1].firstTexCoord;
+
+    std::span<const uint32_t> indices = std::span<const uint32_t>(allIndices).subspan(hostRange.indices, range.indexCount * 3);
+    std::span<const uint32_t> tbnsIndices = indices;
+    std::span<const uint32_t> texIndices = range.texIndexOffset == static_cast<uint32_t>(-1) ? std::span<const uint32_t>{} : indices;
+    if (!(range.indexFlags & INDEX_FLAG_SHARED_TOPOLOGY)) {
+        tbnsIndices = std::span<const uint32_t>(allTBNsIndices).subspan(hostRange.tbnsIndices, range.tbnsIndexCount * 3);
+        texIndices = std::span<const uint32_t>(allTexIndices).subspan(hostRange.texIndices, range.texIndexCount * 3);
     }
 
-    return modelData[index];
+    return ModelView{
+            .vertices = std::span<const float>(allVertices).subspan(range.firstVertex * 3, (vertexEnd - range.firstVertex) * 3),
+            .indices = indices,
+            .tbnsIndices = tbnsIndices,
+            .texCoords = std::span<const float>(allTexCoords).subspan(range.firstTexCoord * 2, (texCoordEnd - range.firstTexCoord) * 2),
+            .texIndices = texIndices
+    };
 }
 
 
@@ -207,28 +529,33 @@ reina::scene::ModelRange reina::scene::Models::getModelRange(uint32_t index) con
     return modelRanges[index];
 }
 
+std::span<const reina::scene::LodLevel> reina::scene::Models::getLodChain(uint32_t index) const {
+    if (index >= lodChains.size()) {
+        throw std::runtime_error("Index " + std::to_string(index) + " out of range for models");
+    }
+
+    return lodChains[index];
+}
+
+glm::vec4 reina::scene::Models::getBoundingSphere(uint32_t index) const {
+    if (index >= boundingSpheres.size()) {
+        throw std::runtime_error("Index " + std::to_string(index) + " out of range for models");
+    }
+
+    return boundingSpheres[index];
+}
+
 void reina::scene::Models::destroy(VkDevice logicalDevice) {
     verticesBuffer.destroy(logicalDevice);
-    offsetIndicesBuffer.destroy(logicalDevice);
-    nonOffsetIndicesBuffer.destroy(logicalDevice);
-    offsetTbnsIndicesBuffer.destroy(logicalDevice);
+    indicesBuffer.destroy(logicalDevice);
     tbnsBuffer.destroy(logicalDevice);
     texCoordsBuffer.destroy(logicalDevice);
-    offsetTexIndicesBuffer.destroy(logicalDevice);
 }
 
 const reina::core::Buffer& reina::scene::Models::getTbnsBuffer() const {
     return tbnsBuffer;
 }
 
-const reina::core::Buffer& reina::scene::Models::getOffsetTbnsIndicesBuffer() const {
-    return offsetTbnsIndicesBuffer;
-}
-
-const reina::core::Buffer &reina::scene::Models::getOffsetTexIndicesBuffer() const {
-    return offsetTexIndicesBuffer;
-}
-
 const reina::core::Buffer &reina::scene::Models::getTexCoordsBuffer() const {
     return texCoordsBuffer;
 }
@@ -237,6 +564,26 @@ size_t reina::scene::Models::getNumModels() const {
     return modelRanges.size();
 }
 
+void reina::scene::Models::setGeometryCache(reina::scene::GeometryCache cache) {
+    geometryCache = std::move(cache);
+}
+
+const reina::scene::GeometryCache& reina::scene::Models::getGeometryCache() const {
+    return geometryCache;
+}
+
+void reina::scene::Models::setUseNativeObjLoader(bool useNative) {
+    useNativeObjLoader = useNative;
+}
+
+void reina::scene::Models::setOptimizeMeshes(bool optimize) {
+    optimizeMeshes = optimize;
+}
+
+void reina::scene::Models::setGenerateLods(bool generate) {
+    lodsEnabled = generate;
+}
+
 bool reina::scene::Models::areBuffersBuilt() const {
     return builtBuffers;
 }
@@ -4,29 +4,40 @@
 #include <vector>
 #include <string>
 #include <optional>
+#include <span>
 #include <glm/glm.hpp>
 
 #include "../core/Buffer.h"
+#include "ModelData.h"
+#include "GeometryCache.h"
+#include "VertexEncoding.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
 
 namespace reina::scene {
+    /**
+     * Where a model lives in the packed streams. Index offsets are in uints into the index buffer, and the indices
+     * themselves are relative to firstVertex, firstNormal and firstTexCoord.
+     */
     struct ModelRange {
         uint32_t firstVertex;
         uint32_t firstNormal;
+        uint32_t firstTexCoord;
         uint32_t indexOffset;
         uint32_t tbnsIndexOffset;
-        uint32_t texIndexOffset;
+        uint32_t texIndexOffset;  // -1 if the model has no UVs
         uint32_t indexCount;
         uint32_t tbnsIndexCount;
         uint32_t texIndexCount;
+        uint32_t indexFlags;  // INDEX_FLAG_* from raytrace.h
     };
 
-    struct ModelData {
-        std::vector<float> vertices;
-        std::vector<uint32_t> indices;
-        std::vector<glm::mat3> tbns;
-        std::vector<uint32_t> tbnsIndices;
-        std::vector<float> texCoords;
-        std::vector<uint32_t> texIndices;
+    /**
+     * A simplified version of a model. Each level is packed as a model of its own.
+     */
+    struct LodLevel {
+        uint32_t modelID;
+        float error;  // object space distance bound to the full resolution model; 0 for the model itself
     };
 
     class Models {
@@ -41,24 +52,108 @@ namespace reina::scene {
         uint32_t addModel(const std::string& filepath);
 
         /**
-         * @param objData The model's OBJ data
+         * Copies the model into the packed geometry streams. Models keeps no other copy of the data.
+         * @param model The model's streams
+         * @param optimized Whether the model already went through optimizeModels, or was cached under
+         *                  geometryCacheOptions after it did, and is packed as is
          * @return The model ID
          */
-        uint32_t addModel(const ModelData& objData);
+        uint32_t addModel(const ModelView& model, bool optimized = false);
+
+        /**
+         * Takes ownership of the model so its memory is released as soon as it is packed
+         * @param objData The model's data
+         * @param optimized Whether the model already went through optimizeModels (see addModel(const ModelView&, bool))
+         * @return The model ID
+         */
+        uint32_t addModel(ModelData&& objData, bool optimized = false);
+
+        /**
+         * Welds and reorders imported models in place if mesh optimization is on, so they can be stored in the
+         * geometry cache optimized and added with optimized = true
+         * @param models The imported models
+         */
+        void optimizeModels(std::vector<ImportedModel>& models);
+
+        /**
+         * @param importOptions The options a loader caches its geometry under
+         * @return importOptions with a bit set if mesh optimization is on, so optimized geometry is cached apart from
+         *         geometry as imported
+         */
+        [[nodiscard]] uint32_t geometryCacheOptions(uint32_t importOptions) const;
+
+        /**
+         * Reserves room for models that are about to be added, so the packed streams are allocated once instead of
+         * growing (and briefly existing twice) while the models are added
+         * @param upcoming The models that will be added
+         */
+        void reserve(std::span<const ModelView> upcoming);
+
+        /**
+         * Frees the host copies of the packed geometry streams. Call once the buffers are built and nothing needs to
+         * read the geometry on the CPU anymore; getModelData throws afterward.
+         */
+        void releaseHostData();
+
+        /**
+         * @return The number of bytes allocated for the packed host geometry streams
+         */
+        [[nodiscard]] size_t getHostDataBytes() const;
+
+        /**
+         * @param cache The cache used by addModel(filepath). A default constructed cache disables caching.
+         */
+        void setGeometryCache(GeometryCache cache);
+        [[nodiscard]] const GeometryCache& getGeometryCache() const;
+
+        /**
+         * @param useNative Whether addModel(filepath) loads .obj files with the native multithreaded loader instead of
+         *                  Assimp. Assimp is still used as a fallback if the native loader fails.
+         */
+        void setUseNativeObjLoader(bool useNative);
+
+        /**
+         * @param optimize Whether added models are welded and reordered for memory locality first (see optimizeMesh)
+         */
+        void setOptimizeMeshes(bool optimize);
+
+        /**
+         * @param generate Whether models added from now on get a chain of simplified LOD levels (see getLodChain)
+         */
+        void setGenerateLods(bool generate);
+
         void buildBuffers(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue);
 
         [[nodiscard]] size_t getVerticesBufferSize() const;
 
         [[nodiscard]] const reina::core::Buffer& getVerticesBuffer() const;
-        [[nodiscard]] const reina::core::Buffer& getOffsetIndicesBuffer() const;
-        [[nodiscard]] const reina::core::Buffer& getNonOffsetIndicesBuffer() const;
+        /**
+         * @return The buffer holding every model's index streams, 16 or 32 bits wide depending on the model
+         */
+        [[nodiscard]] const reina::core::Buffer& getIndicesBuffer() const;
         [[nodiscard]] const reina::core::Buffer& getTbnsBuffer() const;
-        [[nodiscard]] const reina::core::Buffer& getOffsetTbnsIndicesBuffer() const;
         [[nodiscard]] const reina::core::Buffer& getTexCoordsBuffer() const;
-        [[nodiscard]] const reina::core::Buffer& getOffsetTexIndicesBuffer() const;
 
-        [[nodiscard]] const ModelData& getModelData(uint32_t index) const;
+        /**
+         * @param index The model ID
+         * @return A view into the packed host streams. Indices are relative to the model's first vertex. TBNs are only
+         *         kept encoded, so the view's tbns are empty.
+         */
+        [[nodiscard]] ModelView getModelData(uint32_t index) const;
         [[nodiscard]] ModelRange getModelRange(uint32_t index) const;
+
+        /**
+         * @param index The model ID
+         * @return The model's LOD levels from full resolution to coarsest. The first level is always the model itself,
+         *         and it is the only level if LOD generation is off or the model couldn't be simplified.
+         */
+        [[nodiscard]] std::span<const LodLevel> getLodChain(uint32_t index) const;
+
+        /**
+         * @param index The model ID
+         * @return A sphere around the model in object space, with the center in xyz and the radius in w
+         */
+        [[nodiscard]] glm::vec4 getBoundingSphere(uint32_t index) const;
         [[nodiscard]] size_t getNumModels() const;
 
         [[nodiscard]] bool areBuffersBuilt() const;
@@ -66,30 +161,69 @@ namespace reina::scene {
         void destroy(VkDevice logicalDevice);
 
     private:
+        // Offsets of a model's index streams in the host index vectors
+        struct HostIndexRange {
+            size_t indices;
+            size_t tbnsIndices;
+            size_t texIndices;
+        };
+
+        uint32_t packModel(const ModelView& model);
+
+        /**
+         * Runs optimizeMesh on the model and adds its stats to the totals reported by buildBuffers
+         */
+        [[nodiscard]] ModelData optimizeWithStats(const ModelView& model);
+
+        /**
+         * Simplifies the model in steps of half the triangles, packing every level that made progress
+         * @param model The full resolution model
+         * @param modelID The model's ID, whose LOD chain the levels are appended to
+         */
+        void generateLods(const ModelView& model, uint32_t modelID);
+
+        /**
+         * @param native Whether to try the native OBJ loader before Assimp. Set to false if Assimp made the model.
+         */
+        [[nodiscard]] static ModelData importModel(const std::string& filepath, bool& native);
         [[nodiscard]] static ModelData getObjData(const std::string& filepath);
 
-        std::vector<ModelData> modelData;
+        GeometryCache geometryCache;
+        bool useNativeObjLoader = true;
+        bool optimizeMeshes = false;
+        bool lodsEnabled = false;
+
+        // Totals over every model optimized in this run, reported by buildBuffers. Models read from the geometry cache
+        // were optimized when they were stored and aren't counted
+        MeshOptimizeStats optimizeTotals{};
+        size_t optimizedTriangles = 0;
+
         reina::core::Buffer verticesBuffer;
-        reina::core::Buffer offsetIndicesBuffer;
-        reina::core::Buffer nonOffsetIndicesBuffer;
+        reina::core::Buffer indicesBuffer;
         reina::core::Buffer tbnsBuffer;
-        reina::core::Buffer offsetTbnsIndicesBuffer;
         reina::core::Buffer texCoordsBuffer;
-        reina::core::Buffer offsetTexIndicesBuffer;
 
         size_t verticesBufferSize = 0;
+        uint32_t indexBufferWords = 0;
+        size_t unsharedIndexBytes = 0;  // what the index streams would take as separate 32-bit buffers
 
         bool builtBuffers = false;
+        bool releasedHostData = false;
 
         std::vector<float> allVertices = std::vector<float>(0);
-        std::vector<float> allTBNs = std::vector<float>(0);
+        std::vector<PackedTBN> allTBNs = std::vector<PackedTBN>(0);
         std::vector<float> allTexCoords = std::vector<float>(0);
-        std::vector<uint32_t> allIndicesOffset = std::vector<uint32_t>(0);
-        std::vector<uint32_t> allTexIndicesOffset = std::vector<uint32_t>(0);
-        std::vector<uint32_t> allTBNsIndicesOffset = std::vector<uint32_t>(0);
-        std::vector<uint32_t> allIndicesNonOffset = std::vector<uint32_t>(0);
+        // Host index streams are kept at 32 bits and relative to the model; buildBuffers packs them for the GPU.
+        // TBN and UV indices are only stored for models that don't share topology.
+        std::vector<uint32_t> allIndices = std::vector<uint32_t>(0);
+        std::vector<uint32_t> allTBNsIndices = std::vector<uint32_t>(0);
+        std::vector<uint32_t> allTexIndices = std::vector<uint32_t>(0);
 
         std::vector<ModelRange> modelRanges;
+        std::vector<glm::vec4> boundingSpheres;
+        std::vector<std::vector<LodLevel>> lodChains;
+        size_t lodTriangles = 0;  // triangles packed for LOD levels, reported by buildBuffers
+        std::vector<HostIndexRange> hostIndexRanges;
     };
 }
 
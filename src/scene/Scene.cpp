@@ -3,24 +3,87 @@
 #include <vulkan/vulkan.h>
 
 #include "Instances.h"
+#include "../tools/Memory.h"
+#include "../tools/ThreadPool.h"
+#include "../graphics/EmissionMap.h"
+#include "../graphics/BlasBuilder.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <unordered_map>
+
+namespace {
+    // Points the geometry fields of an instance's properties at a model
+    void setGeometry(reina::scene::InstanceProperties& properties, const reina::scene::ModelRange& range) {
+        properties.indicesOffset = range.indexOffset;
+        properties.tbnsIndicesOffset = range.tbnsIndexOffset;
+        properties.texIndicesOffset = range.texIndexOffset;
+        properties.vertexOffset = range.firstVertex;
+        properties.tbnsOffset = range.firstNormal;
+        properties.texCoordsOffset = range.firstTexCoord;
+        properties.indexFlags = range.indexFlags;
+    }
+}
+
+reina::scene::Scene::Scene(const reina::scene::SceneOptions& options) {
+    if (options.geometryCacheDirectory.has_value()) {
+        models.setGeometryCache(GeometryCache{options.geometryCacheDirectory.value()});
+    }
+    if (options.mipCacheDirectory.has_value()) {
+        mipCache = reina::graphics::MipCache{options.mipCacheDirectory.value()};
+    }
+
+    models.setUseNativeObjLoader(options.nativeObjLoader);
+    models.setOptimizeMeshes(options.optimizeMeshes);
+    models.setGenerateLods(options.generateLods);
+    compressTextures = options.compressTextures;
+    textureBudgetBytes = options.textureBudgetBytes;
+    environmentMapPath = options.environmentMap;
+    environmentIntensity = options.environmentIntensity;
+    buildLightBvh = options.buildLightBvh;
+
+    lodMaxErrorPixels = options.lodMaxErrorPixels;
+    lodViewpoint = options.lodViewpoint;
+}
 
 uint32_t reina::scene::Scene::defineObject(const std::string& filepath) {
     return models.addModel(filepath);
 }
 
 uint32_t reina::scene::Scene::defineObject(const reina::scene::ModelData &modelData) {
-    return models.addModel(modelData);
+    return models.addModel(modelData.view());
 }
 
-uint32_t reina::scene::Scene::defineTexture(const std::string& filepath) {
+uint32_t reina::scene::Scene::defineObject(reina::scene::ModelData&& modelData, bool optimized) {
+    return models.addModel(std::move(modelData), optimized);
+}
+
+uint32_t reina::scene::Scene::defineObject(const reina::scene::ModelView& modelView, bool optimized) {
+    return models.addModel(modelView, optimized);
+}
+
+void reina::scene::Scene::optimizeObjects(std::vector<reina::scene::ImportedModel>& importedModels) {
+    models.optimizeModels(importedModels);
+}
+
+void reina::scene::Scene::reserveObjects(std::span<const reina::scene::ModelView> upcoming) {
+    models.reserve(upcoming);
+}
+
+uint32_t reina::scene::Scene::defineTexture(const std::string& filepath, float importance) {
     // TODO: make it so that validation layer warnings do not occur if there are no textures in the scene
     texturesToCreate.emplace_back(filepath);
+    textureImportance.push_back(importance);
     return static_cast<uint32_t>(texturesToCreate.size() - 1);
 }
 
 
-uint32_t reina::scene::Scene::defineTexture(std::byte* imageData, size_t imageLengthBytes) {
+uint32_t reina::scene::Scene::defineTexture(std::byte* imageData, size_t imageLengthBytes, float importance) {
     texturesToCreate.emplace_back(RawImageData{imageData, imageLengthBytes});
+    textureImportance.push_back(importance);
     return static_cast<uint32_t>(texturesToCreate.size() - 1);
 }
 
@@ -47,73 +110,227 @@ void reina::scene::Scene::addInstance(uint32_t objectID, glm::mat4 transform, co
             mat.metallic,
             mat.clearcoat,
             mat.specularTransmission,
-            mat.sheen
+            mat.sheen,
+            models.getModelRange(objectID).firstVertex,
+            models.getModelRange(objectID).firstNormal,
+            models.getModelRange(objectID).firstTexCoord,
+            models.getModelRange(objectID).indexFlags,
+            mat.emissionMapID
             );
 
-    instancesToCreate.emplace_back(instanceProperties.size() - 1, mat.materialIdx, objectID, transform);
+    instancesToCreate.emplace_back(instanceProperties.size() - 1, mat.materialIdx, objectID, objectID, transform);
 }
 
 void reina::scene::Scene::build(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue) {
     /*
      * Steps:
-     * 1. Create textures
+     * 1. Create textures and the environment map
      * 2. Build models buffers
      * 3. Build BLASes
      * 4. Create instances
      * 5. Build TLAS
      * 6. Create instance properties buffer
+     * 7. Release host geometry
      */
 
-    // Step 1
-    for (const auto& texToCreate : texturesToCreate) {
-        std::visit(
-            [&](auto&& arg) {
-                using T = std::decay_t<decltype(arg)>;
-                if constexpr (std::is_same_v<T, std::string>) {
-                    textures.emplace_back(logicalDevice, physicalDevice, cmdPool, queue, arg);
-                } else {
-                    textures.emplace_back(
-                            logicalDevice,
-                            physicalDevice,
-                            cmdPool,
-                            queue,
-                            arg.imageData,
-                            arg.imageLengthBytes
-                    );
-                }
-            },
-            texToCreate
-        );
+    // Step 1. Texture IDs are indices into texturesToCreate until the textures are loaded. Each texture's mip chain is
+    // filtered for how materials use it, and its weight under the memory budget grows with the instances that use it.
+    std::vector<reina::graphics::ImageSource> textureSources(texturesToCreate.size());
+    for (size_t i = 0; i < texturesToCreate.size(); i++) {
+        if (const auto* filepath = std::get_if<std::string>(&texturesToCreate[i])) {
+            textureSources[i].data = *filepath;
+        } else {
+            const RawImageData& raw = std::get<RawImageData>(texturesToCreate[i]);
+            textureSources[i].data = std::span<const std::byte>(raw.imageData, raw.imageLengthBytes);
+        }
+    }
+
+    std::vector<bool> filterAssigned(texturesToCreate.size(), false);
+    std::vector<uint32_t> references(texturesToCreate.size(), 0);
+    auto assignFilter = [&](int textureID, reina::graphics::MipFilter filter) {
+        if (textureID < 0) {
+            return;
+        }
+        references[textureID]++;
+        if (!filterAssigned[textureID]) {
+            textureSources[textureID].mipFilter = filter;
+            filterAssigned[textureID] = true;
+        } else if (textureSources[textureID].mipFilter != filter) {
+            std::cerr << "Warning: texture " << textureID << " is used both as a color and as a normal or bump map; its mips are filtered for the first use\n";
+        }
+    };
+    for (const InstanceProperties& properties : instanceProperties) {
+        assignFilter(properties.textureID, reina::graphics::MipFilter::COLOR);
+        assignFilter(properties.normalMapTexID, reina::graphics::MipFilter::NORMAL);
+        assignFilter(properties.bumpMapTexID, reina::graphics::MipFilter::LINEAR);
+        assignFilter(properties.emissionMapTexID, reina::graphics::MipFilter::COLOR);
+    }
+    for (size_t i = 0; i < texturesToCreate.size(); i++) {
+        textureSources[i].weight = static_cast<float>(references[i]) * textureImportance[i];
     }
 
+    reina::graphics::LoadedImages loadedTextures = reina::graphics::loadImages(logicalDevice, physicalDevice, cmdPool, queue, textureSources, mipCache,
+                                                                               compressTextures, textureBudgetBytes);
+    textures = std::move(loadedTextures.images);
+
+    // Duplicate textures share one image, so materials are pointed at its descriptor slot
+    auto remapTexture = [&](int& textureID) {
+        if (textureID >= 0) {
+            textureID = static_cast<int>(loadedTextures.imageIndices[textureID]);
+        }
+    };
+    for (InstanceProperties& properties : instanceProperties) {
+        remapTexture(properties.textureID);
+        remapTexture(properties.normalMapTexID);
+        remapTexture(properties.bumpMapTexID);
+        remapTexture(properties.emissionMapTexID);
+
+        // A bump map whose mips were filtered for another use doesn't have them, so it is marched without skipping
+        properties.bumpMapMinHeights = properties.bumpMapTexID >= 0 && loadedTextures.minHeights[properties.bumpMapTexID] ? 1u : 0u;
+    }
+
+    // Emission maps of instances that emit are also decoded to luminance on the CPU, which step 4 weighs the emissive
+    // triangles with. Sources of the same image are decoded once.
+    std::vector<int> emissionMapSources(textures.size(), -1);
+    for (size_t i = 0; i < texturesToCreate.size(); i++) {
+        emissionMapSources[loadedTextures.imageIndices[i]] = static_cast<int>(i);
+    }
+    std::vector<uint32_t> emissionMapImages;
+    for (const InstanceProperties& properties : instanceProperties) {
+        if (properties.emissionMapTexID >= 0 && glm::dot(properties.emission, properties.emission) > 0.0f) {
+            emissionMapImages.push_back(static_cast<uint32_t>(properties.emissionMapTexID));
+        }
+    }
+    std::ranges::sort(emissionMapImages);
+    emissionMapImages.erase(std::unique(emissionMapImages.begin(), emissionMapImages.end()), emissionMapImages.end());
+
+    std::vector<reina::graphics::EmissionMap> emissionMaps(textures.size());
+    reina::tools::ThreadPool::shared().parallelFor(emissionMapImages.size(), [&](size_t i) {
+        emissionMaps[emissionMapImages[i]] = reina::graphics::EmissionMap{textureSources[emissionMapSources[emissionMapImages[i]]]};
+    });
+
+    environmentMap = reina::graphics::EnvironmentMap{logicalDevice, physicalDevice, cmdPool, queue, environmentMapPath, environmentIntensity};
+
     // Step 2
+    size_t hostGeometryBytes = models.getHostDataBytes();
+    reina::tools::MemoryUsage memoryBeforeUpload = reina::tools::getMemoryUsage();
     models.buildBuffers(logicalDevice, physicalDevice, cmdPool, queue);
 
-    // Step 3
+    // Step 3. Models no instance uses, such as LOD levels that weren't selected, keep a default constructed BLAS
+    selectLods();
+
+    std::vector<bool> modelUsed(models.getNumModels(), false);
+    for (const auto& instanceToCreate : instancesToCreate) {
+        modelUsed[instanceToCreate.objectID] = true;
+    }
+
+    size_t selectedTriangles = 0;
+    size_t fullTriangles = 0;
+    for (const auto& instanceToCreate : instancesToCreate) {
+        selectedTriangles += models.getModelRange(instanceToCreate.objectID).indexCount;
+        fullTriangles += models.getModelRange(instanceToCreate.fullResolutionID).indexCount;
+    }
+
+    VkDeviceSize selectedBuildBytes = 0;
+    VkDeviceSize fullBuildBytes = 0;
+    VkDeviceSize compactedBytes = 0;
+    std::vector<bool> fullUsed(models.getNumModels(), false);
+    for (const auto& instanceToCreate : instancesToCreate) {
+        fullUsed[instanceToCreate.fullResolutionID] = true;
+    }
+
+    // All the BLASes are built together, so a scene of many models waits on the device a few times rather than per model
+    reina::graphics::BlasBuilder blasBuilder{models};
+    std::vector<uint32_t> builtModels;
+    for (uint32_t i = 0; i < models.getNumModels(); i++) {
+        if (fullUsed[i]) {
+            fullBuildBytes += reina::graphics::Blas::queryBuildSize(logicalDevice, models, models.getModelRange(i));
+        }
+        if (!modelUsed[i]) {
+            continue;
+        }
+
+        selectedBuildBytes += reina::graphics::Blas::queryBuildSize(logicalDevice, models, models.getModelRange(i));
+        blasBuilder.add(models.getModelRange(i));
+        builtModels.push_back(i);
+    }
+
+    std::vector<reina::graphics::Blas> builtBlases = blasBuilder.build(logicalDevice, physicalDevice, cmdPool, queue, true);
     blases.resize(models.getNumModels());
-    for (size_t i = 0; i < models.getNumModels(); i++) {
-        blases[i] = reina::graphics::Blas{logicalDevice, physicalDevice, cmdPool, queue, models, models.getModelRange(i), true};
+    for (size_t i = 0; i < builtModels.size(); i++) {
+        blases[builtModels[i]] = builtBlases[i];
+        compactedBytes += builtBlases[i].getBuffer().getSize();
+    }
+
+    if (selectedTriangles != fullTriangles) {
+        std::cout << "LOD selection: " << selectedTriangles << " instanced triangles, down from " << fullTriangles
+                  << " at full resolution; BLAS build size " << static_cast<double>(selectedBuildBytes) / (1024.0 * 1024.0)
+                  << " MiB, down from " << static_cast<double>(fullBuildBytes) / (1024.0 * 1024.0) << " MiB ("
+                  << static_cast<double>(compactedBytes) / (1024.0 * 1024.0) << " MiB after compaction)\n";
+    }
+
+    // Step 4. Emissive instances of a model whose transforms have the same shape share how their emission is spread
+    // over the triangles, so it is computed once per shape, and the shapes are computed in parallel.
+    auto emissiveStart = std::chrono::high_resolution_clock::now();
+
+    auto emissionMapOf = [&](const InstanceProperties& properties) -> const reina::graphics::EmissionMap* {
+        return properties.emissionMapTexID >= 0 ? &emissionMaps[properties.emissionMapTexID] : nullptr;
+    };
+
+    std::unordered_map<EmissiveShapeKey, size_t, EmissiveShapeKeyHash> shapeIndices;
+    std::vector<const InstanceToCreate*> shapeInstances;  // the first instance of each shape
+    std::vector<size_t> instanceShapes(instancesToCreate.size(), SIZE_MAX);  // SIZE_MAX for instances that don't emit
+    size_t emissiveInstanceCount = 0;
+    for (size_t i = 0; i < instancesToCreate.size(); i++) {
+        const InstanceProperties& properties = instanceProperties[instancesToCreate[i].instancePropertiesID];
+        if (glm::dot(properties.emission, properties.emission) <= 0.00001f * 0.00001f) {
+            continue;
+        }
+
+        EmissiveShapeKey key{instancesToCreate[i].objectID, properties.emissionMapTexID, glm::mat3(instancesToCreate[i].transform)};
+        auto [shape, inserted] = shapeIndices.try_emplace(key, shapeInstances.size());
+        if (inserted) {
+            shapeInstances.push_back(&instancesToCreate[i]);
+        }
+        instanceShapes[i] = shape->second;
+        emissiveInstanceCount++;
     }
 
-    // Step 4
+    std::vector<std::shared_ptr<const EmissiveTriangles>> shapes(shapeInstances.size());
+    reina::tools::ThreadPool::shared().parallelFor(shapes.size(), [&](size_t i) {
+        const InstanceToCreate& instanceToCreate = *shapeInstances[i];
+        shapes[i] = std::make_shared<const EmissiveTriangles>(EmissiveTriangles::compute(
+                models.getModelData(instanceToCreate.objectID), glm::mat3(instanceToCreate.transform),
+                emissionMapOf(instanceProperties[instanceToCreate.instancePropertiesID])
+        ));
+    });
+
     std::vector<Instance> instancesVec;
-    for (const auto& instanceToCreate : instancesToCreate) {
+    instancesVec.reserve(instancesToCreate.size());
+    for (size_t i = 0; i < instancesToCreate.size(); i++) {
+        const InstanceToCreate& instanceToCreate = instancesToCreate[i];
         instancesVec.emplace_back(
                 blases[instanceToCreate.objectID],
                 instanceProperties[instanceToCreate.instancePropertiesID].emission,
                 models.getModelRange(instanceToCreate.objectID),
-                models.getModelData(instanceToCreate.objectID),
+                instanceToCreate.objectID,
                 instanceToCreate.instancePropertiesID,
                 instanceToCreate.materialIdx,
                 instanceProperties[instanceToCreate.instancePropertiesID].cullBackface,
-                instanceToCreate.transform
+                instanceToCreate.transform,
+                instanceProperties[instanceToCreate.instancePropertiesID].emissionMapTexID,
+                instanceShapes[i] != SIZE_MAX ? shapes[instanceShapes[i]] : nullptr
                 );
     }
 
-    instances = Instances{logicalDevice, physicalDevice, instancesVec};
+    instances = Instances{logicalDevice, physicalDevice, instancesVec, models, buildLightBvh};
+
+    auto emissiveEnd = std::chrono::high_resolution_clock::now();
+    std::cout << "Emissive sampling data: " << emissiveInstanceCount << " emissive instances sharing " << shapes.size()
+              << " triangle distributions in " << std::chrono::duration<double, std::milli>(emissiveEnd - emissiveStart).count() << " ms\n";
 
     // Step 5
-    tlas = vktools::createTlas(logicalDevice, physicalDevice, cmdPool, queue, instancesVec);
+    tlas = reina::graphics::Tlas{logicalDevice, physicalDevice, cmdPool, queue, instancesVec};
 
     // Step 6
     instancePropertiesBuffer = reina::core::Buffer{
@@ -122,6 +339,55 @@ void reina::scene::Scene::build(VkDevice logicalDevice, VkPhysicalDevice physica
             static_cast<VkMemoryAllocateFlagBits>(0),
             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
     };
+
+    // Step 7. The packed geometry is only read on the CPU by steps 3 and 4, so the host copies can go now
+    models.releaseHostData();
+
+    std::cout << "Host geometry: " << static_cast<double>(hostGeometryBytes) / (1024.0 * 1024.0) << " MiB released after upload\n"
+              << "Process memory before upload: " << reina::tools::formatMemoryUsage(memoryBeforeUpload) << "\n"
+              << "Process memory after build: " << reina::tools::formatMemoryUsage(reina::tools::getMemoryUsage()) << "\n";
+}
+
+void reina::scene::Scene::selectLods() {
+    if (!lodViewpoint.has_value()) {
+        return;
+    }
+
+    // Pixels per radian near the center of the image
+    float pixelsPerRadian = static_cast<float>(lodViewpoint->imageHeight) / (2.0f * std::tan(lodViewpoint->verticalFov / 2.0f));
+
+    size_t simplifiedInstances = 0;
+    for (auto& instanceToCreate : instancesToCreate) {
+        std::span<const LodLevel> chain = models.getLodChain(instanceToCreate.fullResolutionID);
+        if (chain.size() < 2) {
+            continue;
+        }
+
+        // The largest axis scale bounds how much the transform stretches the object space error and bounding sphere
+        const glm::mat4& transform = instanceToCreate.transform;
+        float scale = std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))});
+
+        glm::vec4 sphere = models.getBoundingSphere(instanceToCreate.fullResolutionID);
+        glm::vec3 center = glm::vec3(transform * glm::vec4(glm::vec3(sphere), 1.0f));
+        float distance = std::max(glm::length(center - lodViewpoint->position) - sphere.w * scale, 1e-4f);
+
+        // Levels are ordered by increasing error, so the last one that fits is the coarsest
+        LodLevel selected = chain.front();
+        for (const LodLevel& level : chain) {
+            if (level.error * scale / distance * pixelsPerRadian <= lodMaxErrorPixels) {
+                selected = level;
+            }
+        }
+
+        if (selected.modelID != instanceToCreate.objectID) {
+            simplifiedInstances++;
+        }
+
+        instanceToCreate.objectID = selected.modelID;
+        setGeometry(instanceProperties[instanceToCreate.instancePropertiesID], models.getModelRange(selected.modelID));
+    }
+
+    std::cout << "LOD selection: " << simplifiedInstances << "/" << instancesToCreate.size() << " instances use a simplified level\n";
 }
 
 void reina::scene::Scene::destroy(VkDevice logicalDevice) {
@@ -129,11 +395,7 @@ void reina::scene::Scene::destroy(VkDevice logicalDevice) {
     instancePropertiesBuffer.destroy(logicalDevice);
     models.destroy(logicalDevice);
 
-    auto vkDestroyAccelerationStructureKHR = reinterpret_cast<PFN_vkDestroyAccelerationStructureKHR>(
-            vkGetDeviceProcAddr(logicalDevice, "vkDestroyAccelerationStructureKHR"));
-
-    vkDestroyAccelerationStructureKHR(logicalDevice, tlas.accelerationStructure, nullptr);
-    tlas.buffer.destroy(logicalDevice);
+    tlas.destroy(logicalDevice);
 
     for (auto& blas : blases) {
         blas.destroy(logicalDevice);
@@ -142,6 +404,33 @@ void reina::scene::Scene::destroy(VkDevice logicalDevice) {
     for (auto& texture : textures) {
         texture.destroy(logicalDevice);
     }
+    environmentMap.destroy(logicalDevice);
+}
+
+void reina::scene::Scene::setInstanceTransform(size_t instanceIndex, glm::mat4 transform) {
+    if (isInstanceEmissive(instanceIndex)) {
+        throw std::invalid_argument("Cannot move an emissive instance; its light sampling data is built in world space");
+    }
+
+    instancesToCreate[instanceIndex].transform = transform;
+    tlas.setInstanceTransform(instanceIndex, transform);
+}
+
+size_t reina::scene::Scene::getInstanceCount() const {
+    return instancesToCreate.size();
+}
+
+bool reina::scene::Scene::isInstanceEmissive(size_t instanceIndex) const {
+    const InstanceProperties& properties = instanceProperties[instancesToCreate.at(instanceIndex).instancePropertiesID];
+    return glm::dot(properties.emission, properties.emission) > 0.00001f * 0.00001f;
+}
+
+glm::mat4 reina::scene::Scene::getInstanceTransform(size_t instanceIndex) const {
+    return instancesToCreate.at(instanceIndex).transform;
+}
+
+bool reina::scene::Scene::updateTlas(VkDevice logicalDevice, VkCommandBuffer cmdBuffer) {
+    return tlas.update(logicalDevice, cmdBuffer);
 }
 
 float reina::scene::Scene::getEmissiveWeight() {
@@ -149,7 +438,7 @@ float reina::scene::Scene::getEmissiveWeight() {
 }
 
 const vktools::AccStructureInfo& reina::scene::Scene::getTlas() const {
-    return tlas;
+    return tlas.getAccStructureInfo();
 }
 
 const reina::scene::Models& reina::scene::Scene::getModels() const {
@@ -168,6 +457,10 @@ const std::vector<reina::graphics::Image> &reina::scene::Scene::getTextures() co
     return textures;
 }
 
+const reina::graphics::EnvironmentMap& reina::scene::Scene::getEnvironmentMap() const {
+    return environmentMap;
+}
+
 uint32_t reina::scene::Scene::addObject(const std::string& filepath, glm::mat4 transform,
                                         const reina::scene::Material& mat) {
     uint32_t objectID = defineObject(filepath);
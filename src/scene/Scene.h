@@ -6,11 +6,16 @@
 #include <vector>
 #include <unordered_map>
 #include <variant>
+#include <span>
+#include <optional>
+#include <filesystem>
 #include <glm/glm.hpp>
 
 #include "../graphics/Image.h"
+#include "../graphics/EnvironmentMap.h"
 #include "Instance.h"
 #include "../graphics/Blas.h"
+#include "../graphics/Tlas.h"
 #include "../tools/vktools.h"
 #include "Instances.h"
 #include "../../polyglot/raytrace.h"
@@ -43,6 +48,32 @@ namespace reina::scene {
         float clearcoat;
         float specularTransmission;
         float sheen;
+
+        int emissionMapID = -1;  // scales the emission, e.g. for screens and lamp shades
+    };
+
+    /**
+     * The camera that LOD levels are chosen for
+     */
+    struct LodViewpoint {
+        glm::vec3 position;
+        float verticalFov;  // radians
+        uint32_t imageHeight;  // pixels
+    };
+
+    struct SceneOptions {
+        std::optional<std::filesystem::path> geometryCacheDirectory;  // std::nullopt disables the geometry cache
+        std::optional<std::filesystem::path> mipCacheDirectory;  // std::nullopt disables the texture mip cache
+        bool nativeObjLoader = true;  // load .obj files with the native loader instead of Assimp
+        bool optimizeMeshes = false;  // weld vertices and reorder triangles for memory locality when models are added
+        bool generateLods = false;  // simplify models into LOD levels when they are added
+        float lodMaxErrorPixels = 0.5f;  // each instance uses the coarsest LOD whose error projects to at most this
+        std::optional<LodViewpoint> lodViewpoint;  // std::nullopt renders every instance at full resolution
+        bool compressTextures = false;  // store color textures as BC7, and normal and bump textures as BC5
+        std::optional<size_t> textureBudgetBytes;  // std::nullopt leaves texture memory unbounded
+        std::optional<std::filesystem::path> environmentMap;  // equirectangular HDR image; std::nullopt keeps the gradient sky
+        float environmentIntensity = 1.0f;
+        bool buildLightBvh = false;  // build a light BVH over the emissive triangles, which NEE can pick them with
     };
 
     namespace {
@@ -50,6 +81,7 @@ namespace reina::scene {
             uint32_t instancePropertiesID;
             uint32_t materialIdx;
             uint32_t objectID;
+            uint32_t fullResolutionID;  // objectID before a LOD level was selected
             glm::mat4 transform;
         };
 
@@ -62,6 +94,7 @@ namespace reina::scene {
     class Scene {
     public:
         Scene() = default;
+        explicit Scene(const SceneOptions& options);
 
         /**
          * Define an object to be referenced by instances
@@ -78,18 +111,55 @@ namespace reina::scene {
         uint32_t defineObject(const ModelData& modelData);
 
         /**
-         * Define a texture to be referenced by materials
+         * Define an object to be referenced by instances. The model data is released once it is copied into the scene.
+         * @param modelData The model data of the object
+         * @param optimized Whether the model already went through optimizeObjects and is used as is
+         * @return The object ID
+         */
+        uint32_t defineObject(ModelData&& modelData, bool optimized = false);
+
+        /**
+         * Define an object to be referenced by instances
+         * @param modelView A view of the model data of the object
+         * @param optimized Whether the model already went through optimizeObjects, or was cached after it did, and is
+         *                  used as is
+         * @return The object ID
+         */
+        uint32_t defineObject(const ModelView& modelView, bool optimized = false);
+
+        /**
+         * Optimizes models that are about to be defined in place if mesh optimization is on (see
+         * Models::optimizeModels), so they can be cached optimized
+         * @param importedModels The imported models
+         */
+        void optimizeObjects(std::vector<ImportedModel>& importedModels);
+
+        /**
+         * Reserves room for objects that are about to be defined so the scene's geometry is allocated once
+         * @param upcoming The objects that will be defined
+         */
+        void reserveObjects(std::span<const ModelView> upcoming);
+
+        /**
+         * Define a texture to be referenced by materials. Textures with identical contents are loaded once when the
+         * scene is built, and the materials that use them share a descriptor slot. KTX2 files in the formats parseKtx2
+         * supports are uploaded with their levels as stored, without decoding or flipping.
+         *
+         * Over the texture memory budget, textures are downscaled starting with those that are referenced by the fewest
+         * instances relative to their importance and size.
          * @param image The image
+         * @param importance How much the texture's resolution matters relative to other textures
          * @return The image ID
          */
-        uint32_t defineTexture(const std::string& filepath);
+        uint32_t defineTexture(const std::string& filepath, float importance = 1.0f);
 
         /**
          * Define a texture to be referenced by materials
          * @param image The image data
+         * @param importance How much the texture's resolution matters relative to other textures
          * @return The image ID
          */
-         uint32_t defineTexture(std::byte* imageData, size_t imageLengthBytes);
+         uint32_t defineTexture(std::byte* imageData, size_t imageLengthBytes, float importance = 1.0f);
 
         /**
          * A combination of defineObject and addInstance. Intended for when only one instance is required; saves on
@@ -113,8 +183,45 @@ namespace reina::scene {
          */
         void addInstance(uint32_t objectID, glm::mat4 transform, const Material& mat);
 
+        /**
+         * Builds the scene. If LODs were generated and a viewpoint is set, every instance is first switched to the
+         * coarsest LOD level whose error projects to at most lodMaxErrorPixels from the viewpoint, and only the levels
+         * in use get a BLAS.
+         */
         void build(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue);
 
+        /**
+         * Moves a non-emissive instance after the scene is built. The TLAS is refit by the next updateTlas(). Emissive
+         * instances can't be moved, since their light sampling data is in world space.
+         * @param instanceIndex The index of the instance, in the order the instances were added
+         * @param transform The new object to world transform
+         */
+        void setInstanceTransform(size_t instanceIndex, glm::mat4 transform);
+
+        /**
+         * @return The number of instances added to the scene
+         */
+        [[nodiscard]] size_t getInstanceCount() const;
+
+        /**
+         * @param instanceIndex The index of the instance, in the order the instances were added
+         * @return Whether the instance emits light, which means setInstanceTransform can't move it
+         */
+        [[nodiscard]] bool isInstanceEmissive(size_t instanceIndex) const;
+
+        /**
+         * @param instanceIndex The index of the instance, in the order the instances were added
+         * @return The instance's current object to world transform
+         */
+        [[nodiscard]] glm::mat4 getInstanceTransform(size_t instanceIndex) const;
+
+        /**
+         * Records a refit of the TLAS if any instance moved since the last call
+         * @param cmdBuffer A command buffer in the recording state, which the previous frame's rays are done with
+         * @return Whether any instance moved, in which case the accumulated image is stale
+         */
+        bool updateTlas(VkDevice logicalDevice, VkCommandBuffer cmdBuffer);
+
         [[nodiscard]] float getEmissiveWeight();
 
         [[nodiscard]] const vktools::AccStructureInfo& getTlas() const;
@@ -122,18 +229,34 @@ namespace reina::scene {
         [[nodiscard]] const Instances& getInstances() const;
         [[nodiscard]] const core::Buffer& getInstancePropertiesBuffer() const;
         [[nodiscard]] const std::vector<reina::graphics::Image>& getTextures() const;
+        [[nodiscard]] const reina::graphics::EnvironmentMap& getEnvironmentMap() const;
 
         void destroy(VkDevice logicalDevice);
 
     private:
+        /**
+         * Picks each instance's LOD level and points its objectID and instance properties at it
+         */
+        void selectLods();
+
         Models models;
+        float lodMaxErrorPixels = 0.5f;
+        std::optional<LodViewpoint> lodViewpoint;
         std::vector<std::variant<std::string, RawImageData>> texturesToCreate;
+        std::vector<float> textureImportance;  // of each texture to create
+        reina::graphics::MipCache mipCache;
+        bool compressTextures = false;
+        std::optional<size_t> textureBudgetBytes;
+        std::optional<std::filesystem::path> environmentMapPath;
+        float environmentIntensity = 1.0f;
+        bool buildLightBvh = false;
+        reina::graphics::EnvironmentMap environmentMap;
         std::vector<InstanceToCreate> instancesToCreate;
         std::vector<InstanceProperties> instanceProperties;
         std::vector<reina::graphics::Blas> blases;
         Instances instances;
         std::vector<reina::graphics::Image> textures;
-        vktools::AccStructureInfo tlas;
+        reina::graphics::Tlas tlas;
         reina::core::Buffer instancePropertiesBuffer;
     };
 }
@@ -0,0 +1,96 @@
+#include "VertexEncoding.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace {
+    constexpr float SNORM16_MAX = 32767.0f;
+    constexpr float UNORM15_MAX = 32767.0f;
+    constexpr uint32_t UNORM15_MASK = 0x7FFFu;
+    constexpr uint32_t BITANGENT_SIGN_BIT = 0x80000000u;
+
+    float signNotZero(float x) {
+        return x >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    // Matches GLSL's packSnorm2x16/unpackSnorm2x16
+    uint32_t packSnorm16(float x) {
+        auto quantized = static_cast<int16_t>(std::round(std::clamp(x, -1.0f, 1.0f) * SNORM16_MAX));
+        return static_cast<uint16_t>(quantized);
+    }
+
+    float unpackSnorm16(uint32_t bits) {
+        auto quantized = static_cast<int16_t>(static_cast<uint16_t>(bits));
+        return std::clamp(static_cast<float>(quantized) / SNORM16_MAX, -1.0f, 1.0f);
+    }
+
+    uint32_t packUnorm15(float x) {
+        return static_cast<uint32_t>(std::round((std::clamp(x, -1.0f, 1.0f) * 0.5f + 0.5f) * UNORM15_MAX));
+    }
+
+    float unpackUnorm15(uint32_t bits) {
+        return static_cast<float>(bits & UNORM15_MASK) / UNORM15_MAX * 2.0f - 1.0f;
+    }
+
+    // Duff et al. 2017, "Building an Orthonormal Basis, Revisited"
+    glm::vec3 perpendicular(glm::vec3 n) {
+        float sign = std::copysign(1.0f, n.z);
+        float a = -1.0f / (sign + n.z);
+        float b = n.x * n.y * a;
+        return glm::vec3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+    }
+}
+
+glm::vec2 reina::scene::octEncode(glm::vec3 v) {
+    float l1 = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+    glm::vec2 p = glm::vec2(v.x / l1, v.y / l1);
+
+    // Fold the lower hemisphere over the diagonals
+    if (v.z < 0.0f) {
+        p = glm::vec2((1.0f - std::abs(p.y)) * signNotZero(p.x), (1.0f - std::abs(p.x)) * signNotZero(p.y));
+    }
+
+    return p;
+}
+
+glm::vec3 reina::scene::octDecode(glm::vec2 e) {
+    glm::vec3 v = glm::vec3(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+    float t = std::max(-v.z, 0.0f);
+    v.x += v.x >= 0.0f ? -t : t;
+    v.y += v.y >= 0.0f ? -t : t;
+    return glm::normalize(v);
+}
+
+reina::scene::PackedTBN reina::scene::encodeTBN(const glm::mat3& tbn) {
+    glm::vec3 tangent = tbn[0];
+    glm::vec3 bitangent = tbn[1];
+    glm::vec3 normal = tbn[2];
+
+    float normalLength = glm::length(normal);
+    normal = normalLength > 0.0f ? normal / normalLength : glm::vec3(0.0f, 0.0f, 1.0f);
+
+    // Gram-Schmidt so the bitangent can be rebuilt from the cross product. A tangent within a few hundredths of a degree
+    // of the normal leaves mostly rounding error, whose direction is meaningless, so it's treated as degenerate too.
+    float inputLength = glm::length(tangent);
+    tangent = tangent - normal * glm::dot(normal, tangent);
+    float tangentLength = glm::length(tangent);
+    tangent = tangentLength > 1e-3f * inputLength ? tangent / tangentLength : perpendicular(normal);
+
+    bool flipped = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f;
+
+    glm::vec2 n = octEncode(normal);
+    glm::vec2 t = octEncode(tangent);
+
+    return PackedTBN{
+            .normal = packSnorm16(n.x) | (packSnorm16(n.y) << 16),
+            .tangent = packUnorm15(t.x) | (packUnorm15(t.y) << 15) | (flipped ? BITANGENT_SIGN_BIT : 0u)
+    };
+}
+
+glm::mat3 reina::scene::decodeTBN(reina::scene::PackedTBN packed) {
+    glm::vec3 normal = octDecode(glm::vec2(unpackSnorm16(packed.normal), unpackSnorm16(packed.normal >> 16)));
+    glm::vec3 tangent = octDecode(glm::vec2(unpackUnorm15(packed.tangent), unpackUnorm15(packed.tangent >> 15)));
+    float sign = (packed.tangent & BITANGENT_SIGN_BIT) ? -1.0f : 1.0f;
+
+    return glm::mat3(tangent, glm::cross(normal, tangent) * sign, normal);
+}
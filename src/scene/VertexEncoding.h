@@ -0,0 +1,51 @@
+#ifndef REINA_VK_VERTEXENCODING_H
+#define REINA_VK_VERTEXENCODING_H
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+namespace reina::scene {
+    /**
+     * A tangent frame in 8 bytes, decoded by decodeTBN in closestHitCommon.h.glsl. The bitangent is not stored; it is
+     * rebuilt as cross(normal, tangent) times the stored sign.
+     */
+    struct PackedTBN {
+        uint32_t normal;   // octahedral normal as two 16-bit snorms, x in the low half
+        uint32_t tangent;  // octahedral tangent as two 15-bit unorms, x in the low bits; bit 31 set if the bitangent is flipped
+    };
+
+    // Largest angle between a unit vector and its decoded value. Measured at 0.0037 and 0.0074 degrees over 4M random
+    // frames; the bounds leave some margin. VertexEncodingTest checks them.
+    constexpr float MAX_NORMAL_ERROR_DEGREES = 0.01f;
+    constexpr float MAX_TANGENT_ERROR_DEGREES = 0.02f;
+
+    /**
+     * Octahedral mapping of a unit vector onto [-1, 1]^2 (Cigolle et al. 2014, "A Survey of Efficient Representations
+     * for Independent Unit Vectors")
+     * @param v A non-zero vector
+     * @return The point on the octahedron's unfolded square
+     */
+    [[nodiscard]] glm::vec2 octEncode(glm::vec3 v);
+
+    /**
+     * @param e A point in [-1, 1]^2
+     * @return The unit vector it maps to
+     */
+    [[nodiscard]] glm::vec3 octDecode(glm::vec2 e);
+
+    /**
+     * Encodes a tangent frame. The tangent is made orthogonal to the normal first, and a frame with a degenerate
+     * tangent gets an arbitrary one perpendicular to the normal.
+     * @param tbn The tangent, bitangent and normal columns
+     * @return The encoded frame
+     */
+    [[nodiscard]] PackedTBN encodeTBN(const glm::mat3& tbn);
+
+    /**
+     * @param packed An encoded frame
+     * @return The orthonormal tangent, bitangent and normal columns
+     */
+    [[nodiscard]] glm::mat3 decodeTBN(PackedTBN packed);
+}
+
+#endif //REINA_VK_VERTEXENCODING_H
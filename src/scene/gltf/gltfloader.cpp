@@ -8,9 +8,20 @@
 
 #include <fastgltf/core.hpp>
 #include <iostream>
+#include <chrono>
+#include <algorithm>
 #include <unordered_set>
 
 #include "mikktspace.h"
+#include "../../tools/Hash.h"
+#include "../../tools/ThreadPool.h"
+#include "../../tools/MappedFile.h"
+#include "../../graphics/Ktx2.h"
+
+namespace {
+    // The glTF importer has no options yet; this only separates its cache entries from other importers
+    constexpr uint32_t GLTF_IMPORT_OPTIONS = 0;
+}
 
 
 static int getNumFaces(const SMikkTSpaceContext* ctx) {
@@ -87,6 +98,7 @@ fastgltf::Asset reina::scene::gltf::loadGltf(const std::string& filepath) {
     static constexpr auto supportedExts =
             fastgltf::Extensions::KHR_mesh_quantization |
             fastgltf::Extensions::KHR_texture_transform |
+            fastgltf::Extensions::KHR_texture_basisu |
             fastgltf::Extensions::KHR_materials_variants |
             fastgltf::Extensions::KHR_materials_transmission |
             fastgltf::Extensions::KHR_materials_clearcoat |
@@ -119,6 +131,120 @@ fastgltf::Asset reina::scene::gltf::loadGltf(const std::string& filepath) {
     return std::move(assetOrErr.get());
 }
 
+static reina::scene::gltf::Primitive decodePrimitive(const fastgltf::Asset& asset, const fastgltf::Primitive& prim) {
+    using reina::scene::gltf::Primitive;
+
+    Primitive m;
+
+    // - MATERIAL
+    m.materialIdx = static_cast<int>(prim.materialIndex.value_or(-1));
+
+    // — POSITION
+    if (auto a = prim.findAttribute("POSITION")) {
+        const auto& acc = asset.accessors[a->accessorIndex];
+        m.vertices.resize(acc.count);
+        fastgltf::iterateAccessorWithIndex<fastgltf::math::fvec3>(
+                asset, acc,
+                [&](const fastgltf::math::fvec3& p, std::size_t i) {
+                    m.vertices[i].position = p;
+                }
+        );
+    }
+    // — NORMAL
+    if (auto a = prim.findAttribute("NORMAL")) {
+        if (a == prim.attributes.end()) {
+            throw std::runtime_error("Meshes without vertex normals are not supported");
+        }
+
+        const auto& acc = asset.accessors[a->accessorIndex];
+        fastgltf::iterateAccessorWithIndex<fastgltf::math::fvec3>(
+            asset, acc,
+            [&](fastgltf::math::fvec3 n, size_t i) {
+                m.vertices[i].normal = n;
+            });
+    }
+
+    if (auto tanIt = prim.findAttribute("TANGENT"); tanIt != prim.attributes.end()) {
+        const auto& acc = asset.accessors[tanIt->accessorIndex];
+        // Vec4 case: apply w as bitangent sign
+        if (acc.type == fastgltf::AccessorType::Vec4) {
+            fastgltf::iterateAccessorWithIndex<fastgltf::math::fvec4>(
+                    asset, acc,
+                    [&](const fastgltf::math::fvec4& t, std::size_t i) {
+                        // tangent.xyz
+                        m.vertices[i].tangent  = { t.x(), t.y(), t.z() };
+                        // bitangent = cross(normal, tangent) * w
+                        m.vertices[i].bitangent =
+                                fastgltf::math::cross(m.vertices[i].normal,
+                                                      m.vertices[i].tangent)
+                                * t.w();
+                    }
+            );
+        }
+            // Vec3 fallback: no handedness, assume w == +1
+        else if (acc.type == fastgltf::AccessorType::Vec3) {
+            fastgltf::iterateAccessorWithIndex<fastgltf::math::fvec3>(
+                    asset, acc,
+                    [&](const fastgltf::math::fvec3& t, std::size_t i) {
+                        m.vertices[i].tangent   = t;
+                        // bitangent = cross(normal, tangent)
+                        m.vertices[i].bitangent =
+                                fastgltf::math::cross(m.vertices[i].normal,
+                                                      m.vertices[i].tangent);
+                    }
+            );
+        }
+        else {
+            // Unexpected accessor type—either skip or log a warning
+            std::cerr << "Warning: TANGENT accessor is neither Vec4 nor Vec3\n";
+        }
+    } else {
+        // Tangents not provided; compute them yourself
+        SMikkTSpaceInterface interface = {
+                .m_getNumFaces         = getNumFaces,
+                .m_getNumVerticesOfFace= getNumVertsOfFace,
+                .m_getPosition         = getPosition,
+                .m_getNormal           = getNormal,
+                .m_getTexCoord         = getTexCoord,
+                .m_setTSpace           = setTSpace
+        };
+
+        SMikkTSpaceContext ctx = {
+                .m_pInterface = &interface,
+                .m_pUserData = &m
+        };
+
+        genTangSpaceDefault(&ctx);
+    }
+
+    // — TEXCOORD_0
+    if (auto a = prim.findAttribute("TEXCOORD_0")) {
+        if (a != prim.attributes.end()) {
+            const auto& acc = asset.accessors[a->accessorIndex];
+
+            fastgltf::iterateAccessorWithIndex<fastgltf::math::fvec2>(
+                    asset, acc,
+                    [&](fastgltf::math::fvec2 uv, size_t i) {
+                        m.vertices[i].uv = uv;
+                    });
+        } else {
+            std::cerr << "Warning: falling back to UV coords (0, 0) since none were found" << std::endl;
+            // Fallback with UV (0, 0)
+            for (auto& vertex : m.vertices) {
+                vertex.uv = fastgltf::math::fvec2(0, 0);
+            }
+        }
+    }
+    // — INDICES
+    if (prim.indicesAccessor.has_value()) {
+        const auto& acc = asset.accessors[*prim.indicesAccessor];
+        m.indices.resize(acc.count);
+        fastgltf::copyFromAccessor<uint32_t>(asset, acc, m.indices.data());
+    }
+
+    return m;
+}
+
 std::unordered_map<uint32_t, std::vector<reina::scene::gltf::Primitive>> reina::scene::gltf::loadPrimitives(fastgltf::Asset& asset) {
     // — Gather meshes used by default scene
     std::unordered_set<size_t> used;
@@ -133,135 +259,118 @@ std::unordered_map<uint32_t, std::vector<reina::scene::gltf::Primitive>> reina::
                                     if (node.meshIndex.has_value()) used.insert(*node.meshIndex);
                                 });
 
+    std::vector<size_t> usedSorted(used.begin(), used.end());
+    std::sort(usedSorted.begin(), usedSorted.end());
+
+    // — Every primitive is decoded independently, so flatten them into jobs. Each job writes to its own slot, which
+    //   keeps the output order independent of thread scheduling.
     std::unordered_map<uint32_t, std::vector<Primitive>> meshIdToPrimitives;
+    std::vector<std::pair<size_t, size_t>> jobs;  // (mesh index, primitive index)
 
-    // — For each used mesh → each primitive
-    for (auto mi : used) {
-        const auto& mesh = asset.meshes[mi];
-        for (const auto& prim : mesh.primitives) {
-            Primitive m;
-
-            // - MATERIAL
-            m.materialIdx = static_cast<int>(prim.materialIndex.value_or(-1));
-
-            // — POSITION
-            if (auto a = prim.findAttribute("POSITION")) {
-                const auto& acc = asset.accessors[a->accessorIndex];
-                m.vertices.resize(acc.count);
-                fastgltf::iterateAccessorWithIndex<fastgltf::math::fvec3>(
-                        asset, acc,
-                        [&](const fastgltf::math::fvec3& p, std::size_t i) {
-                            m.vertices[i].position = p;
-                        }
-                );
-            }
-            // — NORMAL
-            if (auto a = prim.findAttribute("NORMAL")) {
-                if (a == prim.attributes.end()) {
-                    throw std::runtime_error("Meshes without vertex normals are not supported");
-                }
+    for (size_t mi : usedSorted) {
+        meshIdToPrimitives[mi].resize(asset.meshes[mi].primitives.size());
+        for (size_t pi = 0; pi < asset.meshes[mi].primitives.size(); pi++) {
+            jobs.emplace_back(mi, pi);
+        }
+    }
 
-                const auto& acc = asset.accessors[a->accessorIndex];
-                fastgltf::iterateAccessorWithIndex<fastgltf::math::fvec3>(
-                    asset, acc,
-                    [&](fastgltf::math::fvec3 n, size_t i) {
-                        m.vertices[i].normal = n;
-                    });
-            }
+    reina::tools::ThreadPool::shared().parallelFor(jobs.size(), [&](size_t job) {
+        auto [mi, pi] = jobs[job];
+        meshIdToPrimitives.at(mi)[pi] = decodePrimitive(asset, asset.meshes[mi].primitives[pi]);
+    });
 
-            if (auto tanIt = prim.findAttribute("TANGENT"); tanIt != prim.attributes.end()) {
-                const auto& acc = asset.accessors[tanIt->accessorIndex];
-                // Vec4 case: apply w as bitangent sign
-                if (acc.type == fastgltf::AccessorType::Vec4) {
-                    fastgltf::iterateAccessorWithIndex<fastgltf::math::fvec4>(
-                            asset, acc,
-                            [&](const fastgltf::math::fvec4& t, std::size_t i) {
-                                // tangent.xyz
-                                m.vertices[i].tangent  = { t.x(), t.y(), t.z() };
-                                // bitangent = cross(normal, tangent) * w
-                                m.vertices[i].bitangent =
-                                        fastgltf::math::cross(m.vertices[i].normal,
-                                                              m.vertices[i].tangent)
-                                        * t.w();
-                            }
-                    );
-                }
-                    // Vec3 fallback: no handedness, assume w == +1
-                else if (acc.type == fastgltf::AccessorType::Vec3) {
-                    fastgltf::iterateAccessorWithIndex<fastgltf::math::fvec3>(
-                            asset, acc,
-                            [&](const fastgltf::math::fvec3& t, std::size_t i) {
-                                m.vertices[i].tangent   = t;
-                                // bitangent = cross(normal, tangent)
-                                m.vertices[i].bitangent =
-                                        fastgltf::math::cross(m.vertices[i].normal,
-                                                              m.vertices[i].tangent);
-                            }
-                    );
-                }
-                else {
-                    // Unexpected accessor type—either skip or log a warning
-                    std::cerr << "Warning: TANGENT accessor is neither Vec4 nor Vec3\n";
-                }
-            } else {
-                // Tangents not provided; compute them yourself
-                SMikkTSpaceInterface interface = {
-                        .m_getNumFaces         = getNumFaces,
-                        .m_getNumVerticesOfFace= getNumVertsOfFace,
-                        .m_getPosition         = getPosition,
-                        .m_getNormal           = getNormal,
-                        .m_getTexCoord         = getTexCoord,
-                        .m_setTSpace           = setTSpace
-                };
+    return meshIdToPrimitives;
+}
 
-                SMikkTSpaceContext ctx = {
-                        .m_pInterface = &interface,
-                        .m_pUserData = &m
-                };
+std::vector<reina::scene::ImportedModel> reina::scene::gltf::primitivesToModelData(const std::unordered_map<uint32_t, std::vector<reina::scene::gltf::Primitive>>& meshIdToPrimitives) {
+    // Sort by mesh ID so object IDs do not depend on unordered_map iteration order
+    std::vector<uint32_t> meshIDs;
+    meshIDs.reserve(meshIdToPrimitives.size());
+    for (const auto& [meshID, primitives] : meshIdToPrimitives) {
+        meshIDs.push_back(meshID);
+    }
+    std::sort(meshIDs.begin(), meshIDs.end());
 
-                genTangSpaceDefault(&ctx);
-            }
+    std::vector<std::pair<uint32_t, const Primitive*>> jobs;
+    for (uint32_t meshID : meshIDs) {
+        for (const Primitive& primitive : meshIdToPrimitives.at(meshID)) {
+            jobs.emplace_back(meshID, &primitive);
+        }
+    }
 
-            // — TEXCOORD_0
-            if (auto a = prim.findAttribute("TEXCOORD_0")) {
-                if (a != prim.attributes.end()) {
-                    const auto& acc = asset.accessors[a->accessorIndex];
-
-                    fastgltf::iterateAccessorWithIndex<fastgltf::math::fvec2>(
-                            asset, acc,
-                            [&](fastgltf::math::fvec2 uv, size_t i) {
-                                m.vertices[i].uv = uv;
-                            });
-                } else {
-                    std::cerr << "Warning: falling back to UV coords (0, 0) since none were found" << std::endl;
-                    // Fallback with UV (0, 0)
-                    for (auto& vertex : m.vertices) {
-                        vertex.uv = fastgltf::math::fvec2(0, 0);
-                    }
+    std::vector<ImportedModel> models(jobs.size());
+    reina::tools::ThreadPool::shared().parallelFor(jobs.size(), [&](size_t job) {
+        models[job] = ImportedModel{jobs[job].first, jobs[job].second->toModelData()};
+    });
+
+    return models;
+}
+
+static uint64_t hashAssetSources(const fastgltf::Asset& asset, const std::string& filepath) {
+    uint64_t hash = reina::tools::hashFile(filepath);
+
+    // External buffers are not part of the glTF file itself, so their contents are hashed too
+    for (const fastgltf::Buffer& buffer : asset.buffers) {
+        std::visit(fastgltf::visitor{
+                [](const auto&) {},
+                [&](const fastgltf::sources::Vector& vector) {
+                    hash = reina::tools::hashCombine(hash, reina::tools::hash64(vector.bytes.data(), vector.bytes.size()));
+                },
+                [&](const fastgltf::sources::Array& array) {
+                    hash = reina::tools::hashCombine(hash, reina::tools::hash64(array.bytes.data(), array.bytes.size()));
                 }
-            }
-            // — INDICES
-            if (prim.indicesAccessor.has_value()) {
-                const auto& acc = asset.accessors[*prim.indicesAccessor];
-                m.indices.resize(acc.count);
-                fastgltf::copyFromAccessor<uint32_t>(asset, acc, m.indices.data());
-            }
+        }, buffer.data);
+    }
 
-            meshIdToPrimitives[mi].emplace_back(std::move(m));
+    return hash;
+}
+
+std::unordered_map<uint32_t, std::vector<uint32_t>> reina::scene::gltf::loadMeshes(fastgltf::Asset& asset, const std::string& filepath, reina::scene::Scene& scene) {
+    auto start = std::chrono::high_resolution_clock::now();
+    const GeometryCache& cache = scene.getModels().getGeometryCache();
+
+    std::unordered_map<uint32_t, std::vector<uint32_t>> meshIdToSceneObjectId;
+    bool cacheHit = false;
+
+    if (!cache.isEnabled()) {
+        meshIdToSceneObjectId = addMeshesToScene(scene, primitivesToModelData(loadPrimitives(asset)));
+    } else {
+        uint64_t sourceHash = hashAssetSources(asset, filepath);
+        uint32_t importOptions = scene.getModels().geometryCacheOptions(GLTF_IMPORT_OPTIONS);
+        std::optional<CachedGeometry> cached = cache.load(filepath, importOptions, sourceHash);
+        cacheHit = cached.has_value();
+
+        // Models are optimized before they are stored, so cache hits skip optimizing too
+        if (cacheHit) {
+            meshIdToSceneObjectId = addMeshesToScene(scene, cached->models);
+        } else {
+            std::vector<ImportedModel> models = primitivesToModelData(loadPrimitives(asset));
+            scene.optimizeObjects(models);
+            cache.store(filepath, importOptions, sourceHash, models);
+            meshIdToSceneObjectId = addMeshesToScene(scene, std::move(models), true);
         }
     }
 
-    return meshIdToPrimitives;
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Loaded geometry of " << filepath << (cacheHit ? " from geometry cache" : "") << " in "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+
+    return meshIdToSceneObjectId;
 }
 
 reina::scene::ModelData reina::scene::gltf::Primitive::toModelData() const {
     reina::scene::ModelData modelData;
+    modelData.vertices.reserve(vertices.size() * 3);
+    modelData.tbns.reserve(vertices.size());
+    modelData.texCoords.reserve(vertices.size() * 2);
+    modelData.indices.reserve(indices.size());
+    modelData.tbnsIndices.reserve(indices.size());
+    modelData.texIndices.reserve(indices.size());
 
     for (const VertexTBN& vertex : vertices) {
         modelData.vertices.push_back(vertex.position.x());
         modelData.vertices.push_back(vertex.position.y());
         modelData.vertices.push_back(vertex.position.z());
-        modelData.vertices.push_back(1.0f);
 
         glm::mat3 tbn = glm::mat3(
                 glm::vec3(vertex.tangent.x(), vertex.tangent.y(), vertex.tangent.z()),
@@ -284,10 +393,88 @@ reina::scene::ModelData reina::scene::gltf::Primitive::toModelData() const {
     return modelData;
 }
 
+namespace {
+    /**
+     * @return The encoded bytes of an image. Images in separate files are memory mapped into file.
+     */
+    std::span<const std::byte> imageBytes(fastgltf::Asset& asset, fastgltf::Image& image, reina::tools::MappedFile& file) {
+        std::span<const std::byte> bytes;
+
+        std::visit(fastgltf::visitor{
+            [](auto& arg) {
+                throw std::runtime_error("Could not parse texture; internal gLTF data type not supported");
+            },
+            [&](fastgltf::sources::URI& uri) {
+                file = reina::tools::MappedFile{uri.uri.fspath().string()};
+                bytes = file.bytes();
+            },
+            [&](fastgltf::sources::Vector& vector) {
+                bytes = std::span<const std::byte>(vector.bytes.data(), vector.bytes.size());
+            },
+            [&](fastgltf::sources::Array& array) {
+                bytes = std::span<const std::byte>(array.bytes.data(), array.bytes.size());
+            },
+            [&](fastgltf::sources::BufferView& view) {
+                auto& bufferView = asset.bufferViews[view.bufferViewIndex];
+
+                std::visit(fastgltf::visitor{
+                        [](auto&&) {
+                            throw std::runtime_error("Unsupported buffer data source");
+                        },
+                        [&](fastgltf::sources::Vector& vector) {
+                            bytes = std::span<const std::byte>(vector.bytes.data() + bufferView.byteOffset, bufferView.byteLength);
+                        },
+                        [&](fastgltf::sources::Array& array) {
+                            bytes = std::span<const std::byte>(array.bytes.data() + bufferView.byteOffset, bufferView.byteLength);
+                        }
+                }, asset.buffers[bufferView.bufferIndex].data);
+            },
+        }, image.data);
+
+        return bytes;
+    }
+
+    /**
+     * KHR_texture_basisu textures name a KTX2 image and usually a PNG or JPEG fallback. The KTX2 image is used when its
+     * levels can be uploaded as stored; Basis Universal payloads would need transcoding, so the fallback is used then.
+     * @return The image a texture samples, or std::nullopt if none of its images can be loaded
+     */
+    std::optional<size_t> textureImage(fastgltf::Asset& asset, const fastgltf::Texture& texture, size_t textureIndex) {
+        if (texture.basisuImageIndex.has_value()) {
+            try {
+                reina::tools::MappedFile file;
+                (void) reina::graphics::parseKtx2(imageBytes(asset, asset.images[texture.basisuImageIndex.value()], file));
+                return texture.basisuImageIndex.value();
+            } catch (const std::exception& e) {
+                std::cerr << "Warning: KTX2 image of texture " << textureIndex << " can't be uploaded directly (" << e.what() << ")"
+                          << (texture.imageIndex.has_value() ? "; using its fallback image\n" : "; the texture is skipped\n");
+            }
+        }
+
+        if (texture.imageIndex.has_value()) {
+            return texture.imageIndex.value();
+        }
+        return std::nullopt;
+    }
+}
+
 std::unordered_map<uint32_t, uint32_t> addTexturesToScene(fastgltf::Asset& asset, reina::scene::Scene& scene) {
-    std::unordered_map<uint32_t, uint32_t> gltfIdToSceneId;
+    std::unordered_map<uint32_t, uint32_t> gltfImageIdToSceneId;
+    std::unordered_map<uint32_t, uint32_t> gltfTexIdToSceneId;
+
+    // Only images that a texture samples are defined, so unused fallbacks aren't loaded
+    for (uint32_t textureIndex = 0; textureIndex < asset.textures.size(); textureIndex++) {
+        std::optional<size_t> imageIndex = textureImage(asset, asset.textures[textureIndex], textureIndex);
+        if (!imageIndex.has_value()) {
+            continue;
+        }
+
+        auto i = static_cast<uint32_t>(imageIndex.value());
+        if (auto defined = gltfImageIdToSceneId.find(i); defined != gltfImageIdToSceneId.end()) {
+            gltfTexIdToSceneId[textureIndex] = defined->second;
+            continue;
+        }
 
-    for (uint32_t i = 0; i < asset.images.size(); i++) {
         // Modified from: https://vkguide.dev/docs/new_chapter_5/gltf_textures/
         fastgltf::Image& img = asset.images[i];
 
@@ -305,15 +492,15 @@ std::unordered_map<uint32_t, uint32_t> addTexturesToScene(fastgltf::Asset& asset
                 std::string path = uri.uri.fspath().string();
 
                 uint32_t texIDScene = scene.defineTexture(path);
-                gltfIdToSceneId[i] = texIDScene;
+                gltfImageIdToSceneId[i] = texIDScene;
             },
             [&](fastgltf::sources::Vector& vector) {
                 uint32_t texIDScene = scene.defineTexture(vector.bytes.data(), vector.bytes.size());
-                gltfIdToSceneId[i] = texIDScene;
+                gltfImageIdToSceneId[i] = texIDScene;
             },
             [&](fastgltf::sources::Array& array) {
                 uint32_t texIDScene = scene.defineTexture(array.bytes.data(), array.bytes.size());
-                gltfIdToSceneId[i] = texIDScene;
+                gltfImageIdToSceneId[i] = texIDScene;
             },
             [&](fastgltf::sources::BufferView& view) {
                 auto& bufferView = asset.bufferViews[view.bufferViewIndex];
@@ -326,30 +513,56 @@ std::unordered_map<uint32_t, uint32_t> addTexturesToScene(fastgltf::Asset& asset
                         [&](fastgltf::sources::Vector& vector) {
                             auto ptr = vector.bytes.data() + bufferView.byteOffset;
                             uint32_t texIDScene = scene.defineTexture(ptr, bufferView.byteLength);
-                            gltfIdToSceneId[i] = texIDScene;
+                            gltfImageIdToSceneId[i] = texIDScene;
                         },
                         [&](fastgltf::sources::Array& array) {
                             auto ptr = array.bytes.data() + bufferView.byteOffset;
 
                             uint32_t texIDScene = scene.defineTexture(ptr, bufferView.byteLength);
-                            gltfIdToSceneId[i] = texIDScene;
+                            gltfImageIdToSceneId[i] = texIDScene;
                         }
                 }, buffer.data);
             },
         }, img.data);
+
+        gltfTexIdToSceneId[textureIndex] = gltfImageIdToSceneId.at(i);
+    }
+
+    return gltfTexIdToSceneId;
+}
+
+std::unordered_map<uint32_t, std::vector<uint32_t>> reina::scene::gltf::addMeshesToScene(reina::scene::Scene& scene, std::vector<reina::scene::ImportedModel>&& models, bool optimized) {
+    std::vector<ModelView> views;
+    views.reserve(models.size());
+    for (const ImportedModel& model : models) {
+        views.push_back(model.modelData.view());
+    }
+    scene.reserveObjects(views);
+
+    std::unordered_map<uint32_t, std::vector<uint32_t>> meshIdToSceneObjectId;
+
+    for (ImportedModel& model : models) {
+        // Moving each model in releases it as soon as it is packed, instead of when the whole list goes away
+        uint32_t sceneID = scene.defineObject(std::move(model.modelData), optimized);
+        meshIdToSceneObjectId[model.meshID].push_back(sceneID);
     }
 
-    return gltfIdToSceneId;
+    return meshIdToSceneObjectId;
 }
 
-std::unordered_map<uint32_t, std::vector<uint32_t>> reina::scene::gltf::addMeshesToScene(reina::scene::Scene& scene, const std::unordered_map<uint32_t, std::vector<reina::scene::gltf::Primitive>>& meshIdToPrimitive) {
+std::unordered_map<uint32_t, std::vector<uint32_t>> reina::scene::gltf::addMeshesToScene(reina::scene::Scene& scene, const std::vector<reina::scene::CachedModel>& models) {
+    std::vector<ModelView> views;
+    views.reserve(models.size());
+    for (const CachedModel& model : models) {
+        views.push_back(model.view);
+    }
+    scene.reserveObjects(views);
+
     std::unordered_map<uint32_t, std::vector<uint32_t>> meshIdToSceneObjectId;
 
-    for (const auto& [meshID, primitives] : meshIdToPrimitive) {
-        for (const Primitive& primitive : primitives) {
-            uint32_t sceneID = scene.defineObject(primitive.toModelData());
-            meshIdToSceneObjectId[meshID].push_back(sceneID);
-        }
+    for (const CachedModel& model : models) {
+        uint32_t sceneID = scene.defineObject(model.view, true);
+        meshIdToSceneObjectId[model.meshID].push_back(sceneID);
     }
 
     return meshIdToSceneObjectId;
@@ -384,20 +597,30 @@ inline glm::vec3 toGlm(const fastgltf::math::nvec3& v) {
     return glm::vec3{ v.x(), v.y(), v.z() };
 }
 
-std::unordered_map<uint32_t, std::vector<reina::scene::Material>> reina::scene::gltf::materialsFromMeshTBNs(fastgltf::Asset &asset, const std::unordered_map<uint32_t, std::vector<reina::scene::gltf::Primitive>>& meshIdToPrimitives, std::unordered_map<uint32_t, uint32_t> gltfTexIdToSceneId) {
+std::unordered_map<uint32_t, std::vector<reina::scene::Material>> reina::scene::gltf::materialsFromMeshTBNs(fastgltf::Asset &asset, const std::unordered_map<uint32_t, std::vector<uint32_t>>& meshIdToSceneIds, std::unordered_map<uint32_t, uint32_t> gltfTexIdToSceneId) {
     std::unordered_map<uint32_t, std::vector<Material>> meshIdToMaterials;
 
-    for (const auto& [meshID, primitives] : meshIdToPrimitives) {
-        for (const Primitive& primitive : primitives) {
+    // Materials are read from the asset rather than the primitives, since cached geometry skips primitive decoding
+    for (const auto& [meshID, sceneIds] : meshIdToSceneIds) {
+        for (size_t primitiveIdx = 0; primitiveIdx < sceneIds.size(); primitiveIdx++) {
             Material material{3, -1, -1, -1, glm::vec3(1.0f), glm::vec3(0.0f), 0.0f, 1.5f, true, 0.0f, false, 0.0f, 0.0f, 0.0f, glm::vec3(1.0f), glm::vec3(1.0f), 0.0f, 0.0f, 0.0f, 0.0f};
 
-            if (primitive.materialIdx != -1) {
-                const auto& gltfMaterial = asset.materials[primitive.materialIdx];
+            const auto& materialIndex = asset.meshes[meshID].primitives[primitiveIdx].materialIndex;
+            if (materialIndex.has_value()) {
+                const auto& gltfMaterial = asset.materials[*materialIndex];
 
-                if (glm::any(glm::greaterThan(toGlm(gltfMaterial.emissiveFactor), glm::vec3(0))) && !gltfMaterial.emissiveTexture.has_value()) {
-                    // emission maps are not supported yet so do not include any emissive materials that require an emission map
+                if (glm::any(glm::greaterThan(toGlm(gltfMaterial.emissiveFactor), glm::vec3(0)))) {
                     std::cout << "emissive factor: " << gltfMaterial.emissiveFactor.x() << " " << gltfMaterial.emissiveFactor.y() << " " << gltfMaterial.emissiveFactor.z() << " | strength: " << gltfMaterial.emissiveStrength << "\n";
                     material.emission = toGlm(gltfMaterial.emissiveFactor) * gltfMaterial.emissiveStrength;
+
+                    if (gltfMaterial.emissiveTexture.has_value()) {
+                        try {
+                            material.emissionMapID = static_cast<int>(gltfTexIdToSceneId.at(static_cast<uint32_t>(gltfMaterial.emissiveTexture.value().textureIndex)));
+                        } catch (const std::out_of_range& e) {
+                            std::cerr << "Warning: Emissive Texture ID not found. Exception: " << e.what() << std::endl;
+                            material.emissionMapID = -1;  // Fallback
+                        }
+                    }
                 }
 
                 material.metallic = gltfMaterial.pbrData.metallicFactor;
@@ -415,14 +638,14 @@ std::unordered_map<uint32_t, std::vector<reina::scene::Material>> reina::scene::
 
                 if (gltfMaterial.pbrData.baseColorTexture.has_value()) {
                     try {
-                        material.textureID = static_cast<int>(gltfTexIdToSceneId.at(static_cast<uint32_t>(asset.textures[gltfMaterial.pbrData.baseColorTexture.value().textureIndex].imageIndex.value())));
+                        material.textureID = static_cast<int>(gltfTexIdToSceneId.at(static_cast<uint32_t>(gltfMaterial.pbrData.baseColorTexture.value().textureIndex)));
                     } catch (const std::out_of_range& e) {
                         std::cerr << "Warning: Texture ID not found. Exception: " << e.what() << std::endl;
                         material.textureID = -1;  // Fallback
                     }
                 } if (gltfMaterial.normalTexture.has_value()) {
                     try {
-                        material.normalMapID = static_cast<int>(gltfTexIdToSceneId.at(static_cast<uint32_t>(asset.textures[gltfMaterial.normalTexture.value().textureIndex].imageIndex.value())));
+                        material.normalMapID = static_cast<int>(gltfTexIdToSceneId.at(static_cast<uint32_t>(gltfMaterial.normalTexture.value().textureIndex)));
                     }  catch (const std::out_of_range& e) {
                         std::cerr << "Warning: Normal Texture ID not found. Exception: " << e.what() << std::endl;
                         material.normalMapID = -1;  // Fallback
@@ -437,15 +660,13 @@ std::unordered_map<uint32_t, std::vector<reina::scene::Material>> reina::scene::
     return meshIdToMaterials;
 }
 
-reina::scene::Scene reina::scene::gltf::loadScene(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue, const std::string& filepath) {
+reina::scene::Scene reina::scene::gltf::loadScene(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue, const std::string& filepath, const reina::scene::SceneOptions& options) {
     auto asset = loadGltf(filepath);
 
-    auto meshIdToPrimitives = loadPrimitives(asset);
-
-    Scene scene;
-    auto gltfModelIdToSceneId = addMeshesToScene(scene, meshIdToPrimitives);
+    Scene scene{options};
+    auto gltfModelIdToSceneId = loadMeshes(asset, filepath, scene);
     auto gltfTexIdToSceneId = addTexturesToScene(asset, scene);
-    auto gltfModelIdToMaterials = materialsFromMeshTBNs(asset, meshIdToPrimitives, gltfTexIdToSceneId);
+    auto gltfModelIdToMaterials = materialsFromMeshTBNs(asset, gltfModelIdToSceneId, gltfTexIdToSceneId);
     addInstancesToScene(asset, scene, gltfModelIdToSceneId, gltfModelIdToMaterials);
     reina::scene::Material lightMaterial{0, -1, -1, -1, glm::vec3(0.9f), glm::vec3(16.0f), 0.0f, 0.0f, false, 0.0f, true};
 
@@ -28,10 +28,33 @@ namespace reina::scene::gltf {
 
     std::unordered_map<uint32_t, std::vector<reina::scene::gltf::Primitive>> loadPrimitives(fastgltf::Asset& asset);
 
+    /**
+     * @param meshIdToPrimitives The primitives of each mesh
+     * @return The model data of every primitive, sorted by mesh ID then primitive index
+     */
+    std::vector<reina::scene::ImportedModel> primitivesToModelData(
+            const std::unordered_map<uint32_t, std::vector<reina::scene::gltf::Primitive>>& meshIdToPrimitives
+            );
+
+    /**
+     * Adds every primitive in the default scene to the scene as an object, using the scene's geometry cache if it is
+     * enabled
+     * @param asset The glTF asset
+     * @param filepath The filepath the asset was loaded from
+     * @param scene The scene to add the objects to
+     * @return The scene object IDs of each mesh's primitives
+     */
+    std::unordered_map<uint32_t, std::vector<uint32_t>> loadMeshes(fastgltf::Asset& asset, const std::string& filepath, reina::scene::Scene& scene);
+
+    std::unordered_map<uint32_t, std::vector<uint32_t>> addMeshesToScene(
+            reina::scene::Scene& scene,
+            std::vector<reina::scene::ImportedModel>&& models,
+            bool optimized = false
+            );
+
     std::unordered_map<uint32_t, std::vector<uint32_t>> addMeshesToScene(
             reina::scene::Scene& scene,
-            const std::unordered_map<uint32_t,
-            std::vector<reina::scene::gltf::Primitive>>& meshIdToPrimitive
+            const std::vector<reina::scene::CachedModel>& models
             );
 
     void addInstancesToScene(
@@ -42,11 +65,11 @@ namespace reina::scene::gltf {
 
     std::unordered_map<uint32_t, std::vector<reina::scene::Material>> materialsFromMeshTBNs(
             fastgltf::Asset& asset,
-            const std::unordered_map<uint32_t, std::vector<reina::scene::gltf::Primitive>>& meshIdToPrimitives,
+            const std::unordered_map<uint32_t, std::vector<uint32_t>>& meshIdToSceneIds,
             std::unordered_map<uint32_t, uint32_t> gltfTexIdToSceneId
             );
 
-    reina::scene::Scene loadScene(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue, const std::string& filepath);
+    reina::scene::Scene loadScene(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkCommandPool cmdPool, VkQueue queue, const std::string& filepath, const reina::scene::SceneOptions& options);
 }
 
 #endif  // REINA_VK_GLTFLOADER_H
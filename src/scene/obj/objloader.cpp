@@ -0,0 +1,386 @@
+#include "objloader.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include <glm/glm.hpp>
+
+#include "../../tools/MappedFile.h"
+#include "../../tools/ThreadPool.h"
+
+namespace {
+    constexpr int64_t MISSING = std::numeric_limits<int64_t>::min();
+    constexpr uint32_t NO_INDEX = 0xFFFFFFFFu;
+    constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+
+    /**
+     * A face corner. Positive OBJ indices are stored as global 0-based indices. Negative OBJ indices are relative to the
+     * elements defined so far, which a chunk only knows locally, so they are stored relative to the start of the chunk
+     * (possibly negative, referring to an earlier chunk) and flagged until the chunk's global offset is known.
+     */
+    struct Corner {
+        int64_t v = MISSING;
+        int64_t vt = MISSING;
+        int64_t vn = MISSING;
+        uint8_t relative = 0;  // bit 0: v, bit 1: vt, bit 2: vn
+    };
+
+    struct Chunk {
+        std::vector<float> positions;
+        std::vector<float> texCoords;
+        std::vector<float> normals;
+        std::vector<Corner> corners;  // triangulated, three per triangle
+    };
+
+    bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    const char* skipSpaces(const char* p, const char* end) {
+        while (p < end && isSpace(*p)) {
+            p++;
+        }
+        return p;
+    }
+
+    const char* parseFloat(const char* p, const char* end, float& out) {
+        p = skipSpaces(p, end);
+        if (p < end && *p == '+') {
+            p++;
+        }
+
+        auto [ptr, ec] = std::from_chars(p, end, out);
+        if (ec != std::errc{}) {
+            throw std::runtime_error("Malformed number in OBJ file");
+        }
+        return ptr;
+    }
+
+    const char* parseFloats(const char* p, const char* end, std::vector<float>& out, int count) {
+        for (int i = 0; i < count; i++) {
+            float value;
+            p = parseFloat(p, end, value);
+            out.push_back(value);
+        }
+        return p;
+    }
+
+    int64_t encodeIndex(int64_t objIndex, size_t localCount, uint8_t bit, uint8_t& relative) {
+        if (objIndex > 0) {
+            return objIndex - 1;
+        } if (objIndex < 0) {
+            relative |= bit;
+            return static_cast<int64_t>(localCount) + objIndex;
+        }
+
+        throw std::runtime_error("OBJ indices must not be zero");
+    }
+
+    const char* parseCorner(const char* p, const char* end, const Chunk& chunk, Corner& corner) {
+        int64_t value;
+        auto [ptr, ec] = std::from_chars(p, end, value);
+        if (ec != std::errc{}) {
+            throw std::runtime_error("Malformed face in OBJ file");
+        }
+        corner.v = encodeIndex(value, chunk.positions.size() / 3, 1, corner.relative);
+        p = ptr;
+
+        if (p < end && *p == '/') {
+            p++;
+            if (p < end && *p != '/') {
+                auto [ptrVt, ecVt] = std::from_chars(p, end, value);
+                if (ecVt != std::errc{}) {
+                    throw std::runtime_error("Malformed face in OBJ file");
+                }
+                corner.vt = encodeIndex(value, chunk.texCoords.size() / 2, 2, corner.relative);
+                p = ptrVt;
+            }
+
+            if (p < end && *p == '/') {
+                p++;
+                auto [ptrVn, ecVn] = std::from_chars(p, end, value);
+                if (ecVn != std::errc{}) {
+                    throw std::runtime_error("Malformed face in OBJ file");
+                }
+                corner.vn = encodeIndex(value, chunk.normals.size() / 3, 4, corner.relative);
+                p = ptrVn;
+            }
+        }
+
+        return p;
+    }
+
+    void parseChunk(const char* p, const char* end, Chunk& chunk) {
+        std::vector<Corner> polygon;
+
+        while (p < end) {
+            const char* lineEnd = std::find(p, end, '\n');
+            const char* q = skipSpaces(p, lineEnd);
+
+            if (lineEnd - q >= 2 && q[0] == 'v' && isSpace(q[1])) {
+                parseFloats(q + 2, lineEnd, chunk.positions, 3);  // an optional w or vertex color is ignored
+            } else if (lineEnd - q >= 3 && q[0] == 'v' && q[1] == 't' && isSpace(q[2])) {
+                parseFloats(q + 3, lineEnd, chunk.texCoords, 2);
+            } else if (lineEnd - q >= 3 && q[0] == 'v' && q[1] == 'n' && isSpace(q[2])) {
+                parseFloats(q + 3, lineEnd, chunk.normals, 3);
+            } else if (lineEnd - q >= 2 && q[0] == 'f' && isSpace(q[1])) {
+                polygon.clear();
+                q = skipSpaces(q + 2, lineEnd);
+
+                while (q < lineEnd && *q != '#') {
+                    Corner corner;
+                    q = parseCorner(q, lineEnd, chunk, corner);
+                    polygon.push_back(corner);
+                    q = skipSpaces(q, lineEnd);
+                }
+
+                if (polygon.size() < 3) {
+                    throw std::runtime_error("OBJ face has fewer than three vertices");
+                }
+
+                // Fan triangulation
+                for (size_t i = 1; i + 1 < polygon.size(); i++) {
+                    chunk.corners.push_back(polygon[0]);
+                    chunk.corners.push_back(polygon[i]);
+                    chunk.corners.push_back(polygon[i + 1]);
+                }
+            }
+
+            p = lineEnd + 1;
+        }
+    }
+
+    uint32_t resolveIndex(int64_t encoded, bool relative, size_t chunkOffset, size_t count) {
+        if (encoded == MISSING) {
+            return NO_INDEX;
+        }
+
+        int64_t index = relative ? static_cast<int64_t>(chunkOffset) + encoded : encoded;
+        if (index < 0 || index >= static_cast<int64_t>(count)) {
+            throw std::runtime_error("OBJ face index out of range");
+        }
+
+        return static_cast<uint32_t>(index);
+    }
+
+    uint64_t hashKey(const std::array<uint32_t, 3>& key) {
+        // splitmix64 finalizer over the packed key
+        uint64_t x = (static_cast<uint64_t>(key[0]) << 32 | key[1]) ^ (static_cast<uint64_t>(key[2]) * 0x9E3779B97F4A7C15ull);
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    /**
+     * Builds a tangent and bitangent perpendicular to the normal for vertices without usable UVs.
+     * From "Building an Orthonormal Basis, Revisited" (Duff et al. 2017).
+     */
+    void orthonormalBasis(const glm::vec3& n, glm::vec3& t, glm::vec3& b) {
+        float sign = std::copysign(1.0f, n.z);
+        float a = -1.0f / (sign + n.z);
+        float c = n.x * n.y * a;
+        t = glm::vec3(1.0f + sign * n.x * n.x * a, sign * c, -sign * n.x);
+        b = glm::vec3(c, sign + n.y * n.y * a, -n.y);
+    }
+}
+
+reina::scene::ModelData reina::scene::obj::loadObj(const std::string& filepath) {
+    reina::tools::MappedFile file{filepath};
+    const char* begin = reinterpret_cast<const char*>(file.data());
+    const char* end = begin + file.size();
+
+    reina::tools::ThreadPool& pool = reina::tools::ThreadPool::shared();
+
+    // Split the file into chunks that start at the beginning of a line
+    size_t chunkCount = std::clamp<size_t>(file.size() / MIN_CHUNK_SIZE, 1, (pool.getThreadCount() + 1) * 4);
+    std::vector<const char*> boundaries{begin};
+    for (size_t i = 1; i < chunkCount; i++) {
+        const char* p = std::max(begin + file.size() * i / chunkCount, boundaries.back());
+        p = std::find(p, end, '\n');
+        boundaries.push_back(p == end ? end : p + 1);
+    }
+    boundaries.push_back(end);
+
+    std::vector<Chunk> chunks(chunkCount);
+    pool.parallelFor(chunkCount, [&](size_t i) {
+        parseChunk(boundaries[i], boundaries[i + 1], chunks[i]);
+    });
+
+    // Global offsets of each chunk's elements
+    std::vector<size_t> positionOffsets(chunkCount + 1, 0);
+    std::vector<size_t> texCoordOffsets(chunkCount + 1, 0);
+    std::vector<size_t> normalOffsets(chunkCount + 1, 0);
+    std::vector<size_t> cornerOffsets(chunkCount + 1, 0);
+    for (size_t i = 0; i < chunkCount; i++) {
+        positionOffsets[i + 1] = positionOffsets[i] + chunks[i].positions.size() / 3;
+        texCoordOffsets[i + 1] = texCoordOffsets[i] + chunks[i].texCoords.size() / 2;
+        normalOffsets[i + 1] = normalOffsets[i] + chunks[i].normals.size() / 3;
+        cornerOffsets[i + 1] = cornerOffsets[i] + chunks[i].corners.size();
+    }
+
+    std::vector<float> positions(positionOffsets.back() * 3);
+    std::vector<float> texCoords(texCoordOffsets.back() * 2);
+    std::vector<float> normals(normalOffsets.back() * 3);
+    std::vector<std::array<uint32_t, 3>> corners(cornerOffsets.back());
+
+    pool.parallelFor(chunkCount, [&](size_t i) {
+        const Chunk& chunk = chunks[i];
+        std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + static_cast<long long>(positionOffsets[i] * 3));
+        std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), texCoords.begin() + static_cast<long long>(texCoordOffsets[i] * 2));
+        std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + static_cast<long long>(normalOffsets[i] * 3));
+
+        for (size_t c = 0; c < chunk.corners.size(); c++) {
+            const Corner& corner = chunk.corners[c];
+            corners[cornerOffsets[i] + c] = {
+                    resolveIndex(corner.v, corner.relative & 1, positionOffsets[i], positionOffsets.back()),
+                    resolveIndex(corner.vt, corner.relative & 2, texCoordOffsets[i], texCoordOffsets.back()),
+                    resolveIndex(corner.vn, corner.relative & 4, normalOffsets[i], normalOffsets.back())
+            };
+        }
+    });
+
+    chunks.clear();
+
+    if (corners.empty()) {
+        throw std::runtime_error("OBJ file has no faces: " + filepath);
+    }
+
+    // Weld corners that share a position, UV and normal into one vertex with an open addressing hash table
+    size_t capacity = 1;
+    while (capacity < corners.size() * 2) {
+        capacity <<= 1;
+    }
+
+    std::vector<uint32_t> table(capacity, NO_INDEX);
+    std::vector<std::array<uint32_t, 3>> uniqueVertices;
+    std::vector<uint32_t> indices(corners.size());
+
+    for (size_t i = 0; i < corners.size(); i++) {
+        size_t slot = hashKey(corners[i]) & (capacity - 1);
+
+        while (table[slot] != NO_INDEX && uniqueVertices[table[slot]] != corners[i]) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+
+        if (table[slot] == NO_INDEX) {
+            table[slot] = static_cast<uint32_t>(uniqueVertices.size());
+            uniqueVertices.push_back(corners[i]);
+        }
+
+        indices[i] = table[slot];
+    }
+
+    std::vector<uint32_t>().swap(table);
+    std::vector<std::array<uint32_t, 3>>().swap(corners);
+
+    auto position = [&](uint32_t v) {
+        return glm::vec3(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2]);
+    };
+
+    // Smooth, area weighted normals per position for corners that do not reference a normal
+    bool anyMissingNormal = std::any_of(uniqueVertices.begin(), uniqueVertices.end(), [](const auto& key) { return key[2] == NO_INDEX; });
+    std::vector<glm::vec3> smoothNormals;
+    if (anyMissingNormal) {
+        smoothNormals.assign(positions.size() / 3, glm::vec3(0.0f));
+
+        for (size_t tri = 0; tri < indices.size(); tri += 3) {
+            uint32_t v0 = uniqueVertices[indices[tri]][0];
+            uint32_t v1 = uniqueVertices[indices[tri + 1]][0];
+            uint32_t v2 = uniqueVertices[indices[tri + 2]][0];
+
+            glm::vec3 faceNormal = glm::cross(position(v1) - position(v0), position(v2) - position(v0));
+            smoothNormals[v0] += faceNormal;
+            smoothNormals[v1] += faceNormal;
+            smoothNormals[v2] += faceNormal;
+        }
+    }
+
+    std::vector<glm::vec3> vertexNormals(uniqueVertices.size());
+    pool.parallelFor(uniqueVertices.size(), [&](size_t i) {
+        const auto& key = uniqueVertices[i];
+        glm::vec3 n = key[2] == NO_INDEX
+                ? smoothNormals[key[0]]
+                : glm::vec3(normals[key[2] * 3], normals[key[2] * 3 + 1], normals[key[2] * 3 + 2]);
+
+        float len = glm::length(n);
+        vertexNormals[i] = len > 0.0f ? n / len : glm::vec3(0.0f, 0.0f, 1.0f);
+    }, 1024);
+
+    // Per-vertex tangents and bitangents from UV derivatives (Lengyel's method)
+    bool hasTexCoords = !texCoords.empty();
+    auto uv = [&](uint32_t vertex) {
+        uint32_t vt = uniqueVertices[vertex][1];
+        return vt == NO_INDEX ? glm::vec2(0.0f) : glm::vec2(texCoords[vt * 2], 1.0f - texCoords[vt * 2 + 1]);
+    };
+
+    std::vector<glm::vec3> tangents(uniqueVertices.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> bitangents(uniqueVertices.size(), glm::vec3(0.0f));
+    if (hasTexCoords) {
+        for (size_t tri = 0; tri < indices.size(); tri += 3) {
+            uint32_t i0 = indices[tri], i1 = indices[tri + 1], i2 = indices[tri + 2];
+
+            glm::vec3 e1 = position(uniqueVertices[i1][0]) - position(uniqueVertices[i0][0]);
+            glm::vec3 e2 = position(uniqueVertices[i2][0]) - position(uniqueVertices[i0][0]);
+            glm::vec2 d1 = uv(i1) - uv(i0);
+            glm::vec2 d2 = uv(i2) - uv(i0);
+
+            float det = d1.x * d2.y - d2.x * d1.y;
+            if (std::abs(det) < 1e-12f) {
+                continue;
+            }
+
+            float r = 1.0f / det;
+            glm::vec3 t = (e1 * d2.y - e2 * d1.y) * r;
+            glm::vec3 b = (e2 * d1.x - e1 * d2.x) * r;
+
+            for (uint32_t idx : {i0, i1, i2}) {
+                tangents[idx] += t;
+                bitangents[idx] += b;
+            }
+        }
+    }
+
+    reina::scene::ModelData modelData;
+    modelData.vertices.resize(uniqueVertices.size() * 3);
+    modelData.tbns.resize(uniqueVertices.size());
+    if (hasTexCoords) {
+        modelData.texCoords.resize(uniqueVertices.size() * 2);
+    }
+
+    pool.parallelFor(uniqueVertices.size(), [&](size_t i) {
+        glm::vec3 p = position(uniqueVertices[i][0]);
+        modelData.vertices[i * 3] = p.x;
+        modelData.vertices[i * 3 + 1] = p.y;
+        modelData.vertices[i * 3 + 2] = p.z;
+
+        const glm::vec3& n = vertexNormals[i];
+        glm::vec3 t = tangents[i] - n * glm::dot(n, tangents[i]);  // Gram-Schmidt
+        glm::vec3 b;
+
+        if (glm::dot(t, t) > 1e-20f) {
+            t = glm::normalize(t);
+            float handedness = glm::dot(glm::cross(n, t), bitangents[i]) < 0.0f ? -1.0f : 1.0f;
+            b = glm::cross(n, t) * handedness;
+        } else {
+            orthonormalBasis(n, t, b);
+        }
+
+        modelData.tbns[i] = glm::mat3(t, b, n);
+
+        if (hasTexCoords) {
+            glm::vec2 texCoord = uv(static_cast<uint32_t>(i));
+            modelData.texCoords[i * 2] = texCoord.x;
+            modelData.texCoords[i * 2 + 1] = texCoord.y;
+        }
+    }, 1024);
+
+    modelData.tbnsIndices = indices;
+    modelData.texIndices = indices;
+    modelData.indices = std::move(indices);
+
+    return modelData;
+}
@@ -0,0 +1,23 @@
+#ifndef REINA_VK_OBJLOADER_H
+#define REINA_VK_OBJLOADER_H
+
+#include <string>
+
+#include "../Models.h"
+
+namespace reina::scene::obj {
+    /**
+     * Loads a Wavefront OBJ file without going through Assimp. The file is memory mapped and split into chunks that
+     * are parsed in parallel, polygons are fan triangulated, and every unique position/UV/normal combination is welded
+     * into one vertex. Smooth normals are generated where the file has none, tangents are computed from the UVs, and
+     * V is flipped to match the Assimp path.
+     *
+     * Materials, groups and objects are ignored; every face in the file becomes part of the same model.
+     *
+     * @param filepath The filepath of the OBJ file
+     * @return The model data
+     */
+    [[nodiscard]] reina::scene::ModelData loadObj(const std::string& filepath);
+}
+
+#endif //REINA_VK_OBJLOADER_H
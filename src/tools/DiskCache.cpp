@@ -0,0 +1,130 @@
+#include "DiskCache.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+namespace {
+    constexpr char MAGIC[4] = {'R', 'V', 'K', 'C'};
+
+    struct CacheHeader {
+        char magic[4];
+        uint32_t kind;
+        uint32_t formatVersion;
+        uint32_t headerSize;
+        uint64_t sourceHash;
+        uint64_t payloadSize;
+    };
+
+    static_assert(sizeof(CacheHeader) == 32, "Cache header must stay 32 bytes so payloads stay aligned");
+}
+
+reina::tools::DiskCache::DiskCache(std::filesystem::path directory, std::string_view kind, uint32_t formatVersion)
+        : directory(std::move(directory)), formatVersion(formatVersion) {
+    if (kind.size() != 4) {
+        throw std::runtime_error("Disk cache kind must be a four character code");
+    }
+
+    memcpy(&this->kind, kind.data(), sizeof(uint32_t));
+}
+
+std::optional<reina::tools::CacheEntry> reina::tools::DiskCache::load(uint64_t key, uint64_t sourceHash) const {
+    std::filesystem::path path = entryPath(key);
+
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec)) {
+        return std::nullopt;
+    }
+
+    // The entry may have been removed since, or be unreadable, which is a miss rather than an error
+    MappedFile file;
+    try {
+        file = MappedFile{path.string()};
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Warning: could not read cache entry " << path << ": " << e.what() << "\n";
+        return std::nullopt;
+    }
+
+    CacheHeader header{};
+    bool valid = file.size() >= sizeof(CacheHeader);
+    if (valid) {
+        memcpy(&header, file.data(), sizeof(CacheHeader));
+        valid = memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0
+                && header.kind == kind
+                && header.formatVersion == formatVersion
+                && header.headerSize == sizeof(CacheHeader)
+                && header.sourceHash == sourceHash
+                && header.payloadSize == file.size() - sizeof(CacheHeader);
+    }
+
+    if (!valid) {
+        // stale or corrupt; remove it so it is rebuilt
+        file = MappedFile{};
+        std::filesystem::remove(path, ec);
+        return std::nullopt;
+    }
+
+    std::span<const std::byte> payload = file.bytes().subspan(sizeof(CacheHeader));
+    return CacheEntry{std::move(file), payload};
+}
+
+void reina::tools::DiskCache::store(uint64_t key, uint64_t sourceHash, const std::vector<std::span<const std::byte>>& sections) const {
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) {
+        std::cerr << "Warning: could not create cache directory " << directory << ": " << ec.message() << "\n";
+        return;
+    }
+
+    CacheHeader header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.kind = kind;
+    header.formatVersion = formatVersion;
+    header.headerSize = sizeof(CacheHeader);
+    header.sourceHash = sourceHash;
+    header.payloadSize = 0;
+    for (const auto& section : sections) {
+        header.payloadSize += section.size();
+    }
+
+    // write to a temporary file first so a crash never leaves a truncated entry behind
+    std::filesystem::path path = entryPath(key);
+    std::filesystem::path tmpPath = path;
+    tmpPath += ".tmp";
+
+    {
+        std::ofstream out{tmpPath, std::ios::binary | std::ios::trunc};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const auto& section : sections) {
+            out.write(reinterpret_cast<const char*>(section.data()), static_cast<std::streamsize>(section.size()));
+        }
+
+        if (!out) {
+            std::cerr << "Warning: could not write cache entry " << tmpPath << "\n";
+            out.close();
+            std::filesystem::remove(tmpPath, ec);
+            return;
+        }
+    }
+
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        std::cerr << "Warning: could not write cache entry " << path << ": " << ec.message() << "\n";
+        std::filesystem::remove(tmpPath, ec);
+    }
+}
+
+const std::filesystem::path& reina::tools::DiskCache::getDirectory() const {
+    return directory;
+}
+
+std::filesystem::path reina::tools::DiskCache::entryPath(uint64_t key) const {
+    std::ostringstream name;
+    name << std::string_view{reinterpret_cast<const char*>(&kind), sizeof(kind)} << "_"
+         << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+
+    return directory / name.str();
+}
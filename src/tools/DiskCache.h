@@ -0,0 +1,59 @@
+#ifndef REINA_VK_DISKCACHE_H
+#define REINA_VK_DISKCACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.h"
+
+namespace reina::tools {
+    struct CacheEntry {
+        MappedFile file;
+        std::span<const std::byte> payload;
+    };
+
+    /**
+     * A directory of versioned binary blobs. Each blob is named by a key and records the hash of the source data it
+     * was derived from, so entries whose source changed (or whose format version is outdated) are detected and
+     * discarded on load.
+     */
+    class DiskCache {
+    public:
+        DiskCache() = default;
+
+        /**
+         * @param directory The directory to store entries in. Created when the first entry is stored.
+         * @param kind A four character code identifying what the cache stores, e.g. "GEOM"
+         * @param formatVersion The version of the payload layout. Bump it whenever the layout changes.
+         */
+        DiskCache(std::filesystem::path directory, std::string_view kind, uint32_t formatVersion);
+
+        /**
+         * @param key The key of the entry, usually a hash of the source path and import options
+         * @param sourceHash The hash of the current source data
+         * @return The memory mapped entry, or std::nullopt if it does not exist or is stale
+         */
+        [[nodiscard]] std::optional<CacheEntry> load(uint64_t key, uint64_t sourceHash) const;
+
+        /**
+         * Writes an entry whose payload is the concatenation of the sections. Failures are reported as warnings since
+         * the cache is only an optimization.
+         */
+        void store(uint64_t key, uint64_t sourceHash, const std::vector<std::span<const std::byte>>& sections) const;
+
+        [[nodiscard]] const std::filesystem::path& getDirectory() const;
+
+    private:
+        [[nodiscard]] std::filesystem::path entryPath(uint64_t key) const;
+
+        std::filesystem::path directory;
+        uint32_t kind = 0;
+        uint32_t formatVersion = 0;
+    };
+}
+
+#endif //REINA_VK_DISKCACHE_H
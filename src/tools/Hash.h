@@ -0,0 +1,31 @@
+#ifndef REINA_VK_HASH_H
+#define REINA_VK_HASH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace reina::tools {
+    /**
+     * 64-bit xxHash (XXH64) of a block of memory.
+     * @param data The data to hash
+     * @param length The length of the data in bytes
+     * @param seed The seed of the hash
+     * @return The hash
+     */
+    [[nodiscard]] uint64_t hash64(const void* data, size_t length, uint64_t seed = 0);
+
+    /**
+     * Hashes the contents of a file by memory mapping it.
+     * @param filepath The filepath of the file to hash
+     * @return The hash of the file's contents
+     */
+    [[nodiscard]] uint64_t hashFile(const std::string& filepath);
+
+    /**
+     * Combines two hashes into one. Order matters: hashCombine(a, b) != hashCombine(b, a)
+     */
+    [[nodiscard]] uint64_t hashCombine(uint64_t seed, uint64_t value);
+}
+
+#endif //REINA_VK_HASH_H
@@ -0,0 +1,140 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+reina::tools::MappedFile::MappedFile(const std::string& filepath) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Could not open file for mapping: " + filepath);
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        throw std::runtime_error("Could not query file size: " + filepath);
+    }
+
+    fileHandle = file;
+    length = static_cast<size_t>(fileSize.QuadPart);
+
+    if (length == 0) {
+        return;  // empty files cannot be mapped
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        release();
+        throw std::runtime_error("Could not create file mapping: " + filepath);
+    }
+
+    mappingHandle = mapping;
+    mapped = static_cast<const std::byte*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (mapped == nullptr) {
+        release();
+        throw std::runtime_error("Could not map file: " + filepath);
+    }
+#else
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open file for mapping: " + filepath);
+    }
+
+    struct stat fileStat{};
+    if (fstat(fd, &fileStat) != 0) {
+        close(fd);
+        throw std::runtime_error("Could not query file size: " + filepath);
+    }
+
+    length = static_cast<size_t>(fileStat.st_size);
+
+    if (length == 0) {
+        close(fd);
+        return;  // empty files cannot be mapped
+    }
+
+    void* ptr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // the mapping keeps its own reference to the file
+
+    if (ptr == MAP_FAILED) {
+        length = 0;
+        throw std::runtime_error("Could not map file: " + filepath);
+    }
+
+    madvise(ptr, length, MADV_SEQUENTIAL);
+    mapped = static_cast<const std::byte*>(ptr);
+#endif
+}
+
+reina::tools::MappedFile::MappedFile(MappedFile&& other) noexcept
+        : mapped(std::exchange(other.mapped, nullptr)), length(std::exchange(other.length, 0))
+#ifdef _WIN32
+        , fileHandle(std::exchange(other.fileHandle, nullptr)), mappingHandle(std::exchange(other.mappingHandle, nullptr))
+#endif
+{}
+
+reina::tools::MappedFile& reina::tools::MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        release();
+        mapped = std::exchange(other.mapped, nullptr);
+        length = std::exchange(other.length, 0);
+#ifdef _WIN32
+        fileHandle = std::exchange(other.fileHandle, nullptr);
+        mappingHandle = std::exchange(other.mappingHandle, nullptr);
+#endif
+    }
+
+    return *this;
+}
+
+reina::tools::MappedFile::~MappedFile() {
+    release();
+}
+
+void reina::tools::MappedFile::release() {
+#ifdef _WIN32
+    if (mapped != nullptr) {
+        UnmapViewOfFile(mapped);
+    }
+    if (mappingHandle != nullptr) {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle != nullptr) {
+        CloseHandle(fileHandle);
+    }
+
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    if (mapped != nullptr) {
+        munmap(const_cast<std::byte*>(mapped), length);
+    }
+#endif
+
+    mapped = nullptr;
+    length = 0;
+}
+
+const std::byte* reina::tools::MappedFile::data() const {
+    return mapped;
+}
+
+size_t reina::tools::MappedFile::size() const {
+    return length;
+}
+
+std::span<const std::byte> reina::tools::MappedFile::bytes() const {
+    return {mapped, length};
+}
@@ -0,0 +1,41 @@
+#ifndef REINA_VK_MAPPEDFILE_H
+#define REINA_VK_MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <span>
+
+namespace reina::tools {
+    /**
+     * A read-only memory mapping of a file. The mapping is released when the object is destroyed.
+     */
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        explicit MappedFile(const std::string& filepath);
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+        ~MappedFile();
+
+        [[nodiscard]] const std::byte* data() const;
+        [[nodiscard]] size_t size() const;
+        [[nodiscard]] std::span<const std::byte> bytes() const;
+
+    private:
+        void release();
+
+        const std::byte* mapped = nullptr;
+        size_t length = 0;
+
+#ifdef _WIN32
+        void* fileHandle = nullptr;
+        void* mappingHandle = nullptr;
+#endif
+    };
+}
+
+#endif //REINA_VK_MAPPEDFILE_H
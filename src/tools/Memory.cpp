@@ -0,0 +1,57 @@
+#include "Memory.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define PSAPI_VERSION 2  // GetProcessMemoryInfo from kernel32, so psapi.lib does not need to be linked
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+reina::tools::MemoryUsage reina::tools::getMemoryUsage() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return {0, 0};
+    }
+
+    return {counters.WorkingSetSize, counters.PeakWorkingSetSize};
+#else
+    MemoryUsage usage{0, 0};
+
+    rusage resourceUsage{};
+    if (getrusage(RUSAGE_SELF, &resourceUsage) == 0) {
+#ifdef __APPLE__
+        usage.peakResidentBytes = static_cast<size_t>(resourceUsage.ru_maxrss);  // bytes on macOS
+#else
+        usage.peakResidentBytes = static_cast<size_t>(resourceUsage.ru_maxrss) * 1024;  // kilobytes on Linux
+#endif
+    }
+
+    // The second field of /proc/self/statm is the resident set size in pages. Not available on macOS, where only the
+    // peak is reported.
+    if (FILE* statm = fopen("/proc/self/statm", "r")) {
+        unsigned long totalPages = 0;
+        unsigned long residentPages = 0;
+        if (fscanf(statm, "%lu %lu", &totalPages, &residentPages) == 2) {
+            usage.residentBytes = residentPages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        }
+        fclose(statm);
+    }
+
+    return usage;
+#endif
+}
+
+std::string reina::tools::formatMemoryUsage(const MemoryUsage& usage) {
+    char buffer[96];
+    snprintf(buffer, sizeof(buffer), "%.1f MiB (peak %.1f MiB)",
+             static_cast<double>(usage.residentBytes) / (1024.0 * 1024.0),
+             static_cast<double>(usage.peakResidentBytes) / (1024.0 * 1024.0));
+    return buffer;
+}
@@ -0,0 +1,24 @@
+#ifndef REINA_VK_MEMORY_H
+#define REINA_VK_MEMORY_H
+
+#include <cstddef>
+#include <string>
+
+namespace reina::tools {
+    struct MemoryUsage {
+        size_t residentBytes;      // current resident set size
+        size_t peakResidentBytes;  // highest resident set size since the process started
+    };
+
+    /**
+     * @return The resident memory of this process, as reported by the OS
+     */
+    [[nodiscard]] MemoryUsage getMemoryUsage();
+
+    /**
+     * @return A human-readable summary of the process' resident memory, e.g. "512.0 MiB (peak 1024.0 MiB)"
+     */
+    [[nodiscard]] std::string formatMemoryUsage(const MemoryUsage& usage);
+}
+
+#endif //REINA_VK_MEMORY_H
@@ -0,0 +1,142 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <exception>
+
+reina::tools::ThreadPool::ThreadPool(size_t threadCount) {
+    // Always have at least one queue so tasks can be pushed even when the caller is the only thread running them
+    size_t queueCount = std::max<size_t>(threadCount, 1);
+    for (size_t i = 0; i < queueCount; i++) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+
+    for (size_t i = 0; i < threadCount; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+reina::tools::ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+reina::tools::ThreadPool& reina::tools::ThreadPool::shared() {
+    static ThreadPool pool{std::max(std::thread::hardware_concurrency(), 2u) - 1};
+    return pool;
+}
+
+size_t reina::tools::ThreadPool::getThreadCount() const {
+    return workers.size();
+}
+
+void reina::tools::ThreadPool::push(std::function<void()> task) {
+    WorkerQueue& queue = *queues[nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        // Counted before it can be taken, so a worker that runs it right away can't decrement pendingTasks below zero
+        pendingTasks.fetch_add(1);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    // Locking before notifying prevents a worker from missing the wakeup between checking pendingTasks and sleeping
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    wake.notify_one();
+}
+
+bool reina::tools::ThreadPool::tryRunTask(size_t preferredQueue) {
+    std::function<void()> task;
+
+    for (size_t i = 0; i < queues.size() && !task; i++) {
+        WorkerQueue& queue = *queues[(preferredQueue + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.tasks.empty()) {
+            continue;
+        }
+
+        // Own queue: newest task first for cache locality. Other queues: steal the oldest task.
+        if (i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+
+    if (!task) {
+        return false;
+    }
+
+    pendingTasks.fetch_sub(1);
+    task();
+    return true;
+}
+
+void reina::tools::ThreadPool::workerLoop(size_t index) {
+    while (true) {
+        if (tryRunTask(index)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [&] { return stopping || pendingTasks.load() > 0; });
+
+        if (stopping && pendingTasks.load() == 0) {
+            return;
+        }
+    }
+}
+
+void reina::tools::ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& func, size_t grainSize) {
+    if (count == 0) {
+        return;
+    }
+
+    // Several tasks per thread so faster threads can steal the remaining work
+    size_t targetTasks = (workers.size() + 1) * 8;
+    size_t rangeSize = std::max(std::max<size_t>(grainSize, 1), (count + targetTasks - 1) / targetTasks);
+    size_t taskCount = (count + rangeSize - 1) / rangeSize;
+
+    std::atomic<size_t> remaining = taskCount;
+    std::exception_ptr firstException;
+    std::mutex exceptionMutex;
+
+    for (size_t task = 0; task < taskCount; task++) {
+        size_t begin = task * rangeSize;
+        size_t end = std::min(begin + rangeSize, count);
+
+        push([&, begin, end] {
+            try {
+                for (size_t i = begin; i < end; i++) {
+                    func(i);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(exceptionMutex);
+                if (!firstException) {
+                    firstException = std::current_exception();
+                }
+            }
+
+            remaining.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    // Help out instead of blocking, which also keeps nested parallelFor calls from deadlocking
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        if (!tryRunTask(0)) {
+            std::this_thread::yield();
+        }
+    }
+
+    if (firstException) {
+        std::rethrow_exception(firstException);
+    }
+}
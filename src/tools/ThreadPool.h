@@ -0,0 +1,67 @@
+#ifndef REINA_VK_THREADPOOL_H
+#define REINA_VK_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace reina::tools {
+    /**
+     * A work-stealing thread pool. Each worker owns a task queue, pops work from the back of its own queue, and steals
+     * from the front of other workers' queues when it runs out. Threads waiting on parallelFor help run tasks, so
+     * parallelFor may be called from inside a task.
+     */
+    class ThreadPool {
+    public:
+        /**
+         * @param threadCount The number of worker threads. The thread calling parallelFor also runs tasks.
+         */
+        explicit ThreadPool(size_t threadCount);
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        ~ThreadPool();
+
+        /**
+         * Runs func(i) for every i in [0, count) and blocks until all calls are finished. Indices are grouped into
+         * contiguous ranges of at least grainSize indices per task. If any call throws, the first exception is
+         * rethrown after all tasks are finished.
+         */
+        void parallelFor(size_t count, const std::function<void(size_t)>& func, size_t grainSize = 1);
+
+        [[nodiscard]] size_t getThreadCount() const;
+
+        /**
+         * @return A pool shared by the whole program with one worker per hardware thread, excluding the caller
+         */
+        [[nodiscard]] static ThreadPool& shared();
+
+    private:
+        struct WorkerQueue {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        void workerLoop(size_t index);
+        void push(std::function<void()> task);
+        bool tryRunTask(size_t preferredQueue);
+
+        std::vector<std::unique_ptr<WorkerQueue>> queues;
+        std::vector<std::thread> workers;
+
+        std::atomic<size_t> pendingTasks = 0;
+        std::atomic<size_t> nextQueue = 0;
+
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        bool stopping = false;
+    };
+}
+
+#endif //REINA_VK_THREADPOOL_H
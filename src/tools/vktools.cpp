@@ -457,144 +457,6 @@ VkRenderPass vktools::createRenderPass(VkDevice logicalDevice, VkFormat swapchai
     return renderPass;
 }
 
-vktools::AccStructureInfo vktools::createTlas(VkDevice logicalDevice, VkPhysicalDevice physicalDevice,
-                                              VkCommandPool cmdPool, VkQueue queue,
-                                              const std::vector<reina::scene::Instance>& instances) {
-
-    std::vector<VkAccelerationStructureInstanceKHR> vkInstances;
-    for (const auto& instance : instances) {
-        glm::mat4x4 tmp = glm::transpose(instance.getTransform());
-        VkTransformMatrixKHR vkTransform;
-        memcpy(&vkTransform, &tmp, sizeof(VkTransformMatrixKHR));
-
-        VkAccelerationStructureDeviceAddressInfoKHR addressInfo{
-                .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
-                .accelerationStructure = instance.getBlas().getHandle()
-        };
-
-        auto vkGetAccelerationStructureDeviceAddressKHR = reinterpret_cast<PFN_vkGetAccelerationStructureDeviceAddressKHR>(
-                vkGetDeviceProcAddr(logicalDevice, "vkGetAccelerationStructureDeviceAddressKHR"));
-        VkDeviceAddress blasAddress = vkGetAccelerationStructureDeviceAddressKHR(logicalDevice, &addressInfo);
-
-        VkAccelerationStructureInstanceKHR vkInstance{
-                .transform = vkTransform,
-                .instanceCustomIndex = instance.getInstancePropertiesID(),
-                .mask = 0xFF,
-                .instanceShaderBindingTableRecordOffset = instance.getMaterialOffset(),
-                .flags = 0,
-                .accelerationStructureReference = blasAddress
-        };
-        vkInstances.push_back(vkInstance);
-    }
-
-    // Create the instance buffer
-    reina::core::Buffer instanceBuffer{
-        logicalDevice, physicalDevice,
-        vkInstances,
-        VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
-        VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
-        VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-    };
-
-    VkAccelerationStructureGeometryInstancesDataKHR instancesData{
-            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR,
-            .arrayOfPointers = VK_FALSE, // Contiguous array (not pointers)
-            .data = {.deviceAddress = instanceBuffer.getDeviceAddress(logicalDevice)}
-    };
-
-    VkAccelerationStructureGeometryKHR geometry{
-            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
-            .geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR,
-            .geometry = {.instances = instancesData},
-            .flags = VK_GEOMETRY_OPAQUE_BIT_KHR
-    };
-
-    // Query build sizes
-    VkAccelerationStructureBuildGeometryInfoKHR buildInfo{
-            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
-            .type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
-            .flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR,
-            .mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
-            .geometryCount = 1,
-            .pGeometries = &geometry
-    };
-
-    // Query build sizes
-    VkAccelerationStructureBuildSizesInfoKHR buildSizes{
-            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR
-    };
-
-    auto vkGetAccelerationStructureBuildSizesKHR = reinterpret_cast<PFN_vkGetAccelerationStructureBuildSizesKHR>(
-            vkGetDeviceProcAddr(logicalDevice, "vkGetAccelerationStructureBuildSizesKHR"));
-    auto instanceCount = static_cast<uint32_t>(vkInstances.size());
-    vkGetAccelerationStructureBuildSizesKHR(
-            logicalDevice,
-            VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
-            &buildInfo,
-            &instanceCount,
-            &buildSizes
-    );
-
-    // Create TLAS buffer
-    reina::core::Buffer tlasBuffer{
-            logicalDevice, physicalDevice,
-            buildSizes.accelerationStructureSize,
-            VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-            VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-    };
-
-    // Create acceleration structure
-    VkAccelerationStructureCreateInfoKHR createInfo{
-            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
-            .buffer = tlasBuffer.getHandle(),
-            .size = buildSizes.accelerationStructureSize,
-            .type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR
-    };
-
-    auto vkCreateAccelerationStructureKHR = reinterpret_cast<PFN_vkCreateAccelerationStructureKHR>(
-            vkGetDeviceProcAddr(logicalDevice, "vkCreateAccelerationStructureKHR"));
-
-    VkAccelerationStructureKHR tlas;
-    vkCreateAccelerationStructureKHR(logicalDevice, &createInfo, nullptr, &tlas);
-
-    // Build TLAS
-    VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo{
-            .primitiveCount = instanceCount,
-            .primitiveOffset = 0,
-            .firstVertex = 0,
-            .transformOffset = 0
-    };
-    const VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &buildRangeInfo;
-
-    // Allocate scratch buffer (similar to BLAS)
-    reina::core::Buffer scratchBuffer{
-        logicalDevice, physicalDevice, buildSizes.buildScratchSize,
-        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-        VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-    };
-
-    buildInfo.dstAccelerationStructure = tlas;
-    buildInfo.scratchData.deviceAddress = scratchBuffer.getDeviceAddress(logicalDevice);
-
-    // Submit the build command
-    reina::core::CmdBuffer cmdBuffer{logicalDevice, cmdPool, true};
-
-    auto vkCmdBuildAccelerationStructuresKHR = reinterpret_cast<PFN_vkCmdBuildAccelerationStructuresKHR>(
-            vkGetDeviceProcAddr(logicalDevice, "vkCmdBuildAccelerationStructuresKHR"));
-    vkCmdBuildAccelerationStructuresKHR(cmdBuffer.getHandle(), 1, &buildInfo, &pBuildRangeInfo);
-
-    cmdBuffer.endWaitSubmit(logicalDevice, queue);
-
-    cmdBuffer.destroy(logicalDevice);
-    scratchBuffer.destroy(logicalDevice);
-    instanceBuffer.destroy(logicalDevice);
-
-    return {tlas, tlasBuffer};
-}
-
 vktools::SyncObjects vktools::createSyncObjects(VkDevice logicalDevice) {
     VkSemaphoreCreateInfo semaphoreCreateInfo{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
     vktools::SyncObjects syncObjects{};
@@ -787,6 +649,40 @@ VkSampler vktools::createSampler(VkDevice logicalDevice) {
     return sampler;
 }
 
+VkSampler vktools::createTextureSampler(VkDevice logicalDevice, VkPhysicalDevice physicalDevice) {
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    VkSamplerCreateInfo samplerInfo{
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_LINEAR,
+        .minFilter = VK_FILTER_LINEAR,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        .mipLodBias = 0.0f,
+        .anisotropyEnable = features.samplerAnisotropy,
+        .maxAnisotropy = std::min(16.0f, properties.limits.maxSamplerAnisotropy),
+        .compareEnable = VK_FALSE,
+        .compareOp = VK_COMPARE_OP_ALWAYS,
+        .minLod = 0.0f,
+        .maxLod = VK_LOD_CLAMP_NONE,
+        .borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
+        .unnormalizedCoordinates = VK_FALSE,
+    };
+
+    VkSampler sampler;
+    if (vkCreateSampler(logicalDevice, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture sampler!");
+    }
+
+    return sampler;
+}
+
 VkCommandPool vktools::createCommandPool(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkSurfaceKHR surface) {
     QueueFamilyIndices queueFamilyIndices = findQueueFamilies(surface, physicalDevice);
 
@@ -0,0 +1,159 @@
+// Builds alias tables over several weight distributions and checks the probabilities they encode, both exactly from
+// the thresholds and aliases and with a chi-square test over samples drawn the way the shaders draw them.
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "scene/AliasTable.h"
+
+namespace {
+    constexpr int SAMPLES = 400000;
+
+    uint32_t sample(std::span<const AliasEntry> table, std::mt19937_64& rng) {
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        auto i = static_cast<uint32_t>(unit(rng) * static_cast<float>(table.size()));
+        i = std::min(i, static_cast<uint32_t>(table.size() - 1));
+        return unit(rng) < table[i].threshold ? i : table[i].alias;
+    }
+
+    /**
+     * @return The upper 0.1% critical value of a chi-square distribution, with the Wilson-Hilferty approximation
+     */
+    double chiSquareCritical(int degreesOfFreedom) {
+        const double z = 3.09;
+        double k = degreesOfFreedom;
+        double term = 1.0 - 2.0 / (9.0 * k) + z * std::sqrt(2.0 / (9.0 * k));
+        return k * term * term * term;
+    }
+
+    void checkDistribution(const std::string& name, const std::vector<float>& weights) {
+        std::vector<AliasEntry> table(weights.size());
+        reina::scene::buildAliasTable(weights, table);
+
+        double total = 0.0;
+        for (float weight : weights) {
+            total += weight;
+        }
+
+        // The probability of an entry is its own share of its column plus what other columns give it as their alias
+        std::vector<double> encoded(weights.size(), 0.0);
+        for (uint32_t i = 0; i < table.size(); i++) {
+            CHECK(table[i].threshold >= 0.0f && table[i].threshold <= 1.0f);
+            CHECK(table[i].alias < table.size());
+            CHECK(std::abs(table[i].probability - weights[i] / total) <= 1e-6 * std::max(1.0, weights[i] / total));
+
+            encoded[i] += table[i].threshold / static_cast<double>(table.size());
+            if (table[i].alias != i) {
+                encoded[table[i].alias] += (1.0 - table[i].threshold) / static_cast<double>(table.size());
+            }
+        }
+        for (uint32_t i = 0; i < table.size(); i++) {
+            CHECK(std::abs(encoded[i] - weights[i] / total) < 1e-5);
+            if (weights[i] == 0.0f) {
+                CHECK(encoded[i] == 0.0);
+            }
+        }
+
+        std::mt19937_64 rng(7);
+        std::vector<int> counts(weights.size(), 0);
+        for (int i = 0; i < SAMPLES; i++) {
+            counts[sample(table, rng)]++;
+        }
+
+        // Entries expected fewer than 5 times are pooled, so every bin of the test has enough samples
+        double chiSquare = 0.0;
+        int bins = 0;
+        double pooledExpected = 0.0;
+        int pooledObserved = 0;
+        for (uint32_t i = 0; i < weights.size(); i++) {
+            double expected = SAMPLES * weights[i] / total;
+            if (weights[i] == 0.0f) {
+                CHECK(counts[i] == 0);
+            } else if (expected < 5.0) {
+                pooledExpected += expected;
+                pooledObserved += counts[i];
+            } else {
+                chiSquare += (counts[i] - expected) * (counts[i] - expected) / expected;
+                bins++;
+            }
+        }
+        if (pooledExpected > 0.0) {
+            chiSquare += (pooledObserved - pooledExpected) * (pooledObserved - pooledExpected) / pooledExpected;
+            bins++;
+        }
+
+        if (bins > 1) {
+            double critical = chiSquareCritical(bins - 1);
+            std::printf("%-24s %5zu entries, chi-square %8.1f over %4d bins (0.1%% critical value %.1f)\n",
+                        name.c_str(), weights.size(), chiSquare, bins, critical);
+            CHECK(chiSquare < critical);
+        } else {
+            std::printf("%-24s %5zu entries, every sample is the one nonzero entry\n", name.c_str(), weights.size());
+        }
+    }
+}
+
+int main() {
+    checkDistribution("uniform", std::vector<float>(64, 1.0f));
+
+    std::vector<float> ramp(100);
+    for (size_t i = 0; i < ramp.size(); i++) {
+        ramp[i] = static_cast<float>(i + 1);
+    }
+    checkDistribution("ramp", ramp);
+
+    // Like the emissive triangles of a scene, a few bright ones among many dim ones
+    std::vector<float> geometric(1000);
+    for (size_t i = 0; i < geometric.size(); i++) {
+        geometric[i] = std::pow(0.99f, static_cast<float>(i));
+    }
+    checkDistribution("geometric", geometric);
+
+    std::vector<float> wideRange(500);
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> exponent(-6.0f, 0.0f);
+    for (float& weight : wideRange) {
+        weight = std::pow(10.0f, exponent(rng));
+    }
+    checkDistribution("six decades", wideRange);
+
+    std::vector<float> withZeros(200);
+    for (size_t i = 0; i < withZeros.size(); i++) {
+        withZeros[i] = i % 3 == 0 ? 0.0f : static_cast<float>(i % 7 + 1);
+    }
+    checkDistribution("a third zero", withZeros);
+
+    std::vector<float> oneNonzero(50, 0.0f);
+    oneNonzero[17] = 2.5f;
+    checkDistribution("one nonzero", oneNonzero);
+
+    checkDistribution("single entry", {3.0f});
+
+    // Degenerate inputs
+    std::vector<AliasEntry> empty;
+    reina::scene::buildAliasTable({}, empty);
+
+    std::vector<AliasEntry> table(4);
+    bool threw = false;
+    try {
+        reina::scene::buildAliasTable(std::vector<float>(4, 0.0f), table);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    threw = false;
+    try {
+        reina::scene::buildAliasTable(std::vector<float>(3, 1.0f), table);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    return REINA_TEST_RESULT();
+}
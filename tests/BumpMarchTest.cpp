@@ -0,0 +1,329 @@
+// A CPU port of bumpMapping in shaders/raytrace/texutils.h.glsl over chains from generateMips. It checks that skipping
+// down the min heights never passes a point where the ray is below the surface, that the march ends on the surface, and
+// that the skip takes fewer height map fetches per hit than the layers on maps it suits, and prints both.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "Check.h"
+#include "graphics/Mipmaps.h"
+
+namespace {
+    constexpr float HEIGHT_SCALE = 0.2f;
+    constexpr float MIN_LAYERS = 64.0f;
+    constexpr float MAX_LAYERS = 512.0f;
+    constexpr int MAX_SKIPS = 64;
+    constexpr int REFINE_STEPS = 4;
+    constexpr float MIN_HEIGHT_BIAS = 1.0f / 512.0f;
+    constexpr float SURFACE_TOLERANCE = HEIGHT_SCALE / 256.0f;  // how far from the surface a hit may end
+
+    struct HeightMap {
+        uint32_t width;
+        uint32_t height;
+        std::vector<uint8_t> chain;
+
+        [[nodiscard]] int levels() const {
+            return static_cast<int>(reina::graphics::mipLevelCount(width, height));
+        }
+
+        [[nodiscard]] int levelWidth(int level) const {
+            return std::max(static_cast<int>(width >> level), 1);
+        }
+
+        [[nodiscard]] int levelHeight(int level) const {
+            return std::max(static_cast<int>(height >> level), 1);
+        }
+
+        [[nodiscard]] float fetch(int x, int y, int level, int channel) const {
+            size_t offset = reina::graphics::mipLevelOffset(width, height, level);
+            return chain[offset + (static_cast<size_t>(y) * levelWidth(level) + x) * 4 + channel] / 255.0f;
+        }
+
+        // Bilinear R of one level with the sampler repeating
+        [[nodiscard]] float sampleLevel(float u, float v, int level) const {
+            int w = levelWidth(level);
+            int h = levelHeight(level);
+            float x = u * static_cast<float>(w) - 0.5f;
+            float y = v * static_cast<float>(h) - 0.5f;
+            float x0 = std::floor(x);
+            float y0 = std::floor(y);
+            float fx = x - x0;
+            float fy = y - y0;
+
+            auto wrap = [](float i, int size) {
+                int wrapped = static_cast<int>(std::fmod(i, static_cast<float>(size)));
+                return wrapped < 0 ? wrapped + size : wrapped;
+            };
+            int xa = wrap(x0, w), xb = wrap(x0 + 1, w);
+            int ya = wrap(y0, h), yb = wrap(y0 + 1, h);
+
+            float top = fetch(xa, ya, level, 0) * (1 - fx) + fetch(xb, ya, level, 0) * fx;
+            float bottom = fetch(xa, yb, level, 0) * (1 - fx) + fetch(xb, yb, level, 0) * fx;
+            return top * (1 - fy) + bottom * fy;
+        }
+
+        // textureLod with linear filtering between levels
+        [[nodiscard]] float sample(float u, float v, float lod) const {
+            lod = std::clamp(lod, 0.0f, static_cast<float>(levels() - 1));
+            int low = static_cast<int>(std::floor(lod));
+            int high = std::min(low + 1, levels() - 1);
+            float t = lod - static_cast<float>(low);
+            return sampleLevel(u, v, low) * (1 - t) + (t > 0 ? sampleLevel(u, v, high) * t : 0.0f);
+        }
+    };
+
+    struct March {
+        float skipDepth;   // how far the min heights alone carried the ray, before it was tested against the surface
+        float hitDepth;
+        int fetches;
+    };
+
+    float glslMod(float x, float y) {
+        return x - y * std::floor(x / y);
+    }
+
+    // V is the tangent space view vector, with V.z > 0
+    March bumpMapping(const HeightMap& map, float u, float v, const float V[3], float lod, bool minHeights) {
+        int fetches = 0;
+
+        float numLayers = MAX_LAYERS + (MIN_LAYERS - MAX_LAYERS) * std::clamp(V[2], 0.0f, 1.0f);
+        float layerDepth = 1.0f / numLayers;
+
+        float P[2] = {V[0] / V[2] * HEIGHT_SCALE, V[1] / V[2] * HEIGHT_SCALE};
+
+        const int baseSize[2] = {static_cast<int>(map.width), static_cast<int>(map.height)};
+        const int topLevel = map.levels() - 1;
+        const int stopLevel = std::clamp(static_cast<int>(std::ceil(lod)), 0, topLevel);
+        const float origin[2] = {(u - std::floor(u)) * baseSize[0], (v - std::floor(v)) * baseSize[1]};
+        const float direction[2] = {-P[0] * baseSize[0], -P[1] * baseSize[1]};
+        const float reach = std::max(std::abs(direction[0]), std::abs(direction[1]));
+        const float nudge = 1e-3f / std::max(reach, 1e-6f);
+
+        auto surface = [&](float depth) {
+            fetches++;
+            return map.sample(u - depth * P[0], v - depth * P[1], lod) * HEIGHT_SCALE;
+        };
+
+        float depth = 0.0f;
+        float skipDepth = HEIGHT_SCALE;
+        int level = std::clamp(static_cast<int>(std::ceil(std::log2(std::max(reach * HEIGHT_SCALE, 1.0f)))), stopLevel, topLevel);
+        for (int i = 0; minHeights && i < MAX_SKIPS && level >= stopLevel && depth < HEIGHT_SCALE; i++) {
+            const int levelSize[2] = {map.levelWidth(level), map.levelHeight(level)};
+
+            float exitDepth = depth;
+            float exits[2];
+            int cell[2];
+            for (int axis = 0; axis < 2; axis++) {
+                float position = origin[axis] + direction[axis] * depth;
+                float wrapped = glslMod(position, static_cast<float>(baseSize[axis]));
+                cell[axis] = std::min(static_cast<int>(wrapped) >> level, levelSize[axis] - 1);
+
+                float cellLow = position - wrapped + static_cast<float>(cell[axis] << level);
+                float cellHigh = position - wrapped + (cell[axis] == levelSize[axis] - 1
+                        ? static_cast<float>(baseSize[axis]) : static_cast<float>((cell[axis] + 1) << level));
+                float exit = direction[axis] > 0 ? (cellHigh - position) / direction[axis] : (cellLow - position) / direction[axis];
+                exits[axis] = direction[axis] != 0 ? exit : 1e30f;
+            }
+            exitDepth += std::min(exits[0], exits[1]);
+
+            fetches++;
+            const float minHeight = (map.fetch(cell[0], cell[1], level, 1) - MIN_HEIGHT_BIAS) * HEIGHT_SCALE;
+            if (minHeight >= exitDepth) {
+                depth = exitDepth + nudge;
+                level = std::min(level + 1, topLevel);
+                continue;
+            }
+
+            depth = std::max(depth, minHeight);
+            if (level > stopLevel) {
+                level--;
+                continue;
+            }
+
+            // The ray may meet the surface in this cell. If it's below it at the exit, the crossing is refined between
+            // there and here with the Illinois variant of regula falsi
+            skipDepth = std::min(skipDepth, depth);
+            float below = surface(exitDepth) - exitDepth;
+            if (below <= 0) {
+                float next = exitDepth;
+                float above = std::max(surface(depth) - depth, 0.0f);
+                int side = 0;
+                for (int step = 0; step < REFINE_STEPS && above > 0; step++) {
+                    float middle = depth + (next - depth) * above / (above - below);
+                    float height = surface(middle) - middle;
+                    if (height > 0) {
+                        depth = middle;
+                        above = height;
+                        below *= side > 0 ? 0.5f : 1.0f;
+                        side = 1;
+                    } else {
+                        next = middle;
+                        below = height;
+                        above *= side < 0 ? 0.5f : 1.0f;
+                        side = -1;
+                    }
+                }
+                return March{skipDepth, depth + (next - depth) * above / std::max(above - below, 1e-9f), fetches};
+            }
+            depth = exitDepth + nudge;
+            level = std::min(level + 1, topLevel);
+        }
+        depth = std::min(depth, HEIGHT_SCALE);
+        skipDepth = std::min(skipDepth, depth);
+
+        float depthSum = depth;
+        float h = surface(depthSum);
+        while (depthSum < h) {
+            depthSum += layerDepth;
+            h = surface(depthSum);
+        }
+
+        // The interpolation between the last two samples
+        float after = h - depthSum;
+        float before = surface(depthSum - layerDepth) - (depthSum - layerDepth);
+        float weight = after / (after - before);
+
+        return March{skipDepth, depthSum - layerDepth * weight, fetches};
+    }
+
+    HeightMap makeMap(uint32_t width, uint32_t height, auto&& heightAt) {
+        HeightMap map{width, height, {}};
+        map.chain.resize(reina::graphics::mipLevelOffset(width, height, reina::graphics::mipLevelCount(width, height)));
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                uint8_t value = heightAt(x, y);
+                uint8_t* texel = map.chain.data() + (static_cast<size_t>(y) * width + x) * 4;
+                texel[0] = texel[1] = texel[2] = value;
+                texel[3] = 255;
+            }
+        }
+        return map;
+    }
+
+    struct Result {
+        double linearFetches;
+        double skipFetches;
+        int misses;      // rays the skip carried past a point below the surface
+        int offSurface;  // rays the skip ended away from the surface
+        int linearOffSurface;
+    };
+
+    constexpr int RAYS = 2000;
+
+    Result measure(const HeightMap& map, float lod, bool minHeights) {
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        long linearFetches = 0;
+        long skipFetches = 0;
+        int misses = 0;
+        int offSurface = 0;
+        int linearOffSurface = 0;
+
+        for (int ray = 0; ray < RAYS; ray++) {
+            float u = unit(rng);
+            float v = unit(rng);
+
+            // Cosine distributed, leaving out the most grazing angles
+            float r = std::sqrt(unit(rng) * 0.96f);
+            float phi = 6.2831853f * unit(rng);
+            float V[3] = {r * std::cos(phi), r * std::sin(phi), std::sqrt(1 - r * r)};
+
+            March linear = bumpMapping(map, u, v, V, lod, false);
+            March skip = bumpMapping(map, u, v, V, lod, minHeights);
+            linearFetches += linear.fetches;
+            skipFetches += skip.fetches;
+
+            // The ray must stay above the surface everywhere the skip passed over, and end on it
+            float P[2] = {V[0] / V[2] * HEIGHT_SCALE, V[1] / V[2] * HEIGHT_SCALE};
+            float hitHeight = map.sample(u - skip.hitDepth * P[0], v - skip.hitDepth * P[1], lod) * HEIGHT_SCALE;
+            if (skip.hitDepth < HEIGHT_SCALE && std::abs(skip.hitDepth - hitHeight) > SURFACE_TOLERANCE) {
+                offSurface++;
+            }
+            float linearHeight = map.sample(u - linear.hitDepth * P[0], v - linear.hitDepth * P[1], lod) * HEIGHT_SCALE;
+            if (linear.hitDepth < HEIGHT_SCALE && std::abs(linear.hitDepth - linearHeight) > SURFACE_TOLERANCE) {
+                linearOffSurface++;
+            }
+
+            constexpr int STEPS = 1024;
+            for (int step = 0; step < STEPS; step++) {
+                float s = skip.skipDepth * static_cast<float>(step) / STEPS;
+                if (s > map.sample(u - s * P[0], v - s * P[1], lod) * HEIGHT_SCALE + 1e-5f) {
+                    misses++;
+                    break;
+                }
+            }
+        }
+
+        return Result{static_cast<double>(linearFetches) / RAYS, static_cast<double>(skipFetches) / RAYS, misses, offSurface, linearOffSurface};
+    }
+}
+
+int main() {
+    std::mt19937 rng(42);
+
+    struct Case {
+        const char* name;
+        HeightMap map;
+        bool coherent;  // whether its min heights let the skip take fewer fetches than the layers
+    };
+
+    std::vector<Case> cases;
+
+    // Smooth rolling hills over the whole depth range
+    for (auto [width, height] : {std::pair{256u, 256u}, std::pair{200u, 120u}}) {
+        std::uniform_real_distribution<float> phase(0.0f, 6.2831853f);
+        float phases[4] = {phase(rng), phase(rng), phase(rng), phase(rng)};
+        cases.push_back({width == 256 ? "hills 256x256" : "hills 200x120", makeMap(width, height, [&](uint32_t x, uint32_t y) {
+            float fx = 6.2831853f * static_cast<float>(x) / static_cast<float>(width);
+            float fy = 6.2831853f * static_cast<float>(y) / static_cast<float>(height);
+            float value = std::sin(3 * fx + phases[0]) + std::sin(5 * fy + phases[1]) + 0.5f * std::sin(7 * (fx + fy) + phases[2]) + 0.5f * std::sin(11 * fx - 4 * fy + phases[3]);
+            return static_cast<uint8_t>(std::clamp(127.5f + value * 42.0f, 0.0f, 255.0f));
+        }), true});
+    }
+
+    // Tiles with faces a third of the way down and grout at the bottom
+    cases.push_back({"tiles 256x256", makeMap(256, 256, [](uint32_t x, uint32_t y) {
+        return static_cast<uint8_t>(x % 32 < 3 || y % 32 < 3 ? 255 : 85);
+    }), true});
+
+    // Independent random heights, the worst case for the skip
+    std::uniform_int_distribution<int> byte(0, 255);
+    cases.push_back({"noise 256x256", makeMap(256, 256, [&](uint32_t, uint32_t) {
+        return static_cast<uint8_t>(byte(rng));
+    }), false});
+
+    std::printf("%-16s %6s %18s %18s %20s %20s\n", "map", "lod", "linear fetches/hit", "skip fetches/hit",
+            "linear off surface", "skip off surface");
+    for (Case& testCase : cases) {
+        HeightMap colorFiltered = testCase.map;
+        reina::graphics::generateMips(testCase.map.chain, testCase.map.width, testCase.map.height, reina::graphics::MipFilter::LINEAR);
+        reina::graphics::generateMips(colorFiltered.chain, colorFiltered.width, colorFiltered.height, reina::graphics::MipFilter::COLOR);
+
+        for (float lod : {0.0f, 1.5f}) {
+            Result result = measure(testCase.map, lod, true);
+            std::printf("%-16s %6.1f %18.1f %18.1f %20d %20d\n", testCase.name, lod, result.linearFetches,
+                    result.skipFetches, result.linearOffSurface, result.offSurface);
+            CHECK(result.misses == 0);
+
+            // Refining the crossing must land on the surface about as often as interpolating between the layers
+            CHECK(result.offSurface <= result.linearOffSurface + RAYS / 100);
+            if (testCase.coherent) {
+                CHECK(result.skipFetches < result.linearFetches);
+            }
+
+            // G of a chain filtered as color is not a min height, so skipping with it passes through the surface
+            CHECK(measure(colorFiltered, lod, true).misses > 0);
+
+            // Without min heights, the march must not skip at all
+            Result unflagged = measure(colorFiltered, lod, false);
+            CHECK(unflagged.misses == 0);
+            CHECK(unflagged.skipFetches == unflagged.linearFetches);
+        }
+    }
+
+    return REINA_TEST_RESULT();
+}
@@ -0,0 +1,24 @@
+#ifndef REINA_VK_CHECK_H
+#define REINA_VK_CHECK_H
+
+#include <iostream>
+
+namespace reina::tests {
+    inline int failures = 0;
+}
+
+/**
+ * Reports a failed condition with its location and keeps going, so one run shows every failure. A test's main returns
+ * REINA_TEST_RESULT() at the end.
+ */
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n"; \
+            reina::tests::failures++; \
+        } \
+    } while (false)
+
+#define REINA_TEST_RESULT() (reina::tests::failures == 0 ? 0 : 1)
+
+#endif //REINA_VK_CHECK_H
@@ -0,0 +1,170 @@
+// Parses KTX2 containers built in memory and checks that flipping them moves every texel's data to the mirrored row.
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "graphics/Ktx2.h"
+
+namespace {
+    constexpr uint8_t IDENTIFIER[] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+    constexpr size_t LEVEL_INDEX_OFFSET = 80;
+
+    template<typename T>
+    void write(std::vector<std::byte>& bytes, size_t offset, T value) {
+        std::memcpy(bytes.data() + offset, &value, sizeof(T));
+    }
+
+    /**
+     * @param orientation The KTXorientation value, or empty for none
+     * @param levels The data of each level, largest first
+     */
+    std::vector<std::byte> makeKtx2(VkFormat format, uint32_t width, uint32_t height, const std::string& orientation,
+                                    const std::vector<std::vector<uint8_t>>& levels) {
+        std::vector<std::byte> keyValues;
+        if (!orientation.empty()) {
+            std::string entry = std::string("KTXorientation") + '\0' + orientation + '\0';
+            keyValues.resize(sizeof(uint32_t) + ((entry.size() + 3) & ~size_t{3}));
+            write(keyValues, 0, static_cast<uint32_t>(entry.size()));
+            std::memcpy(keyValues.data() + sizeof(uint32_t), entry.data(), entry.size());
+        }
+
+        size_t kvdOffset = LEVEL_INDEX_OFFSET + levels.size() * 3 * sizeof(uint64_t);
+        size_t dataOffset = kvdOffset + keyValues.size();
+        size_t totalBytes = dataOffset;
+        for (const auto& level : levels) {
+            totalBytes += level.size();
+        }
+
+        std::vector<std::byte> bytes(totalBytes);
+        std::memcpy(bytes.data(), IDENTIFIER, sizeof(IDENTIFIER));
+        uint32_t header[] = {static_cast<uint32_t>(format), 1, width, height, 0, 0, 1, static_cast<uint32_t>(levels.size()), 0,
+                             0, 0, static_cast<uint32_t>(kvdOffset), static_cast<uint32_t>(keyValues.size())};
+        std::memcpy(bytes.data() + sizeof(IDENTIFIER), header, sizeof(header));
+        std::memcpy(bytes.data() + kvdOffset, keyValues.data(), keyValues.size());
+
+        size_t offset = dataOffset;
+        for (size_t level = 0; level < levels.size(); level++) {
+            size_t entry = LEVEL_INDEX_OFFSET + level * 3 * sizeof(uint64_t);
+            write(bytes, entry, static_cast<uint64_t>(offset));
+            write(bytes, entry + sizeof(uint64_t), static_cast<uint64_t>(levels[level].size()));
+            write(bytes, entry + 2 * sizeof(uint64_t), static_cast<uint64_t>(levels[level].size()));
+            std::memcpy(bytes.data() + offset, levels[level].data(), levels[level].size());
+            offset += levels[level].size();
+        }
+
+        return bytes;
+    }
+
+    std::vector<uint8_t> pattern(size_t size, uint8_t seed) {
+        std::vector<uint8_t> bytes(size);
+        for (size_t i = 0; i < size; i++) {
+            bytes[i] = static_cast<uint8_t>(i * 37 + seed);
+        }
+        return bytes;
+    }
+
+    // The 2 bit BC1 index of texel (x, y) in a block
+    uint32_t bc1Index(const uint8_t* block, uint32_t x, uint32_t y) {
+        return (block[4 + y] >> (2 * x)) & 3;
+    }
+
+    // The 3 bit BC4 index of texel (x, y) in a block
+    uint32_t bc4Index(const uint8_t* block, uint32_t x, uint32_t y) {
+        uint64_t indices = 0;
+        std::memcpy(&indices, block + 2, 6);
+        return static_cast<uint32_t>(indices >> (3 * (4 * y + x))) & 7;
+    }
+
+    /**
+     * Checks that the texel indices of every level of a block compressed texture are mirrored vertically
+     * @param index Reads the index of a texel from a block
+     */
+    void checkBlocksFlipped(VkFormat format, uint32_t width, uint32_t height, uint32_t levelCount, uint32_t blockBytes,
+                            uint32_t (*index)(const uint8_t*, uint32_t, uint32_t)) {
+        std::vector<std::vector<uint8_t>> levels;
+        for (uint32_t level = 0; level < levelCount; level++) {
+            uint32_t blocksX = (std::max(width >> level, 1u) + 3) / 4;
+            uint32_t blocksY = (std::max(height >> level, 1u) + 3) / 4;
+            levels.push_back(pattern(static_cast<size_t>(blocksX) * blocksY * blockBytes, static_cast<uint8_t>(level)));
+        }
+
+        std::vector<std::byte> bytes = makeKtx2(format, width, height, "", levels);
+        reina::graphics::Ktx2Texture texture = reina::graphics::parseKtx2(bytes);
+        std::vector<uint8_t> flipped = reina::graphics::flipKtx2(texture);
+
+        size_t offset = 0;
+        for (uint32_t level = 0; level < levelCount; level++) {
+            uint32_t levelWidth = std::max(width >> level, 1u);
+            uint32_t levelHeight = std::max(height >> level, 1u);
+            uint32_t blocksX = (levelWidth + 3) / 4;
+
+            for (uint32_t y = 0; y < levelHeight; y++) {
+                for (uint32_t x = 0; x < levelWidth; x++) {
+                    uint32_t flippedY = levelHeight - 1 - y;
+                    const uint8_t* original = levels[level].data() + (static_cast<size_t>(y / 4) * blocksX + x / 4) * blockBytes;
+                    const uint8_t* moved = flipped.data() + offset + (static_cast<size_t>(flippedY / 4) * blocksX + x / 4) * blockBytes;
+                    CHECK(index(original, x % 4, y % 4) == index(moved, x % 4, flippedY % 4));
+                }
+            }
+            offset += levels[level].size();
+        }
+    }
+
+    bool flipThrows(VkFormat format, uint32_t width, uint32_t height, uint32_t blockBytes) {
+        std::vector<uint8_t> level = pattern(static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockBytes, 0);
+        std::vector<std::byte> bytes = makeKtx2(format, width, height, "", {level});
+        try {
+            (void) reina::graphics::flipKtx2(reina::graphics::parseKtx2(bytes));
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    }
+}
+
+int main() {
+    // Rows go down unless KTXorientation says otherwise
+    std::vector<uint8_t> rgba = pattern(8 * 4 * 4, 0);
+    CHECK(!reina::graphics::parseKtx2(makeKtx2(VK_FORMAT_R8G8B8A8_UNORM, 8, 4, "", {rgba})).rowsUp);
+    CHECK(!reina::graphics::parseKtx2(makeKtx2(VK_FORMAT_R8G8B8A8_UNORM, 8, 4, "rd", {rgba})).rowsUp);
+    CHECK(reina::graphics::parseKtx2(makeKtx2(VK_FORMAT_R8G8B8A8_UNORM, 8, 4, "ru", {rgba})).rowsUp);
+
+    // Uncompressed levels reverse their rows
+    {
+        std::vector<uint8_t> level1 = pattern(4 * 2 * 4, 1);
+        std::vector<std::byte> bytes = makeKtx2(VK_FORMAT_R8G8B8A8_UNORM, 8, 4, "", {rgba, level1});
+        std::vector<uint8_t> flipped = reina::graphics::flipKtx2(reina::graphics::parseKtx2(bytes));
+        CHECK(flipped.size() == rgba.size() + level1.size());
+        for (uint32_t y = 0; y < 4; y++) {
+            CHECK(std::memcmp(flipped.data() + y * 32, rgba.data() + (3 - y) * 32, 32) == 0);
+        }
+        for (uint32_t y = 0; y < 2; y++) {
+            CHECK(std::memcmp(flipped.data() + rgba.size() + y * 16, level1.data() + (1 - y) * 16, 16) == 0);
+        }
+    }
+
+    // Full chains, down to the levels shorter than a block
+    checkBlocksFlipped(VK_FORMAT_BC1_RGB_UNORM_BLOCK, 16, 8, 5, 8, bc1Index);
+    checkBlocksFlipped(VK_FORMAT_BC4_UNORM_BLOCK, 8, 16, 5, 8, bc4Index);
+    checkBlocksFlipped(VK_FORMAT_BC5_UNORM_BLOCK, 8, 8, 4, 16, bc4Index);
+    checkBlocksFlipped(VK_FORMAT_BC5_UNORM_BLOCK, 8, 8, 4, 16, [](const uint8_t* block, uint32_t x, uint32_t y) {
+        return bc4Index(block + 8, x, y);
+    });
+    checkBlocksFlipped(VK_FORMAT_BC3_UNORM_BLOCK, 8, 8, 4, 16, bc4Index);
+    checkBlocksFlipped(VK_FORMAT_BC3_UNORM_BLOCK, 8, 8, 4, 16, [](const uint8_t* block, uint32_t x, uint32_t y) {
+        return bc1Index(block + 8, x, y);
+    });
+    checkBlocksFlipped(VK_FORMAT_BC2_UNORM_BLOCK, 8, 8, 4, 16, [](const uint8_t* block, uint32_t x, uint32_t y) {
+        return static_cast<uint32_t>((block[2 * y + x / 2] >> (4 * (x % 2))) & 0xF);
+    });
+
+    // BC7 partitions aren't symmetric, and blocks of a level 6 texels tall straddle the flipped rows
+    CHECK(flipThrows(VK_FORMAT_BC7_UNORM_BLOCK, 8, 8, 16));
+    CHECK(flipThrows(VK_FORMAT_BC1_RGB_UNORM_BLOCK, 8, 6, 8));
+
+    return REINA_TEST_RESULT();
+}
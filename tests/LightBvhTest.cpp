@@ -0,0 +1,170 @@
+// Checks that LightBvh::sample picks leaves with the probabilities LightBvh::pmf gives them: each sample reports the pmf
+// of its leaf, and the leaves come up as often as their pmfs say, with the walks that find nothing making up the rest.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Check.h"
+#include "scene/LightBvh.h"
+
+namespace {
+    constexpr int SAMPLES = 200000;
+
+    /**
+     * @return Triangles of random sizes, orientations and powers in a 10x10x10 box, every seventh without power
+     */
+    std::vector<reina::scene::LightTriangle> randomTriangles(size_t count, std::mt19937& rng) {
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        auto randomVec = [&](float scale) {
+            return glm::vec3(unit(rng) - 0.5f, unit(rng) - 0.5f, unit(rng) - 0.5f) * scale;
+        };
+
+        std::vector<reina::scene::LightTriangle> triangles;
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 corner = randomVec(10.0f);
+            triangles.push_back(reina::scene::LightTriangle{
+                    .v0 = corner,
+                    .v1 = corner + randomVec(1.0f),
+                    .v2 = corner + randomVec(1.0f),
+                    .power = i % 7 == 3 ? 0.0f : 0.1f + 5.0f * unit(rng),
+                    .emissiveInstance = static_cast<uint32_t>(i / 16),
+                    .triangle = static_cast<uint32_t>(i % 16),
+                    .twoSided = i % 3 == 0
+            });
+        }
+        return triangles;
+    }
+
+    void checkPoint(const reina::scene::LightBvh& bvh, const std::set<std::pair<uint32_t, uint32_t>>& powered,
+                    glm::vec3 p, glm::vec3 n, std::mt19937& rng) {
+        const std::vector<LightBvhNode>& nodes = bvh.getNodes();
+
+        double pmfSum = 0.0;
+        for (uint32_t i = 0; i < nodes.size(); i++) {
+            if (nodes[i].triangle != LIGHT_BVH_INTERIOR) {
+                pmfSum += bvh.pmf(p, n, i);
+            } else {
+                CHECK(bvh.pmf(p, n, i) == 0.0f);
+            }
+        }
+
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<int> counts(nodes.size(), 0);
+        int misses = 0;
+        for (int i = 0; i < SAMPLES; i++) {
+            std::optional<reina::scene::LightBvhSample> sample = bvh.sample(p, n, unit(rng));
+            if (!sample.has_value()) {
+                misses++;
+                continue;
+            }
+
+            CHECK(nodes[sample->leaf].triangle != LIGHT_BVH_INTERIOR);
+            CHECK(powered.contains({sample->emissiveInstance, sample->triangle}));
+            float pmf = bvh.pmf(p, n, sample->leaf);
+            CHECK(std::abs(sample->pmf - pmf) <= 1e-4f * pmf);
+            counts[sample->leaf]++;
+        }
+
+        // Nothing is important at the point
+        if (pmfSum == 0.0) {
+            CHECK(misses == SAMPLES);
+            std::printf("  no light reaches (%5.1f, %5.1f, %5.1f)\n", p.x, p.y, p.z);
+            return;
+        }
+        CHECK(pmfSum <= 1.0 + 1e-4);
+
+        // Leaves expected fewer than 5 times are pooled, so every bin of the test has enough samples. The walk down can
+        // also end at a node whose children are both unimportant, which is the probability the pmfs leave over.
+        double chiSquare = 0.0;
+        int bins = 0;
+        double pooledExpected = 0.0;
+        int pooledObserved = 0;
+
+        double missExpected = SAMPLES * std::max(1.0 - pmfSum, 0.0);
+        if (missExpected >= 5.0) {
+            chiSquare += (misses - missExpected) * (misses - missExpected) / missExpected;
+            bins++;
+        } else {
+            pooledExpected += missExpected;
+            pooledObserved += misses;
+        }
+        for (uint32_t i = 0; i < nodes.size(); i++) {
+            if (nodes[i].triangle == LIGHT_BVH_INTERIOR) {
+                continue;
+            }
+
+            double expected = SAMPLES * static_cast<double>(bvh.pmf(p, n, i));
+            if (expected == 0.0) {
+                CHECK(counts[i] == 0);
+            } else if (expected < 5.0) {
+                pooledExpected += expected;
+                pooledObserved += counts[i];
+            } else {
+                chiSquare += (counts[i] - expected) * (counts[i] - expected) / expected;
+                bins++;
+            }
+        }
+        if (pooledExpected > 0.0) {
+            chiSquare += (pooledObserved - pooledExpected) * (pooledObserved - pooledExpected) / pooledExpected;
+            bins++;
+        }
+
+        if (bins > 1) {
+            // The upper 0.1% critical value, with the Wilson-Hilferty approximation
+            double k = bins - 1;
+            double term = 1.0 - 2.0 / (9.0 * k) + 3.09 * std::sqrt(2.0 / (9.0 * k));
+            double critical = k * term * term * term;
+            std::printf("  chi-square %8.1f over %5d bins (0.1%% critical value %.1f), pmfs sum to %.6f, %d walks ended early\n",
+                        chiSquare, bins, critical, pmfSum, misses);
+            CHECK(chiSquare < critical);
+        }
+    }
+
+    void checkScene(size_t triangleCount, int points, std::mt19937& rng) {
+        std::vector<reina::scene::LightTriangle> triangles = randomTriangles(triangleCount, rng);
+        std::set<std::pair<uint32_t, uint32_t>> powered;
+        for (const reina::scene::LightTriangle& triangle : triangles) {
+            if (triangle.power > 0.0f) {
+                powered.insert({triangle.emissiveInstance, triangle.triangle});
+            }
+        }
+
+        reina::scene::LightBvh bvh{triangles};
+        size_t leaves = std::ranges::count_if(bvh.getNodes(), [](const LightBvhNode& node) { return node.triangle != LIGHT_BVH_INTERIOR; });
+        CHECK(leaves == powered.size());
+        std::printf("%zu triangles, %zu with power\n", triangleCount, leaves);
+
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (int i = 0; i < points; i++) {
+            glm::vec3 p = glm::vec3(unit(rng) - 0.5f, unit(rng) - 0.5f, unit(rng) - 0.5f) * 14.0f;
+            glm::vec3 n = glm::normalize(glm::vec3(unit(rng) - 0.5f, unit(rng) - 0.5f, unit(rng) - 0.5f));
+
+            // With and without a shading normal bounding the cosine
+            checkPoint(bvh, powered, p, n, rng);
+            checkPoint(bvh, powered, p, glm::vec3(0.0f), rng);
+        }
+    }
+}
+
+int main() {
+    std::mt19937 rng(11);
+
+    reina::scene::LightBvh empty{std::vector<reina::scene::LightTriangle>{}};
+    CHECK(!empty.sample(glm::vec3(0.0f), glm::vec3(0.0f), 0.5f).has_value());
+    CHECK(empty.pmf(glm::vec3(0.0f), glm::vec3(0.0f), 0) == 0.0f);
+
+    checkScene(1, 2, rng);
+    checkScene(2, 2, rng);
+    checkScene(300, 3, rng);
+
+    // Large enough for the children of the top nodes to be built in parallel
+    checkScene(20000, 1, rng);
+
+    return REINA_TEST_RESULT();
+}
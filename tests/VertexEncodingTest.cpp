@@ -0,0 +1,92 @@
+// Encodes random tangent frames and checks the decoded ones against MAX_NORMAL_ERROR_DEGREES and
+// MAX_TANGENT_ERROR_DEGREES, along with the bitangent sign and the frames with degenerate tangents.
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <glm/glm.hpp>
+
+#include "Check.h"
+#include "scene/VertexEncoding.h"
+
+namespace {
+    constexpr int FRAMES = 1000000;
+
+    // atan2 stays precise for small angles, unlike acos of the dot product
+    float angleDegrees(glm::vec3 a, glm::vec3 b) {
+        return std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b)) * 180.0f / 3.14159265f;
+    }
+
+    glm::vec3 randomUnitVector(std::mt19937& rng) {
+        std::normal_distribution<float> gaussian;
+        glm::vec3 v;
+        do {
+            v = glm::vec3(gaussian(rng), gaussian(rng), gaussian(rng));
+        } while (glm::dot(v, v) < 1e-8f);
+        return glm::normalize(v);
+    }
+
+    // The normal and tangent are quantized separately, so they are only orthogonal to within their errors
+    bool orthonormal(const glm::mat3& frame) {
+        constexpr float TOLERANCE = 1e-3f;
+        return std::abs(glm::length(frame[0]) - 1.0f) < TOLERANCE && std::abs(glm::length(frame[1]) - 1.0f) < TOLERANCE
+               && std::abs(glm::length(frame[2]) - 1.0f) < TOLERANCE && std::abs(glm::dot(frame[0], frame[1])) < TOLERANCE
+               && std::abs(glm::dot(frame[0], frame[2])) < TOLERANCE && std::abs(glm::dot(frame[1], frame[2])) < TOLERANCE;
+    }
+}
+
+int main() {
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    float maxNormalError = 0.0f;
+    float maxTangentError = 0.0f;
+    int wrongSigns = 0;
+
+    for (int i = 0; i < FRAMES; i++) {
+        glm::vec3 normal = randomUnitVector(rng);
+        glm::vec3 tangent = glm::normalize(glm::cross(normal, randomUnitVector(rng)));
+        glm::vec3 bitangent = glm::cross(normal, tangent) * (unit(rng) < 0.5f ? -1.0f : 1.0f);
+
+        glm::mat3 decoded = reina::scene::decodeTBN(reina::scene::encodeTBN(glm::mat3(tangent, bitangent, normal)));
+        maxNormalError = std::max(maxNormalError, angleDegrees(normal, decoded[2]));
+        maxTangentError = std::max(maxTangentError, angleDegrees(tangent, decoded[0]));
+        if (glm::dot(bitangent, decoded[1]) <= 0.0f) {
+            wrongSigns++;
+        }
+    }
+
+    std::printf("%d random frames: largest normal error %.4f deg (bound %.4f), tangent %.4f deg (bound %.4f)\n",
+                FRAMES, maxNormalError, reina::scene::MAX_NORMAL_ERROR_DEGREES, maxTangentError, reina::scene::MAX_TANGENT_ERROR_DEGREES);
+    CHECK(maxNormalError <= reina::scene::MAX_NORMAL_ERROR_DEGREES);
+    CHECK(maxTangentError <= reina::scene::MAX_TANGENT_ERROR_DEGREES);
+    CHECK(wrongSigns == 0);
+
+    // The axes and the folds of the octahedron
+    const glm::vec3 edges[] = {
+            {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1},
+            glm::normalize(glm::vec3(1, 1, 0)), glm::normalize(glm::vec3(-1, 1, 0)), glm::normalize(glm::vec3(1, -1, 0)),
+            glm::normalize(glm::vec3(1, 1, -1)), glm::normalize(glm::vec3(-1, -1, -1)), glm::normalize(glm::vec3(0, 1, -1e-7f))
+    };
+    for (glm::vec3 v : edges) {
+        CHECK(angleDegrees(v, reina::scene::octDecode(reina::scene::octEncode(v))) <= 1e-3f);
+
+        glm::vec3 tangent = std::abs(v.x) < 0.9f ? glm::normalize(glm::cross(v, glm::vec3(1, 0, 0))) : glm::normalize(glm::cross(v, glm::vec3(0, 1, 0)));
+        glm::mat3 decoded = reina::scene::decodeTBN(reina::scene::encodeTBN(glm::mat3(tangent, glm::cross(v, tangent), v)));
+        CHECK(angleDegrees(v, decoded[2]) <= reina::scene::MAX_NORMAL_ERROR_DEGREES);
+        CHECK(angleDegrees(tangent, decoded[0]) <= reina::scene::MAX_TANGENT_ERROR_DEGREES);
+    }
+
+    // Tangents that aren't orthogonal to the normal, are parallel to it or are zero still give an orthonormal frame
+    for (int i = 0; i < 1000; i++) {
+        glm::vec3 normal = randomUnitVector(rng);
+        glm::vec3 skewed = glm::normalize(randomUnitVector(rng) + normal * 0.9f);
+        for (glm::vec3 tangent : {skewed, normal, -normal, glm::vec3(0.0f)}) {
+            glm::mat3 decoded = reina::scene::decodeTBN(reina::scene::encodeTBN(glm::mat3(tangent, glm::cross(normal, tangent), normal)));
+            CHECK(orthonormal(decoded));
+            CHECK(angleDegrees(normal, decoded[2]) <= reina::scene::MAX_NORMAL_ERROR_DEGREES);
+        }
+    }
+
+    return REINA_TEST_RESULT();
+}